@@ -0,0 +1,146 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef RECAST_PROFILE_H
+#define RECAST_PROFILE_H
+
+#include "Recast.h"
+#include "RecastAlloc.h"
+#include "DetourClock.h"
+
+struct duFileIO;
+
+/// A timed build stage recorded by #duProfileContext.
+struct duProfileEvent
+{
+	rcTimerLabel label;		///< The timer of the stage.
+	int threadId;			///< The id of the thread given to the context.
+	int tileX;				///< The x-position of the tile being built, or -1.
+	int tileY;				///< The y-position of the tile being built, or -1.
+	int depth;				///< The number of enclosing stages.
+	double start;			///< The start time of the stage. [Units: us]
+	double duration;		///< The duration of the stage. [Units: us]
+	int allocCount;			///< The number of Recast allocations during the stage, including nested stages.
+	size_t peakBytes;		///< The peak of the live Recast allocations during the stage above those live at its start. [Units: bytes]
+};
+
+/// A build context recording each timed stage with its nesting, thread, tile and Recast allocations.
+///
+/// Use one context per build thread, and write the events of all of them with #duWriteProfileChromeTrace
+/// or #duWriteProfileCsv once the builds are done. Allocations are only counted while the allocation
+/// functions installed by #enableAllocationTracking are in use, and temporary allocations served by
+/// an #rcArena are not counted.
+class duProfileContext : public rcContext
+{
+public:
+	/// Constructor.
+	///  @param[in]		clock		The clock providing the time stamps. Must outlive the context.
+	///  @param[in]		threadId	The id of the thread using the context.
+	duProfileContext(dtClock* clock, const int threadId = 0);
+	virtual ~duProfileContext();
+
+	/// Sets the tile the following stages belong to.
+	///  @param[in]		tileX	The x-position of the tile, or -1 if the stages do not belong to a tile.
+	///  @param[in]		tileY	The y-position of the tile, or -1 if the stages do not belong to a tile.
+	void setTile(const int tileX, const int tileY);
+
+	/// Returns the id of the thread using the context.
+	int getThreadId() const { return m_threadId; }
+
+	/// Returns the number of recorded stages.
+	int getEventCount() const { return m_eventCount; }
+
+	/// Returns a recorded stage. Stages are in the order they started.
+	///  @param[in]		i	The index of the stage. [Limit: 0 <= value < #getEventCount()]
+	const duProfileEvent& getEvent(const int i) const { return m_events[i]; }
+
+	/// Discards the recorded stages. Accumulated times are cleared by #resetTimers.
+	void clearEvents();
+
+	/// Installs Recast allocation functions that attribute allocations to the context running a stage on the
+	/// calling thread. Install them before building and keep them while objects allocated through them are alive.
+	///  @param[in]		allocFunc	The function allocating the memory, or null for malloc.
+	///  @param[in]		freeFunc	The function freeing the memory, or null for free.
+	static void enableAllocationTracking(rcAllocFunc* allocFunc = 0, rcFreeFunc* freeFunc = 0);
+
+	/// Restores the default Recast allocation functions.
+	static void disableAllocationTracking();
+
+protected:
+	virtual void doResetTimers();
+	virtual void doStartTimer(const rcTimerLabel label);
+	virtual void doStopTimer(const rcTimerLabel label);
+	virtual int doGetAccumulatedTime(const rcTimerLabel label) const;
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	duProfileContext(const duProfileContext&);
+	duProfileContext& operator=(const duProfileContext&);
+
+	static void* profileAlloc(size_t size, rcAllocHint hint);
+	static void profileFree(void* ptr);
+
+	/// A stage that has started and not yet stopped.
+	struct OpenStage
+	{
+		rcTimerLabel label;
+		int event;
+		int allocCount;
+		size_t startBytes;
+		size_t peakBytes;
+	};
+	static const int MAX_DEPTH = 32;
+
+	dtClock* m_clock;
+	int m_threadId;
+	int m_tileX;
+	int m_tileY;
+
+	OpenStage m_open[MAX_DEPTH];
+	int m_depth;
+	duProfileContext* m_prevThreadContext;
+
+	duProfileEvent* m_events;
+	int m_eventCount;
+	int m_eventCapacity;
+
+	double m_accTime[RC_MAX_TIMERS];
+
+	int m_allocCount;
+	size_t m_liveBytes;
+};
+
+/// Returns the name of a build stage.
+const char* duGetTimerLabelName(const rcTimerLabel label);
+
+/// Writes the stages recorded by the contexts as complete events of the Chrome trace event format,
+/// which chrome://tracing and Perfetto display as a timeline per thread.
+///  @param[in]		contexts	The contexts.
+///  @param[in]		count		The number of contexts.
+///  @param[in]		io			The output.
+/// @return True if the events were written.
+bool duWriteProfileChromeTrace(const duProfileContext* const* contexts, const int count, duFileIO* io);
+
+/// Writes the stages recorded by the contexts as comma separated values, one stage per line after a header.
+///  @param[in]		contexts	The contexts.
+///  @param[in]		count		The number of contexts.
+///  @param[in]		io			The output.
+/// @return True if the events were written.
+bool duWriteProfileCsv(const duProfileContext* const* contexts, const int count, duFileIO* io);
+
+#endif // RECAST_PROFILE_H
@@ -0,0 +1,334 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Recast.h"
+#include "RecastAlloc.h"
+#include "RecastDump.h"
+#include "RecastProfile.h"
+
+#if defined(_MSC_VER)
+#define DU_THREAD_LOCAL __declspec(thread)
+#else
+#define DU_THREAD_LOCAL __thread
+#endif
+
+// The context running a stage on this thread, which the profile allocator attributes allocations to.
+static DU_THREAD_LOCAL duProfileContext* sThreadContext = 0;
+
+static rcAllocFunc* sProfileAllocFunc = 0;
+static rcFreeFunc* sProfileFreeFunc = 0;
+
+// Each allocation is prefixed with its size, padded to keep the alignment of malloc.
+static const size_t ALLOC_HEADER_SIZE = 16;
+
+duProfileContext::duProfileContext(dtClock* clock, const int threadId) :
+	m_clock(clock),
+	m_threadId(threadId),
+	m_tileX(-1),
+	m_tileY(-1),
+	m_depth(0),
+	m_prevThreadContext(0),
+	m_events(0),
+	m_eventCount(0),
+	m_eventCapacity(0),
+	m_allocCount(0),
+	m_liveBytes(0)
+{
+	doResetTimers();
+}
+
+duProfileContext::~duProfileContext()
+{
+	if (sThreadContext == this)
+		sThreadContext = m_prevThreadContext;
+	delete [] m_events;
+}
+
+void duProfileContext::setTile(const int tileX, const int tileY)
+{
+	m_tileX = tileX;
+	m_tileY = tileY;
+}
+
+void duProfileContext::clearEvents()
+{
+	m_eventCount = 0;
+	m_depth = 0;
+}
+
+void duProfileContext::enableAllocationTracking(rcAllocFunc* allocFunc, rcFreeFunc* freeFunc)
+{
+	sProfileAllocFunc = allocFunc;
+	sProfileFreeFunc = freeFunc;
+	rcAllocSetCustom(profileAlloc, profileFree);
+}
+
+void duProfileContext::disableAllocationTracking()
+{
+	rcAllocSetCustom(0, 0);
+}
+
+void* duProfileContext::profileAlloc(size_t size, rcAllocHint hint)
+{
+	const size_t total = size + ALLOC_HEADER_SIZE;
+	unsigned char* mem = (unsigned char*)(sProfileAllocFunc ? sProfileAllocFunc(total, hint) : malloc(total));
+	if (!mem)
+		return 0;
+	memcpy(mem, &size, sizeof(size));
+
+	duProfileContext* ctx = sThreadContext;
+	if (ctx && ctx->m_depth > 0)
+	{
+		ctx->m_allocCount++;
+		ctx->m_liveBytes += size;
+		OpenStage& stage = ctx->m_open[rcMin(ctx->m_depth, (int)MAX_DEPTH) - 1];
+		stage.peakBytes = rcMax(stage.peakBytes, ctx->m_liveBytes);
+	}
+	return mem + ALLOC_HEADER_SIZE;
+}
+
+void duProfileContext::profileFree(void* ptr)
+{
+	if (!ptr)
+		return;
+	unsigned char* mem = (unsigned char*)ptr - ALLOC_HEADER_SIZE;
+	size_t size;
+	memcpy(&size, mem, sizeof(size));
+
+	// Memory allocated on another thread or outside of a stage may be freed here.
+	duProfileContext* ctx = sThreadContext;
+	if (ctx)
+		ctx->m_liveBytes -= rcMin(size, ctx->m_liveBytes);
+
+	if (sProfileFreeFunc)
+		sProfileFreeFunc(mem);
+	else
+		free(mem);
+}
+
+void duProfileContext::doResetTimers()
+{
+	for (int i = 0; i < RC_MAX_TIMERS; ++i)
+		m_accTime[i] = -1;
+}
+
+void duProfileContext::doStartTimer(const rcTimerLabel label)
+{
+	const double now = m_clock->getTime();
+	if (m_depth >= MAX_DEPTH)
+	{
+		m_depth++;
+		return;
+	}
+
+	if (m_eventCount == m_eventCapacity)
+	{
+		const int capacity = m_eventCapacity ? m_eventCapacity * 2 : 256;
+		duProfileEvent* events = new duProfileEvent[capacity];
+		if (m_eventCount)
+			memcpy(events, m_events, sizeof(duProfileEvent) * m_eventCount);
+		delete [] m_events;
+		m_events = events;
+		m_eventCapacity = capacity;
+	}
+
+	if (m_depth == 0)
+	{
+		// Attribute the allocations of this thread to this context until the outermost stage stops.
+		m_prevThreadContext = sThreadContext;
+		sThreadContext = this;
+		m_liveBytes = 0;
+	}
+
+	duProfileEvent& event = m_events[m_eventCount];
+	event.label = label;
+	event.threadId = m_threadId;
+	event.tileX = m_tileX;
+	event.tileY = m_tileY;
+	event.depth = m_depth;
+	event.start = now;
+	event.duration = 0;
+	event.allocCount = 0;
+	event.peakBytes = 0;
+
+	OpenStage& stage = m_open[m_depth];
+	stage.label = label;
+	stage.event = m_eventCount;
+	stage.allocCount = m_allocCount;
+	stage.startBytes = m_liveBytes;
+	stage.peakBytes = m_liveBytes;
+
+	m_eventCount++;
+	m_depth++;
+}
+
+void duProfileContext::doStopTimer(const rcTimerLabel label)
+{
+	const double now = m_clock->getTime();
+	if (m_depth > MAX_DEPTH)
+	{
+		m_depth--;
+		return;
+	}
+
+	// Find the stage, closing any stage nested in it that was not stopped.
+	int depth = m_depth - 1;
+	while (depth >= 0 && m_open[depth].label != label)
+		depth--;
+	if (depth < 0)
+		return;
+
+	while (m_depth > depth)
+	{
+		OpenStage& stage = m_open[m_depth - 1];
+		duProfileEvent& event = m_events[stage.event];
+		event.duration = now - event.start;
+		event.allocCount = m_allocCount - stage.allocCount;
+		event.peakBytes = stage.peakBytes - stage.startBytes;
+		if (m_accTime[stage.label] < 0)
+			m_accTime[stage.label] = event.duration;
+		else
+			m_accTime[stage.label] += event.duration;
+
+		m_depth--;
+		if (m_depth > 0)
+		{
+			OpenStage& parent = m_open[m_depth - 1];
+			parent.peakBytes = rcMax(parent.peakBytes, stage.peakBytes);
+		}
+	}
+
+	if (m_depth == 0 && sThreadContext == this)
+		sThreadContext = m_prevThreadContext;
+}
+
+int duProfileContext::doGetAccumulatedTime(const rcTimerLabel label) const
+{
+	return m_accTime[label] < 0 ? -1 : (int)m_accTime[label];
+}
+
+const char* duGetTimerLabelName(const rcTimerLabel label)
+{
+	switch (label)
+	{
+	case RC_TIMER_TOTAL: return "Total";
+	case RC_TIMER_TEMP: return "Temp";
+	case RC_TIMER_RASTERIZE_TRIANGLES: return "Rasterize";
+	case RC_TIMER_BUILD_COMPACTHEIGHTFIELD: return "Build Compact";
+	case RC_TIMER_BUILD_CONTOURS: return "Build Contours";
+	case RC_TIMER_BUILD_CONTOURS_TRACE: return "Trace";
+	case RC_TIMER_BUILD_CONTOURS_SIMPLIFY: return "Simplify";
+	case RC_TIMER_FILTER_BORDER: return "Filter Border";
+	case RC_TIMER_FILTER_WALKABLE: return "Filter Walkable";
+	case RC_TIMER_MEDIAN_AREA: return "Median Area";
+	case RC_TIMER_FILTER_LOW_OBSTACLES: return "Filter Low Obstacles";
+	case RC_TIMER_BUILD_POLYMESH: return "Build Polymesh";
+	case RC_TIMER_MERGE_POLYMESH: return "Merge Polymeshes";
+	case RC_TIMER_ERODE_AREA: return "Erode Area";
+	case RC_TIMER_MARK_BOX_AREA: return "Mark Box Area";
+	case RC_TIMER_MARK_CYLINDER_AREA: return "Mark Cylinder Area";
+	case RC_TIMER_MARK_CONVEXPOLY_AREA: return "Mark Convex Area";
+	case RC_TIMER_BUILD_DISTANCEFIELD: return "Build Distance Field";
+	case RC_TIMER_BUILD_DISTANCEFIELD_DIST: return "Distance";
+	case RC_TIMER_BUILD_DISTANCEFIELD_BLUR: return "Blur";
+	case RC_TIMER_BUILD_REGIONS: return "Build Regions";
+	case RC_TIMER_BUILD_REGIONS_WATERSHED: return "Watershed";
+	case RC_TIMER_BUILD_REGIONS_EXPAND: return "Expand";
+	case RC_TIMER_BUILD_REGIONS_FLOOD: return "Find Basins";
+	case RC_TIMER_BUILD_REGIONS_FILTER: return "Filter";
+	case RC_TIMER_BUILD_LAYERS: return "Build Layers";
+	case RC_TIMER_BUILD_POLYMESHDETAIL: return "Build Polymesh Detail";
+	case RC_TIMER_MERGE_POLYMESHDETAIL: return "Merge Polymesh Details";
+	case RC_MAX_TIMERS: break;
+	}
+	return "Unknown";
+}
+
+static bool ioprintf(duFileIO* io, const char* format, ...)
+{
+	char line[256];
+	va_list ap;
+	va_start(ap, format);
+	const int n = vsnprintf(line, sizeof(line), format, ap);
+	va_end(ap);
+	if (n <= 0 || n >= (int)sizeof(line))
+		return false;
+	return io->write(line, sizeof(char)*n);
+}
+
+bool duWriteProfileChromeTrace(const duProfileContext* const* contexts, const int count, duFileIO* io)
+{
+	if (!io)
+	{
+		printf("duWriteProfileChromeTrace: input IO is null.\n");
+		return false;
+	}
+	if (!io->isWriting())
+	{
+		printf("duWriteProfileChromeTrace: input IO not writing.\n");
+		return false;
+	}
+
+	bool ok = ioprintf(io, "{\"traceEvents\":[");
+	bool first = true;
+	for (int i = 0; i < count && ok; ++i)
+	{
+		const duProfileContext& ctx = *contexts[i];
+		for (int j = 0; j < ctx.getEventCount() && ok; ++j)
+		{
+			const duProfileEvent& e = ctx.getEvent(j);
+			ok = ioprintf(io, "%s\n{\"name\":\"%s\",\"cat\":\"recast\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+						  "\"args\":{\"tileX\":%d,\"tileY\":%d,\"depth\":%d,\"allocs\":%d,\"peakBytes\":%lu}}",
+						  first ? "" : ",", duGetTimerLabelName(e.label), e.threadId, e.start, e.duration,
+						  e.tileX, e.tileY, e.depth, e.allocCount, (unsigned long)e.peakBytes);
+			first = false;
+		}
+	}
+	return ok && ioprintf(io, "\n]}\n");
+}
+
+bool duWriteProfileCsv(const duProfileContext* const* contexts, const int count, duFileIO* io)
+{
+	if (!io)
+	{
+		printf("duWriteProfileCsv: input IO is null.\n");
+		return false;
+	}
+	if (!io->isWriting())
+	{
+		printf("duWriteProfileCsv: input IO not writing.\n");
+		return false;
+	}
+
+	bool ok = ioprintf(io, "thread,tileX,tileY,depth,stage,startUs,durationUs,allocs,peakBytes\n");
+	for (int i = 0; i < count && ok; ++i)
+	{
+		const duProfileContext& ctx = *contexts[i];
+		for (int j = 0; j < ctx.getEventCount() && ok; ++j)
+		{
+			const duProfileEvent& e = ctx.getEvent(j);
+			ok = ioprintf(io, "%d,%d,%d,%d,%s,%.3f,%.3f,%d,%lu\n", e.threadId, e.tileX, e.tileY, e.depth,
+						  duGetTimerLabelName(e.label), e.start, e.duration, e.allocCount, (unsigned long)e.peakBytes);
+		}
+	}
+	return ok;
+}
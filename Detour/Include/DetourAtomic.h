@@ -0,0 +1,152 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+// Thin wrappers around the compiler's atomic intrinsics.
+// They are used to publish navigation mesh changes to concurrent readers.
+
+#ifndef DETOURATOMIC_H
+#define DETOURATOMIC_H
+
+#if defined(_MSC_VER)
+#	include <intrin.h>
+#	include <string.h>
+#	define dtCompilerBarrier() _ReadWriteBarrier()
+
+// x86 and x64 keep loads and stores in order, so volatile accesses fenced against compiler reordering are
+// acquire loads and release stores. ARM64 uses the load-acquire and store-release instructions. Other targets,
+// such as ARM64EC and 32-bit ARM, use interlocked operations, which are full barriers.
+#	if defined(_M_ARM64)
+#		define DT_ATOMIC_MSVC_ARM64
+#	elif (defined(_M_X64) && !defined(_M_ARM64EC)) || defined(_M_IX86)
+#		define DT_ATOMIC_MSVC_X86
+#	endif
+
+// The atomic values are 4 or 8 bytes. They are passed through the intrinsics as their bits.
+template<class T> inline T dtAtomicFromBits(unsigned __int64 bits)
+{
+	typedef char dtAtomicSizeCheck[(sizeof(T) == 4 || sizeof(T) == 8) ? 1 : -1];
+	(void)sizeof(dtAtomicSizeCheck);
+	T value;
+	memcpy(&value, &bits, sizeof(T));
+	return value;
+}
+
+template<class T> inline unsigned __int64 dtAtomicToBits(T value)
+{
+	unsigned __int64 bits = 0;
+	memcpy(&bits, &value, sizeof(T));
+	return bits;
+}
+
+template<class T> inline T dtAtomicInterlockedLoad(const T* ptr)
+{
+	if (sizeof(T) == 8)
+		return dtAtomicFromBits<T>((unsigned __int64)_InterlockedCompareExchange64((volatile __int64*)ptr, 0, 0));
+	return dtAtomicFromBits<T>((unsigned long)_InterlockedCompareExchange((volatile long*)ptr, 0, 0));
+}
+
+template<class T> inline void dtAtomicInterlockedStore(T* ptr, T value)
+{
+	const unsigned __int64 bits = dtAtomicToBits(value);
+	if (sizeof(T) == 8)
+		_InterlockedExchange64((volatile __int64*)ptr, (__int64)bits);
+	else
+		_InterlockedExchange((volatile long*)ptr, (long)bits);
+}
+#endif
+
+/// Loads a value with acquire semantics.
+template<class T> inline T dtAtomicLoadAcquire(const T* ptr)
+{
+#if defined(DT_ATOMIC_MSVC_ARM64)
+	if (sizeof(T) == 8)
+		return dtAtomicFromBits<T>(__ldar64((unsigned __int64 volatile*)ptr));
+	return dtAtomicFromBits<T>(__ldar32((unsigned __int32 volatile*)ptr));
+#elif defined(DT_ATOMIC_MSVC_X86)
+#	if defined(_M_IX86)
+	// 8 byte loads are not atomic on 32-bit x86.
+	if (sizeof(T) == 8)
+		return dtAtomicInterlockedLoad(ptr);
+#	endif
+	const T value = *(const volatile T*)ptr;
+	dtCompilerBarrier();
+	return value;
+#elif defined(_MSC_VER)
+	return dtAtomicInterlockedLoad(ptr);
+#else
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/// Stores a value with release semantics.
+template<class T> inline void dtAtomicStoreRelease(T* ptr, T value)
+{
+#if defined(DT_ATOMIC_MSVC_ARM64)
+	if (sizeof(T) == 8)
+		__stlr64((unsigned __int64 volatile*)ptr, dtAtomicToBits(value));
+	else
+		__stlr32((unsigned __int32 volatile*)ptr, (unsigned __int32)dtAtomicToBits(value));
+#elif defined(DT_ATOMIC_MSVC_X86)
+#	if defined(_M_IX86)
+	// 8 byte stores are not atomic on 32-bit x86.
+	if (sizeof(T) == 8)
+	{
+		dtAtomicInterlockedStore(ptr, value);
+		return;
+	}
+#	endif
+	dtCompilerBarrier();
+	*(volatile T*)ptr = value;
+#elif defined(_MSC_VER)
+	dtAtomicInterlockedStore(ptr, value);
+#else
+	__atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/// Issues a full memory fence.
+inline void dtAtomicThreadFence()
+{
+#if defined(_MSC_VER)
+	// The fences MemoryBarrier() expands to, without including windows.h.
+#	if defined(_M_ARM64)
+	__dmb(_ARM64_BARRIER_ISH);
+#	elif defined(_M_ARM)
+	__dmb(_ARM_BARRIER_ISH);
+#	elif defined(_M_X64)
+	__faststorefence();
+#	else
+	_mm_mfence();
+#	endif
+#else
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+/// Atomically replaces @p ptr with @p desired if it equals @p expected.
+/// @return True if the value was replaced.
+inline bool dtAtomicCompareExchange(int* ptr, int expected, int desired)
+{
+#if defined(_MSC_VER)
+	return _InterlockedCompareExchange((volatile long*)ptr, (long)desired, (long)expected) == (long)expected;
+#else
+	return __atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+#endif // DETOURATOMIC_H
@@ -13,9 +13,77 @@ inline float dtMathFabsf(float x) { return fabsf(x); }
 inline float dtMathSqrtf(float x) { return sqrtf(x); }
 inline float dtMathFloorf(float x) { return floorf(x); }
 inline float dtMathCeilf(float x) { return ceilf(x); }
+#ifndef DT_DETERMINISTIC
 inline float dtMathCosf(float x) { return cosf(x); }
 inline float dtMathSinf(float x) { return sinf(x); }
 inline float dtMathAtan2f(float y, float x) { return atan2f(y, x); }
+#else
+// The trigonometric functions are computed with basic arithmetic only, which IEEE 754 rounds the same
+// way on every platform, instead of by the math library of the platform. The results are only identical
+// when compiled without floating point contraction and excess precision, see RECASTNAVIGATION_DT_DETERMINISTIC.
+
+/// Reduces an angle to [-pi/4, pi/4] and returns the quadrant it was in.
+inline int dtMathReduceAngle(float x, float* r)
+{
+	const float k = floorf(x * 0.636619772f + 0.5f);
+	*r = (x - k * 1.57079625f) - k * 7.54978995e-08f;
+	return (int)k & 3;
+}
+inline float dtMathSinReduced(float r)
+{
+	const float r2 = r * r;
+	return r + r * r2 * (-1.66666672e-01f + r2 * (8.33333377e-03f + r2 * (-1.98412701e-04f + r2 * 2.75573188e-06f)));
+}
+inline float dtMathCosReduced(float r)
+{
+	const float r2 = r * r;
+	return 1.0f + r2 * (-0.5f + r2 * (4.16666679e-02f + r2 * (-1.38888892e-03f + r2 * 2.48015876e-05f)));
+}
+/// Returns the arc tangent of a value in [-tan(pi/8), tan(pi/8)].
+inline float dtMathAtanReduced(float t)
+{
+	const float t2 = t * t;
+	return t + t * t2 * (-3.33333343e-01f + t2 * (2.00000003e-01f + t2 * (-1.42857149e-01f + t2 * (1.11111112e-01f +
+		t2 * (-9.09090936e-02f + t2 * (7.69230798e-02f + t2 * -6.66666701e-02f))))));
+}
+inline float dtMathCosf(float x)
+{
+	float r;
+	switch (dtMathReduceAngle(x, &r))
+	{
+	case 0: return dtMathCosReduced(r);
+	case 1: return -dtMathSinReduced(r);
+	case 2: return -dtMathCosReduced(r);
+	default: return dtMathSinReduced(r);
+	}
+}
+inline float dtMathSinf(float x)
+{
+	float r;
+	switch (dtMathReduceAngle(x, &r))
+	{
+	case 0: return dtMathSinReduced(r);
+	case 1: return dtMathCosReduced(r);
+	case 2: return -dtMathSinReduced(r);
+	default: return -dtMathCosReduced(r);
+	}
+}
+inline float dtMathAtan2f(float y, float x)
+{
+	const float ax = fabsf(x);
+	const float ay = fabsf(y);
+	if (ax == 0 && ay == 0)
+		return 0;
+	// Arc tangent of the smaller over the larger coordinate, reduced around pi/4.
+	const float t = ay > ax ? ax / ay : ay / ax;
+	float a = t > 0.414213568f ? 7.85398185e-01f + dtMathAtanReduced((t - 1.0f) / (t + 1.0f)) : dtMathAtanReduced(t);
+	if (ay > ax)
+		a = 1.57079637f - a;
+	if (x < 0)
+		a = 3.14159274f - a;
+	return y < 0 ? -a : a;
+}
+#endif
 inline bool dtMathIsfinite(float x)
 {
 #ifndef RC_FAST_MATH
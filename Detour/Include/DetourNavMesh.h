@@ -102,6 +102,48 @@ enum dtTileFlags
 	DT_TILE_FREE_DATA = 0x01
 };
 
+/// Flags used to select optional behaviour in dtNavMesh::init().
+enum dtNavMeshInitFlags
+{
+	/// Allow tiles to be added and removed while other threads are querying the mesh.
+	/// Memory of removed tiles is reclaimed once no reader can access it anymore.
+	/// See dtNavMesh::beginRead() for details.
+	DT_NAVMESH_CONCURRENT_READS = 0x01,
+
+	/// Reserve link slots for each polygon when a tile is added, so that the links
+	/// of a polygon are allocated next to each other. (See: #dtPolyLinkRange)
+	DT_NAVMESH_POLY_LINK_RANGES = 0x02
+};
+
+/// Structures used by dtNavMesh to find tiles by their grid location.
+/// @ingroup detour
+enum dtTileLookupType
+{
+	/// Open addressed hash table. Works with any tile coordinates.
+	DT_TILE_LOOKUP_HASH = 0,
+
+	/// Dense 2D array covering a fixed range of tile coordinates.
+	/// Fastest lookups for bounded worlds, tiles outside of the range cannot be added.
+	DT_TILE_LOOKUP_GRID = 1
+};
+
+/// Configures the tile lookup of a navigation mesh.
+/// @see dtNavMesh::init
+/// @ingroup detour
+struct dtTileLookupParams
+{
+	int type;			///< The lookup structure. (See: #dtTileLookupType)
+	int gridMinX;		///< The minimum x-coordinate of the tiles. (#DT_TILE_LOOKUP_GRID only)
+	int gridMinY;		///< The minimum y-coordinate of the tiles. (#DT_TILE_LOOKUP_GRID only)
+	int gridWidth;		///< The number of tile columns. (#DT_TILE_LOOKUP_GRID only) [Limit: > 0]
+	int gridHeight;		///< The number of tile rows. (#DT_TILE_LOOKUP_GRID only) [Limit: > 0]
+};
+
+/// The maximum number of readers that can be allocated for a navigation mesh
+/// initialized with #DT_NAVMESH_CONCURRENT_READS.
+/// @ingroup detour
+static const int DT_MAX_NAVMESH_READERS = 64;
+
 /// Vertex flags returned by dtNavMeshQuery::findStraightPath.
 enum dtStraightPathFlags
 {
@@ -244,6 +286,19 @@ struct dtOffMeshConnection
 	unsigned int userId;
 };
 
+/// The link slots reserved for a polygon when the mesh was initialized with #DT_NAVMESH_POLY_LINK_RANGES.
+/// Links of the polygon are allocated from its slots first, so that iterating them
+/// touches consecutive memory. Links which do not fit come from the free links of the tile
+/// that were not reserved, e.g. the links of a polygon to off-mesh connections, and then
+/// from the unused slots of other polygons, so no link is dropped that the tile has room for.
+/// @ingroup detour
+struct dtPolyLinkRange
+{
+	unsigned int base;			///< Index of the first link reserved for the polygon.
+	unsigned short count;		///< The number of links reserved for the polygon.
+	unsigned short freeList;	///< Offset of the first free reserved link, or 0xffff.
+};
+
 /// Provides high level information related to a dtMeshTile object.
 /// @ingroup detour
 struct dtMeshHeader
@@ -301,11 +356,16 @@ struct dtMeshTile
 	dtBVNode* bvTree;
 
 	dtOffMeshConnection* offMeshCons;		///< The tile off-mesh connections. [Size: dtMeshHeader::offMeshConCount]
+
+	/// The link slots reserved for each polygon. [Size: dtMeshHeader::polyCount]
+	/// Allocated when the tile is added, not stored in the tile data.
+	/// (Null unless the mesh was initialized with #DT_NAVMESH_POLY_LINK_RANGES.)
+	dtPolyLinkRange* linkRanges;
 		
 	unsigned char* data;					///< The tile data. (Not directly accessed under normal situations.)
 	int dataSize;							///< Size of the tile data.
 	int flags;								///< Tile flags. (See: #dtTileFlags)
-	dtMeshTile* next;						///< The next free tile, or the next tile in the spatial grid.
+	dtMeshTile* next;						///< The next free tile, or the next tile at the same grid location.
 private:
 	dtMeshTile(const dtMeshTile&);
 	dtMeshTile& operator=(const dtMeshTile&);
@@ -349,6 +409,19 @@ public:
 	/// @return The status flags for the operation.
 	dtStatus init(const dtNavMeshParams* params);
 
+	/// Initializes the navigation mesh for tiled use.
+	///  @param[in]	params		Initialization parameters.
+	///  @param[in]	initFlags	Initialization flags. (See: #dtNavMeshInitFlags)
+	/// @return The status flags for the operation.
+	dtStatus init(const dtNavMeshParams* params, const int initFlags);
+
+	/// Initializes the navigation mesh for tiled use.
+	///  @param[in]	params			Initialization parameters.
+	///  @param[in]	initFlags		Initialization flags. (See: #dtNavMeshInitFlags)
+	///  @param[in]	lookupParams	Tile lookup parameters. [opt] [Default: #DT_TILE_LOOKUP_HASH]
+	/// @return The status flags for the operation.
+	dtStatus init(const dtNavMeshParams* params, const int initFlags, const dtTileLookupParams* lookupParams);
+
 	/// Initializes the navigation mesh for single tile use.
 	///  @param[in]	data		Data of the new tile. (See: #dtCreateNavMeshData)
 	///  @param[in]	dataSize	The data size of the new tile.
@@ -366,7 +439,8 @@ public:
 	///  @param[in]		flags		Tile flags. (See: #dtTileFlags)
 	///  @param[in]		lastRef		The desired reference for the tile. (When reloading a tile.) [opt] [Default: 0]
 	///  @param[out]	result		The tile reference. (If the tile was succesfully added.) [opt]
-	/// @return The status flags for the operation.
+	/// @return The status flags for the operation. The tile is added with #DT_OUT_OF_MEMORY set when
+	/// the links of the tile or of a neighbour ran out and some polygon links were dropped.
 	dtStatus addTile(unsigned char* data, int dataSize, int flags, dtTileRef lastRef, dtTileRef* result);
 	
 	/// Removes the specified tile from the navigation mesh.
@@ -517,6 +591,37 @@ public:
 	
 	/// @}
 
+	/// @{
+	/// @name Concurrent Access
+	/// These functions are only used when the mesh was initialized with #DT_NAVMESH_CONCURRENT_READS.
+
+	/// Allocates a reader slot for a thread that queries the mesh.
+	/// @return The reader id, or -1 if all readers are in use or concurrent reads are not enabled.
+	int allocReader() const;
+
+	/// Frees a reader slot allocated with #allocReader.
+	///  @param[in]	reader	The reader id.
+	void freeReader(const int reader) const;
+
+	/// Enters a read section. Tiles visible in the read section stay valid until #endRead is called.
+	/// Read sections of the same reader can be nested.
+	///  @param[in]	reader	The reader id.
+	void beginRead(const int reader) const;
+
+	/// Leaves a read section entered with #beginRead.
+	///  @param[in]	reader	The reader id.
+	void endRead(const int reader) const;
+
+	/// Frees the tile memory and links retired by #removeTile which no reader can access anymore.
+	/// Called automatically by #addTile and #removeTile.
+	/// @return The number of removed tiles whose memory has not been reclaimed yet.
+	int reclaimRetired();
+
+	/// Returns true if the mesh was initialized with #DT_NAVMESH_CONCURRENT_READS.
+	bool isConcurrent() const { return m_readers != 0; }
+
+	/// @}
+
 	/// @{
 	/// @name Encoding and Decoding
 	/// These functions are generally meant for internal use only.
@@ -629,18 +734,39 @@ private:
 							const dtMeshTile* tile, int side,
 							dtPolyRef* con, float* conarea, int maxcon) const;
 	
+	// The link builders return false if a link was dropped because the tile ran out of links.
+
 	/// Builds internal polygons links for a tile.
-	void connectIntLinks(dtMeshTile* tile);
+	bool connectIntLinks(dtMeshTile* tile);
 	/// Builds internal polygons links for a tile.
-	void baseOffMeshLinks(dtMeshTile* tile);
+	bool baseOffMeshLinks(dtMeshTile* tile);
 
 	/// Builds external polygon links for a tile.
-	void connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side);
+	bool connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side);
 	/// Builds external polygon links for a tile.
-	void connectExtOffMeshLinks(dtMeshTile* tile, dtMeshTile* target, int side);
+	bool connectExtOffMeshLinks(dtMeshTile* tile, dtMeshTile* target, int side);
 	
 	/// Removes external links at specified side.
 	void unconnectLinks(dtMeshTile* tile, dtMeshTile* target);
+
+	/// Returns a link of the polygon to the tile's free list, or retires it if readers may still be following it.
+	void releaseLink(dtMeshTile* tile, const int poly, unsigned int link);
+
+	/// Frees the tile data and returns the tile to the free list.
+	void resetTile(dtMeshTile* tile);
+
+	/// Returns the oldest epoch observed by an active reader.
+	unsigned int getOldestReaderEpoch() const;
+
+	/// Returns the lookup cell holding the tiles at the location, or null if there is none.
+	dtMeshTile** findTileCell(const int x, const int y) const;
+
+	/// Returns the lookup cell for the tiles at the location, creating it if needed.
+	/// Returns null if the location cannot be stored in the lookup.
+	dtMeshTile** allocTileCell(const int x, const int y);
+
+	/// Rebuilds the tile hash without the cells that do not hold tiles anymore.
+	bool rebuildTileHash();
 	
 
 	// TODO: These methods are duplicates from dtNavMeshQuery, but are needed for off-mesh connection finding.
@@ -660,13 +786,28 @@ private:
 	float m_orig[3];					///< Origin of the tile (0,0)
 	float m_tileWidth, m_tileHeight;	///< Dimensions of each tile.
 	int m_maxTiles;						///< Max number of tiles.
-	int m_tileLutSize;					///< Tile hash lookup size (must be pot).
-	int m_tileLutMask;					///< Tile hash lookup mask.
 
-	dtMeshTile** m_posLookup;			///< Tile hash lookup.
+	struct dtTileHashEntry* m_tileHash;	///< Open addressed tile lookup. (#DT_TILE_LOOKUP_HASH)
+	int m_tileHashSize;					///< Number of entries in the tile hash (must be pot).
+	int m_tileHashUsed;					///< Number of tile hash entries with a key, including entries without tiles.
+	dtMeshTile** m_tileGrid;			///< Dense tile lookup. (#DT_TILE_LOOKUP_GRID)
+	int m_tileGridMinX, m_tileGridMinY;	///< Tile coordinates of the first grid cell.
+	int m_tileGridWidth, m_tileGridHeight;	///< Dimensions of the tile grid.
+
 	dtMeshTile* m_nextFree;				///< Freelist of tiles.
 	dtMeshTile* m_tiles;				///< List of tiles.
+	int m_initFlags;					///< Initialization flags. (See: #dtNavMeshInitFlags)
 		
+	struct dtNavMeshReader* m_readers;	///< Reader slots. (Only used with concurrent reads.)
+	unsigned int m_epoch;				///< Current reclamation epoch. (Only used with concurrent reads.)
+	struct dtRetiredTile* m_retiredTiles;	///< Removed tiles waiting for readers to leave.
+	int m_retiredTileCount;				///< Number of removed tiles waiting for readers to leave.
+	struct dtRetiredLink* m_retiredLinks;	///< Unlinked links waiting for readers to leave.
+	int m_retiredLinkCount;				///< Number of unlinked links waiting for readers to leave.
+	int m_retiredLinkCapacity;			///< Capacity of the retired links array.
+	struct dtTileHashEntry* m_retiredTileHash;	///< Replaced tile hash waiting for readers to leave.
+	unsigned int m_retiredTileHashEpoch;	///< The epoch during which the tile hash was replaced.
+
 #ifndef DT_POLYREF64
 	unsigned int m_saltBits;			///< Number of salt bits in the tile ID.
 	unsigned int m_tileBits;			///< Number of tile bits in the tile ID.
@@ -686,6 +827,34 @@ dtNavMesh* dtAllocNavMesh();
 ///  @ingroup detour
 void dtFreeNavMesh(dtNavMesh* navmesh);
 
+/// Keeps a read section of a navigation mesh open for the lifetime of the object.
+/// Does nothing if the mesh was not initialized with #DT_NAVMESH_CONCURRENT_READS.
+/// @ingroup detour
+class dtNavMeshReadScope
+{
+public:
+	///  @param[in]	nav		The navigation mesh to read. [opt]
+	///  @param[in]	reader	The reader id. (See: dtNavMesh::allocReader)
+	dtNavMeshReadScope(const dtNavMesh* nav, const int reader) : m_nav(nav), m_reader(reader)
+	{
+		if (m_nav)
+			m_nav->beginRead(m_reader);
+	}
+	~dtNavMeshReadScope()
+	{
+		if (m_nav)
+			m_nav->endRead(m_reader);
+	}
+
+private:
+	const dtNavMesh* m_nav;
+	int m_reader;
+
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtNavMeshReadScope(const dtNavMeshReadScope&);
+	dtNavMeshReadScope& operator=(const dtNavMeshReadScope&);
+};
+
 #endif // DETOURNAVMESH_H
 
 ///////////////////////////////////////////////////////////////////////////
@@ -27,6 +27,12 @@
 // On certain platforms indirect or virtual function call is expensive. The default
 // setting is to use non-virtual functions, the actual implementations of the functions
 // are declared as inline for maximum speed. 
+//
+// Queries which visit many polygons are also available as templates on the filter type,
+// see findPathT() and raycastT(). Passing a filter class that is not derived from
+// dtQueryFilter (or that is declared final) lets the compiler inline its passFilter()
+// and getCost() functions, regardless of DT_VIRTUAL_QUERYFILTER. The templates are
+// defined in DetourNavMeshQuery.inl, which must be included to use them with other filters.
 
 //#define DT_VIRTUAL_QUERYFILTER 1
 
@@ -192,6 +198,15 @@ public:
 					  const dtQueryFilter* filter,
 					  dtPolyRef* path, int* pathCount, const int maxPath) const;
 
+	/// Finds a path from the start polygon to the end polygon using a filter known at compile time.
+	/// @p TFilter must provide passFilter() and getCost() with the signatures of dtQueryFilter.
+	/// The parameters are the same as for findPath(). (Defined in DetourNavMeshQuery.inl)
+	template<class TFilter>
+	dtStatus findPathT(dtPolyRef startRef, dtPolyRef endRef,
+					  const float* startPos, const float* endPos,
+					  const TFilter* filter,
+					  dtPolyRef* path, int* pathCount, const int maxPath) const;
+
 	/// Finds the straight path from the start to the end position within the polygon corridor.
 	///  @param[in]		startPos			Path start position. [(x, y, z)]
 	///  @param[in]		endPos				Path end position. [(x, y, z)]
@@ -338,7 +353,25 @@ public:
 	dtStatus findNearestPoly(const float* center, const float* halfExtents,
 							 const dtQueryFilter* filter,
 							 dtPolyRef* nearestRef, float* nearestPt, bool* isOverPoly) const;
-	
+
+	/// Finds the polygon nearest to each of the specified center points.
+	/// The results are identical to calling findNearestPoly() for every point, but the points are
+	/// sorted spatially and each tile's bounding volume tree is traversed once per group of points.
+	///  @param[in]		centers		The centers of the search boxes. [(x, y, z) * @p count]
+	///  @param[in]		halfExtents	The search distance along each axis for each point. [(x, y, z) * @p count]
+	///  @param[in]		count		The number of points to query. [Limit: >= 0]
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[out]	nearestRefs	The reference id of the nearest polygon for each point. Set to 0 if no
+	///  							polygon is found. [(polyRef) * @p count]
+	///  @param[out]	nearestPts	The nearest point on the polygon for each point. Unchanged if no polygon
+	///  							is found. [opt] [(x, y, z) * @p count]
+	///  @param[out]	isOverPoly	Set to true if the point's X/Z coordinate lies inside the polygon, false
+	///  							otherwise. Unchanged if no polygon is found. [opt] [(bool) * @p count]
+	/// @returns The status flags for the query.
+	dtStatus findNearestPolyBatch(const float* centers, const float* halfExtents, const int count,
+								  const dtQueryFilter* filter,
+								  dtPolyRef* nearestRefs, float* nearestPts, bool* isOverPoly) const;
+
 	/// Finds polygons that overlap the search box.
 	///  @param[in]		center		The center of the search box. [(x, y, z)]
 	///  @param[in]		halfExtents		The search distance along each axis. [(x, y, z)]
@@ -375,6 +408,23 @@ public:
 									dtPolyRef* resultRef, dtPolyRef* resultParent,
 									int* resultCount, const int maxResult) const;
 
+	/// Updates the non-overlapping navigation polygons in the local neighbourhood after the center position moved.
+	/// While the start polygon stays the same, polygons the circle no longer touches are removed and polygons
+	/// reached from the remaining ones are added, so only the added polygons are tested for overlap.
+	/// When the start polygon changed, the neighbourhood is searched again with #findLocalNeighbourhood.
+	///  @param[in]		startRef		The reference id of the polygon at the center position.
+	///  @param[in]		centerPos		The center of the query circle. [(x, y, z)]
+	///  @param[in]		radius			The radius of the query circle.
+	///  @param[in]		filter			The polygon filter to apply to the query.
+	///  @param[in,out]	polys			The polygons of the previous neighbourhood, replaced by the polygons touched
+	///  								by the circle. The start polygon is the first polygon.
+	///  @param[in,out]	polyCount		The number of polygons of the previous neighbourhood, replaced by the number
+	///  								of polygons found.
+	///  @param[in]		maxPolys		The maximum number of polygons the array can hold.
+	/// @returns The status flags for the query.
+	dtStatus updateLocalNeighbourhood(dtPolyRef startRef, const float* centerPos, const float radius,
+									  const dtQueryFilter* filter, dtPolyRef* polys, int* polyCount, const int maxPolys) const;
+
 	/// Moves from the start to the end position constrained to the navigation mesh.
 	///  @param[in]		startRef		The reference id of the start polygon.
 	///  @param[in]		startPos		A position of the mover within the start polygon. [(x, y, x)]
@@ -422,6 +472,22 @@ public:
 					 const dtQueryFilter* filter, const unsigned int options,
 					 dtRaycastHit* hit, dtPolyRef prevRef = 0) const;
 
+	/// Casts a 'walkability' ray using a filter known at compile time.
+	/// @p TFilter must provide passFilter() and getCost() with the signatures of dtQueryFilter.
+	/// The parameters are the same as for raycast(). (Defined in DetourNavMeshQuery.inl)
+	template<class TFilter>
+	dtStatus raycastT(dtPolyRef startRef, const float* startPos, const float* endPos,
+					 const TFilter* filter,
+					 float* t, float* hitNormal, dtPolyRef* path, int* pathCount, const int maxPath) const;
+
+	/// Casts a 'walkability' ray using a filter known at compile time.
+	/// @p TFilter must provide passFilter() and getCost() with the signatures of dtQueryFilter.
+	/// The parameters are the same as for raycast(). (Defined in DetourNavMeshQuery.inl)
+	template<class TFilter>
+	dtStatus raycastT(dtPolyRef startRef, const float* startPos, const float* endPos,
+					 const TFilter* filter, const unsigned int options,
+					 dtRaycastHit* hit, dtPolyRef prevRef = 0) const;
+
 
 	/// Finds the distance from the specified position to the nearest polygon wall.
 	///  @param[in]		startRef		The reference id of the polygon containing @p centerPos.
@@ -531,6 +597,19 @@ private:
 	void queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, const float* qmax,
 							 const dtQueryFilter* filter, dtPolyQuery* query) const;
 
+	/// Finds the nearest polygons within a tile for a group of batched points.
+	void findNearestPolyInTileBatch(const dtMeshTile* tile, const dtQueryFilter* filter,
+									struct dtNearestPolyBatchPoint* points, const int npoints) const;
+
+	/// Tests a polygon against the current nearest polygon of a batched point.
+	void updateNearestPolyBatchPoint(const dtMeshTile* tile, const dtPolyRef ref,
+									 struct dtNearestPolyBatchPoint& point) const;
+
+	/// Expands a local neighbourhood from the polygons on the stack. The results hold the polygons found so far.
+	dtStatus expandLocalNeighbourhood(struct dtNode** stack, int nstack, const int maxStack, const float* centerPos,
+									  const float radius, const dtQueryFilter* filter,
+									  dtPolyRef* resultRef, dtPolyRef* resultParent, int* resultCount, const int maxResult) const;
+
 	/// Returns portal points between two polygons.
 	dtStatus getPortalPoints(dtPolyRef from, dtPolyRef to, float* left, float* right,
 							 unsigned char& fromType, unsigned char& toType) const;
@@ -558,6 +637,7 @@ private:
 	dtStatus getPathToNode(struct dtNode* endNode, dtPolyRef* path, int* pathCount, int maxPath) const;
 	
 	const dtNavMesh* m_nav;				///< Pointer to navmesh data.
+	int m_reader;						///< Reader id used with concurrently modified navmeshes, or -1.
 
 	struct dtQueryData
 	{
@@ -19,12 +19,14 @@
 #include <float.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 #include "DetourNavMesh.h"
 #include "DetourNode.h"
 #include "DetourCommon.h"
 #include "DetourMath.h"
 #include "DetourAlloc.h"
 #include "DetourAssert.h"
+#include "DetourAtomic.h"
 #include <new>
 
 
@@ -119,21 +121,172 @@ inline int computeTileHash(int x, int y, const int mask)
 	return (int)(n & mask);
 }
 
-inline unsigned int allocLink(dtMeshTile* tile)
+/// Pops a link from the free list of a reserved link range.
+inline unsigned int allocRangeLink(dtMeshTile* tile, dtPolyLinkRange& range)
 {
-	if (tile->linksFreeList == DT_NULL_LINK)
-		return DT_NULL_LINK;
-	unsigned int link = tile->linksFreeList;
-	tile->linksFreeList = tile->links[link].next;
+	const unsigned int link = range.base + range.freeList;
+	const unsigned int next = tile->links[link].next;
+	range.freeList = next == DT_NULL_LINK ? 0xffff : (unsigned short)(next - range.base);
 	return link;
 }
 
-inline void freeLink(dtMeshTile* tile, unsigned int link)
+inline unsigned int allocLink(dtMeshTile* tile, const int poly)
 {
+	// Prefer the links reserved for the polygon.
+	if (tile->linkRanges && tile->linkRanges[poly].freeList != 0xffff)
+		return allocRangeLink(tile, tile->linkRanges[poly]);
+	if (tile->linksFreeList != DT_NULL_LINK)
+	{
+		unsigned int link = tile->linksFreeList;
+		tile->linksFreeList = tile->links[link].next;
+		return link;
+	}
+	// The reservations are estimates, e.g. a portal edge can connect to up to four polygons.
+	// Borrow a link reserved for another polygon before running out of links.
+	if (tile->linkRanges)
+	{
+		const int polyCount = tile->header->polyCount;
+		for (int i = 1; i < polyCount; ++i)
+		{
+			dtPolyLinkRange& range = tile->linkRanges[(poly + i) % polyCount];
+			if (range.freeList != 0xffff)
+				return allocRangeLink(tile, range);
+		}
+	}
+	return DT_NULL_LINK;
+}
+
+/// Reserves link slots for each polygon of the tile and builds their free lists.
+/// Returns the index of the first link which was not reserved.
+static int initLinkRanges(dtMeshTile* tile, const dtMeshHeader* header)
+{
+	// Reserve a link for each internal edge and two for each portal edge, as many as the builder
+	// sizes the links of a tile for. Off-mesh connections get a link for each end point. The remaining
+	// links are shared by the polygons, e.g. for links to off-mesh connections. A polygon which needs
+	// more links, e.g. across a portal to a finer tile, borrows them (see allocLink).
+	unsigned int base = 0;
+	for (int i = 0; i < header->polyCount; ++i)
+	{
+		const dtPoly* p = &tile->polys[i];
+		int count = 0;
+		if (p->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+		{
+			count = 2;
+		}
+		else
+		{
+			for (int j = 0; j < p->vertCount; ++j)
+			{
+				if (p->neis[j] & DT_EXT_LINK)
+					count += 2;
+				else if (p->neis[j] != 0)
+					count++;
+			}
+		}
+		// Tiles from other builders may have fewer links, leave the rest unreserved.
+		if (base + count > (unsigned int)header->maxLinkCount)
+			count = 0;
+
+		dtPolyLinkRange& range = tile->linkRanges[i];
+		range.base = base;
+		range.count = (unsigned short)count;
+		range.freeList = count ? 0 : 0xffff;
+		for (int j = 0; j < count; ++j)
+			tile->links[base+j].next = j+1 < count ? base+j+1 : DT_NULL_LINK;
+		base += (unsigned int)count;
+	}
+	return (int)base;
+}
+
+/// Returns the link range the link was reserved in, or null if it is a shared link.
+static dtPolyLinkRange* findLinkRange(dtMeshTile* tile, const int poly, const unsigned int link)
+{
+	dtPolyLinkRange* ranges = tile->linkRanges;
+	if (link >= ranges[poly].base && link < ranges[poly].base + ranges[poly].count)
+		return &ranges[poly];
+	// The link was borrowed, find the last range starting at or before it.
+	int lo = 0;
+	int hi = tile->header->polyCount - 1;
+	while (lo < hi)
+	{
+		const int mid = (lo + hi + 1) / 2;
+		if (ranges[mid].base <= link)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	if (link >= ranges[lo].base && link < ranges[lo].base + ranges[lo].count)
+		return &ranges[lo];
+	return 0;
+}
+
+inline void freeLink(dtMeshTile* tile, const int poly, unsigned int link)
+{
+	dtPolyLinkRange* range = tile->linkRanges ? findLinkRange(tile, poly, link) : 0;
+	if (range)
+	{
+		tile->links[link].next = range->freeList == 0xffff ? DT_NULL_LINK : range->base + range->freeList;
+		range->freeList = (unsigned short)(link - range->base);
+		return;
+	}
 	tile->links[link].next = tile->linksFreeList;
 	tile->linksFreeList = link;
 }
 
+/// An entry of the open addressed tile hash.
+struct dtTileHashEntry
+{
+	uint64_t key;		///< The packed tile location, or #DT_TILE_KEY_EMPTY.
+	dtMeshTile* tiles;	///< The tiles at the location, linked through dtMeshTile::next.
+};
+
+inline uint64_t dtTileKey(const int x, const int y)
+{
+	return ((uint64_t)(unsigned int)x << 32) | (uint64_t)(unsigned int)y;
+}
+
+/// Marks tile hash entries which have never been used. Reserves the location (INT_MIN, INT_MIN).
+static const uint64_t DT_TILE_KEY_EMPTY = 0x8000000080000000ULL;
+
+static dtTileHashEntry* allocTileHash(const int size)
+{
+	dtTileHashEntry* hash = (dtTileHashEntry*)dtAlloc(sizeof(dtTileHashEntry)*size, DT_ALLOC_PERM);
+	if (!hash)
+		return 0;
+	for (int i = 0; i < size; ++i)
+	{
+		hash[i].key = DT_TILE_KEY_EMPTY;
+		hash[i].tiles = 0;
+	}
+	return hash;
+}
+
+/// Reader slot of a navigation mesh initialized with #DT_NAVMESH_CONCURRENT_READS.
+struct dtNavMeshReader
+{
+	unsigned int epoch;	///< The epoch observed when the outermost read section was entered, or 0 if not reading.
+	int used;			///< Non-zero if the slot is allocated.
+	int depth;			///< Nesting depth of the read sections. Only accessed by the owning thread.
+	char pad[64 - 3*sizeof(int)];	///< Keeps the slots on separate cache lines.
+};
+
+/// A tile removed from the navigation mesh which may still be accessed by readers.
+struct dtRetiredTile
+{
+	int index;			///< Index of the tile.
+	unsigned int epoch;	///< The epoch during which the tile was removed.
+};
+
+/// A link unlinked from a polygon which may still be followed by readers.
+struct dtRetiredLink
+{
+	int tileIndex;		///< Index of the tile owning the link.
+	unsigned int salt;	///< Salt of the tile when the link was unlinked.
+	int poly;			///< Index of the polygon the link belonged to.
+	unsigned int link;	///< Index of the link.
+	unsigned int epoch;	///< The epoch during which the link was unlinked.
+};
+
 
 dtNavMesh* dtAllocNavMesh()
 {
@@ -189,11 +342,26 @@ dtNavMesh::dtNavMesh() :
 	m_tileWidth(0),
 	m_tileHeight(0),
 	m_maxTiles(0),
-	m_tileLutSize(0),
-	m_tileLutMask(0),
-	m_posLookup(0),
+	m_tileHash(0),
+	m_tileHashSize(0),
+	m_tileHashUsed(0),
+	m_tileGrid(0),
+	m_tileGridMinX(0),
+	m_tileGridMinY(0),
+	m_tileGridWidth(0),
+	m_tileGridHeight(0),
 	m_nextFree(0),
-	m_tiles(0)
+	m_tiles(0),
+	m_initFlags(0),
+	m_readers(0),
+	m_epoch(0),
+	m_retiredTiles(0),
+	m_retiredTileCount(0),
+	m_retiredLinks(0),
+	m_retiredLinkCount(0),
+	m_retiredLinkCapacity(0),
+	m_retiredTileHash(0),
+	m_retiredTileHashEpoch(0)
 {
 #ifndef DT_POLYREF64
 	m_saltBits = 0;
@@ -216,32 +384,56 @@ dtNavMesh::~dtNavMesh()
 			m_tiles[i].data = 0;
 			m_tiles[i].dataSize = 0;
 		}
+		dtFree(m_tiles[i].linkRanges);
 	}
-	dtFree(m_posLookup);
+	dtFree(m_tileHash);
+	dtFree(m_tileGrid);
+	dtFree(m_retiredTileHash);
 	dtFree(m_tiles);
+	dtFree(m_readers);
+	dtFree(m_retiredTiles);
+	dtFree(m_retiredLinks);
 }
 		
 dtStatus dtNavMesh::init(const dtNavMeshParams* params)
+{
+	return init(params, 0, 0);
+}
+
+dtStatus dtNavMesh::init(const dtNavMeshParams* params, const int initFlags)
+{
+	return init(params, initFlags, 0);
+}
+
+/// @par
+///
+/// When #DT_NAVMESH_CONCURRENT_READS is set, tiles can be added and removed
+/// while other threads are querying the mesh. See #beginRead for details.
+///
+/// When #DT_NAVMESH_POLY_LINK_RANGES is set, each added tile reserves link slots
+/// for its polygons, so that the links a search follows from a polygon are
+/// next to each other in memory. The ranges are built when the tile is added rather
+/// than stored in the tile data, because the links to neighbour tiles are only known
+/// then, so the tile data format does not change. Polygon flags and areas stay in #dtPoly,
+/// where #setPolyFlags and #setPolyArea change them.
+///
+/// The tile lookup defaults to #DT_TILE_LOOKUP_HASH. Worlds with known bounds
+/// can use #DT_TILE_LOOKUP_GRID, which finds tiles with a single array access.
+dtStatus dtNavMesh::init(const dtNavMeshParams* params, const int initFlags, const dtTileLookupParams* lookupParams)
 {
 	memcpy(&m_params, params, sizeof(dtNavMeshParams));
 	dtVcopy(m_orig, params->orig);
 	m_tileWidth = params->tileWidth;
 	m_tileHeight = params->tileHeight;
+	m_initFlags = initFlags;
 	
 	// Init tiles
 	m_maxTiles = params->maxTiles;
-	m_tileLutSize = dtNextPow2(params->maxTiles/4);
-	if (!m_tileLutSize) m_tileLutSize = 1;
-	m_tileLutMask = m_tileLutSize-1;
 	
 	m_tiles = (dtMeshTile*)dtAlloc(sizeof(dtMeshTile)*m_maxTiles, DT_ALLOC_PERM);
 	if (!m_tiles)
 		return DT_FAILURE | DT_OUT_OF_MEMORY;
-	m_posLookup = (dtMeshTile**)dtAlloc(sizeof(dtMeshTile*)*m_tileLutSize, DT_ALLOC_PERM);
-	if (!m_posLookup)
-		return DT_FAILURE | DT_OUT_OF_MEMORY;
 	memset(m_tiles, 0, sizeof(dtMeshTile)*m_maxTiles);
-	memset(m_posLookup, 0, sizeof(dtMeshTile*)*m_tileLutSize);
 	m_nextFree = 0;
 	for (int i = m_maxTiles-1; i >= 0; --i)
 	{
@@ -249,6 +441,31 @@ dtStatus dtNavMesh::init(const dtNavMeshParams* params)
 		m_tiles[i].next = m_nextFree;
 		m_nextFree = &m_tiles[i];
 	}
+
+	// Init tile lookup.
+	if (lookupParams && lookupParams->type == DT_TILE_LOOKUP_GRID)
+	{
+		if (lookupParams->gridWidth <= 0 || lookupParams->gridHeight <= 0)
+			return DT_FAILURE | DT_INVALID_PARAM;
+		m_tileGridMinX = lookupParams->gridMinX;
+		m_tileGridMinY = lookupParams->gridMinY;
+		m_tileGridWidth = lookupParams->gridWidth;
+		m_tileGridHeight = lookupParams->gridHeight;
+		const int cellCount = m_tileGridWidth*m_tileGridHeight;
+		m_tileGrid = (dtMeshTile**)dtAlloc(sizeof(dtMeshTile*)*cellCount, DT_ALLOC_PERM);
+		if (!m_tileGrid)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		memset(m_tileGrid, 0, sizeof(dtMeshTile*)*cellCount);
+	}
+	else
+	{
+		// Keep the load factor at most 0.5 for the locations in use.
+		m_tileHashSize = (int)dtNextPow2((unsigned int)dtMax(params->maxTiles*2, 2));
+		m_tileHashUsed = 0;
+		m_tileHash = allocTileHash(m_tileHashSize);
+		if (!m_tileHash)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
 	
 	// Init ID generator values.
 #ifndef DT_POLYREF64
@@ -264,6 +481,19 @@ dtStatus dtNavMesh::init(const dtNavMeshParams* params)
 	if (m_saltBits < 10)
 		return DT_FAILURE | DT_INVALID_PARAM;
 #endif
+
+	if (initFlags & DT_NAVMESH_CONCURRENT_READS)
+	{
+		m_readers = (dtNavMeshReader*)dtAlloc(sizeof(dtNavMeshReader)*DT_MAX_NAVMESH_READERS, DT_ALLOC_PERM);
+		if (!m_readers)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		memset(m_readers, 0, sizeof(dtNavMeshReader)*DT_MAX_NAVMESH_READERS);
+		m_retiredTiles = (dtRetiredTile*)dtAlloc(sizeof(dtRetiredTile)*m_maxTiles, DT_ALLOC_PERM);
+		if (!m_retiredTiles)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		m_retiredTileCount = 0;
+		m_epoch = 1;
+	}
 	
 	return DT_SUCCESS;
 }
@@ -370,12 +600,14 @@ void dtNavMesh::unconnectLinks(dtMeshTile* tile, dtMeshTile* target)
 			if (decodePolyIdTile(tile->links[j].ref) == targetNum)
 			{
 				// Remove link.
+				// The removed link keeps pointing to the next link
+				// so that concurrent readers can continue iterating.
 				unsigned int nj = tile->links[j].next;
 				if (pj == DT_NULL_LINK)
-					poly->firstLink = nj;
+					dtAtomicStoreRelease(&poly->firstLink, nj);
 				else
-					tile->links[pj].next = nj;
-				freeLink(tile, j);
+					dtAtomicStoreRelease(&tile->links[pj].next, nj);
+				releaseLink(tile, i, j);
 				j = nj;
 			}
 			else
@@ -388,9 +620,11 @@ void dtNavMesh::unconnectLinks(dtMeshTile* tile, dtMeshTile* target)
 	}
 }
 
-void dtNavMesh::connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side)
+bool dtNavMesh::connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side)
 {
-	if (!tile) return;
+	if (!tile) return true;
+
+	bool placed = true;
 	
 	// Connect border links.
 	for (int i = 0; i < tile->header->polyCount; ++i)
@@ -419,7 +653,7 @@ void dtNavMesh::connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side)
 			int nnei = findConnectingPolys(va,vb, target, dtOppositeTile(dir), nei,neia,4);
 			for (int k = 0; k < nnei; ++k)
 			{
-				unsigned int idx = allocLink(tile);
+				unsigned int idx = allocLink(tile, i);
 				if (idx != DT_NULL_LINK)
 				{
 					dtLink* link = &tile->links[idx];
@@ -428,7 +662,7 @@ void dtNavMesh::connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side)
 					link->side = (unsigned char)dir;
 					
 					link->next = poly->firstLink;
-					poly->firstLink = idx;
+					dtAtomicStoreRelease(&poly->firstLink, idx);
 
 					// Compress portal limits to a byte value.
 					if (dir == 0 || dir == 4)
@@ -450,14 +684,20 @@ void dtNavMesh::connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side)
 						link->bmax = (unsigned char)roundf(dtClamp(tmax, 0.0f, 1.0f)*255.0f);
 					}
 				}
+				else
+					placed = false;
 			}
 		}
 	}
+
+	return placed;
 }
 
-void dtNavMesh::connectExtOffMeshLinks(dtMeshTile* tile, dtMeshTile* target, int side)
+bool dtNavMesh::connectExtOffMeshLinks(dtMeshTile* tile, dtMeshTile* target, int side)
 {
-	if (!tile) return;
+	if (!tile) return true;
+
+	bool placed = true;
 	
 	// Connect off-mesh links.
 	// We are interested on links which land from target tile to this tile.
@@ -490,7 +730,7 @@ void dtNavMesh::connectExtOffMeshLinks(dtMeshTile* tile, dtMeshTile* target, int
 		dtVcopy(v, nearestPt);
 				
 		// Link off-mesh connection to target poly.
-		unsigned int idx = allocLink(target);
+		unsigned int idx = allocLink(target, targetCon->poly);
 		if (idx != DT_NULL_LINK)
 		{
 			dtLink* link = &target->links[idx];
@@ -500,16 +740,18 @@ void dtNavMesh::connectExtOffMeshLinks(dtMeshTile* tile, dtMeshTile* target, int
 			link->bmin = link->bmax = 0;
 			// Add to linked list.
 			link->next = targetPoly->firstLink;
-			targetPoly->firstLink = idx;
+			dtAtomicStoreRelease(&targetPoly->firstLink, idx);
 		}
+		else
+			placed = false;
 		
 		// Link target poly to off-mesh connection.
 		if (targetCon->flags & DT_OFFMESH_CON_BIDIR)
 		{
-			unsigned int tidx = allocLink(tile);
+			const unsigned short landPolyIdx = (unsigned short)decodePolyIdPoly(ref);
+			unsigned int tidx = allocLink(tile, landPolyIdx);
 			if (tidx != DT_NULL_LINK)
 			{
-				const unsigned short landPolyIdx = (unsigned short)decodePolyIdPoly(ref);
 				dtPoly* landPoly = &tile->polys[landPolyIdx];
 				dtLink* link = &tile->links[tidx];
 				link->ref = getPolyRefBase(target) | (dtPolyRef)(targetCon->poly);
@@ -518,16 +760,21 @@ void dtNavMesh::connectExtOffMeshLinks(dtMeshTile* tile, dtMeshTile* target, int
 				link->bmin = link->bmax = 0;
 				// Add to linked list.
 				link->next = landPoly->firstLink;
-				landPoly->firstLink = tidx;
+				dtAtomicStoreRelease(&landPoly->firstLink, tidx);
 			}
+			else
+				placed = false;
 		}
 	}
 
+	return placed;
 }
 
-void dtNavMesh::connectIntLinks(dtMeshTile* tile)
+bool dtNavMesh::connectIntLinks(dtMeshTile* tile)
 {
-	if (!tile) return;
+	if (!tile) return true;
+
+	bool placed = true;
 
 	dtPolyRef base = getPolyRefBase(tile);
 
@@ -546,7 +793,7 @@ void dtNavMesh::connectIntLinks(dtMeshTile* tile)
 			// Skip hard and non-internal edges.
 			if (poly->neis[j] == 0 || (poly->neis[j] & DT_EXT_LINK)) continue;
 
-			unsigned int idx = allocLink(tile);
+			unsigned int idx = allocLink(tile, i);
 			if (idx != DT_NULL_LINK)
 			{
 				dtLink* link = &tile->links[idx];
@@ -556,15 +803,21 @@ void dtNavMesh::connectIntLinks(dtMeshTile* tile)
 				link->bmin = link->bmax = 0;
 				// Add to linked list.
 				link->next = poly->firstLink;
-				poly->firstLink = idx;
+				dtAtomicStoreRelease(&poly->firstLink, idx);
 			}
+			else
+				placed = false;
 		}			
 	}
+
+	return placed;
 }
 
-void dtNavMesh::baseOffMeshLinks(dtMeshTile* tile)
+bool dtNavMesh::baseOffMeshLinks(dtMeshTile* tile)
 {
-	if (!tile) return;
+	if (!tile) return true;
+
+	bool placed = true;
 	
 	dtPolyRef base = getPolyRefBase(tile);
 	
@@ -589,7 +842,7 @@ void dtNavMesh::baseOffMeshLinks(dtMeshTile* tile)
 		dtVcopy(v, nearestPt);
 
 		// Link off-mesh connection to target poly.
-		unsigned int idx = allocLink(tile);
+		unsigned int idx = allocLink(tile, con->poly);
 		if (idx != DT_NULL_LINK)
 		{
 			dtLink* link = &tile->links[idx];
@@ -599,14 +852,16 @@ void dtNavMesh::baseOffMeshLinks(dtMeshTile* tile)
 			link->bmin = link->bmax = 0;
 			// Add to linked list.
 			link->next = poly->firstLink;
-			poly->firstLink = idx;
+			dtAtomicStoreRelease(&poly->firstLink, idx);
 		}
+		else
+			placed = false;
 
 		// Start end-point is always connect back to off-mesh connection. 
-		unsigned int tidx = allocLink(tile);
+		const unsigned short landPolyIdx = (unsigned short)decodePolyIdPoly(ref);
+		unsigned int tidx = allocLink(tile, landPolyIdx);
 		if (tidx != DT_NULL_LINK)
 		{
-			const unsigned short landPolyIdx = (unsigned short)decodePolyIdPoly(ref);
 			dtPoly* landPoly = &tile->polys[landPolyIdx];
 			dtLink* link = &tile->links[tidx];
 			link->ref = base | (dtPolyRef)(con->poly);
@@ -615,9 +870,13 @@ void dtNavMesh::baseOffMeshLinks(dtMeshTile* tile)
 			link->bmin = link->bmax = 0;
 			// Add to linked list.
 			link->next = landPoly->firstLink;
-			landPoly->firstLink = tidx;
+			dtAtomicStoreRelease(&landPoly->firstLink, tidx);
 		}
+		else
+			placed = false;
 	}
+
+	return placed;
 }
 
 namespace
@@ -908,6 +1167,10 @@ int dtNavMesh::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, co
 /// should not be reused in other nav meshes until the tile has been successfully
 /// removed from this nav mesh.
 ///
+/// When the mesh was initialized with #DT_NAVMESH_CONCURRENT_READS, a tile index
+/// freed by #removeTile can only be reused after no reader can access the removed
+/// tile anymore. Restoring a tile with lastRef fails with #DT_OUT_OF_MEMORY until then.
+///
 /// @see dtCreateNavMeshData, #removeTile
 dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 							dtTileRef lastRef, dtTileRef* result)
@@ -925,10 +1188,19 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	if (m_polyBits < dtIlog2(dtNextPow2((unsigned int)header->polyCount)))
 		return DT_FAILURE | DT_INVALID_PARAM;
 #endif
+
+	// Recycle removed tiles which are not accessed by readers anymore.
+	if (m_readers)
+		reclaimRetired();
 		
 	// Make sure the location is free.
 	if (getTileAt(header->x, header->y, header->layer))
 		return DT_FAILURE | DT_ALREADY_OCCUPIED;
+
+	// Make sure the location can be stored in the lookup.
+	dtMeshTile** cell = allocTileCell(header->x, header->y);
+	if (!cell)
+		return DT_FAILURE | DT_INVALID_PARAM;
 		
 	// Allocate a tile.
 	dtMeshTile* tile = 0;
@@ -973,11 +1245,6 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	if (!tile)
 		return DT_FAILURE | DT_OUT_OF_MEMORY;
 	
-	// Insert tile into the position lut.
-	int h = computeTileHash(header->x, header->y, m_tileLutMask);
-	tile->next = m_posLookup[h];
-	m_posLookup[h] = tile;
-	
 	// Patch header pointers.
 	const int headerSize = dtAlign4(sizeof(dtMeshHeader));
 	const int vertsSize = dtAlign4(sizeof(float)*3*header->vertCount);
@@ -1004,22 +1271,55 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 		tile->bvTree = 0;
 
 	// Build links freelist
-	tile->linksFreeList = 0;
-	tile->links[header->maxLinkCount-1].next = DT_NULL_LINK;
-	for (int i = 0; i < header->maxLinkCount-1; ++i)
-		tile->links[i].next = i+1;
+	int sharedLinkBase = 0;
+	tile->linkRanges = 0;
+	if (m_initFlags & DT_NAVMESH_POLY_LINK_RANGES)
+	{
+		tile->linkRanges = (dtPolyLinkRange*)dtAlloc(sizeof(dtPolyLinkRange)*dtMax(header->polyCount, 1), DT_ALLOC_PERM);
+		if (!tile->linkRanges)
+		{
+			// Return the tile to the free list.
+			tile->next = m_nextFree;
+			m_nextFree = tile;
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		}
+		sharedLinkBase = initLinkRanges(tile, header);
+	}
+	if (sharedLinkBase < header->maxLinkCount)
+	{
+		tile->linksFreeList = (unsigned int)sharedLinkBase;
+		tile->links[header->maxLinkCount-1].next = DT_NULL_LINK;
+		for (int i = sharedLinkBase; i < header->maxLinkCount-1; ++i)
+			tile->links[i].next = i+1;
+	}
+	else
+	{
+		tile->linksFreeList = DT_NULL_LINK;
+	}
+
+	// Readers holding a stale reference to a restored tile may see it before it is
+	// connected, make sure they do not follow links left in the data.
+	if (m_readers)
+	{
+		for (int i = 0; i < header->polyCount; ++i)
+			tile->polys[i].firstLink = DT_NULL_LINK;
+	}
 
 	// Init tile.
-	tile->header = header;
 	tile->data = data;
 	tile->dataSize = dataSize;
 	tile->flags = flags;
+	dtAtomicStoreRelease(&tile->header, header);
 
-	connectIntLinks(tile);
+	bool placed = connectIntLinks(tile);
 
 	// Base off-mesh connections to their starting polygons and connect connections inside the tile.
-	baseOffMeshLinks(tile);
-	connectExtOffMeshLinks(tile, tile, -1);
+	placed &= baseOffMeshLinks(tile);
+	placed &= connectExtOffMeshLinks(tile, tile, -1);
+
+	// Insert tile into the position lookup.
+	tile->next = *cell;
+	dtAtomicStoreRelease(cell, tile);
 
 	// Create connections with neighbour tiles.
 	static const int MAX_NEIS = 32;
@@ -1033,10 +1333,10 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 		if (neis[j] == tile)
 			continue;
 	
-		connectExtLinks(tile, neis[j], -1);
-		connectExtLinks(neis[j], tile, -1);
-		connectExtOffMeshLinks(tile, neis[j], -1);
-		connectExtOffMeshLinks(neis[j], tile, -1);
+		placed &= connectExtLinks(tile, neis[j], -1);
+		placed &= connectExtLinks(neis[j], tile, -1);
+		placed &= connectExtOffMeshLinks(tile, neis[j], -1);
+		placed &= connectExtOffMeshLinks(neis[j], tile, -1);
 	}
 	
 	// Connect with neighbour tiles.
@@ -1045,24 +1345,27 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 		nneis = getNeighbourTilesAt(header->x, header->y, i, neis, MAX_NEIS);
 		for (int j = 0; j < nneis; ++j)
 		{
-			connectExtLinks(tile, neis[j], i);
-			connectExtLinks(neis[j], tile, dtOppositeTile(i));
-			connectExtOffMeshLinks(tile, neis[j], i);
-			connectExtOffMeshLinks(neis[j], tile, dtOppositeTile(i));
+			placed &= connectExtLinks(tile, neis[j], i);
+			placed &= connectExtLinks(neis[j], tile, dtOppositeTile(i));
+			placed &= connectExtOffMeshLinks(tile, neis[j], i);
+			placed &= connectExtOffMeshLinks(neis[j], tile, dtOppositeTile(i));
 		}
 	}
 	
 	if (result)
 		*result = getTileRef(tile);
 	
+	// The tile is added, but some polygons are missing links.
+	if (!placed)
+		return DT_SUCCESS | DT_OUT_OF_MEMORY;
 	return DT_SUCCESS;
 }
 
 const dtMeshTile* dtNavMesh::getTileAt(const int x, const int y, const int layer) const
 {
-	// Find tile based on hash.
-	int h = computeTileHash(x,y,m_tileLutMask);
-	dtMeshTile* tile = m_posLookup[h];
+	// Find tile based on the lookup.
+	dtMeshTile** cell = findTileCell(x, y);
+	dtMeshTile* tile = cell ? dtAtomicLoadAcquire(cell) : 0;
 	while (tile)
 	{
 		if (tile->header &&
@@ -1072,7 +1375,7 @@ const dtMeshTile* dtNavMesh::getTileAt(const int x, const int y, const int layer
 		{
 			return tile;
 		}
-		tile = tile->next;
+		tile = dtAtomicLoadAcquire(&tile->next);
 	}
 	return 0;
 }
@@ -1099,9 +1402,9 @@ int dtNavMesh::getTilesAt(const int x, const int y, dtMeshTile** tiles, const in
 {
 	int n = 0;
 	
-	// Find tile based on hash.
-	int h = computeTileHash(x,y,m_tileLutMask);
-	dtMeshTile* tile = m_posLookup[h];
+	// Find tile based on the lookup.
+	dtMeshTile** cell = findTileCell(x, y);
+	dtMeshTile* tile = cell ? dtAtomicLoadAcquire(cell) : 0;
 	while (tile)
 	{
 		if (tile->header &&
@@ -1111,7 +1414,7 @@ int dtNavMesh::getTilesAt(const int x, const int y, dtMeshTile** tiles, const in
 			if (n < maxTiles)
 				tiles[n++] = tile;
 		}
-		tile = tile->next;
+		tile = dtAtomicLoadAcquire(&tile->next);
 	}
 	
 	return n;
@@ -1125,9 +1428,9 @@ int dtNavMesh::getTilesAt(const int x, const int y, dtMeshTile const** tiles, co
 {
 	int n = 0;
 	
-	// Find tile based on hash.
-	int h = computeTileHash(x,y,m_tileLutMask);
-	dtMeshTile* tile = m_posLookup[h];
+	// Find tile based on the lookup.
+	dtMeshTile** cell = findTileCell(x, y);
+	dtMeshTile* tile = cell ? dtAtomicLoadAcquire(cell) : 0;
 	while (tile)
 	{
 		if (tile->header &&
@@ -1137,18 +1440,137 @@ int dtNavMesh::getTilesAt(const int x, const int y, dtMeshTile const** tiles, co
 			if (n < maxTiles)
 				tiles[n++] = tile;
 		}
-		tile = tile->next;
+		tile = dtAtomicLoadAcquire(&tile->next);
 	}
 	
 	return n;
 }
 
 
+dtMeshTile** dtNavMesh::findTileCell(const int x, const int y) const
+{
+	if (m_tileGrid)
+	{
+		const int gx = x - m_tileGridMinX;
+		const int gy = y - m_tileGridMinY;
+		if (gx < 0 || gy < 0 || gx >= m_tileGridWidth || gy >= m_tileGridHeight)
+			return 0;
+		return &m_tileGrid[gx + gy*m_tileGridWidth];
+	}
+
+	// Linear probing, keys are never removed so the first empty entry ends the search.
+	dtTileHashEntry* hash = dtAtomicLoadAcquire(&m_tileHash);
+	const uint64_t key = dtTileKey(x, y);
+	const int mask = m_tileHashSize-1;
+	int h = computeTileHash(x, y, mask);
+	for (int i = 0; i < m_tileHashSize; ++i)
+	{
+		const uint64_t entryKey = dtAtomicLoadAcquire(&hash[h].key);
+		if (entryKey == key)
+			return &hash[h].tiles;
+		if (entryKey == DT_TILE_KEY_EMPTY)
+			return 0;
+		h = (h+1) & mask;
+	}
+	return 0;
+}
+
+dtMeshTile** dtNavMesh::allocTileCell(const int x, const int y)
+{
+	if (m_tileGrid)
+		return findTileCell(x, y);
+
+	const uint64_t key = dtTileKey(x, y);
+	if (key == DT_TILE_KEY_EMPTY)
+		return 0;
+
+	// Find the location, or the first entry which can be used for it.
+	dtTileHashEntry* unused = 0;
+	dtTileHashEntry* empty = 0;
+	const int mask = m_tileHashSize-1;
+	int h = computeTileHash(x, y, mask);
+	for (int i = 0; i < m_tileHashSize; ++i)
+	{
+		dtTileHashEntry* entry = &m_tileHash[h];
+		if (entry->key == key)
+			return &entry->tiles;
+		if (entry->key == DT_TILE_KEY_EMPTY)
+		{
+			empty = entry;
+			break;
+		}
+		if (!entry->tiles && !unused)
+			unused = entry;
+		h = (h+1) & mask;
+	}
+
+	if (!unused)
+	{
+		// Rebuild before the probe sequences get long.
+		if (empty && (m_tileHashUsed+1)*4 > m_tileHashSize*3 && rebuildTileHash())
+			return allocTileCell(x, y);
+		if (!empty)
+			return 0;
+		unused = empty;
+		m_tileHashUsed++;
+	}
+
+	// Readers still looking for the previous location skip the entry once the key changes.
+	dtAtomicStoreRelease(&unused->key, key);
+	return &unused->tiles;
+}
+
+bool dtNavMesh::rebuildTileHash()
+{
+	// Readers may still be probing the previous hash, wait for them before replacing it again.
+	if (m_readers)
+	{
+		reclaimRetired();
+		if (m_retiredTileHash)
+			return false;
+	}
+
+	dtTileHashEntry* hash = allocTileHash(m_tileHashSize);
+	if (!hash)
+		return false;
+
+	const int mask = m_tileHashSize-1;
+	int used = 0;
+	for (int i = 0; i < m_tileHashSize; ++i)
+	{
+		const dtTileHashEntry& entry = m_tileHash[i];
+		if (!entry.tiles)
+			continue;
+		int h = computeTileHash((int)(entry.key >> 32), (int)(entry.key & 0xffffffff), mask);
+		while (hash[h].key != DT_TILE_KEY_EMPTY)
+			h = (h+1) & mask;
+		hash[h] = entry;
+		used++;
+	}
+
+	dtTileHashEntry* old = m_tileHash;
+	dtAtomicStoreRelease(&m_tileHash, hash);
+	m_tileHashUsed = used;
+
+	if (m_readers)
+	{
+		m_retiredTileHash = old;
+		m_retiredTileHashEpoch = m_epoch;
+		dtAtomicStoreRelease(&m_epoch, m_epoch+1);
+	}
+	else
+	{
+		dtFree(old);
+	}
+
+	return true;
+}
+
 dtTileRef dtNavMesh::getTileRefAt(const int x, const int y, const int layer) const
 {
-	// Find tile based on hash.
-	int h = computeTileHash(x,y,m_tileLutMask);
-	dtMeshTile* tile = m_posLookup[h];
+	// Find tile based on the lookup.
+	dtMeshTile** cell = findTileCell(x, y);
+	dtMeshTile* tile = cell ? dtAtomicLoadAcquire(cell) : 0;
 	while (tile)
 	{
 		if (tile->header &&
@@ -1158,7 +1580,7 @@ dtTileRef dtNavMesh::getTileRefAt(const int x, const int y, const int layer) con
 		{
 			return getTileRef(tile);
 		}
-		tile = tile->next;
+		tile = dtAtomicLoadAcquire(&tile->next);
 	}
 	return 0;
 }
@@ -1204,8 +1626,9 @@ dtStatus dtNavMesh::getTileAndPolyByRef(const dtPolyRef ref, const dtMeshTile**
 	unsigned int salt, it, ip;
 	decodePolyId(ref, salt, it, ip);
 	if (it >= (unsigned int)m_maxTiles) return DT_FAILURE | DT_INVALID_PARAM;
-	if (m_tiles[it].salt != salt || m_tiles[it].header == 0) return DT_FAILURE | DT_INVALID_PARAM;
-	if (ip >= (unsigned int)m_tiles[it].header->polyCount) return DT_FAILURE | DT_INVALID_PARAM;
+	const dtMeshHeader* header = dtAtomicLoadAcquire(&m_tiles[it].header);
+	if (m_tiles[it].salt != salt || header == 0) return DT_FAILURE | DT_INVALID_PARAM;
+	if (ip >= (unsigned int)header->polyCount) return DT_FAILURE | DT_INVALID_PARAM;
 	*tile = &m_tiles[it];
 	*poly = &m_tiles[it].polys[ip];
 	return DT_SUCCESS;
@@ -1230,8 +1653,9 @@ bool dtNavMesh::isValidPolyRef(dtPolyRef ref) const
 	unsigned int salt, it, ip;
 	decodePolyId(ref, salt, it, ip);
 	if (it >= (unsigned int)m_maxTiles) return false;
-	if (m_tiles[it].salt != salt || m_tiles[it].header == 0) return false;
-	if (ip >= (unsigned int)m_tiles[it].header->polyCount) return false;
+	const dtMeshHeader* header = dtAtomicLoadAcquire(&m_tiles[it].header);
+	if (m_tiles[it].salt != salt || header == 0) return false;
+	if (ip >= (unsigned int)header->polyCount) return false;
 	return true;
 }
 
@@ -1240,6 +1664,11 @@ bool dtNavMesh::isValidPolyRef(dtPolyRef ref) const
 /// This function returns the data for the tile so that, if desired,
 /// it can be added back to the navigation mesh at a later point.
 ///
+/// When the mesh was initialized with #DT_NAVMESH_CONCURRENT_READS, the tile is
+/// unlinked immediately but its memory is kept until no reader can access it anymore.
+/// Tile data not owned by the mesh must not be freed or modified before #reclaimRetired
+/// returns zero.
+///
 /// @see #addTile
 dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSize)
 {
@@ -1250,21 +1679,25 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	if ((int)tileIndex >= m_maxTiles)
 		return DT_FAILURE | DT_INVALID_PARAM;
 	dtMeshTile* tile = &m_tiles[tileIndex];
-	if (tile->salt != tileSalt)
+	if (tile->salt != tileSalt || !tile->header)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	// Removed tiles waiting to be reclaimed still have a header.
+	if (m_readers && getTileAt(tile->header->x, tile->header->y, tile->header->layer) != tile)
 		return DT_FAILURE | DT_INVALID_PARAM;
 	
-	// Remove tile from hash lookup.
-	int h = computeTileHash(tile->header->x,tile->header->y,m_tileLutMask);
+	// Remove tile from the position lookup.
+	// The removed tile keeps pointing to the next tile so that concurrent readers can continue iterating.
+	dtMeshTile** cell = findTileCell(tile->header->x, tile->header->y);
 	dtMeshTile* prev = 0;
-	dtMeshTile* cur = m_posLookup[h];
+	dtMeshTile* cur = cell ? *cell : 0;
 	while (cur)
 	{
 		if (cur == tile)
 		{
 			if (prev)
-				prev->next = cur->next;
+				dtAtomicStoreRelease(&prev->next, cur->next);
 			else
-				m_posLookup[h] = cur->next;
+				dtAtomicStoreRelease(cell, cur->next);
 			break;
 		}
 		prev = cur;
@@ -1291,14 +1724,10 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 		for (int j = 0; j < nneis; ++j)
 			unconnectLinks(neis[j], tile);
 	}
-		
-	// Reset tile.
+
 	if (tile->flags & DT_TILE_FREE_DATA)
 	{
 		// Owns data
-		dtFree(tile->data);
-		tile->data = 0;
-		tile->dataSize = 0;
 		if (data) *data = 0;
 		if (dataSize) *dataSize = 0;
 	}
@@ -1308,6 +1737,40 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 		if (dataSize) *dataSize = tile->dataSize;
 	}
 
+	// Update salt, salt should never be zero.
+#ifdef DT_POLYREF64
+	unsigned int salt = (tile->salt+1) & ((1<<DT_SALT_BITS)-1);
+#else
+	unsigned int salt = (tile->salt+1) & ((1<<m_saltBits)-1);
+#endif
+	if (salt == 0)
+		salt++;
+	dtAtomicStoreRelease(&tile->salt, salt);
+
+	if (m_readers)
+	{
+		// Keep the tile until the readers which may have seen it are done.
+		m_retiredTiles[m_retiredTileCount].index = (int)tileIndex;
+		m_retiredTiles[m_retiredTileCount].epoch = m_epoch;
+		m_retiredTileCount++;
+		dtAtomicStoreRelease(&m_epoch, m_epoch+1);
+		reclaimRetired();
+	}
+	else
+	{
+		resetTile(tile);
+	}
+
+	return DT_SUCCESS;
+}
+
+void dtNavMesh::resetTile(dtMeshTile* tile)
+{
+	if (tile->flags & DT_TILE_FREE_DATA)
+		dtFree(tile->data);
+	tile->data = 0;
+	tile->dataSize = 0;
+
 	tile->header = 0;
 	tile->flags = 0;
 	tile->linksFreeList = 0;
@@ -1319,21 +1782,177 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	tile->detailTris = 0;
 	tile->bvTree = 0;
 	tile->offMeshCons = 0;
-
-	// Update salt, salt should never be zero.
-#ifdef DT_POLYREF64
-	tile->salt = (tile->salt+1) & ((1<<DT_SALT_BITS)-1);
-#else
-	tile->salt = (tile->salt+1) & ((1<<m_saltBits)-1);
-#endif
-	if (tile->salt == 0)
-		tile->salt++;
+	dtFree(tile->linkRanges);
+	tile->linkRanges = 0;
 
 	// Add to free list.
 	tile->next = m_nextFree;
 	m_nextFree = tile;
+}
 
-	return DT_SUCCESS;
+void dtNavMesh::releaseLink(dtMeshTile* tile, const int poly, unsigned int link)
+{
+	if (!m_readers)
+	{
+		freeLink(tile, poly, link);
+		return;
+	}
+
+	if (m_retiredLinkCount >= m_retiredLinkCapacity)
+	{
+		const int capacity = m_retiredLinkCapacity ? m_retiredLinkCapacity*2 : 64;
+		dtRetiredLink* links = (dtRetiredLink*)dtAlloc(sizeof(dtRetiredLink)*capacity, DT_ALLOC_PERM);
+		if (!links)
+		{
+			// The link stays unused until the tile is removed.
+			return;
+		}
+		if (m_retiredLinkCount)
+			memcpy(links, m_retiredLinks, sizeof(dtRetiredLink)*m_retiredLinkCount);
+		dtFree(m_retiredLinks);
+		m_retiredLinks = links;
+		m_retiredLinkCapacity = capacity;
+	}
+
+	dtRetiredLink& retired = m_retiredLinks[m_retiredLinkCount++];
+	retired.tileIndex = (int)(tile - m_tiles);
+	retired.salt = tile->salt;
+	retired.poly = poly;
+	retired.link = link;
+	retired.epoch = m_epoch;
+}
+
+/// @par
+///
+/// Each thread querying the mesh needs its own reader. Readers are usually
+/// owned by a dtNavMeshQuery, which allocates one in dtNavMeshQuery::init.
+///
+/// @see #freeReader, #beginRead
+int dtNavMesh::allocReader() const
+{
+	if (!m_readers)
+		return -1;
+	for (int i = 0; i < DT_MAX_NAVMESH_READERS; ++i)
+	{
+		if (dtAtomicCompareExchange(&m_readers[i].used, 0, 1))
+		{
+			m_readers[i].epoch = 0;
+			m_readers[i].depth = 0;
+			return i;
+		}
+	}
+	return -1;
+}
+
+void dtNavMesh::freeReader(const int reader) const
+{
+	if (!m_readers || reader < 0 || reader >= DT_MAX_NAVMESH_READERS)
+		return;
+	m_readers[reader].depth = 0;
+	dtAtomicStoreRelease(&m_readers[reader].epoch, 0u);
+	dtAtomicStoreRelease(&m_readers[reader].used, 0);
+}
+
+/// @par
+///
+/// Tiles, polygons and links reached inside a read section stay valid until the
+/// outermost section is left, even if the writer thread removes them meanwhile.
+/// Polygon references held across read sections must be revalidated with #isValidPolyRef.
+///
+/// Only one thread may add or remove tiles at a time, and it does not need a reader.
+/// The functions of dtNavMeshQuery enter read sections on their own.
+///
+/// @see #endRead, #allocReader
+void dtNavMesh::beginRead(const int reader) const
+{
+	if (!m_readers || reader < 0 || reader >= DT_MAX_NAVMESH_READERS)
+		return;
+	dtNavMeshReader& slot = m_readers[reader];
+	if (slot.depth++ > 0)
+		return;
+
+	// Publish the observed epoch, and retry if the writer advanced it before it could see the slot.
+	unsigned int epoch = dtAtomicLoadAcquire(&m_epoch);
+	for (;;)
+	{
+		dtAtomicStoreRelease(&slot.epoch, epoch);
+		dtAtomicThreadFence();
+		const unsigned int current = dtAtomicLoadAcquire(&m_epoch);
+		if (current == epoch)
+			break;
+		epoch = current;
+	}
+}
+
+void dtNavMesh::endRead(const int reader) const
+{
+	if (!m_readers || reader < 0 || reader >= DT_MAX_NAVMESH_READERS)
+		return;
+	dtNavMeshReader& slot = m_readers[reader];
+	if (slot.depth <= 0 || --slot.depth > 0)
+		return;
+	dtAtomicStoreRelease(&slot.epoch, 0u);
+}
+
+unsigned int dtNavMesh::getOldestReaderEpoch() const
+{
+	dtAtomicThreadFence();
+	unsigned int oldest = m_epoch;
+	for (int i = 0; i < DT_MAX_NAVMESH_READERS; ++i)
+	{
+		const unsigned int epoch = dtAtomicLoadAcquire(&m_readers[i].epoch);
+		if (epoch != 0 && epoch < oldest)
+			oldest = epoch;
+	}
+	return oldest;
+}
+
+int dtNavMesh::reclaimRetired()
+{
+	if (!m_readers)
+		return 0;
+	if (!m_retiredLinkCount && !m_retiredTileCount && !m_retiredTileHash)
+		return 0;
+
+	// Everything retired before the oldest epoch seen by an active reader is unreachable.
+	const unsigned int oldest = getOldestReaderEpoch();
+
+	if (m_retiredTileHash && m_retiredTileHashEpoch < oldest)
+	{
+		dtFree(m_retiredTileHash);
+		m_retiredTileHash = 0;
+	}
+
+	// Links go first, links of a reclaimed tile are simply dropped.
+	int n = 0;
+	for (int i = 0; i < m_retiredLinkCount; ++i)
+	{
+		const dtRetiredLink& retired = m_retiredLinks[i];
+		if (retired.epoch >= oldest)
+		{
+			m_retiredLinks[n++] = retired;
+			continue;
+		}
+		dtMeshTile* tile = &m_tiles[retired.tileIndex];
+		if (tile->salt == retired.salt && tile->header)
+			freeLink(tile, retired.poly, retired.link);
+	}
+	m_retiredLinkCount = n;
+
+	n = 0;
+	for (int i = 0; i < m_retiredTileCount; ++i)
+	{
+		const dtRetiredTile& retired = m_retiredTiles[i];
+		if (retired.epoch >= oldest)
+		{
+			m_retiredTiles[n++] = retired;
+			continue;
+		}
+		resetTile(&m_tiles[retired.index]);
+	}
+	m_retiredTileCount = n;
+
+	return m_retiredTileCount;
 }
 
 dtTileRef dtNavMesh::getTileRef(const dtMeshTile* tile) const
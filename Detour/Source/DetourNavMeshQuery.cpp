@@ -17,8 +17,10 @@
 //
 
 #include <float.h>
+#include <stdlib.h>
 #include <string.h>
 #include "DetourNavMeshQuery.h"
+#include "DetourNavMeshQuery.inl"
 #include "DetourNavMesh.h"
 #include "DetourNode.h"
 #include "DetourCommon.h"
@@ -83,25 +85,8 @@ float dtQueryFilter::getCost(const float* pa, const float* pb,
 {
 	return dtVdist(pa, pb) * m_areaCost[curPoly->getArea()];
 }
-#else
-inline bool dtQueryFilter::passFilter(const dtPolyRef /*ref*/,
-									  const dtMeshTile* /*tile*/,
-									  const dtPoly* poly) const
-{
-	return (poly->flags & m_includeFlags) != 0 && (poly->flags & m_excludeFlags) == 0;
-}
-
-inline float dtQueryFilter::getCost(const float* pa, const float* pb,
-									const dtPolyRef /*prevRef*/, const dtMeshTile* /*prevTile*/, const dtPoly* /*prevPoly*/,
-									const dtPolyRef /*curRef*/, const dtMeshTile* /*curTile*/, const dtPoly* curPoly,
-									const dtPolyRef /*nextRef*/, const dtMeshTile* /*nextTile*/, const dtPoly* /*nextPoly*/) const
-{
-	return dtVdist(pa, pb) * m_areaCost[curPoly->getArea()];
-}
 #endif	
 	
-static const float H_SCALE = 0.999f; // Search heuristic scale.
-
 
 dtNavMeshQuery* dtAllocNavMeshQuery()
 {
@@ -142,6 +127,7 @@ dtPolyQuery::~dtPolyQuery()
 
 dtNavMeshQuery::dtNavMeshQuery() :
 	m_nav(0),
+	m_reader(-1),
 	m_tinyNodePool(0),
 	m_nodePool(0),
 	m_openList(0)
@@ -151,6 +137,8 @@ dtNavMeshQuery::dtNavMeshQuery() :
 
 dtNavMeshQuery::~dtNavMeshQuery()
 {
+	if (m_nav && m_reader >= 0)
+		m_nav->freeReader(m_reader);
 	if (m_tinyNodePool)
 		m_tinyNodePool->~dtNodePool();
 	if (m_nodePool)
@@ -168,12 +156,28 @@ dtNavMeshQuery::~dtNavMeshQuery()
 /// functions are used.
 ///
 /// This function can be used multiple times.
+///
+/// If the navigation mesh was initialized with #DT_NAVMESH_CONCURRENT_READS,
+/// the query allocates a reader of the mesh, and the query functions can be
+/// used while another thread adds and removes tiles. The query must then be
+/// destroyed before the mesh.
 dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
 {
 	if (maxNodes > DT_NULL_IDX || maxNodes > (1 << DT_NODE_PARENT_BITS) - 1)
 		return DT_FAILURE | DT_INVALID_PARAM;
 
+	if (m_nav && m_reader >= 0)
+		m_nav->freeReader(m_reader);
+	m_reader = -1;
+
 	m_nav = nav;
+
+	if (m_nav && m_nav->isConcurrent())
+	{
+		m_reader = m_nav->allocReader();
+		if (m_reader < 0)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
 	
 	if (!m_nodePool || m_nodePool->getMaxNodes() < maxNodes)
 	{
@@ -226,6 +230,7 @@ dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
 dtStatus dtNavMeshQuery::findRandomPoint(const dtQueryFilter* filter, float (*frand)(),
 										 dtPolyRef* randomRef, float* randomPt) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 
 	if (!filter || !frand || !randomRef || !randomPt)
@@ -318,6 +323,7 @@ dtStatus dtNavMeshQuery::findRandomPointAroundCircle(dtPolyRef startRef, const f
 													 const dtQueryFilter* filter, float (*frand)(),
 													 dtPolyRef* randomRef, float* randomPt) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 	dtAssert(m_nodePool);
 	dtAssert(m_openList);
@@ -510,6 +516,7 @@ dtStatus dtNavMeshQuery::findRandomPointAroundCircle(dtPolyRef startRef, const f
 ///
 dtStatus dtNavMeshQuery::closestPointOnPoly(dtPolyRef ref, const float* pos, float* closest, bool* posOverPoly) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 	if (!m_nav->isValidPolyRef(ref) ||
 		!pos || !dtVisfinite(pos) ||
@@ -535,6 +542,7 @@ dtStatus dtNavMeshQuery::closestPointOnPoly(dtPolyRef ref, const float* pos, flo
 /// 
 dtStatus dtNavMeshQuery::closestPointOnPolyBoundary(dtPolyRef ref, const float* pos, float* closest) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 	
 	const dtMeshTile* tile = 0;
@@ -590,6 +598,7 @@ dtStatus dtNavMeshQuery::closestPointOnPolyBoundary(dtPolyRef ref, const float*
 /// 
 dtStatus dtNavMeshQuery::getPolyHeight(dtPolyRef ref, const float* pos, float* height) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 
 	const dtMeshTile* tile = 0;
@@ -694,6 +703,7 @@ dtStatus dtNavMeshQuery::findNearestPoly(const float* center, const float* halfE
 										 const dtQueryFilter* filter,
 										 dtPolyRef* nearestRef, float* nearestPt) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	return findNearestPoly(center, halfExtents, filter, nearestRef, nearestPt, NULL);
 }
 
@@ -703,6 +713,7 @@ dtStatus dtNavMeshQuery::findNearestPoly(const float* center, const float* halfE
 										 const dtQueryFilter* filter,
 										 dtPolyRef* nearestRef, float* nearestPt, bool* isOverPoly) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 
 	if (!nearestRef)
@@ -729,6 +740,296 @@ dtStatus dtNavMeshQuery::findNearestPoly(const float* center, const float* halfE
 	return DT_SUCCESS;
 }
 
+/// Maximum number of points that share a single tile traversal in findNearestPolyBatch.
+static const int DT_NEAREST_BATCH_GROUP_SIZE = 32;
+
+/// Sort key of a point in a batched nearest polygon query.
+struct dtNearestPolyBatchItem
+{
+	int minx, miny, maxx, maxy;	///< Tiles touched by the search box.
+	unsigned int code;			///< Morton code of the center relative to the first touched tile.
+	int index;					///< Index of the point in the input arrays.
+};
+
+/// Search state of a point in a batched nearest polygon query.
+struct dtNearestPolyBatchPoint
+{
+	const float* center;
+	float bmin[3], bmax[3];
+	unsigned short qmin[3], qmax[3];	///< Search box quantized to the tile being traversed.
+	float nearestDistanceSqr;
+	float nearestPt[3];
+	dtPolyRef nearestRef;
+	bool overPoly;
+};
+
+inline unsigned int dtMortonSpread16(unsigned int v)
+{
+	v &= 0x0000ffff;
+	v = (v | (v << 8)) & 0x00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+static int compareNearestPolyBatchItems(const void* va, const void* vb)
+{
+	const dtNearestPolyBatchItem* a = (const dtNearestPolyBatchItem*)va;
+	const dtNearestPolyBatchItem* b = (const dtNearestPolyBatchItem*)vb;
+	if (a->miny != b->miny) return a->miny < b->miny ? -1 : 1;
+	if (a->minx != b->minx) return a->minx < b->minx ? -1 : 1;
+	if (a->maxy != b->maxy) return a->maxy < b->maxy ? -1 : 1;
+	if (a->maxx != b->maxx) return a->maxx < b->maxx ? -1 : 1;
+	if (a->code != b->code) return a->code < b->code ? -1 : 1;
+	return a->index - b->index;
+}
+
+void dtNavMeshQuery::updateNearestPolyBatchPoint(const dtMeshTile* tile, const dtPolyRef ref,
+												 dtNearestPolyBatchPoint& point) const
+{
+	float closestPtPoly[3];
+	float diff[3];
+	bool posOverPoly = false;
+	float d;
+	m_nav->closestPointOnPoly(ref, point.center, closestPtPoly, &posOverPoly);
+
+	// Same metric as dtFindNearestPolyQuery so that the results match findNearestPoly.
+	dtVsub(diff, point.center, closestPtPoly);
+	if (posOverPoly)
+	{
+		d = dtAbs(diff[1]) - tile->header->walkableClimb;
+		d = d > 0 ? d*d : 0;
+	}
+	else
+	{
+		d = dtVlenSqr(diff);
+	}
+
+	if (d < point.nearestDistanceSqr)
+	{
+		dtVcopy(point.nearestPt, closestPtPoly);
+		point.nearestDistanceSqr = d;
+		point.nearestRef = ref;
+		point.overPoly = posOverPoly;
+	}
+}
+
+void dtNavMeshQuery::findNearestPolyInTileBatch(const dtMeshTile* tile, const dtQueryFilter* filter,
+												dtNearestPolyBatchPoint* points, const int npoints) const
+{
+	const dtPolyRef base = m_nav->getPolyRefBase(tile);
+
+	if (tile->bvTree)
+	{
+		const float* tbmin = tile->header->bmin;
+		const float* tbmax = tile->header->bmax;
+		const float qfac = tile->header->bvQuantFactor;
+
+		// Quantize each search box the same way queryPolygonsInTile does, and
+		// accumulate the group bounds which are used to traverse the tree once.
+		unsigned short gmin[3] = { 0xffff, 0xffff, 0xffff };
+		unsigned short gmax[3] = { 0, 0, 0 };
+		for (int i = 0; i < npoints; ++i)
+		{
+			dtNearestPolyBatchPoint& p = points[i];
+			for (int j = 0; j < 3; ++j)
+			{
+				const float minv = dtClamp(p.bmin[j], tbmin[j], tbmax[j]) - tbmin[j];
+				const float maxv = dtClamp(p.bmax[j], tbmin[j], tbmax[j]) - tbmin[j];
+				p.qmin[j] = (unsigned short)(qfac * minv) & 0xfffe;
+				p.qmax[j] = (unsigned short)(qfac * maxv + 1) | 1;
+				gmin[j] = dtMin(gmin[j], p.qmin[j]);
+				gmax[j] = dtMax(gmax[j], p.qmax[j]);
+			}
+		}
+
+		const dtBVNode* node = &tile->bvTree[0];
+		const dtBVNode* end = &tile->bvTree[tile->header->bvNodeCount];
+		while (node < end)
+		{
+			const bool overlap = dtOverlapQuantBounds(gmin, gmax, node->bmin, node->bmax);
+			const bool isLeafNode = node->i >= 0;
+
+			if (isLeafNode && overlap)
+			{
+				const dtPolyRef ref = base | (dtPolyRef)node->i;
+				// The filter is evaluated at most once per polygon for the whole group.
+				int passed = -1;
+				for (int i = 0; i < npoints; ++i)
+				{
+					if (!dtOverlapQuantBounds(points[i].qmin, points[i].qmax, node->bmin, node->bmax))
+						continue;
+					if (passed < 0)
+						passed = filter->passFilter(ref, tile, &tile->polys[node->i]) ? 1 : 0;
+					if (!passed)
+						break;
+					updateNearestPolyBatchPoint(tile, ref, points[i]);
+				}
+			}
+
+			if (overlap || isLeafNode)
+				node++;
+			else
+			{
+				const int escapeIndex = -node->i;
+				node += escapeIndex;
+			}
+		}
+	}
+	else
+	{
+		float bmin[3], bmax[3];
+		for (int ip = 0; ip < tile->header->polyCount; ++ip)
+		{
+			const dtPoly* p = &tile->polys[ip];
+			// Do not return off-mesh connection polygons.
+			if (p->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+				continue;
+			// Calc polygon bounds.
+			const float* v = &tile->verts[p->verts[0]*3];
+			dtVcopy(bmin, v);
+			dtVcopy(bmax, v);
+			for (int j = 1; j < p->vertCount; ++j)
+			{
+				v = &tile->verts[p->verts[j]*3];
+				dtVmin(bmin, v);
+				dtVmax(bmax, v);
+			}
+
+			const dtPolyRef ref = base | (dtPolyRef)ip;
+			int passed = -1;
+			for (int i = 0; i < npoints; ++i)
+			{
+				if (!dtOverlapBounds(points[i].bmin, points[i].bmax, bmin, bmax))
+					continue;
+				if (passed < 0)
+					passed = filter->passFilter(ref, tile, p) ? 1 : 0;
+				if (!passed)
+					break;
+				updateNearestPolyBatchPoint(tile, ref, points[i]);
+			}
+		}
+	}
+}
+
+/// @par
+///
+/// The points are sorted by the tiles their search boxes touch and then by the
+/// Morton order of their centers. Consecutive points touching the same tiles are
+/// processed as a group, so that the tile lookup and the bounding volume tree
+/// traversal are shared by up to 32 points.
+///
+/// The result for each point is the same as the result of findNearestPoly().
+/// If any of the centers or extents is not finite, the whole query fails with
+/// #DT_INVALID_PARAM and no output is written.
+///
+/// @see findNearestPoly
+dtStatus dtNavMeshQuery::findNearestPolyBatch(const float* centers, const float* halfExtents, const int count,
+											  const dtQueryFilter* filter,
+											  dtPolyRef* nearestRefs, float* nearestPts, bool* isOverPoly) const
+{
+	dtNavMeshReadScope readScope(m_nav, m_reader);
+	dtAssert(m_nav);
+
+	if (!centers || !halfExtents || count < 0 || !filter || !nearestRefs)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	for (int i = 0; i < count; ++i)
+	{
+		if (!dtVisfinite(&centers[i*3]) || !dtVisfinite(&halfExtents[i*3]))
+			return DT_FAILURE | DT_INVALID_PARAM;
+	}
+
+	if (count == 0)
+		return DT_SUCCESS;
+
+	dtNearestPolyBatchItem* items = (dtNearestPolyBatchItem*)dtAlloc(sizeof(dtNearestPolyBatchItem)*count, DT_ALLOC_TEMP);
+	if (!items)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+
+	const dtNavMeshParams* params = m_nav->getParams();
+	for (int i = 0; i < count; ++i)
+	{
+		const float* center = &centers[i*3];
+		float bmin[3], bmax[3];
+		dtVsub(bmin, center, &halfExtents[i*3]);
+		dtVadd(bmax, center, &halfExtents[i*3]);
+
+		dtNearestPolyBatchItem& item = items[i];
+		m_nav->calcTileLoc(bmin, &item.minx, &item.miny);
+		m_nav->calcTileLoc(bmax, &item.maxx, &item.maxy);
+		item.index = i;
+
+		// Order the points within the group spatially so that groups stay compact.
+		const float ox = params->orig[0] + item.minx * params->tileWidth;
+		const float oz = params->orig[2] + item.miny * params->tileHeight;
+		const float u = dtClamp((center[0] - ox) / params->tileWidth, 0.0f, 1.0f);
+		const float v = dtClamp((center[2] - oz) / params->tileHeight, 0.0f, 1.0f);
+		item.code = dtMortonSpread16((unsigned int)(u * 65535.0f)) |
+					(dtMortonSpread16((unsigned int)(v * 65535.0f)) << 1);
+	}
+
+	qsort(items, count, sizeof(dtNearestPolyBatchItem), compareNearestPolyBatchItems);
+
+	static const int MAX_NEIS = 32;
+	const dtMeshTile* neis[MAX_NEIS];
+	dtNearestPolyBatchPoint points[DT_NEAREST_BATCH_GROUP_SIZE];
+	int groupIndices[DT_NEAREST_BATCH_GROUP_SIZE];
+
+	int next = 0;
+	while (next < count)
+	{
+		// Collect consecutive points that touch the same tiles.
+		const dtNearestPolyBatchItem& first = items[next];
+		int npoints = 0;
+		while (next < count && npoints < DT_NEAREST_BATCH_GROUP_SIZE)
+		{
+			const dtNearestPolyBatchItem& item = items[next];
+			if (item.minx != first.minx || item.miny != first.miny ||
+				item.maxx != first.maxx || item.maxy != first.maxy)
+				break;
+
+			dtNearestPolyBatchPoint& p = points[npoints];
+			p.center = &centers[item.index*3];
+			dtVsub(p.bmin, p.center, &halfExtents[item.index*3]);
+			dtVadd(p.bmax, p.center, &halfExtents[item.index*3]);
+			p.nearestDistanceSqr = FLT_MAX;
+			p.nearestRef = 0;
+			p.overPoly = false;
+			groupIndices[npoints] = item.index;
+			npoints++;
+			next++;
+		}
+
+		for (int y = first.miny; y <= first.maxy; ++y)
+		{
+			for (int x = first.minx; x <= first.maxx; ++x)
+			{
+				const int nneis = m_nav->getTilesAt(x, y, neis, MAX_NEIS);
+				for (int j = 0; j < nneis; ++j)
+					findNearestPolyInTileBatch(neis[j], filter, points, npoints);
+			}
+		}
+
+		for (int i = 0; i < npoints; ++i)
+		{
+			const int idx = groupIndices[i];
+			nearestRefs[idx] = points[i].nearestRef;
+			if (!points[i].nearestRef)
+				continue;
+			if (nearestPts)
+				dtVcopy(&nearestPts[idx*3], points[i].nearestPt);
+			if (isOverPoly)
+				isOverPoly[idx] = points[i].overPoly;
+		}
+	}
+
+	dtFree(items);
+
+	return DT_SUCCESS;
+}
+
 void dtNavMeshQuery::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, const float* qmax,
 										 const dtQueryFilter* filter, dtPolyQuery* query) const
 {
@@ -900,6 +1201,7 @@ dtStatus dtNavMeshQuery::queryPolygons(const float* center, const float* halfExt
 									   const dtQueryFilter* filter,
 									   dtPolyRef* polys, int* polyCount, const int maxPolys) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	if (!polys || !polyCount || maxPolys < 0)
 		return DT_FAILURE | DT_INVALID_PARAM;
 
@@ -923,6 +1225,7 @@ dtStatus dtNavMeshQuery::queryPolygons(const float* center, const float* halfExt
 dtStatus dtNavMeshQuery::queryPolygons(const float* center, const float* halfExtents,
 									   const dtQueryFilter* filter, dtPolyQuery* query) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 
 	if (!center || !dtVisfinite(center) ||
@@ -975,195 +1278,17 @@ dtStatus dtNavMeshQuery::findPath(dtPolyRef startRef, dtPolyRef endRef,
 								  const dtQueryFilter* filter,
 								  dtPolyRef* path, int* pathCount, const int maxPath) const
 {
-	dtAssert(m_nav);
-	dtAssert(m_nodePool);
-	dtAssert(m_openList);
-
-	if (!pathCount)
-		return DT_FAILURE | DT_INVALID_PARAM;
-
-	*pathCount = 0;
-	
-	// Validate input
-	if (!m_nav->isValidPolyRef(startRef) || !m_nav->isValidPolyRef(endRef) ||
-		!startPos || !dtVisfinite(startPos) ||
-		!endPos || !dtVisfinite(endPos) ||
-		!filter || !path || maxPath <= 0)
-	{
-		return DT_FAILURE | DT_INVALID_PARAM;
-	}
-
-	if (startRef == endRef)
-	{
-		path[0] = startRef;
-		*pathCount = 1;
-		return DT_SUCCESS;
-	}
-	
-	m_nodePool->clear();
-	m_openList->clear();
-	
-	dtNode* startNode = m_nodePool->getNode(startRef);
-	dtVcopy(startNode->pos, startPos);
-	startNode->pidx = 0;
-	startNode->cost = 0;
-	startNode->total = dtVdist(startPos, endPos) * H_SCALE;
-	startNode->id = startRef;
-	startNode->flags = DT_NODE_OPEN;
-	m_openList->push(startNode);
-	
-	dtNode* lastBestNode = startNode;
-	float lastBestNodeCost = startNode->total;
-	
-	bool outOfNodes = false;
-	
-	while (!m_openList->empty())
-	{
-		// Remove node from open list and put it in closed list.
-		dtNode* bestNode = m_openList->pop();
-		bestNode->flags &= ~DT_NODE_OPEN;
-		bestNode->flags |= DT_NODE_CLOSED;
-		
-		// Reached the goal, stop searching.
-		if (bestNode->id == endRef)
-		{
-			lastBestNode = bestNode;
-			break;
-		}
-		
-		// Get current poly and tile.
-		// The API input has been checked already, skip checking internal data.
-		const dtPolyRef bestRef = bestNode->id;
-		const dtMeshTile* bestTile = 0;
-		const dtPoly* bestPoly = 0;
-		m_nav->getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
-		
-		// Get parent poly and tile.
-		dtPolyRef parentRef = 0;
-		const dtMeshTile* parentTile = 0;
-		const dtPoly* parentPoly = 0;
-		if (bestNode->pidx)
-			parentRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
-		if (parentRef)
-			m_nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
-		
-		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
-		{
-			dtPolyRef neighbourRef = bestTile->links[i].ref;
-			
-			// Skip invalid ids and do not expand back to where we came from.
-			if (!neighbourRef || neighbourRef == parentRef)
-				continue;
-			
-			// Get neighbour poly and tile.
-			// The API input has been checked already, skip checking internal data.
-			const dtMeshTile* neighbourTile = 0;
-			const dtPoly* neighbourPoly = 0;
-			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);			
-			
-			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
-				continue;
-
-			// deal explicitly with crossing tile boundaries
-			unsigned char crossSide = 0;
-			if (bestTile->links[i].side != 0xff)
-				crossSide = bestTile->links[i].side >> 1;
-
-			// get the node
-			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef, crossSide);
-			if (!neighbourNode)
-			{
-				outOfNodes = true;
-				continue;
-			}
-			
-			// If the node is visited the first time, calculate node position.
-			if (neighbourNode->flags == 0)
-			{
-				getEdgeMidPoint(bestRef, bestPoly, bestTile,
-								neighbourRef, neighbourPoly, neighbourTile,
-								neighbourNode->pos);
-			}
-
-			// Calculate cost and heuristic.
-			float cost = 0;
-			float heuristic = 0;
-			
-			// Special case for last node.
-			if (neighbourRef == endRef)
-			{
-				// Cost
-				const float curCost = filter->getCost(bestNode->pos, neighbourNode->pos,
-													  parentRef, parentTile, parentPoly,
-													  bestRef, bestTile, bestPoly,
-													  neighbourRef, neighbourTile, neighbourPoly);
-				const float endCost = filter->getCost(neighbourNode->pos, endPos,
-													  bestRef, bestTile, bestPoly,
-													  neighbourRef, neighbourTile, neighbourPoly,
-													  0, 0, 0);
-				
-				cost = bestNode->cost + curCost + endCost;
-				heuristic = 0;
-			}
-			else
-			{
-				// Cost
-				const float curCost = filter->getCost(bestNode->pos, neighbourNode->pos,
-													  parentRef, parentTile, parentPoly,
-													  bestRef, bestTile, bestPoly,
-													  neighbourRef, neighbourTile, neighbourPoly);
-				cost = bestNode->cost + curCost;
-				heuristic = dtVdist(neighbourNode->pos, endPos)*H_SCALE;
-			}
-
-			const float total = cost + heuristic;
-			
-			// The node is already in open list and the new result is worse, skip.
-			if ((neighbourNode->flags & DT_NODE_OPEN) && total >= neighbourNode->total)
-				continue;
-			// The node is already visited and process, and the new result is worse, skip.
-			if ((neighbourNode->flags & DT_NODE_CLOSED) && total >= neighbourNode->total)
-				continue;
-			
-			// Add or update the node.
-			neighbourNode->pidx = m_nodePool->getNodeIdx(bestNode);
-			neighbourNode->id = neighbourRef;
-			neighbourNode->flags = (neighbourNode->flags & ~DT_NODE_CLOSED);
-			neighbourNode->cost = cost;
-			neighbourNode->total = total;
-			
-			if (neighbourNode->flags & DT_NODE_OPEN)
-			{
-				// Already in open, update node location.
-				m_openList->modify(neighbourNode);
-			}
-			else
-			{
-				// Put the node in open list.
-				neighbourNode->flags |= DT_NODE_OPEN;
-				m_openList->push(neighbourNode);
-			}
-			
-			// Update nearest node to target so far.
-			if (heuristic < lastBestNodeCost)
-			{
-				lastBestNodeCost = heuristic;
-				lastBestNode = neighbourNode;
-			}
-		}
-	}
-
-	dtStatus status = getPathToNode(lastBestNode, path, pathCount, maxPath);
-
-	if (lastBestNode->id != endRef)
-		status |= DT_PARTIAL_RESULT;
-
-	if (outOfNodes)
-		status |= DT_OUT_OF_NODES;
-	
-	return status;
+	return findPathT<dtQueryFilter>(startRef, endRef, startPos, endPos, filter, path, pathCount, maxPath);
 }
 
+// Instantiate the templates for dtQueryFilter, so they can be called without DetourNavMeshQuery.inl.
+template dtStatus dtNavMeshQuery::findPathT<dtQueryFilter>(dtPolyRef, dtPolyRef, const float*, const float*,
+														   const dtQueryFilter*, dtPolyRef*, int*, const int) const;
+template dtStatus dtNavMeshQuery::raycastT<dtQueryFilter>(dtPolyRef, const float*, const float*, const dtQueryFilter*,
+														  float*, float*, dtPolyRef*, int*, const int) const;
+template dtStatus dtNavMeshQuery::raycastT<dtQueryFilter>(dtPolyRef, const float*, const float*, const dtQueryFilter*,
+														  const unsigned int, dtRaycastHit*, dtPolyRef) const;
+
 dtStatus dtNavMeshQuery::getPathToNode(dtNode* endNode, dtPolyRef* path, int* pathCount, int maxPath) const
 {
 	// Find the length of the entire path.
@@ -1217,6 +1342,7 @@ dtStatus dtNavMeshQuery::initSlicedFindPath(dtPolyRef startRef, dtPolyRef endRef
 											const float* startPos, const float* endPos,
 											const dtQueryFilter* filter, const unsigned int options)
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 	dtAssert(m_nodePool);
 	dtAssert(m_openList);
@@ -1265,7 +1391,7 @@ dtStatus dtNavMeshQuery::initSlicedFindPath(dtPolyRef startRef, dtPolyRef endRef
 	dtVcopy(startNode->pos, startPos);
 	startNode->pidx = 0;
 	startNode->cost = 0;
-	startNode->total = dtVdist(startPos, endPos) * H_SCALE;
+	startNode->total = dtVdist(startPos, endPos) * DT_HEURISTIC_SCALE;
 	startNode->id = startRef;
 	startNode->flags = DT_NODE_OPEN;
 	m_openList->push(startNode);
@@ -1279,6 +1405,7 @@ dtStatus dtNavMeshQuery::initSlicedFindPath(dtPolyRef startRef, dtPolyRef endRef
 	
 dtStatus dtNavMeshQuery::updateSlicedFindPath(const int maxIter, int* doneIters)
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	if (!dtStatusInProgress(m_query.status))
 		return m_query.status;
 
@@ -1439,7 +1566,7 @@ dtStatus dtNavMeshQuery::updateSlicedFindPath(const int maxIter, int* doneIters)
 			}
 			else
 			{
-				heuristic = dtVdist(neighbourNode->pos, m_query.endPos)*H_SCALE;
+				heuristic = dtVdist(neighbourNode->pos, m_query.endPos)*DT_HEURISTIC_SCALE;
 			}
 			
 			const float total = cost + heuristic;
@@ -1496,6 +1623,7 @@ dtStatus dtNavMeshQuery::updateSlicedFindPath(const int maxIter, int* doneIters)
 
 dtStatus dtNavMeshQuery::finalizeSlicedFindPath(dtPolyRef* path, int* pathCount, const int maxPath)
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	if (!pathCount)
 		return DT_FAILURE | DT_INVALID_PARAM;
 
@@ -1587,6 +1715,7 @@ dtStatus dtNavMeshQuery::finalizeSlicedFindPath(dtPolyRef* path, int* pathCount,
 dtStatus dtNavMeshQuery::finalizeSlicedFindPathPartial(const dtPolyRef* existing, const int existingSize,
 													   dtPolyRef* path, int* pathCount, const int maxPath)
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	if (!pathCount)
 		return DT_FAILURE | DT_INVALID_PARAM;
 
@@ -1795,6 +1924,7 @@ dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* en
 										  float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
 										  int* straightPathCount, const int maxStraightPath, const int options) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 
 	if (!straightPathCount)
@@ -2045,6 +2175,7 @@ dtStatus dtNavMeshQuery::moveAlongSurface(dtPolyRef startRef, const float* start
 										  const dtQueryFilter* filter,
 										  float* resultPos, dtPolyRef* visited, int* visitedCount, const int maxVisitedSize) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 	dtAssert(m_tinyNodePool);
 
@@ -2248,6 +2379,7 @@ dtStatus dtNavMeshQuery::moveAlongSurface(dtPolyRef startRef, const float* start
 dtStatus dtNavMeshQuery::getPortalPoints(dtPolyRef from, dtPolyRef to, float* left, float* right,
 										 unsigned char& fromType, unsigned char& toType) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 	
 	const dtMeshTile* fromTile = 0;
@@ -2342,6 +2474,7 @@ dtStatus dtNavMeshQuery::getPortalPoints(dtPolyRef from, const dtPoly* fromPoly,
 // Returns edge mid point between two polygons.
 dtStatus dtNavMeshQuery::getEdgeMidPoint(dtPolyRef from, dtPolyRef to, float* mid) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	float left[3], right[3];
 	unsigned char fromType, toType;
 	if (dtStatusFailed(getPortalPoints(from, to, left,right, fromType, toType)))
@@ -2409,19 +2542,7 @@ dtStatus dtNavMeshQuery::raycast(dtPolyRef startRef, const float* startPos, cons
 								 const dtQueryFilter* filter,
 								 float* t, float* hitNormal, dtPolyRef* path, int* pathCount, const int maxPath) const
 {
-	dtRaycastHit hit;
-	hit.path = path;
-	hit.maxPath = maxPath;
-
-	dtStatus status = raycast(startRef, startPos, endPos, filter, 0, &hit);
-	
-	*t = hit.t;
-	if (hitNormal)
-		dtVcopy(hitNormal, hit.hitNormal);
-	if (pathCount)
-		*pathCount = hit.pathCount;
-
-	return status;
+	return raycastT<dtQueryFilter>(startRef, startPos, endPos, filter, t, hitNormal, path, pathCount, maxPath);
 }
 
 
@@ -2467,231 +2588,7 @@ dtStatus dtNavMeshQuery::raycast(dtPolyRef startRef, const float* startPos, cons
 								 const dtQueryFilter* filter, const unsigned int options,
 								 dtRaycastHit* hit, dtPolyRef prevRef) const
 {
-	dtAssert(m_nav);
-
-	if (!hit)
-		return DT_FAILURE | DT_INVALID_PARAM;
-
-	hit->t = 0;
-	hit->pathCount = 0;
-	hit->pathCost = 0;
-
-	// Validate input
-	if (!m_nav->isValidPolyRef(startRef) ||
-		!startPos || !dtVisfinite(startPos) ||
-		!endPos || !dtVisfinite(endPos) ||
-		!filter ||
-		(prevRef && !m_nav->isValidPolyRef(prevRef)))
-	{
-		return DT_FAILURE | DT_INVALID_PARAM;
-	}
-	
-	float dir[3], curPos[3], lastPos[3];
-	float verts[DT_VERTS_PER_POLYGON*3+3];	
-	int n = 0;
-
-	dtVcopy(curPos, startPos);
-	dtVsub(dir, endPos, startPos);
-	dtVset(hit->hitNormal, 0, 0, 0);
-
-	dtStatus status = DT_SUCCESS;
-
-	const dtMeshTile* prevTile, *tile, *nextTile;
-	const dtPoly* prevPoly, *poly, *nextPoly;
-	dtPolyRef curRef;
-
-	// The API input has been checked already, skip checking internal data.
-	curRef = startRef;
-	tile = 0;
-	poly = 0;
-	m_nav->getTileAndPolyByRefUnsafe(curRef, &tile, &poly);
-	nextTile = prevTile = tile;
-	nextPoly = prevPoly = poly;
-	if (prevRef)
-		m_nav->getTileAndPolyByRefUnsafe(prevRef, &prevTile, &prevPoly);
-
-	while (curRef)
-	{
-		// Cast ray against current polygon.
-		
-		// Collect vertices.
-		int nv = 0;
-		for (int i = 0; i < (int)poly->vertCount; ++i)
-		{
-			dtVcopy(&verts[nv*3], &tile->verts[poly->verts[i]*3]);
-			nv++;
-		}
-		
-		float tmin, tmax;
-		int segMin, segMax;
-		if (!dtIntersectSegmentPoly2D(startPos, endPos, verts, nv, tmin, tmax, segMin, segMax))
-		{
-			// Could not hit the polygon, keep the old t and report hit.
-			hit->pathCount = n;
-			return status;
-		}
-
-		hit->hitEdgeIndex = segMax;
-
-		// Keep track of furthest t so far.
-		if (tmax > hit->t)
-			hit->t = tmax;
-		
-		// Store visited polygons.
-		if (n < hit->maxPath)
-			hit->path[n++] = curRef;
-		else
-			status |= DT_BUFFER_TOO_SMALL;
-
-		// Ray end is completely inside the polygon.
-		if (segMax == -1)
-		{
-			hit->t = FLT_MAX;
-			hit->pathCount = n;
-			
-			// add the cost
-			if (options & DT_RAYCAST_USE_COSTS)
-				hit->pathCost += filter->getCost(curPos, endPos, prevRef, prevTile, prevPoly, curRef, tile, poly, curRef, tile, poly);
-			return status;
-		}
-
-		// Follow neighbours.
-		dtPolyRef nextRef = 0;
-		
-		for (unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
-		{
-			const dtLink* link = &tile->links[i];
-			
-			// Find link which contains this edge.
-			if ((int)link->edge != segMax)
-				continue;
-			
-			// Get pointer to the next polygon.
-			nextTile = 0;
-			nextPoly = 0;
-			m_nav->getTileAndPolyByRefUnsafe(link->ref, &nextTile, &nextPoly);
-			
-			// Skip off-mesh connections.
-			if (nextPoly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
-				continue;
-			
-			// Skip links based on filter.
-			if (!filter->passFilter(link->ref, nextTile, nextPoly))
-				continue;
-			
-			// If the link is internal, just return the ref.
-			if (link->side == 0xff)
-			{
-				nextRef = link->ref;
-				break;
-			}
-			
-			// If the link is at tile boundary,
-			
-			// Check if the link spans the whole edge, and accept.
-			if (link->bmin == 0 && link->bmax == 255)
-			{
-				nextRef = link->ref;
-				break;
-			}
-			
-			// Check for partial edge links.
-			const int v0 = poly->verts[link->edge];
-			const int v1 = poly->verts[(link->edge+1) % poly->vertCount];
-			const float* left = &tile->verts[v0*3];
-			const float* right = &tile->verts[v1*3];
-			
-			// Check that the intersection lies inside the link portal.
-			if (link->side == 0 || link->side == 4)
-			{
-				// Calculate link size.
-				const float s = 1.0f/255.0f;
-				float lmin = left[2] + (right[2] - left[2])*(link->bmin*s);
-				float lmax = left[2] + (right[2] - left[2])*(link->bmax*s);
-				if (lmin > lmax) dtSwap(lmin, lmax);
-				
-				// Find Z intersection.
-				float z = startPos[2] + (endPos[2]-startPos[2])*tmax;
-				if (z >= lmin && z <= lmax)
-				{
-					nextRef = link->ref;
-					break;
-				}
-			}
-			else if (link->side == 2 || link->side == 6)
-			{
-				// Calculate link size.
-				const float s = 1.0f/255.0f;
-				float lmin = left[0] + (right[0] - left[0])*(link->bmin*s);
-				float lmax = left[0] + (right[0] - left[0])*(link->bmax*s);
-				if (lmin > lmax) dtSwap(lmin, lmax);
-				
-				// Find X intersection.
-				float x = startPos[0] + (endPos[0]-startPos[0])*tmax;
-				if (x >= lmin && x <= lmax)
-				{
-					nextRef = link->ref;
-					break;
-				}
-			}
-		}
-		
-		// add the cost
-		if (options & DT_RAYCAST_USE_COSTS)
-		{
-			// compute the intersection point at the furthest end of the polygon
-			// and correct the height (since the raycast moves in 2d)
-			dtVcopy(lastPos, curPos);
-			dtVmad(curPos, startPos, dir, hit->t);
-			float* e1 = &verts[segMax*3];
-			float* e2 = &verts[((segMax+1)%nv)*3];
-			float eDir[3], diff[3];
-			dtVsub(eDir, e2, e1);
-			dtVsub(diff, curPos, e1);
-			float s = dtSqr(eDir[0]) > dtSqr(eDir[2]) ? diff[0] / eDir[0] : diff[2] / eDir[2];
-			curPos[1] = e1[1] + eDir[1] * s;
-
-			hit->pathCost += filter->getCost(lastPos, curPos, prevRef, prevTile, prevPoly, curRef, tile, poly, nextRef, nextTile, nextPoly);
-		}
-
-		if (!nextRef)
-		{
-			// No neighbour, we hit a wall.
-			
-			// Calculate hit normal.
-			const int a = segMax;
-			const int b = segMax+1 < nv ? segMax+1 : 0;
-			const float* va = &verts[a*3];
-			const float* vb = &verts[b*3];
-			const float dx = vb[0] - va[0];
-			const float dz = vb[2] - va[2];
-			hit->hitNormal[0] = dz;
-			hit->hitNormal[1] = 0;
-			hit->hitNormal[2] = -dx;
-			dtVnormalize(hit->hitNormal);
-			
-			hit->pathCount = n;
-			return status;
-		}
-
-		// No hit, advance to neighbour polygon.
-		prevRef = curRef;
-		curRef = nextRef;
-		prevTile = tile;
-		tile = nextTile;
-		prevPoly = poly;
-		poly = nextPoly;
-
-		if (status & DT_BUFFER_TOO_SMALL)
-		{
-			status |= DT_PARTIAL_RESULT;
-			break;
-		}
-	}
-	
-	hit->pathCount = n;
-	
-	return status;
+	return raycastT<dtQueryFilter>(startRef, startPos, endPos, filter, options, hit, prevRef);
 }
 
 /// @par
@@ -2728,6 +2625,7 @@ dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float*
 											   dtPolyRef* resultRef, dtPolyRef* resultParent, float* resultCost,
 											   int* resultCount, const int maxResult) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 	dtAssert(m_nodePool);
 	dtAssert(m_openList);
@@ -2902,6 +2800,7 @@ dtStatus dtNavMeshQuery::findPolysAroundShape(dtPolyRef startRef, const float* v
 											  dtPolyRef* resultRef, dtPolyRef* resultParent, float* resultCost,
 											  int* resultCount, const int maxResult) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 	dtAssert(m_nodePool);
 	dtAssert(m_openList);
@@ -3100,6 +2999,7 @@ dtStatus dtNavMeshQuery::findLocalNeighbourhood(dtPolyRef startRef, const float*
 												dtPolyRef* resultRef, dtPolyRef* resultParent,
 												int* resultCount, const int maxResult) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 	dtAssert(m_tinyNodePool);
 
@@ -3128,11 +3028,6 @@ dtStatus dtNavMeshQuery::findLocalNeighbourhood(dtPolyRef startRef, const float*
 	startNode->flags = DT_NODE_CLOSED;
 	stack[nstack++] = startNode;
 	
-	const float radiusSqr = dtSqr(radius);
-	
-	float pa[DT_VERTS_PER_POLYGON*3];
-	float pb[DT_VERTS_PER_POLYGON*3];
-	
 	dtStatus status = DT_SUCCESS;
 	
 	int n = 0;
@@ -3148,6 +3043,129 @@ dtStatus dtNavMeshQuery::findLocalNeighbourhood(dtPolyRef startRef, const float*
 		status |= DT_BUFFER_TOO_SMALL;
 	}
 	
+	*resultCount = n;
+	status |= expandLocalNeighbourhood(stack, nstack, MAX_STACK, centerPos, radius, filter,
+									   resultRef, resultParent, resultCount, maxResult);
+	
+	return status;
+}
+
+/// @par
+///
+/// When the start polygon is not the first polygon of the previous neighbourhood, the neighbourhood is searched
+/// again with #findLocalNeighbourhood. The previous polygons were only tested for overlap against that start
+/// polygon, so keeping them after the agent moved onto another polygon, for example from the ground onto a bridge
+/// above it, could keep polygons that overlap the new start polygon vertically.
+///
+/// While the start polygon stays the same, the previous polygons the circle still touches are kept and
+/// only the polygons added by the update are tested for overlap. A kept polygon the search would not reach
+/// again from the new center can stay in the result until the circle does not touch it anymore.
+dtStatus dtNavMeshQuery::updateLocalNeighbourhood(dtPolyRef startRef, const float* centerPos, const float radius,
+												  const dtQueryFilter* filter, dtPolyRef* polys, int* polyCount,
+												  const int maxPolys) const
+{
+	dtNavMeshReadScope readScope(m_nav, m_reader);
+	dtAssert(m_nav);
+	dtAssert(m_tinyNodePool);
+
+	if (!polyCount)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	const int nprev = dtClamp(*polyCount, 0, maxPolys);
+	*polyCount = 0;
+
+	if (!m_nav->isValidPolyRef(startRef) ||
+		!centerPos || !dtVisfinite(centerPos) ||
+		radius < 0 || !dtMathIsfinite(radius) ||
+		!filter || !polys || maxPolys <= 0)
+	{
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+
+	// The previous polygons were only tested for overlap against the previous start polygon.
+	if (nprev == 0 || polys[0] != startRef)
+		return findLocalNeighbourhood(startRef, centerPos, radius, filter, polys, 0, polyCount, maxPolys);
+
+	static const int MAX_STACK = 48;
+	dtNode* stack[MAX_STACK];
+	int nstack = 0;
+	
+	m_tinyNodePool->clear();
+
+	const float radiusSqr = dtSqr(radius);
+	float verts[DT_VERTS_PER_POLYGON*3];
+	float edgeDist[DT_VERTS_PER_POLYGON];
+	float edgeT[DT_VERTS_PER_POLYGON];
+
+	// Keep the previous polygons the circle still touches.
+	int n = 0;
+	for (int i = 0; i < nprev; ++i)
+	{
+		const dtPolyRef ref = polys[i];
+		if (ref == startRef)
+			continue;
+		const dtMeshTile* tile = 0;
+		const dtPoly* poly = 0;
+		if (dtStatusFailed(m_nav->getTileAndPolyByRef(ref, &tile, &poly)))
+			continue;
+		if (!filter->passFilter(ref, tile, poly))
+			continue;
+		const int nv = (int)poly->vertCount;
+		for (int k = 0; k < nv; ++k)
+			dtVcopy(&verts[k*3], &tile->verts[poly->verts[k]*3]);
+		if (!dtDistancePtPolyEdgesSqr(centerPos, verts, nv, edgeDist, edgeT))
+		{
+			float minDist = edgeDist[0];
+			for (int k = 1; k < nv; ++k)
+				minDist = dtMin(minDist, edgeDist[k]);
+			if (minDist > radiusSqr)
+				continue;
+		}
+		polys[n++] = ref;
+	}
+
+	// The start polygon leads the result.
+	if (n == maxPolys)
+		n--;
+	memmove(polys+1, polys, sizeof(dtPolyRef)*n);
+	polys[0] = startRef;
+	n++;
+
+	// Expand the neighbourhood from the kept polygons. They were reached from the start polygon,
+	// so it is their parent.
+	unsigned int startIdx = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		dtNode* node = m_tinyNodePool->getNode(polys[i]);
+		if (!node)
+			break;
+		node->pidx = startIdx;
+		if (i == 0)
+			startIdx = m_tinyNodePool->getNodeIdx(node);
+		node->id = polys[i];
+		node->flags = DT_NODE_CLOSED;
+		if (nstack < MAX_STACK)
+			stack[nstack++] = node;
+	}
+
+	*polyCount = n;
+	return expandLocalNeighbourhood(stack, nstack, MAX_STACK, centerPos, radius, filter,
+									polys, 0, polyCount, maxPolys);
+}
+
+dtStatus dtNavMeshQuery::expandLocalNeighbourhood(dtNode** stack, int nstack, const int maxStack, const float* centerPos,
+												  const float radius, const dtQueryFilter* filter,
+												  dtPolyRef* resultRef, dtPolyRef* resultParent, int* resultCount,
+												  const int maxResult) const
+{
+	const float radiusSqr = dtSqr(radius);
+	
+	float pa[DT_VERTS_PER_POLYGON*3];
+	float pb[DT_VERTS_PER_POLYGON*3];
+	
+	dtStatus status = DT_SUCCESS;
+	int n = *resultCount;
+	
 	while (nstack)
 	{
 		// Pop front.
@@ -3252,20 +3270,20 @@ dtStatus dtNavMeshQuery::findLocalNeighbourhood(dtPolyRef startRef, const float*
 			if (overlap)
 				continue;
 			
-			// This poly is fine, store and advance to the poly.
-			if (n < maxResult)
-			{
-				resultRef[n] = neighbourRef;
-				if (resultParent)
-					resultParent[n] = curRef;
-				++n;
-			}
-			else
+			// The result is full, no more polygons can be stored.
+			if (n >= maxResult)
 			{
-				status |= DT_BUFFER_TOO_SMALL;
+				*resultCount = n;
+				return status | DT_BUFFER_TOO_SMALL;
 			}
 			
-			if (nstack < MAX_STACK)
+			// This poly is fine, store and advance to the poly.
+			resultRef[n] = neighbourRef;
+			if (resultParent)
+				resultParent[n] = curRef;
+			++n;
+			
+			if (nstack < maxStack)
 			{
 				stack[nstack++] = neighbourNode;
 			}
@@ -3321,6 +3339,7 @@ dtStatus dtNavMeshQuery::getPolyWallSegments(dtPolyRef ref, const dtQueryFilter*
 											 float* segmentVerts, dtPolyRef* segmentRefs, int* segmentCount,
 											 const int maxSegments) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 
 	if (!segmentCount)
@@ -3477,6 +3496,7 @@ dtStatus dtNavMeshQuery::findDistanceToWall(dtPolyRef startRef, const float* cen
 											const dtQueryFilter* filter,
 											float* hitDist, float* hitPos, float* hitNormal) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	dtAssert(m_nav);
 	dtAssert(m_nodePool);
 	dtAssert(m_openList);
@@ -3662,6 +3682,7 @@ dtStatus dtNavMeshQuery::findDistanceToWall(dtPolyRef startRef, const float* cen
 
 bool dtNavMeshQuery::isValidPolyRef(dtPolyRef ref, const dtQueryFilter* filter) const
 {
+	dtNavMeshReadScope readScope(m_nav, m_reader);
 	const dtMeshTile* tile = 0;
 	const dtPoly* poly = 0;
 	dtStatus status = m_nav->getTileAndPolyByRef(ref, &tile, &poly);
@@ -19,25 +19,55 @@
 #ifndef DETOURCROWD_H
 #define DETOURCROWD_H
 
+#include "DetourClock.h"
 #include "DetourNavMeshQuery.h"
 #include "DetourObstacleAvoidance.h"
 #include "DetourLocalBoundary.h"
 #include "DetourPathCorridor.h"
 #include "DetourProximityGrid.h"
 #include "DetourPathQueue.h"
+#include "DetourFlowField.h"
 
-/// The maximum number of neighbors that a crowd agent can take into account
+/// The default maximum number of neighbors that a crowd agent can take into account
 /// for steering decisions.
 /// @ingroup crowd
+/// @see dtCrowdParams::maxNeighbours
 static const int DT_CROWDAGENT_MAX_NEIGHBOURS = 6;
 
-/// The maximum number of corners a crowd agent will look ahead in the path.
+/// The default maximum number of corners a crowd agent will look ahead in the path.
 /// This value is used for sizing the crowd agent corner buffers.
 /// Due to the behavior of the crowd manager, the actual number of useful
 /// corners will be one less than this number.
 /// @ingroup crowd
+/// @see dtCrowdParams::maxCorners
 static const int DT_CROWDAGENT_MAX_CORNERS = 4;
 
+/// The default maximum number of agents found in the proximity grid that are
+/// checked when searching the neighbors of a crowd agent.
+/// @ingroup crowd
+/// @see dtCrowdParams::maxNeighbourQuery
+static const int DT_CROWD_MAX_NEIGHBOUR_QUERY = 32;
+
+/// The default maximum number of flow fields shared by agents moving to the same target.
+/// @ingroup crowd
+/// @see dtCrowdParams::maxFlowFields, dtCrowd::requestMoveTargetShared()
+static const int DT_CROWD_MAX_FLOW_FIELDS = 4;
+
+/// The default maximum number of polygons in a shared flow field.
+/// @ingroup crowd
+/// @see dtCrowdParams::maxFlowFieldPolys
+static const int DT_CROWD_MAX_FLOW_FIELD_POLYS = 4096;
+
+/// The default maximum number of path requests searched at the same time.
+/// @ingroup crowd
+/// @see dtCrowdParams::maxPathRequests
+static const int DT_CROWD_MAX_PATH_REQUESTS = 8;
+
+/// The maximum number of observers choosing the level of detail of the agents.
+/// @ingroup crowd
+/// @see dtCrowd::setLodObservers
+static const int DT_CROWD_MAX_LOD_OBSERVERS = 16;
+
 /// The maximum number of crowd avoidance configurations supported by the
 /// crowd manager.
 /// @ingroup crowd
@@ -69,6 +99,17 @@ enum CrowdAgentState
 	DT_CROWDAGENT_STATE_OFFMESH 		///< The agent is traversing an off-mesh connection.
 };
 
+/// The level of detail at which an agent is simulated.
+/// @ingroup crowd
+/// @see dtCrowd::setAgentLod, dtCrowd::setLodObservers, dtCrowdLodParams
+enum CrowdAgentLod
+{
+	DT_CROWDAGENT_LOD_FULL = 0,			///< The agent is fully simulated every update.
+	DT_CROWDAGENT_LOD_REDUCED,			///< The boundary, neighbours and obstacle avoidance of the agent are refreshed every #dtCrowdLodParams::interval updates.
+	DT_CROWDAGENT_LOD_CORRIDOR,			///< The agent follows its corridor without boundary, neighbours or obstacle avoidance.
+	DT_CROWDAGENT_LOD_SLEEPING			///< The agent does not move. Its move requests are still processed.
+};
+
 /// Configuration parameters for a crowd agent.
 /// @ingroup crowd
 struct dtCrowdAgentParams
@@ -112,6 +153,9 @@ enum MoveRequestState
 };
 
 /// Represents an agent managed by a #dtCrowd object.
+///
+/// The state updated by every simulation phase lives in the #dtCrowdAgentArrays of the crowd. The
+/// agent returned by #dtCrowd::getAgent is a view of it, refreshed whenever the agent is retrieved.
 /// @ingroup crowd
 struct dtCrowdAgent
 {
@@ -133,8 +177,9 @@ struct dtCrowdAgent
 	/// Time since the agent's path corridor was optimized.
 	float topologyOptTime;
 	
-	/// The known neighbors of the agent.
-	dtCrowdNeighbour neis[DT_CROWDAGENT_MAX_NEIGHBOURS];
+	/// The known neighbors of the agent. [(neighbour) * #nneis] Points to a pool of the crowd
+	/// holding dtCrowd::getMaxNeighbours() neighbours per agent.
+	dtCrowdNeighbour* neis;
 
 	/// The number of neighbors.
 	int nneis;
@@ -152,13 +197,14 @@ struct dtCrowdAgent
 	dtCrowdAgentParams params;
 
 	/// The local path corridor corners for the agent. (Staight path.) [(x, y, z) * #ncorners]
-	float cornerVerts[DT_CROWDAGENT_MAX_CORNERS*3];
+	/// The corner buffers point to pools of the crowd holding dtCrowd::getMaxCorners() corners per agent.
+	float* cornerVerts;
 
 	/// The local path corridor corner flags. (See: #dtStraightPathFlags) [(flags) * #ncorners]
-	unsigned char cornerFlags[DT_CROWDAGENT_MAX_CORNERS];
+	unsigned char* cornerFlags;
 
 	/// The reference id of the polygon being entered at the corner. [(polyRef) * #ncorners]
-	dtPolyRef cornerPolys[DT_CROWDAGENT_MAX_CORNERS];
+	dtPolyRef* cornerPolys;
 
 	/// The number of corners.
 	int ncorners;
@@ -171,6 +217,30 @@ struct dtCrowdAgent
 	float targetReplanTime;				/// <Time since the agent's target was replanned.
 };
 
+/// The per-agent state iterated by the simulation phases of #dtCrowd::update, stored as parallel
+/// arrays indexed by the agent index. Vectors are stored as [(x, y, z) * maxAgents].
+/// @see dtCrowd::getAgentArrays
+/// @ingroup crowd
+struct dtCrowdAgentArrays
+{
+	unsigned char* active;		///< Non-zero if the agent is in use.
+	unsigned char* state;		///< The type of mesh polygon the agent is traversing. (See: #CrowdAgentState)
+	unsigned char* updateFlags;	///< Flags that impact steering behavior. (See: #UpdateFlags)
+	unsigned char* lod;			///< The level of detail at which the agent is simulated. (See: #CrowdAgentLod)
+	float* npos;				///< The current agent positions.
+	float* disp;				///< The displacements accumulated during iterative collision resolution.
+	float* dvel;				///< The desired velocities.
+	float* nvel;				///< The desired velocities adjusted by obstacle avoidance.
+	float* vel;					///< The actual velocities.
+	float* radius;				///< The agent radii.
+	float* height;				///< The agent heights.
+	float* maxAcceleration;		///< The maximum allowed accelerations.
+	float* collisionQueryRange;	///< The ranges within which neighbours are considered for steering.
+	float* desiredSpeed;		///< The desired speeds.
+	int* nneis;					///< The number of neighbours of each agent.
+	dtCrowdNeighbour* neis;		///< The neighbours of each agent. [(neighbour) * maxNeighbours * maxAgents]
+};
+
 struct dtCrowdAgentAnimation
 {
 	bool active;
@@ -191,6 +261,136 @@ enum UpdateFlags
 	DT_CROWD_OPTIMIZE_TOPO = 16 		///< Use dtPathCorridor::optimizePathTopology() to optimize the agent path.
 };
 
+/// Configures the capacities of a crowd.
+/// Initialize the params with #dtInitCrowdParams and change the fields that need other values,
+/// so that fields added later get their defaults.
+/// @ingroup crowd
+/// @see dtCrowd::init
+struct dtCrowdParams
+{
+	/// The maximum number of agents the crowd can manage. [Limit: 1 <= value <= 65535]
+	int maxAgents;
+
+	/// The maximum radius of any agent that will be added to the crowd. [Limit: > 0]
+	float maxAgentRadius;
+
+	/// The maximum number of neighbours an agent takes into account for steering and collisions.
+	/// [Limit: >= 1] [Default: #DT_CROWDAGENT_MAX_NEIGHBOURS]
+	int maxNeighbours;
+
+	/// The maximum number of path corners an agent looks ahead. [Limit: >= 2] [Default: #DT_CROWDAGENT_MAX_CORNERS]
+	int maxCorners;
+
+	/// The maximum number of agents found in the proximity grid that are checked when searching the
+	/// neighbours of an agent. [Limit: >= #maxNeighbours] [Default: #DT_CROWD_MAX_NEIGHBOUR_QUERY]
+	int maxNeighbourQuery;
+
+	/// The maximum number of targets with a flow field shared by the agents moving to them.
+	/// [Limit: >= 0] [Default: #DT_CROWD_MAX_FLOW_FIELDS]
+	int maxFlowFields;
+
+	/// The maximum number of polygons in a shared flow field. [Limit: 0 < value <= 65535]
+	/// [Default: #DT_CROWD_MAX_FLOW_FIELD_POLYS]
+	int maxFlowFieldPolys;
+
+	/// The maximum number of path requests the path queue searches at the same time. Agents waiting for a
+	/// longer path than the quick search towards their target finds wait for a free request.
+	/// [Limit: >= 1] [Default: #DT_CROWD_MAX_PATH_REQUESTS]
+	int maxPathRequests;
+};
+
+/// Sets the crowd params to the capacities used by dtCrowd::init(const int, const float, dtNavMesh*).
+///  @param[out]	params			The params to initialize.
+///  @param[in]		maxAgents		The maximum number of agents the crowd can manage. [Limit: >= 1]
+///  @param[in]		maxAgentRadius	The maximum radius of any agent that will be added to the crowd. [Limit: > 0]
+/// @ingroup crowd
+void dtInitCrowdParams(dtCrowdParams* params, const int maxAgents, const float maxAgentRadius);
+
+/// Configures how much path searching and path topology optimization #dtCrowd::update does.
+///
+/// Without a clock, or with a zero time, each update runs the fixed number of search iterations or
+/// optimizations. With a clock and a time, the crowd measures the cost of a search iteration and of
+/// an optimization and runs as many as are expected to fit the time, but never fewer than the fixed number.
+/// @ingroup crowd
+/// @see dtCrowd::setBudgetParams
+struct dtCrowdBudgetParams
+{
+	/// The number of path search iterations (node expansions) run every update, or the minimum with a time budget.
+	/// A shared flow field build counts each polygon it visits as an iteration. [Limit: >= 1] [Default: 100]
+	int pathIterations;
+
+	/// The number of agents whose path topology is optimized every update, or the minimum with a time budget.
+	/// [Limit: >= 0] [Default: 1]
+	int optimizations;
+
+	/// The time available for path searches every update, or zero for a fixed budget. [Limit: >= 0] [Units: us]
+	float pathTime;
+
+	/// The time available for path topology optimizations every update, or zero for a fixed budget.
+	/// [Limit: >= 0] [Units: us]
+	float optimizationTime;
+
+	/// The clock measuring the time budgets, or null for fixed budgets. Must outlive its use by the crowd.
+	/// Updates with a clock depend on the time they take, so they are not deterministic.
+	dtClock* clock;
+};
+
+/// Describes the path searching and optimization done by the last #dtCrowd::update.
+/// @ingroup crowd
+/// @see dtCrowd::getBudgetStats
+struct dtCrowdBudgetStats
+{
+	int pathIterations;			///< The path search iterations run, more than the budget when a flow field build overran it.
+	int pathIterationBudget;	///< The path search iterations the update was allowed to run.
+	int pathRequestsWaiting;	///< The agents waiting for a free path request.
+	int pathRequestsSearching;	///< The agents whose path is being searched.
+	int optimizations;			///< The path topology optimizations run.
+	int optimizationBudget;		///< The path topology optimizations the update was allowed to run.
+	int optimizationsWaiting;	///< The agents due for a path topology optimization that was not run.
+	float pathTime;				///< The time spent searching paths, or zero without a clock. [Units: us]
+	float optimizationTime;		///< The time spent optimizing paths, or zero without a clock. [Units: us]
+	float pathIterationCost;	///< The estimated time of a path search iteration, or zero if not measured. [Units: us]
+	float optimizationCost;		///< The estimated time of a path topology optimization, or zero if not measured. [Units: us]
+};
+
+/// Configures the iterative resolution of agent overlaps in #dtCrowd::update.
+/// @ingroup crowd
+/// @see dtCrowd::setCollisionParams
+struct dtCrowdCollisionParams
+{
+	/// The number of resolve iterations run every update. [Limit: >= 0] [Default: 4]
+	int iterations;
+
+	/// The maximum number of resolve iterations. Iterations beyond #iterations are run while any two agents
+	/// overlap by more than #overlapTolerance. [Limit: >= #iterations] [Default: 4]
+	int maxIterations;
+
+	/// The overlap, relative to the sum of the radii of two agents, below which no extra iteration is run. [Limit: >= 0]
+	float overlapTolerance;
+};
+
+/// Configures the level of detail of the agents chosen from their distance to the nearest observer.
+/// @ingroup crowd
+/// @see dtCrowd::setLodParams, dtCrowd::setLodObservers
+struct dtCrowdLodParams
+{
+	/// The distance beyond which agents are simulated at #DT_CROWDAGENT_LOD_REDUCED. [Limit: >= 0] [Default: 20]
+	float reducedDistance;
+
+	/// The distance beyond which agents are simulated at #DT_CROWDAGENT_LOD_CORRIDOR. [Limit: >= #reducedDistance] [Default: 50]
+	float corridorDistance;
+
+	/// The distance beyond which agents sleep. [Limit: >= #corridorDistance] [Default: FLT_MAX]
+	float sleepDistance;
+
+	/// The number of updates between refreshes of the reduced agents and between path visibility optimizations of the
+	/// reduced and corridor agents. The refreshes are staggered over the updates by agent index. [Limit: >= 1] [Default: 4]
+	int interval;
+};
+
+struct dtCrowdCollisionData;
+struct dtCrowdFlowFieldSlot;
+
 struct dtCrowdAgentDebugInfo
 {
 	int idx;
@@ -198,21 +398,80 @@ struct dtCrowdAgentDebugInfo
 	dtObstacleAvoidanceDebugData* vod;
 };
 
+/// The phases of a crowd update.
+/// @ingroup crowd
+/// @see dtCrowdUpdateProfile
+enum CrowdUpdatePhase
+{
+	DT_CROWD_PHASE_PATHS = 0,			///< Levels of detail, path validity, path requests and topology optimization.
+	DT_CROWD_PHASE_NEIGHBOURS,			///< The proximity grid, local boundaries and neighbours.
+	DT_CROWD_PHASE_STEERING,			///< Corners, off-mesh connection triggers and steering.
+	DT_CROWD_PHASE_AVOIDANCE,			///< Velocity planning.
+	DT_CROWD_PHASE_COLLISIONS,			///< Integration and collision resolution.
+	DT_CROWD_PHASE_MOVEMENT,			///< Moving the corridors and off-mesh connection animations.
+	DT_CROWD_MAX_PHASES
+};
+
+/// The time each phase of a crowd update took, measured when passed to dtCrowd::update.
+/// @ingroup crowd
+struct dtCrowdUpdateProfile
+{
+	/// The clock measuring the phases. [Required]
+	dtClock* clock;
+
+	/// The time each phase took in the last update, indexed by #CrowdUpdatePhase. [Units: us]
+	double phaseTimes[DT_CROWD_MAX_PHASES];
+};
+
 /// Provides local steering behaviors for a group of agents. 
 /// @ingroup crowd
 class dtCrowd
 {
 	int m_maxAgents;
 	dtCrowdAgent* m_agents;
-	dtCrowdAgent** m_activeAgents;
+	dtCrowdAgentArrays m_agentArrays;
+	void* m_agentArrayData;
+	int* m_activeAgents;
+	unsigned char* m_agentEdited;
+	int* m_editedAgents;
+	int m_nedited;
 	dtCrowdAgentAnimation* m_agentAnims;
 	
 	dtPathQueue m_pathq;
+	dtPathPool m_pathPool;
 
 	dtObstacleAvoidanceParams m_obstacleQueryParams[DT_CROWD_MAX_OBSTAVOIDANCE_PARAMS];
 	dtObstacleAvoidanceQuery* m_obstacleQuery;
 	
 	dtProximityGrid* m_grid;
+
+	int m_maxNeighbours;
+	int m_maxCorners;
+	int m_maxNeighbourQuery;
+	unsigned short* m_neighbourQueryIds;
+	float* m_cornerVerts;
+	unsigned char* m_cornerFlags;
+	dtPolyRef* m_cornerPolys;
+
+	dtCrowdCollisionParams m_collisionParams;
+	dtCrowdCollisionData* m_collision;
+	int m_collisionIterationCount;
+
+	dtCrowdLodParams m_lodParams;
+	float m_lodObservers[DT_CROWD_MAX_LOD_OBSERVERS*3];
+	int m_nlodObservers;
+	int m_lodFrame;			///< The update count, modulo the level of detail refresh interval.
+
+	dtCrowdBudgetParams m_budgetParams;
+	dtCrowdBudgetStats m_budgetStats;
+	int m_pathIterationDebt;	///< The iterations of flow field builds beyond the budget, taken from the next updates.
+	dtCrowdAgent** m_pathRequestQueue;
+	dtCrowdAgent** m_optimizationQueue;
+
+	dtCrowdFlowFieldSlot* m_flowFields;
+	int m_maxFlowFields;
+	int m_maxFlowFieldPolys;
+	int* m_agentFlowField;
 	
 	dtPolyRef* m_pathResult;
 	int m_maxPathResult;
@@ -227,13 +486,27 @@ class dtCrowd
 
 	dtNavMeshQuery* m_navquery;
 
-	void updateTopologyOptimization(dtCrowdAgent** agents, const int nagents, const float dt);
+	void updateTopologyOptimization(const int* agents, const int nagents, const float dt);
 	void updateMoveRequest(const float dt);
-	void checkPathValidity(dtCrowdAgent** agents, const int nagents, const float dt);
+	void checkPathValidity(const int* agents, const int nagents, const float dt);
+	void resolveCollisions(const int* agents, const int nagents);
+	void updateLod(const int* agents, const int nagents);
+
+	inline bool isLodRefresh(const int idx) const
+	{
+		return m_agentArrays.lod[idx] == DT_CROWDAGENT_LOD_FULL || (idx + m_lodFrame) % m_lodParams.interval == 0;
+	}
 
 	inline int getAgentIndex(const dtCrowdAgent* agent) const  { return (int)(agent - m_agents); }
 
+	int collectActiveAgents(int* agents) const;
+	void setAgentArrayParams(const int idx, const dtCrowdAgentParams* params);
+	void pullEditedAgents();
+	void refreshAgentView(const int idx);
+
 	bool requestMoveTargetReplan(const int idx, dtPolyRef ref, const float* pos);
+	void releaseFlowField(const int idx);
+	bool setCorridorFromFlowField(const int idx);
 
 	void purge();
 	
@@ -241,12 +514,18 @@ public:
 	dtCrowd();
 	~dtCrowd();
 	
-	/// Initializes the crowd.  
+	/// Initializes the crowd with the default neighbour and corner capacities.
 	///  @param[in]		maxAgents		The maximum number of agents the crowd can manage. [Limit: >= 1]
 	///  @param[in]		maxAgentRadius	The maximum radius of any agent that will be added to the crowd. [Limit: > 0]
 	///  @param[in]		nav				The navigation mesh to use for planning.
 	/// @return True if the initialization succeeded.
 	bool init(const int maxAgents, const float maxAgentRadius, dtNavMesh* nav);
+
+	/// Initializes the crowd.
+	///  @param[in]		params			The capacities of the crowd.
+	///  @param[in]		nav				The navigation mesh to use for planning.
+	/// @return True if the initialization succeeded.
+	bool init(const dtCrowdParams* params, dtNavMesh* nav);
 	
 	/// Sets the shared avoidance configuration for the specified index.
 	///  @param[in]		idx		The index. [Limits: 0 <= value < #DT_CROWD_MAX_OBSTAVOIDANCE_PARAMS]
@@ -258,6 +537,72 @@ public:
 	///							[Limits:  0 <= value < #DT_CROWD_MAX_OBSTAVOIDANCE_PARAMS]
 	/// @return The requested configuration.
 	const dtObstacleAvoidanceParams* getObstacleAvoidanceParams(const int idx) const;
+
+	/// Sets the configuration of the collision resolution.
+	///  @param[in]		params	The new configuration.
+	void setCollisionParams(const dtCrowdCollisionParams* params);
+
+	/// Gets the configuration of the collision resolution.
+	/// @return The configuration of the collision resolution.
+	const dtCrowdCollisionParams* getCollisionParams() const { return &m_collisionParams; }
+
+	/// Sets the path search and path topology optimization budgets of each update.
+	///  @param[in]		params	The new budgets.
+	void setBudgetParams(const dtCrowdBudgetParams* params);
+
+	/// Gets the path search and path topology optimization budgets of each update.
+	/// @return The budgets.
+	const dtCrowdBudgetParams* getBudgetParams() const { return &m_budgetParams; }
+
+	/// Gets the path searching and optimization done by the last update and the agents waiting for it.
+	/// @return The counters of the last update.
+	const dtCrowdBudgetStats* getBudgetStats() const { return &m_budgetStats; }
+
+	/// Sets how the level of detail of the agents is chosen from their distance to the observers.
+	///  @param[in]		params	The new configuration.
+	void setLodParams(const dtCrowdLodParams* params);
+
+	/// Gets how the level of detail of the agents is chosen from their distance to the observers.
+	/// @return The configuration of the level of detail.
+	const dtCrowdLodParams* getLodParams() const { return &m_lodParams; }
+
+	/// Sets the positions around which agents are fully simulated, such as the positions of the players.
+	/// While there are observers, every update chooses the level of detail of each agent from its distance
+	/// to the nearest observer. Without observers, the levels set with #setAgentLod are kept.
+	///  @param[in]		pos		The observer positions. [(x, y, z) * @p count]
+	///  @param[in]		count	The number of observers. [Limits: 0 <= value <= #DT_CROWD_MAX_LOD_OBSERVERS]
+	/// @return True if the observers were set.
+	bool setLodObservers(const float* pos, const int count);
+
+	/// Gets the number of observers.
+	/// @return The number of observers.
+	int getLodObserverCount() const { return m_nlodObservers; }
+
+	/// Sets the level of detail at which an agent is simulated. Overridden at the next update while there are observers.
+	///  @param[in]		idx		The agent index. [Limits: 0 <= value < #getAgentCount()]
+	///  @param[in]		lod		The level of detail. (See: #CrowdAgentLod)
+	void setAgentLod(const int idx, const unsigned char lod);
+
+	/// Gets the maximum number of neighbours of an agent.
+	/// @return The maximum number of neighbours of an agent.
+	int getMaxNeighbours() const { return m_maxNeighbours; }
+
+	/// Gets the maximum number of path corners of an agent.
+	/// @return The maximum number of path corners of an agent.
+	int getMaxCorners() const { return m_maxCorners; }
+
+	/// Gets the maximum number of shared flow fields.
+	/// @return The maximum number of shared flow fields.
+	int getMaxFlowFields() const { return m_maxFlowFields; }
+
+	/// Gets a shared flow field.
+	///  @param[in]		i		The index of the field. [Limits: 0 <= value < #getMaxFlowFields()]
+	/// @return The flow field, or null if the field is not in use.
+	const dtFlowField* getFlowField(const int i) const;
+
+	/// Gets the number of collision resolve iterations applied by the last update.
+	/// @return The number of collision resolve iterations applied by the last update.
+	int getCollisionIterationCount() const { return m_collisionIterationCount; }
 	
 	/// Gets the specified agent from the pool.
 	///	 @param[in]		idx		The agent index. [Limits: 0 <= value < #getAgentCount()]
@@ -265,10 +610,16 @@ public:
 	const dtCrowdAgent* getAgent(const int idx);
 
 	/// Gets the specified agent from the pool.
+	/// Changes to the agent are applied at the next #update().
 	///	 @param[in]		idx		The agent index. [Limits: 0 <= value < #getAgentCount()]
 	/// @return The requested agent.
 	dtCrowdAgent* getEditableAgent(const int idx);
 
+	/// Gets the state of all agents as parallel arrays indexed by the agent index.
+	/// The arrays are current after #update(), without refreshing an agent view per agent.
+	/// @return The agent arrays.
+	const dtCrowdAgentArrays& getAgentArrays() const { return m_agentArrays; }
+
 	/// The maximum number of agents that can be managed by the object.
 	/// @return The maximum number of agents.
 	int getAgentCount() const;
@@ -295,6 +646,14 @@ public:
 	/// @return True if the request was successfully submitted.
 	bool requestMoveTarget(const int idx, dtPolyRef ref, const float* pos);
 
+	/// Submits a new move request for the specified agent, sharing a flow field with the other agents
+	/// moving to the same target.
+	///  @param[in]		idx		The agent index. [Limits: 0 <= value < #getAgentCount()]
+	///  @param[in]		ref		The position's polygon reference.
+	///  @param[in]		pos		The position within the polygon. [(x, y, z)]
+	/// @return True if the request was successfully submitted.
+	bool requestMoveTargetShared(const int idx, dtPolyRef ref, const float* pos);
+
 	/// Submits a new move request for the specified agent.
 	///  @param[in]		idx		The agent index. [Limits: 0 <= value < #getAgentCount()]
 	///  @param[in]		vel		The movement velocity. [(x, y, z)]
@@ -315,7 +674,8 @@ public:
 	/// Updates the steering and positions of all agents.
 	///  @param[in]		dt		The time, in seconds, to update the simulation. [Limit: > 0]
 	///  @param[out]	debug	A debug object to load with debug information. [Opt]
-	void update(const float dt, dtCrowdAgentDebugInfo* debug);
+	///  @param[out]	profile	A profile to load with the time of each phase. [Opt]
+	void update(const float dt, dtCrowdAgentDebugInfo* debug, dtCrowdUpdateProfile* profile = 0);
 	
 	/// Gets the filter used by the crowd.
 	/// @return The filter used by the crowd.
@@ -345,6 +705,10 @@ public:
 	/// @return The crowd's path request queue.
 	const dtPathQueue* getPathQueue() const { return &m_pathq; }
 
+	/// Gets the pool holding the corridor paths of the agents.
+	/// @return The pool of corridor paths.
+	const dtPathPool* getPathPool() const { return &m_pathPool; }
+
 	/// Gets the query object used by the crowd.
 	const dtNavMeshQuery* getNavMeshQuery() const { return m_navquery; }
 
@@ -419,6 +783,14 @@ Other significant limitations:
   management at any one time is between 20 and 30.  A good place to start
   is a maximum of 25 agents for 0.5ms per frame.
 
+<b>Determinism</b>
+
+Given the same navigation mesh and the same sequence of calls, the crowd gives the 
+same results on every run. Building with RECASTNAVIGATION_DT_DETERMINISTIC (which 
+defines DT_DETERMINISTIC) makes the results identical across platforms and compilers 
+as well, for lockstep simulations. Time budgets break determinism, so leave 
+dtCrowdBudgetParams::clock null in lockstep simulations.
+
 @note This is a summary list of members.  Use the index or search 
 feature to find minor members.
 
@@ -0,0 +1,129 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURFLOWFIELD_H
+#define DETOURFLOWFIELD_H
+
+#include "DetourNavMeshQuery.h"
+
+/// The lowest cost routes from the polygons around a goal to the goal, shared by all agents moving to it.
+///
+/// The field is built by a single Dijkstra search over the polygon graph starting at the goal. Each reached
+/// polygon stores the next polygon towards the goal, so the path of any agent inside the field is read by
+/// following those links instead of searching.
+///
+/// The field keeps the tiles under and next to its polygons, and is no longer valid once any of them is added,
+/// removed or replaced.
+/// @ingroup crowd
+class dtFlowField
+{
+public:
+	dtFlowField();
+	~dtFlowField();
+
+	/// Initializes the field.
+	///  @param[in]		maxPolys	The maximum number of polygons the field can hold. [Limits: 0 < value <= 65535]
+	///  @param[in]		nav			The navigation mesh to search.
+	/// @return True if the initialization succeeded.
+	bool init(const int maxPolys, const dtNavMesh* nav);
+
+	/// Builds the field for a goal, discarding the previous one.
+	///  @param[in]		goalRef		The reference of the goal polygon.
+	///  @param[in]		goalPos		The goal position. [(x, y, z)]
+	///  @param[in]		filter		The polygon filter to apply to the search.
+	/// @returns The status flags for the build. #DT_OUT_OF_NODES is set when the reachable polygons did not fit.
+	///			The field is empty if the tiles it covers could not be recorded.
+	dtStatus build(dtPolyRef goalRef, const float* goalPos, const dtQueryFilter* filter);
+
+	/// Removes all polygons from the field.
+	void reset();
+
+	/// Finds the path from a polygon to the goal.
+	///  @param[in]		startRef	The reference of the polygon to start from.
+	///  @param[out]	path		The polygons from the start towards the goal. [(polyRef) * @p pathCount]
+	///  @param[in]		maxPath		The maximum number of polygons the path array can hold. [Limit: >= 1]
+	/// @return The number of polygons in the path, or zero if the start polygon is not in the field.
+	///			The path ends before the goal if it is longer than @p maxPath.
+	int getPath(dtPolyRef startRef, dtPolyRef* path, const int maxPath) const;
+
+	/// Returns true if the tiles under and next to the polygons are the ones the field was built on.
+	/// The paths and costs of a field that is not valid may lead through polygons that no longer exist.
+	bool isValid() const;
+
+	/// Returns true if the polygon is in the field.
+	bool contains(dtPolyRef ref) const { return findPoly(ref) != -1; }
+
+	/// Gets the cost of moving from a polygon to the goal.
+	///  @param[in]		ref		The reference of the polygon.
+	/// @return The cost of the path from the polygon to the goal, or a negative value if the polygon is not in the field.
+	float getCost(dtPolyRef ref) const;
+
+	/// The reference of the goal polygon, or zero if the field is empty.
+	dtPolyRef getGoalRef() const { return m_goalRef; }
+
+	/// The goal position. [(x, y, z)]
+	const float* getGoalPos() const { return m_goalPos; }
+
+	/// The number of polygons in the field.
+	int getPolyCount() const { return m_npolys; }
+
+	/// The maximum number of polygons in the field.
+	int getMaxPolys() const { return m_maxPolys; }
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtFlowField(const dtFlowField&);
+	dtFlowField& operator=(const dtFlowField&);
+
+	int findPoly(dtPolyRef ref) const;
+	bool recordTiles();
+	void purge();
+
+	dtNavMeshQuery* m_navquery;
+	dtPolyRef m_goalRef;
+	float m_goalPos[3];
+
+	dtPolyRef* m_polys;		///< The polygons in the order they were reached. [(polyRef) * #m_maxPolys]
+	dtPolyRef* m_parents;	///< The next polygons towards the goal as returned by the search. [(polyRef) * #m_maxPolys]
+	float* m_costs;			///< The costs to the goal. [(cost) * #m_maxPolys]
+	int* m_next;			///< The indices of the next polygons towards the goal, -1 at the goal. [(index) * #m_maxPolys]
+	int m_npolys;
+	int m_maxPolys;
+
+	dtTileRef* m_tiles;		///< The tiles under and next to the polygons when the field was built. [(tileRef) * #m_ntiles]
+	int m_ntiles;
+	int m_maxTiles;
+	int* m_tileLocs;		///< The grid locations under and next to the polygons. [(x, y) * #m_ntileLocs]
+	int m_ntileLocs;
+	int m_maxTileLocs;
+
+	int* m_buckets;			///< An open addressed hash of the polygon indices, -1 if empty. [(index) * (#m_bucketMask + 1)]
+	int m_bucketMask;
+};
+
+/// Allocates a flow field object using the Detour allocator.
+/// @return A flow field object that is ready for initialization, or null on failure.
+/// @ingroup crowd
+dtFlowField* dtAllocFlowField();
+
+/// Frees the specified flow field object using the Detour allocator.
+///  @param[in]		ptr		A flow field object allocated using #dtAllocFlowField
+/// @ingroup crowd
+void dtFreeFlowField(dtFlowField* ptr);
+
+#endif // DETOURFLOWFIELD_H
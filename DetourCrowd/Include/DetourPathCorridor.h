@@ -21,6 +21,68 @@
 
 #include "DetourNavMeshQuery.h"
 
+/// Path buffers of several sizes shared by many corridors, so that each corridor only holds the
+/// polygons of its current path instead of a buffer for the longest path.
+///
+/// Buffers are carved from chunks holding the buffers of one size. Freed buffers are reused by
+/// later allocations of the same size, and the chunks are only released when the pool is destroyed
+/// or initialized again.
+/// @ingroup crowd
+class dtPathPool
+{
+public:
+	dtPathPool();
+	~dtPathPool();
+
+	/// Initializes the pool. All buffers allocated from the pool before must have been freed.
+	///  @param[in]		maxPath		The maximum number of polygons in a path. [Limit: > 0]
+	///  @param[in]		chunkSize	The number of polygon references allocated at once for a buffer size. [Limit: > 0]
+	/// @return True if the initialization succeeded.
+	bool init(const int maxPath, const int chunkSize = 4096);
+
+	/// Allocates a path buffer.
+	///  @param[in]		size		The number of polygons the buffer must hold. [Limits: 0 < value <= #getMaxPath()]
+	///  @param[out]	capacity	The number of polygons the buffer can hold. [Limit: >= @p size]
+	/// @return The buffer, or null if out of memory.
+	dtPolyRef* alloc(const int size, int* capacity);
+
+	/// Returns a buffer to the pool.
+	///  @param[in]		buf			A buffer allocated from the pool, or null.
+	///  @param[in]		capacity	The capacity of the buffer returned by #alloc, or the size it was allocated for.
+	void free(dtPolyRef* buf, const int capacity);
+
+	/// Returns the capacity of the buffers that hold a number of polygons.
+	///  @param[in]		size		The number of polygons. [Limits: 0 < value <= #getMaxPath()]
+	int getCapacity(const int size) const;
+
+	/// The maximum number of polygons in a path.
+	int getMaxPath() const { return m_maxPath; }
+
+	/// The number of polygon references in the buffers allocated from the pool.
+	int getUsedSize() const { return m_usedSize; }
+
+	/// The number of polygon references in the chunks of the pool, used or not.
+	int getReservedSize() const { return m_reservedSize; }
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtPathPool(const dtPathPool&);
+	dtPathPool& operator=(const dtPathPool&);
+
+	void purge();
+	int getSizeClass(const int size) const;
+
+	static const int MAX_SIZE_CLASSES = 24;
+	int m_capacities[MAX_SIZE_CLASSES];		///< The capacity of the buffers of each size class.
+	dtPolyRef* m_freeLists[MAX_SIZE_CLASSES];	///< The first free buffer of each size class. Free buffers start with the next one.
+	int m_nclasses;
+	void* m_chunks;								///< The allocated chunks, each starting with the next one.
+	int m_maxPath;
+	int m_chunkSize;
+	int m_usedSize;
+	int m_reservedSize;
+};
+
 /// Represents a dynamic polygon corridor used to plan agent movement.
 /// @ingroup crowd, detour
 class dtPathCorridor
@@ -31,6 +93,10 @@ class dtPathCorridor
 	dtPolyRef* m_path;
 	int m_npath;
 	int m_maxPath;
+	int m_capacity;
+	dtPathPool* m_pool;
+
+	bool reserve(const int size, const bool shrink = false);
 	
 public:
 	dtPathCorridor();
@@ -40,6 +106,11 @@ public:
 	///  @param[in]		maxPath		The maximum path size the corridor can handle.
 	/// @return True if the initialization succeeded.
 	bool init(const int maxPath);
+
+	/// Initializes the corridor to take its path buffer from a pool, sized to the current path.
+	///  @param[in]		pool		The pool of path buffers. Must outlive the corridor.
+	/// @return True if the initialization succeeded.
+	bool init(dtPathPool* pool);
 	
 	/// Resets the path corridor to the specified position.
 	///  @param[in]		ref		The polygon reference containing the position.
@@ -133,6 +204,14 @@ public:
 	/// @return The number of polygons in the current corridor path.
 	inline int getPathCount() const { return m_npath; }
 
+	/// The number of polygons the corridor's path buffer can hold without growing.
+	/// @return The capacity of the path buffer.
+	inline int getPathCapacity() const { return m_capacity; }
+
+	/// The maximum number of polygons in the corridor path.
+	/// @return The maximum number of polygons in the corridor path.
+	inline int getMaxPath() const { return m_maxPath; }
+
 private:
 	// Explicitly disabled copy constructor and copy assignment operator.
 	dtPathCorridor(const dtPathCorridor&);
@@ -24,6 +24,9 @@
 
 static const unsigned int DT_PATHQ_INVALID = 0;
 
+/// The default maximum number of requests searched by a path queue at the same time.
+static const int DT_PATHQ_MAX_QUEUE = 8;
+
 typedef unsigned int dtPathQueueRef;
 
 class dtPathQueue
@@ -43,8 +46,8 @@ class dtPathQueue
 		const dtQueryFilter* filter; ///< TODO: This is potentially dangerous!
 	};
 	
-	static const int MAX_QUEUE = 8;
-	PathQuery m_queue[MAX_QUEUE];
+	PathQuery* m_queue;
+	int m_maxQueue;
 	dtPathQueueRef m_nextHandle;
 	int m_maxPathSize;
 	int m_queueHead;
@@ -56,9 +59,12 @@ public:
 	dtPathQueue();
 	~dtPathQueue();
 	
-	bool init(const int maxPathSize, const int maxSearchNodeCount, dtNavMesh* nav);
+	bool init(const int maxPathSize, const int maxSearchNodeCount, dtNavMesh* nav, const int maxQueue = DT_PATHQ_MAX_QUEUE);
 	
-	void update(const int maxIters);
+	/// Runs the queued searches.
+	///  @param[in]		maxIters	The maximum number of search iterations to run.
+	/// @return The number of search iterations run.
+	int update(const int maxIters);
 	
 	dtPathQueueRef request(dtPolyRef startRef, dtPolyRef endRef,
 						   const float* startPos, const float* endPos, 
@@ -68,6 +74,12 @@ public:
 	
 	dtStatus getPathResult(dtPathQueueRef ref, dtPolyRef* path, int* pathSize, const int maxPath);
 	
+	/// Returns the number of requests in the queue, including completed requests whose result has not been read.
+	int getRequestCount() const;
+
+	/// Returns the maximum number of requests in the queue.
+	inline int getMaxRequests() const { return m_maxQueue; }
+
 	inline const dtNavMeshQuery* getNavQuery() const { return m_navquery; }
 
 private:
@@ -37,6 +37,18 @@ dtCrowd* dtAllocCrowd()
 	return new(mem) dtCrowd;
 }
 
+void dtInitCrowdParams(dtCrowdParams* params, const int maxAgents, const float maxAgentRadius)
+{
+	params->maxAgents = maxAgents;
+	params->maxAgentRadius = maxAgentRadius;
+	params->maxNeighbours = DT_CROWDAGENT_MAX_NEIGHBOURS;
+	params->maxCorners = DT_CROWDAGENT_MAX_CORNERS;
+	params->maxNeighbourQuery = DT_CROWD_MAX_NEIGHBOUR_QUERY;
+	params->maxFlowFields = DT_CROWD_MAX_FLOW_FIELDS;
+	params->maxFlowFieldPolys = DT_CROWD_MAX_FLOW_FIELD_POLYS;
+	params->maxPathRequests = DT_CROWD_MAX_PATH_REQUESTS;
+}
+
 void dtFreeCrowd(dtCrowd* ptr)
 {
 	if (!ptr) return;
@@ -45,35 +57,165 @@ void dtFreeCrowd(dtCrowd* ptr)
 }
 
 
-static const int MAX_ITERS_PER_UPDATE = 100;
-
 static const int MAX_PATHQUEUE_NODES = 4096;
 static const int MAX_COMMON_NODES = 512;
 
+static const int MAX_PATH_ITERS_PER_UPDATE = 0x100000;
+
+static int alignArraySize(const int size)
+{
+	return (size + 15) & ~15;
+}
+
 inline float tween(const float t, const float t0, const float t1)
 {
 	return dtClamp((t-t0) / (t1-t0), 0.0f, 1.0f);
 }
 
-static void integrate(dtCrowdAgent* ag, const float dt)
+static void integrate(const dtCrowdAgentArrays& agents, const int maxAgents, const float dt)
 {
-	// Fake dynamic constraint.
-	const float maxDelta = ag->params.maxAcceleration * dt;
-	float dv[3];
-	dtVsub(dv, ag->nvel, ag->vel);
-	float ds = dtVlen(dv);
-	if (ds > maxDelta)
-		dtVscale(dv, dv, maxDelta/ds);
-	dtVadd(ag->vel, ag->vel, dv);
-	
-	// Integrate
-	if (dtVlen(ag->vel) > 0.0001f)
-		dtVmad(ag->npos, ag->npos, ag->vel, dt);
-	else
-		dtVset(ag->vel,0,0,0);
+	// Every slot is computed and only walking agents keep the result, so that the loop has no branches.
+	for (int i = 0; i < maxAgents; ++i)
+	{
+		const bool walking = agents.active[i] & (agents.state[i] == DT_CROWDAGENT_STATE_WALKING);
+		float* npos = &agents.npos[i*3];
+		float* vel = &agents.vel[i*3];
+		const float* nvel = &agents.nvel[i*3];
+
+		// Fake dynamic constraint.
+		const float maxDelta = agents.maxAcceleration[i] * dt;
+		const float dv0 = nvel[0] - vel[0];
+		const float dv1 = nvel[1] - vel[1];
+		const float dv2 = nvel[2] - vel[2];
+		const float ds = dtMathSqrtf(dv0*dv0 + dv1*dv1 + dv2*dv2);
+		const float scale = ds > maxDelta ? maxDelta/ds : 1.0f;
+		const float v0 = vel[0] + (ds > maxDelta ? dv0*scale : dv0);
+		const float v1 = vel[1] + (ds > maxDelta ? dv1*scale : dv1);
+		const float v2 = vel[2] + (ds > maxDelta ? dv2*scale : dv2);
+
+		// Integrate
+		const bool moving = dtMathSqrtf(v0*v0 + v1*v1 + v2*v2) > 0.0001f;
+		const float p0 = npos[0] + v0*dt;
+		const float p1 = npos[1] + v1*dt;
+		const float p2 = npos[2] + v2*dt;
+		npos[0] = walking & moving ? p0 : npos[0];
+		npos[1] = walking & moving ? p1 : npos[1];
+		npos[2] = walking & moving ? p2 : npos[2];
+		vel[0] = walking ? (moving ? v0 : 0.0f) : vel[0];
+		vel[1] = walking ? (moving ? v1 : 0.0f) : vel[1];
+		vel[2] = walking ? (moving ? v2 : 0.0f) : vel[2];
+	}
+}
+
+/// The agents taking part in the collision resolution of an update, sorted along a Morton curve of their
+/// positions so that neighbouring agents are close in memory. The per-agent values are indexed by sorted position.
+struct dtCrowdCollisionData
+{
+	unsigned int* keys;		///< The Morton codes of the agents. [(code) * 2 * maxAgents] Double buffered for sorting.
+	int* order;				///< The agent index at each sorted position. [(index) * 2 * maxAgents] Double buffered for sorting.
+	int* sorted;			///< The sorted position of each agent index. [(position) * maxAgents]
+	float* x;				///< The x-positions of the agents.
+	float* z;				///< The z-positions of the agents.
+	float* radius;			///< The radii of the agents.
+	float* dvelx;			///< The x-components of the desired velocities.
+	float* dvelz;			///< The z-components of the desired velocities.
+	float* dispx;			///< The x-components of the displacements of the current iteration.
+	float* dispz;			///< The z-components of the displacements of the current iteration.
+	float* weight;			///< The number of overlapping neighbours of the current iteration.
+	unsigned char* walking;	///< Non-zero if the displacement is applied to the agent.
+	/// The sorted positions of the neighbours, one row of all agents per neighbour slot. Unused slots refer to the agent itself.
+	/// [(position) * maxNeighbours * maxAgents]
+	int* neis;
+};
+
+/// A flow field shared by the agents moving to the same target with the same filter.
+struct dtCrowdFlowFieldSlot
+{
+	dtFlowField* field;		///< The field, allocated when the slot is first used.
+	dtPolyRef ref;			///< The target polygon.
+	float pos[3];			///< The target position.
+	int filterType;			///< The query filter of the agents.
+	int agentCount;			///< The number of agents using the field. The slot is free when zero.
+	bool dirty;				///< True if the field is built before it is next used, within the path search budget.
+};
+
+static dtCrowdCollisionData* allocCollisionData(const int maxAgents, const int maxNeighbours)
+{
+	const int headerSize = alignArraySize((int)sizeof(dtCrowdCollisionData));
+	const int keysSize = alignArraySize((int)sizeof(unsigned int)*2*maxAgents);
+	const int orderSize = alignArraySize((int)sizeof(int)*2*maxAgents);
+	const int intArraySize = alignArraySize((int)sizeof(int)*maxAgents);
+	const int floatArraySize = alignArraySize((int)sizeof(float)*maxAgents);
+	const int byteArraySize = alignArraySize((int)sizeof(unsigned char)*maxAgents);
+	const int neisSize = alignArraySize((int)sizeof(int)*maxNeighbours*maxAgents);
+	const int dataSize = headerSize + keysSize + orderSize + intArraySize + floatArraySize*8 + byteArraySize + neisSize;
+
+	unsigned char* data = (unsigned char*)dtAlloc(dataSize, DT_ALLOC_PERM);
+	if (!data)
+		return 0;
+	dtCrowdCollisionData* col = (dtCrowdCollisionData*)data; data += headerSize;
+	col->keys = (unsigned int*)data; data += keysSize;
+	col->order = (int*)data; data += orderSize;
+	col->sorted = (int*)data; data += intArraySize;
+	col->x = (float*)data; data += floatArraySize;
+	col->z = (float*)data; data += floatArraySize;
+	col->radius = (float*)data; data += floatArraySize;
+	col->dvelx = (float*)data; data += floatArraySize;
+	col->dvelz = (float*)data; data += floatArraySize;
+	col->dispx = (float*)data; data += floatArraySize;
+	col->dispz = (float*)data; data += floatArraySize;
+	col->weight = (float*)data; data += floatArraySize;
+	col->walking = data; data += byteArraySize;
+	col->neis = (int*)data;
+	return col;
+}
+
+/// Interleaves the lower 16 bits of the value with zeros.
+static unsigned int spreadBits(unsigned int v)
+{
+	v &= 0xffff;
+	v = (v | (v << 8)) & 0x00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+/// Sorts the values by their keys with a stable radix sort, skipping the bytes all keys share.
+/// The keys and values are double buffered, [0, n) holding the input and [n, 2n) the scratch space.
+/// @return The offset of the sorted keys and values, 0 or n.
+static int radixSortByKey(unsigned int* keys, int* values, const int n)
+{
+	int src = 0;
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		int counts[256];
+		memset(counts, 0, sizeof(counts));
+		for (int i = 0; i < n; ++i)
+			counts[(keys[src+i] >> shift) & 0xff]++;
+		if (counts[(keys[src] >> shift) & 0xff] == n)
+			continue;
+
+		int sum = 0;
+		for (int i = 0; i < 256; ++i)
+		{
+			const int c = counts[i];
+			counts[i] = sum;
+			sum += c;
+		}
+		const int dst = n - src;
+		for (int i = 0; i < n; ++i)
+		{
+			const int pos = counts[(keys[src+i] >> shift) & 0xff]++;
+			keys[dst+pos] = keys[src+i];
+			values[dst+pos] = values[src+i];
+		}
+		src = dst;
+	}
+	return src;
 }
 
-static bool overOffmeshConnection(const dtCrowdAgent* ag, const float radius)
+static bool overOffmeshConnection(const dtCrowdAgent* ag, const float* pos, const float radius)
 {
 	if (!ag->ncorners)
 		return false;
@@ -81,7 +223,7 @@ static bool overOffmeshConnection(const dtCrowdAgent* ag, const float radius)
 	const bool offMeshConnection = (ag->cornerFlags[ag->ncorners-1] & DT_STRAIGHTPATH_OFFMESH_CONNECTION) ? true : false;
 	if (offMeshConnection)
 	{
-		const float distSq = dtVdist2DSqr(ag->npos, &ag->cornerVerts[(ag->ncorners-1)*3]);
+		const float distSq = dtVdist2DSqr(pos, &ag->cornerVerts[(ag->ncorners-1)*3]);
 		if (distSq < radius*radius)
 			return true;
 	}
@@ -89,19 +231,19 @@ static bool overOffmeshConnection(const dtCrowdAgent* ag, const float radius)
 	return false;
 }
 
-static float getDistanceToGoal(const dtCrowdAgent* ag, const float range)
+static float getDistanceToGoal(const dtCrowdAgent* ag, const float* pos, const float range)
 {
 	if (!ag->ncorners)
 		return range;
 	
 	const bool endOfPath = (ag->cornerFlags[ag->ncorners-1] & DT_STRAIGHTPATH_END) ? true : false;
 	if (endOfPath)
-		return dtMin(dtVdist2D(ag->npos, &ag->cornerVerts[(ag->ncorners-1)*3]), range);
+		return dtMin(dtVdist2D(pos, &ag->cornerVerts[(ag->ncorners-1)*3]), range);
 	
 	return range;
 }
 
-static void calcSmoothSteerDirection(const dtCrowdAgent* ag, float* dir)
+static void calcSmoothSteerDirection(const dtCrowdAgent* ag, const float* pos, float* dir)
 {
 	if (!ag->ncorners)
 	{
@@ -115,8 +257,8 @@ static void calcSmoothSteerDirection(const dtCrowdAgent* ag, float* dir)
 	const float* p1 = &ag->cornerVerts[ip1*3];
 	
 	float dir0[3], dir1[3];
-	dtVsub(dir0, p0, ag->npos);
-	dtVsub(dir1, p1, ag->npos);
+	dtVsub(dir0, p0, pos);
+	dtVsub(dir1, p1, pos);
 	dir0[1] = 0;
 	dir1[1] = 0;
 	
@@ -132,14 +274,14 @@ static void calcSmoothSteerDirection(const dtCrowdAgent* ag, float* dir)
 	dtVnormalize(dir);
 }
 
-static void calcStraightSteerDirection(const dtCrowdAgent* ag, float* dir)
+static void calcStraightSteerDirection(const dtCrowdAgent* ag, const float* pos, float* dir)
 {
 	if (!ag->ncorners)
 	{
 		dtVset(dir, 0,0,0);
 		return;
 	}
-	dtVsub(dir, &ag->cornerVerts[0], ag->npos);
+	dtVsub(dir, &ag->cornerVerts[0], pos);
 	dir[1] = 0;
 	dtVnormalize(dir);
 }
@@ -185,27 +327,26 @@ static int addNeighbour(const int idx, const float dist,
 }
 
 static int getNeighbours(const float* pos, const float height, const float range,
-						 const dtCrowdAgent* skip, dtCrowdNeighbour* result, const int maxResult,
-						 dtCrowdAgent** agents, const int /*nagents*/, dtProximityGrid* grid)
+						 const int skip, dtCrowdNeighbour* result, const int maxResult,
+						 const dtCrowdAgentArrays& agents, dtProximityGrid* grid,
+						 unsigned short* ids, const int maxIds)
 {
 	int n = 0;
 	
-	static const int MAX_NEIS = 32;
-	unsigned short ids[MAX_NEIS];
 	int nids = grid->queryItems(pos[0]-range, pos[2]-range,
 								pos[0]+range, pos[2]+range,
-								ids, MAX_NEIS);
+								ids, maxIds);
 	
 	for (int i = 0; i < nids; ++i)
 	{
-		const dtCrowdAgent* ag = agents[ids[i]];
+		const int idx = ids[i];
 		
-		if (ag == skip) continue;
+		if (idx == skip) continue;
 		
 		// Check for overlap.
 		float diff[3];
-		dtVsub(diff, pos, ag->npos);
-		if (dtMathFabsf(diff[1]) >= (height+ag->params.height)/2.0f)
+		dtVsub(diff, pos, &agents.npos[idx*3]);
+		if (dtMathFabsf(diff[1]) >= (height+agents.height[idx])/2.0f)
 			continue;
 		diff[1] = 0;
 		const float distSqr = dtVlenSqr(diff);
@@ -217,6 +358,23 @@ static int getNeighbours(const float* pos, const float height, const float range
 	return n;
 }
 
+/// Returns the number of work items expected to fit a time budget, but no fewer than the fixed number.
+static int getBudget(const int count, const float time, const float cost, const dtClock* clock, const int maxCount)
+{
+	if (!clock || time <= 0.0f || cost <= 0.0f)
+		return dtMin(count, maxCount);
+	return dtMin(dtMax(count, (int)dtMin(time / cost, (float)maxCount)), maxCount);
+}
+
+/// Updates the estimated time of a work item from the time taken by a number of them.
+static void updateCost(float& estimate, const double time, const int count)
+{
+	if (count <= 0)
+		return;
+	const float cost = dtMax((float)time / (float)count, 1e-6f);
+	estimate = estimate > 0.0f ? estimate*0.75f + cost*0.25f : cost;
+}
+
 static int addToOptQueue(dtCrowdAgent* newag, dtCrowdAgent** agents, const int nagents, const int maxAgents)
 {
 	// Insert neighbour based on greatest time.
@@ -331,16 +489,43 @@ Notes:
 dtCrowd::dtCrowd() :
 	m_maxAgents(0),
 	m_agents(0),
+	m_agentArrayData(0),
 	m_activeAgents(0),
+	m_agentEdited(0),
+	m_editedAgents(0),
+	m_nedited(0),
 	m_agentAnims(0),
 	m_obstacleQuery(0),
 	m_grid(0),
+	m_maxNeighbours(0),
+	m_maxCorners(0),
+	m_maxNeighbourQuery(0),
+	m_neighbourQueryIds(0),
+	m_cornerVerts(0),
+	m_cornerFlags(0),
+	m_cornerPolys(0),
+	m_collision(0),
+	m_collisionIterationCount(0),
+	m_nlodObservers(0),
+	m_lodFrame(0),
+	m_pathIterationDebt(0),
+	m_pathRequestQueue(0),
+	m_optimizationQueue(0),
+	m_flowFields(0),
+	m_maxFlowFields(0),
+	m_maxFlowFieldPolys(0),
+	m_agentFlowField(0),
 	m_pathResult(0),
 	m_maxPathResult(0),
 	m_maxAgentRadius(0),
 	m_velocitySampleCount(0),
 	m_navquery(0)
 {
+	memset(&m_agentArrays, 0, sizeof(m_agentArrays));
+	memset(&m_collisionParams, 0, sizeof(m_collisionParams));
+	memset(&m_lodParams, 0, sizeof(m_lodParams));
+	memset(&m_budgetParams, 0, sizeof(m_budgetParams));
+	memset(&m_budgetStats, 0, sizeof(m_budgetStats));
 }
 
 dtCrowd::~dtCrowd()
@@ -356,9 +541,19 @@ void dtCrowd::purge()
 	m_agents = 0;
 	m_maxAgents = 0;
 	
+	dtFree(m_agentArrayData);
+	m_agentArrayData = 0;
+	memset(&m_agentArrays, 0, sizeof(m_agentArrays));
+
 	dtFree(m_activeAgents);
 	m_activeAgents = 0;
 
+	dtFree(m_agentEdited);
+	m_agentEdited = 0;
+	dtFree(m_editedAgents);
+	m_editedAgents = 0;
+	m_nedited = 0;
+
 	dtFree(m_agentAnims);
 	m_agentAnims = 0;
 	
@@ -368,6 +563,36 @@ void dtCrowd::purge()
 	dtFreeProximityGrid(m_grid);
 	m_grid = 0;
 
+	dtFree(m_neighbourQueryIds);
+	m_neighbourQueryIds = 0;
+	dtFree(m_cornerVerts);
+	m_cornerVerts = 0;
+	dtFree(m_cornerFlags);
+	m_cornerFlags = 0;
+	dtFree(m_cornerPolys);
+	m_cornerPolys = 0;
+	m_maxNeighbours = 0;
+	m_maxCorners = 0;
+	m_maxNeighbourQuery = 0;
+
+	dtFree(m_collision);
+	m_collision = 0;
+	m_collisionIterationCount = 0;
+
+	dtFree(m_pathRequestQueue);
+	m_pathRequestQueue = 0;
+	dtFree(m_optimizationQueue);
+	m_optimizationQueue = 0;
+
+	for (int i = 0; i < m_maxFlowFields; ++i)
+		dtFreeFlowField(m_flowFields[i].field);
+	dtFree(m_flowFields);
+	m_flowFields = 0;
+	m_maxFlowFields = 0;
+	m_maxFlowFieldPolys = 0;
+	dtFree(m_agentFlowField);
+	m_agentFlowField = 0;
+
 	dtFreeObstacleAvoidanceQuery(m_obstacleQuery);
 	m_obstacleQuery = 0;
 	
@@ -379,11 +604,35 @@ void dtCrowd::purge()
 ///
 /// May be called more than once to purge and re-initialize the crowd.
 bool dtCrowd::init(const int maxAgents, const float maxAgentRadius, dtNavMesh* nav)
+{
+	dtCrowdParams params;
+	dtInitCrowdParams(&params, maxAgents, maxAgentRadius);
+	return init(&params, nav);
+}
+
+/// @par
+///
+/// May be called more than once to purge and re-initialize the crowd.
+/// The neighbour and corner buffers of all agents are allocated from pools sized by the params.
+/// The shared flow fields are allocated when they are first used.
+bool dtCrowd::init(const dtCrowdParams* params, dtNavMesh* nav)
 {
 	purge();
-	
+
+	// The proximity grid stores agent indices as 16 bit ids.
+	if (params->maxAgents < 1 || params->maxAgents > 0xffff || params->maxNeighbours < 1 ||
+		params->maxCorners < 2 || params->maxNeighbourQuery < params->maxNeighbours ||
+		params->maxFlowFields < 0 || params->maxFlowFieldPolys < 1 || params->maxFlowFieldPolys > 0xffff ||
+		params->maxPathRequests < 1)
+		return false;
+
+	const int maxAgents = params->maxAgents;
+	const float maxAgentRadius = params->maxAgentRadius;
 	m_maxAgents = maxAgents;
 	m_maxAgentRadius = maxAgentRadius;
+	m_maxNeighbours = params->maxNeighbours;
+	m_maxCorners = params->maxCorners;
+	m_maxNeighbourQuery = params->maxNeighbourQuery;
 
 	// Larger than agent radius because it is also used for agent recovery.
 	dtVset(m_agentPlacementHalfExtents, m_maxAgentRadius*2.0f, m_maxAgentRadius*1.5f, m_maxAgentRadius*2.0f);
@@ -394,10 +643,24 @@ bool dtCrowd::init(const int maxAgents, const float maxAgentRadius, dtNavMesh* n
 	if (!m_grid->init(m_maxAgents*4, maxAgentRadius*3))
 		return false;
 	
+	m_collision = allocCollisionData(m_maxAgents, m_maxNeighbours);
+	if (!m_collision)
+		return false;
+	m_collisionParams.iterations = 4;
+	m_collisionParams.maxIterations = 4;
+	m_collisionParams.overlapTolerance = 0.05f;
+
+	m_lodParams.reducedDistance = 20.0f;
+	m_lodParams.corridorDistance = 50.0f;
+	m_lodParams.sleepDistance = FLT_MAX;
+	m_lodParams.interval = 4;
+	m_nlodObservers = 0;
+	m_lodFrame = 0;
+
 	m_obstacleQuery = dtAllocObstacleAvoidanceQuery();
 	if (!m_obstacleQuery)
 		return false;
-	if (!m_obstacleQuery->init(6, 8))
+	if (!m_obstacleQuery->init(m_maxNeighbours, 8))
 		return false;
 
 	// Init obstacle query params.
@@ -423,26 +686,112 @@ bool dtCrowd::init(const int maxAgents, const float maxAgentRadius, dtNavMesh* n
 	if (!m_pathResult)
 		return false;
 	
-	if (!m_pathq.init(m_maxPathResult, MAX_PATHQUEUE_NODES, nav))
+	if (!m_pathq.init(m_maxPathResult, MAX_PATHQUEUE_NODES, nav, params->maxPathRequests))
+		return false;
+	// The corridors take their paths from a shared pool, sized to the path of each agent.
+	if (!m_pathPool.init(m_maxPathResult))
+		return false;
+	m_pathRequestQueue = (dtCrowdAgent**)dtAlloc(sizeof(dtCrowdAgent*)*params->maxPathRequests, DT_ALLOC_PERM);
+	if (!m_pathRequestQueue)
 		return false;
+
+	m_budgetParams.pathIterations = 100;
+	m_budgetParams.optimizations = 1;
+	m_budgetParams.pathTime = 0;
+	m_budgetParams.optimizationTime = 0;
+	m_budgetParams.clock = 0;
+	memset(&m_budgetStats, 0, sizeof(m_budgetStats));
+	m_pathIterationDebt = 0;
 	
 	m_agents = (dtCrowdAgent*)dtAlloc(sizeof(dtCrowdAgent)*m_maxAgents, DT_ALLOC_PERM);
 	if (!m_agents)
 		return false;
 	
-	m_activeAgents = (dtCrowdAgent**)dtAlloc(sizeof(dtCrowdAgent*)*m_maxAgents, DT_ALLOC_PERM);
+	// The agent arrays share one allocation, each array starting on a 16 byte boundary.
+	const int byteArraySize = alignArraySize((int)sizeof(unsigned char)*m_maxAgents);
+	const int floatArraySize = alignArraySize((int)sizeof(float)*m_maxAgents);
+	const int vecArraySize = alignArraySize((int)sizeof(float)*3*m_maxAgents);
+	const int neisArraySize = alignArraySize((int)sizeof(dtCrowdNeighbour)*m_maxNeighbours*m_maxAgents);
+	const int arrayDataSize = byteArraySize*4 + vecArraySize*5 + floatArraySize*5 + alignArraySize((int)sizeof(int)*m_maxAgents) + neisArraySize;
+	m_agentArrayData = dtAlloc(arrayDataSize, DT_ALLOC_PERM);
+	if (!m_agentArrayData)
+		return false;
+	memset(m_agentArrayData, 0, arrayDataSize);
+	unsigned char* data = (unsigned char*)m_agentArrayData;
+	m_agentArrays.active = data; data += byteArraySize;
+	m_agentArrays.state = data; data += byteArraySize;
+	m_agentArrays.updateFlags = data; data += byteArraySize;
+	m_agentArrays.lod = data; data += byteArraySize;
+	m_agentArrays.npos = (float*)data; data += vecArraySize;
+	m_agentArrays.disp = (float*)data; data += vecArraySize;
+	m_agentArrays.dvel = (float*)data; data += vecArraySize;
+	m_agentArrays.nvel = (float*)data; data += vecArraySize;
+	m_agentArrays.vel = (float*)data; data += vecArraySize;
+	m_agentArrays.radius = (float*)data; data += floatArraySize;
+	m_agentArrays.height = (float*)data; data += floatArraySize;
+	m_agentArrays.maxAcceleration = (float*)data; data += floatArraySize;
+	m_agentArrays.collisionQueryRange = (float*)data; data += floatArraySize;
+	m_agentArrays.desiredSpeed = (float*)data; data += floatArraySize;
+	m_agentArrays.nneis = (int*)data; data += alignArraySize((int)sizeof(int)*m_maxAgents);
+	m_agentArrays.neis = (dtCrowdNeighbour*)data;
+
+	m_activeAgents = (int*)dtAlloc(sizeof(int)*m_maxAgents, DT_ALLOC_PERM);
 	if (!m_activeAgents)
 		return false;
 
+	m_neighbourQueryIds = (unsigned short*)dtAlloc(sizeof(unsigned short)*m_maxNeighbourQuery, DT_ALLOC_PERM);
+	if (!m_neighbourQueryIds)
+		return false;
+
+	m_cornerVerts = (float*)dtAlloc(sizeof(float)*3*m_maxCorners*m_maxAgents, DT_ALLOC_PERM);
+	if (!m_cornerVerts)
+		return false;
+	m_cornerFlags = (unsigned char*)dtAlloc(sizeof(unsigned char)*m_maxCorners*m_maxAgents, DT_ALLOC_PERM);
+	if (!m_cornerFlags)
+		return false;
+	m_cornerPolys = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*m_maxCorners*m_maxAgents, DT_ALLOC_PERM);
+	if (!m_cornerPolys)
+		return false;
+
+	m_agentEdited = (unsigned char*)dtAlloc(sizeof(unsigned char)*m_maxAgents, DT_ALLOC_PERM);
+	if (!m_agentEdited)
+		return false;
+	memset(m_agentEdited, 0, sizeof(unsigned char)*m_maxAgents);
+	m_editedAgents = (int*)dtAlloc(sizeof(int)*m_maxAgents, DT_ALLOC_PERM);
+	if (!m_editedAgents)
+		return false;
+
 	m_agentAnims = (dtCrowdAgentAnimation*)dtAlloc(sizeof(dtCrowdAgentAnimation)*m_maxAgents, DT_ALLOC_PERM);
 	if (!m_agentAnims)
 		return false;
+
+	m_optimizationQueue = (dtCrowdAgent**)dtAlloc(sizeof(dtCrowdAgent*)*m_maxAgents, DT_ALLOC_PERM);
+	if (!m_optimizationQueue)
+		return false;
+
+	if (params->maxFlowFields > 0)
+	{
+		m_flowFields = (dtCrowdFlowFieldSlot*)dtAlloc(sizeof(dtCrowdFlowFieldSlot)*params->maxFlowFields, DT_ALLOC_PERM);
+		if (!m_flowFields)
+			return false;
+		memset(m_flowFields, 0, sizeof(dtCrowdFlowFieldSlot)*params->maxFlowFields);
+		m_maxFlowFields = params->maxFlowFields;
+	}
+	m_maxFlowFieldPolys = params->maxFlowFieldPolys;
+	m_agentFlowField = (int*)dtAlloc(sizeof(int)*m_maxAgents, DT_ALLOC_PERM);
+	if (!m_agentFlowField)
+		return false;
+	memset(m_agentFlowField, 0xff, sizeof(int)*m_maxAgents);
 	
 	for (int i = 0; i < m_maxAgents; ++i)
 	{
 		new(&m_agents[i]) dtCrowdAgent();
 		m_agents[i].active = false;
-		if (!m_agents[i].corridor.init(m_maxPathResult))
+		m_agents[i].neis = &m_agentArrays.neis[i*m_maxNeighbours];
+		m_agents[i].cornerVerts = &m_cornerVerts[i*m_maxCorners*3];
+		m_agents[i].cornerFlags = &m_cornerFlags[i*m_maxCorners];
+		m_agents[i].cornerPolys = &m_cornerPolys[i*m_maxCorners];
+		if (!m_agents[i].corridor.init(&m_pathPool))
 			return false;
 	}
 
@@ -474,6 +823,53 @@ const dtObstacleAvoidanceParams* dtCrowd::getObstacleAvoidanceParams(const int i
 	return 0;
 }
 
+void dtCrowd::setCollisionParams(const dtCrowdCollisionParams* params)
+{
+	m_collisionParams.iterations = dtMax(params->iterations, 0);
+	m_collisionParams.maxIterations = dtMax(params->maxIterations, m_collisionParams.iterations);
+	m_collisionParams.overlapTolerance = dtMax(params->overlapTolerance, 0.0f);
+}
+
+void dtCrowd::setBudgetParams(const dtCrowdBudgetParams* params)
+{
+	m_budgetParams.pathIterations = dtMax(params->pathIterations, 1);
+	m_budgetParams.optimizations = dtMax(params->optimizations, 0);
+	m_budgetParams.pathTime = dtMax(params->pathTime, 0.0f);
+	m_budgetParams.optimizationTime = dtMax(params->optimizationTime, 0.0f);
+	m_budgetParams.clock = params->clock;
+}
+
+void dtCrowd::setLodParams(const dtCrowdLodParams* params)
+{
+	m_lodParams.reducedDistance = dtMax(params->reducedDistance, 0.0f);
+	m_lodParams.corridorDistance = dtMax(params->corridorDistance, m_lodParams.reducedDistance);
+	m_lodParams.sleepDistance = dtMax(params->sleepDistance, m_lodParams.corridorDistance);
+	m_lodParams.interval = dtMax(params->interval, 1);
+}
+
+bool dtCrowd::setLodObservers(const float* pos, const int count)
+{
+	if (count < 0 || count > DT_CROWD_MAX_LOD_OBSERVERS)
+		return false;
+	if (count > 0)
+		memcpy(m_lodObservers, pos, sizeof(float)*3*count);
+	m_nlodObservers = count;
+	return true;
+}
+
+void dtCrowd::setAgentLod(const int idx, const unsigned char lod)
+{
+	if (idx >= 0 && idx < m_maxAgents && lod <= DT_CROWDAGENT_LOD_SLEEPING)
+		m_agentArrays.lod[idx] = lod;
+}
+
+const dtFlowField* dtCrowd::getFlowField(const int i) const
+{
+	if (i >= 0 && i < m_maxFlowFields && m_flowFields[i].agentCount > 0)
+		return m_flowFields[i].field;
+	return 0;
+}
+
 int dtCrowd::getAgentCount() const
 {
 	return m_maxAgents;
@@ -486,6 +882,7 @@ const dtCrowdAgent* dtCrowd::getAgent(const int idx)
 {
 	if (idx < 0 || idx >= m_maxAgents)
 		return 0;
+	refreshAgentView(idx);
 	return &m_agents[idx];
 }
 
@@ -495,6 +892,12 @@ dtCrowdAgent* dtCrowd::getEditableAgent(const int idx)
 {
 	if (idx < 0 || idx >= m_maxAgents)
 		return 0;
+	refreshAgentView(idx);
+	if (!m_agentEdited[idx])
+	{
+		m_agentEdited[idx] = 1;
+		m_editedAgents[m_nedited++] = idx;
+	}
 	return &m_agents[idx];
 }
 
@@ -502,7 +905,58 @@ void dtCrowd::updateAgentParameters(const int idx, const dtCrowdAgentParams* par
 {
 	if (idx < 0 || idx >= m_maxAgents)
 		return;
+	pullEditedAgents();
 	memcpy(&m_agents[idx].params, params, sizeof(dtCrowdAgentParams));
+	setAgentArrayParams(idx, params);
+}
+
+void dtCrowd::setAgentArrayParams(const int idx, const dtCrowdAgentParams* params)
+{
+	m_agentArrays.updateFlags[idx] = params->updateFlags;
+	m_agentArrays.radius[idx] = params->radius;
+	m_agentArrays.height[idx] = params->height;
+	m_agentArrays.maxAcceleration[idx] = params->maxAcceleration;
+	m_agentArrays.collisionQueryRange[idx] = params->collisionQueryRange;
+}
+
+/// Copies the agents changed through #getEditableAgent into the agent arrays.
+void dtCrowd::pullEditedAgents()
+{
+	for (int i = 0; i < m_nedited; ++i)
+	{
+		const int idx = m_editedAgents[i];
+		const dtCrowdAgent* ag = &m_agents[idx];
+		m_agentArrays.active[idx] = ag->active ? 1 : 0;
+		m_agentArrays.state[idx] = ag->state;
+		dtVcopy(&m_agentArrays.npos[idx*3], ag->npos);
+		dtVcopy(&m_agentArrays.disp[idx*3], ag->disp);
+		dtVcopy(&m_agentArrays.dvel[idx*3], ag->dvel);
+		dtVcopy(&m_agentArrays.nvel[idx*3], ag->nvel);
+		dtVcopy(&m_agentArrays.vel[idx*3], ag->vel);
+		m_agentArrays.desiredSpeed[idx] = ag->desiredSpeed;
+		m_agentArrays.nneis[idx] = ag->nneis;
+		setAgentArrayParams(idx, &ag->params);
+		m_agentEdited[idx] = 0;
+	}
+	m_nedited = 0;
+}
+
+/// Copies the state of an agent from the agent arrays into its view.
+void dtCrowd::refreshAgentView(const int idx)
+{
+	// An edited view is newer than the arrays until the next update.
+	if (m_agentEdited[idx])
+		return;
+	dtCrowdAgent* ag = &m_agents[idx];
+	ag->active = m_agentArrays.active[idx] != 0;
+	ag->state = m_agentArrays.state[idx];
+	dtVcopy(ag->npos, &m_agentArrays.npos[idx*3]);
+	dtVcopy(ag->disp, &m_agentArrays.disp[idx*3]);
+	dtVcopy(ag->dvel, &m_agentArrays.dvel[idx*3]);
+	dtVcopy(ag->nvel, &m_agentArrays.nvel[idx*3]);
+	dtVcopy(ag->vel, &m_agentArrays.vel[idx*3]);
+	ag->desiredSpeed = m_agentArrays.desiredSpeed[idx];
+	ag->nneis = m_agentArrays.nneis[idx];
 }
 
 /// @par
@@ -510,11 +964,13 @@ void dtCrowd::updateAgentParameters(const int idx, const dtCrowdAgentParams* par
 /// The agent's position will be constrained to the surface of the navigation mesh.
 int dtCrowd::addAgent(const float* pos, const dtCrowdAgentParams* params)
 {
+	pullEditedAgents();
+
 	// Find empty slot.
 	int idx = -1;
 	for (int i = 0; i < m_maxAgents; ++i)
 	{
-		if (!m_agents[i].active)
+		if (!m_agentArrays.active[i])
 		{
 			idx = i;
 			break;
@@ -544,23 +1000,26 @@ int dtCrowd::addAgent(const float* pos, const dtCrowdAgentParams* params)
 
 	ag->topologyOptTime = 0;
 	ag->targetReplanTime = 0;
-	ag->nneis = 0;
+	m_agentArrays.nneis[idx] = 0;
 	
-	dtVset(ag->dvel, 0,0,0);
-	dtVset(ag->nvel, 0,0,0);
-	dtVset(ag->vel, 0,0,0);
-	dtVcopy(ag->npos, nearest);
+	dtVset(&m_agentArrays.disp[idx*3], 0,0,0);
+	dtVset(&m_agentArrays.dvel[idx*3], 0,0,0);
+	dtVset(&m_agentArrays.nvel[idx*3], 0,0,0);
+	dtVset(&m_agentArrays.vel[idx*3], 0,0,0);
+	dtVcopy(&m_agentArrays.npos[idx*3], nearest);
 	
-	ag->desiredSpeed = 0;
+	m_agentArrays.desiredSpeed[idx] = 0;
+	m_agentArrays.lod[idx] = DT_CROWDAGENT_LOD_FULL;
 
 	if (ref)
-		ag->state = DT_CROWDAGENT_STATE_WALKING;
+		m_agentArrays.state[idx] = DT_CROWDAGENT_STATE_WALKING;
 	else
-		ag->state = DT_CROWDAGENT_STATE_INVALID;
+		m_agentArrays.state[idx] = DT_CROWDAGENT_STATE_INVALID;
 	
 	ag->targetState = DT_CROWDAGENT_TARGET_NONE;
 	
-	ag->active = true;
+	m_agentArrays.active[idx] = 1;
+	refreshAgentView(idx);
 
 	return idx;
 }
@@ -573,6 +1032,9 @@ void dtCrowd::removeAgent(const int idx)
 {
 	if (idx >= 0 && idx < m_maxAgents)
 	{
+		pullEditedAgents();
+		releaseFlowField(idx);
+		m_agentArrays.active[idx] = 0;
 		m_agents[idx].active = false;
 	}
 }
@@ -611,6 +1073,7 @@ bool dtCrowd::requestMoveTarget(const int idx, dtPolyRef ref, const float* pos)
 	if (!ref)
 		return false;
 
+	releaseFlowField(idx);
 	dtCrowdAgent* ag = &m_agents[idx];
 	
 	// Initialize request.
@@ -626,11 +1089,86 @@ bool dtCrowd::requestMoveTarget(const int idx, dtPolyRef ref, const float* pos)
 	return true;
 }
 
+/// @par
+///
+/// The agents requesting the same target polygon and position with the same query filter share a flow field,
+/// built once from the target over up to #dtCrowdParams::maxFlowFieldPolys polygons. Their paths are read from
+/// the field instead of being searched, and they do not use the path queue.
+///
+/// The field is built within the path search iterations of #dtCrowdBudgetParams, so the agents may wait a few
+/// updates for their paths. It is rebuilt, and its agents replan, when the tiles under or next to it change.
+///
+/// The request falls back to #requestMoveTarget() when all flow fields are in use by other targets, and agents
+/// outside the field find their paths as with #requestMoveTarget().
+///
+/// The request will be processed during the next #update().
+bool dtCrowd::requestMoveTargetShared(const int idx, dtPolyRef ref, const float* pos)
+{
+	if (!requestMoveTarget(idx, ref, pos))
+		return false;
+
+	const int filterType = m_agents[idx].params.queryFilterType;
+	int slotIdx = -1;
+	int freeIdx = -1;
+	for (int i = 0; i < m_maxFlowFields; ++i)
+	{
+		const dtCrowdFlowFieldSlot& slot = m_flowFields[i];
+		if (slot.agentCount == 0)
+		{
+			if (freeIdx == -1)
+				freeIdx = i;
+		}
+		else if (slot.ref == ref && slot.filterType == filterType && dtVequal(slot.pos, pos))
+		{
+			slotIdx = i;
+			break;
+		}
+	}
+
+	if (slotIdx == -1)
+	{
+		if (freeIdx == -1)
+			return true;
+
+		dtCrowdFlowFieldSlot& slot = m_flowFields[freeIdx];
+		if (!slot.field)
+		{
+			slot.field = dtAllocFlowField();
+			if (!slot.field || !slot.field->init(m_maxFlowFieldPolys, m_navquery->getAttachedNavMesh()))
+			{
+				dtFreeFlowField(slot.field);
+				slot.field = 0;
+				return true;
+			}
+		}
+		slot.ref = ref;
+		dtVcopy(slot.pos, pos);
+		slot.filterType = filterType;
+		slot.dirty = true;
+		slotIdx = freeIdx;
+	}
+
+	m_flowFields[slotIdx].agentCount++;
+	m_agentFlowField[idx] = slotIdx;
+
+	return true;
+}
+
+void dtCrowd::releaseFlowField(const int idx)
+{
+	const int slotIdx = m_agentFlowField[idx];
+	if (slotIdx == -1)
+		return;
+	m_flowFields[slotIdx].agentCount--;
+	m_agentFlowField[idx] = -1;
+}
+
 bool dtCrowd::requestMoveVelocity(const int idx, const float* vel)
 {
 	if (idx < 0 || idx >= m_maxAgents)
 		return false;
 	
+	releaseFlowField(idx);
 	dtCrowdAgent* ag = &m_agents[idx];
 	
 	// Initialize request.
@@ -648,12 +1186,14 @@ bool dtCrowd::resetMoveTarget(const int idx)
 	if (idx < 0 || idx >= m_maxAgents)
 		return false;
 	
+	pullEditedAgents();
+	releaseFlowField(idx);
 	dtCrowdAgent* ag = &m_agents[idx];
 	
 	// Initialize request.
 	ag->targetRef = 0;
 	dtVset(ag->targetPos, 0,0,0);
-	dtVset(ag->dvel, 0,0,0);
+	dtVset(&m_agentArrays.dvel[idx*3], 0,0,0);
 	ag->targetPathqRef = DT_PATHQ_INVALID;
 	ag->targetReplan = false;
 	ag->targetState = DT_CROWDAGENT_TARGET_NONE;
@@ -666,31 +1206,112 @@ int dtCrowd::getActiveAgents(dtCrowdAgent** agents, const int maxAgents)
 	int n = 0;
 	for (int i = 0; i < m_maxAgents; ++i)
 	{
-		if (!m_agents[i].active) continue;
+		if (!m_agentArrays.active[i]) continue;
 		if (n < maxAgents)
+		{
+			refreshAgentView(i);
 			agents[n++] = &m_agents[i];
+		}
 	}
 	return n;
 }
 
+int dtCrowd::collectActiveAgents(int* agents) const
+{
+	int n = 0;
+	for (int i = 0; i < m_maxAgents; ++i)
+	{
+		if (m_agentArrays.active[i])
+			agents[n++] = i;
+	}
+	return n;
+}
+
+
+/// Sets the corridor of an agent to the path read from its shared flow field, which must be built.
+/// Releases the field and returns false if the agent is not in the field.
+bool dtCrowd::setCorridorFromFlowField(const int idx)
+{
+	dtCrowdAgent* ag = &m_agents[idx];
+	const dtCrowdFlowFieldSlot& slot = m_flowFields[m_agentFlowField[idx]];
+	dtAssert(!slot.dirty);
+
+	const int npath = slot.field->getPath(ag->corridor.getFirstPoly(), m_pathResult, m_maxPathResult);
+	if (!npath)
+	{
+		releaseFlowField(idx);
+		return false;
+	}
+
+	float targetPos[3];
+	if (m_pathResult[npath-1] == ag->targetRef)
+	{
+		dtVcopy(targetPos, ag->targetPos);
+	}
+	else if (dtStatusFailed(m_navquery->closestPointOnPoly(m_pathResult[npath-1], ag->targetPos, targetPos, 0)))
+	{
+		releaseFlowField(idx);
+		return false;
+	}
+
+	ag->corridor.setCorridor(targetPos, m_pathResult, npath);
+	ag->boundary.reset();
+	ag->partial = false;
+	ag->targetState = DT_CROWDAGENT_TARGET_VALID;
+	ag->targetReplanTime = 0.0;
+	return true;
+}
 
 void dtCrowd::updateMoveRequest(const float /*dt*/)
 {
-	const int PATH_MAX_AGENTS = 8;
-	dtCrowdAgent* queue[PATH_MAX_AGENTS];
+	// Only the oldest waiting agents get the free path requests.
+	const int maxQueue = m_pathq.getMaxRequests() - m_pathq.getRequestCount();
+	dtCrowdAgent** queue = m_pathRequestQueue;
 	int nqueue = 0;
+	int nwaiting = 0;
+
+	// Flow field builds count the polygons they visit as path search iterations. A build may start while iterations
+	// are left, and the iterations it takes beyond those are taken from the next updates.
+	dtClock* clock = m_budgetParams.clock;
+	const int maxIters = getBudget(m_budgetParams.pathIterations, m_budgetParams.pathTime, m_budgetStats.pathIterationCost,
+								   clock, MAX_PATH_ITERS_PER_UPDATE);
+	int itersLeft = maxIters - m_pathIterationDebt;
+	int buildIters = 0;
+	double buildTime = 0.0;
 	
 	// Fire off new requests.
 	for (int i = 0; i < m_maxAgents; ++i)
 	{
 		dtCrowdAgent* ag = &m_agents[i];
-		if (!ag->active)
+		if (!m_agentArrays.active[i])
 			continue;
-		if (ag->state == DT_CROWDAGENT_STATE_INVALID)
+		if (m_agentArrays.state[i] == DT_CROWDAGENT_STATE_INVALID)
 			continue;
 		if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
 			continue;
 
+		// Paths shorter than the whole route to the target are extended when their end is near.
+		if (ag->targetState == DT_CROWDAGENT_TARGET_REQUESTING && m_agentFlowField[i] != -1)
+		{
+			dtCrowdFlowFieldSlot& slot = m_flowFields[m_agentFlowField[i]];
+			if (slot.dirty)
+			{
+				// Keep requesting until there are iterations left for the build.
+				if (itersLeft <= 0)
+					continue;
+				const double buildStart = clock ? clock->getTime() : 0.0;
+				slot.field->build(slot.ref, slot.pos, &m_filters[slot.filterType]);
+				if (clock)
+					buildTime += clock->getTime() - buildStart;
+				const int iters = dtMax(slot.field->getPolyCount(), 1);
+				itersLeft -= iters;
+				buildIters += iters;
+				slot.dirty = false;
+			}
+			if (setCorridorFromFlowField(i))
+				continue;
+		}
+
 		if (ag->targetState == DT_CROWDAGENT_TARGET_REQUESTING)
 		{
 			const dtPolyRef* path = ag->corridor.getPath();
@@ -704,7 +1325,7 @@ void dtCrowd::updateMoveRequest(const float /*dt*/)
 
 			// Quick search towards the goal.
 			static const int MAX_ITER = 20;
-			m_navquery->initSlicedFindPath(path[0], ag->targetRef, ag->npos, ag->targetPos, &m_filters[ag->params.queryFilterType]);
+			m_navquery->initSlicedFindPath(path[0], ag->targetRef, &m_agentArrays.npos[i*3], ag->targetPos, &m_filters[ag->params.queryFilterType]);
 			m_navquery->updateSlicedFindPath(MAX_ITER, 0);
 			dtStatus status = 0;
 			if (ag->targetReplan) // && npath > 10)
@@ -741,7 +1362,7 @@ void dtCrowd::updateMoveRequest(const float /*dt*/)
 			if (!reqPathCount)
 			{
 				// Could not find path, start the request from current location.
-				dtVcopy(reqPos, ag->npos);
+				dtVcopy(reqPos, &m_agentArrays.npos[i*3]);
 				reqPath[0] = path[0];
 				reqPathCount = 1;
 			}
@@ -764,7 +1385,9 @@ void dtCrowd::updateMoveRequest(const float /*dt*/)
 		
 		if (ag->targetState == DT_CROWDAGENT_TARGET_WAITING_FOR_QUEUE)
 		{
-			nqueue = addToPathQueue(ag, queue, nqueue, PATH_MAX_AGENTS);
+			nwaiting++;
+			if (maxQueue > 0)
+				nqueue = addToPathQueue(ag, queue, nqueue, maxQueue);
 		}
 	}
 
@@ -774,12 +1397,27 @@ void dtCrowd::updateMoveRequest(const float /*dt*/)
 		ag->targetPathqRef = m_pathq.request(ag->corridor.getLastPoly(), ag->targetRef,
 											 ag->corridor.getTarget(), ag->targetPos, &m_filters[ag->params.queryFilterType]);
 		if (ag->targetPathqRef != DT_PATHQ_INVALID)
+		{
 			ag->targetState = DT_CROWDAGENT_TARGET_WAITING_FOR_PATH;
+			nwaiting--;
+		}
 	}
 
 	
-	// Update requests.
-	m_pathq.update(MAX_ITERS_PER_UPDATE);
+	// Update requests, within the iterations expected to fit the time budget.
+	const double start = clock ? clock->getTime() : 0.0;
+	const int iters = m_pathq.update(dtMax(itersLeft, 0)) + buildIters;
+	m_pathIterationDebt = dtMax(-itersLeft, 0);
+	if (clock)
+	{
+		const double time = clock->getTime() - start + buildTime;
+		updateCost(m_budgetStats.pathIterationCost, time, iters);
+		m_budgetStats.pathTime = (float)time;
+	}
+	m_budgetStats.pathIterations = iters;
+	m_budgetStats.pathIterationBudget = maxIters;
+	m_budgetStats.pathRequestsWaiting = nwaiting;
+	int nsearching = 0;
 
 	dtStatus status;
 
@@ -787,7 +1425,7 @@ void dtCrowd::updateMoveRequest(const float /*dt*/)
 	for (int i = 0; i < m_maxAgents; ++i)
 	{
 		dtCrowdAgent* ag = &m_agents[i];
-		if (!ag->active)
+		if (!m_agentArrays.active[i])
 			continue;
 		if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
 			continue;
@@ -899,25 +1537,36 @@ void dtCrowd::updateMoveRequest(const float /*dt*/)
 				ag->targetReplanTime = 0.0;
 			}
 		}
+		
+		if (ag->targetState == DT_CROWDAGENT_TARGET_WAITING_FOR_PATH)
+			nsearching++;
 	}
 	
+	m_budgetStats.pathRequestsSearching = nsearching;
 }
 
 
-void dtCrowd::updateTopologyOptimization(dtCrowdAgent** agents, const int nagents, const float dt)
+void dtCrowd::updateTopologyOptimization(const int* agents, const int nagents, const float dt)
 {
+	const float OPT_TIME_THR = 0.5f; // seconds
+	dtClock* clock = m_budgetParams.clock;
+	const int maxQueue = getBudget(m_budgetParams.optimizations, m_budgetParams.optimizationTime, m_budgetStats.optimizationCost,
+								   clock, m_maxAgents);
+	m_budgetStats.optimizationBudget = maxQueue;
+	m_budgetStats.optimizations = 0;
+	m_budgetStats.optimizationsWaiting = 0;
+	m_budgetStats.optimizationTime = 0;
 	if (!nagents)
 		return;
 	
-	const float OPT_TIME_THR = 0.5f; // seconds
-	const int OPT_MAX_AGENTS = 1;
-	dtCrowdAgent* queue[OPT_MAX_AGENTS];
+	dtCrowdAgent** queue = m_optimizationQueue;
 	int nqueue = 0;
+	int ndue = 0;
 	
 	for (int i = 0; i < nagents; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
-		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+		dtCrowdAgent* ag = &m_agents[agents[i]];
+		if (m_agentArrays.state[agents[i]] != DT_CROWDAGENT_STATE_WALKING || m_agentArrays.lod[agents[i]] == DT_CROWDAGENT_LOD_SLEEPING)
 			continue;
 		if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
 			continue;
@@ -925,28 +1574,78 @@ void dtCrowd::updateTopologyOptimization(dtCrowdAgent** agents, const int nagent
 			continue;
 		ag->topologyOptTime += dt;
 		if (ag->topologyOptTime >= OPT_TIME_THR)
-			nqueue = addToOptQueue(ag, queue, nqueue, OPT_MAX_AGENTS);
+		{
+			ndue++;
+			if (maxQueue > 0)
+				nqueue = addToOptQueue(ag, queue, nqueue, maxQueue);
+		}
 	}
 
+	const double start = clock && nqueue ? clock->getTime() : 0.0;
 	for (int i = 0; i < nqueue; ++i)
 	{
 		dtCrowdAgent* ag = queue[i];
 		ag->corridor.optimizePathTopology(m_navquery, &m_filters[ag->params.queryFilterType]);
 		ag->topologyOptTime = 0;
 	}
+	if (clock && nqueue)
+	{
+		const double time = clock->getTime() - start;
+		updateCost(m_budgetStats.optimizationCost, time, nqueue);
+		m_budgetStats.optimizationTime = (float)time;
+	}
 
+	m_budgetStats.optimizations = nqueue;
+	m_budgetStats.optimizationsWaiting = ndue - nqueue;
 }
 
-void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const float dt)
+void dtCrowd::updateLod(const int* agents, const int nagents)
+{
+	if (!m_nlodObservers)
+		return;
+
+	const float reducedSqr = dtSqr(m_lodParams.reducedDistance);
+	const float corridorSqr = dtSqr(m_lodParams.corridorDistance);
+	const float sleepSqr = dtSqr(m_lodParams.sleepDistance);
+	for (int i = 0; i < nagents; ++i)
+	{
+		const int idx = agents[i];
+		const float* npos = &m_agentArrays.npos[idx*3];
+		float distSqr = FLT_MAX;
+		for (int j = 0; j < m_nlodObservers; ++j)
+			distSqr = dtMin(distSqr, dtVdist2DSqr(npos, &m_lodObservers[j*3]));
+
+		unsigned char lod = DT_CROWDAGENT_LOD_FULL;
+		if (distSqr > sleepSqr)
+			lod = DT_CROWDAGENT_LOD_SLEEPING;
+		else if (distSqr > corridorSqr)
+			lod = DT_CROWDAGENT_LOD_CORRIDOR;
+		else if (distSqr > reducedSqr)
+			lod = DT_CROWDAGENT_LOD_REDUCED;
+		m_agentArrays.lod[idx] = lod;
+	}
+}
+
+void dtCrowd::checkPathValidity(const int* agents, const int nagents, const float dt)
 {
 	static const int CHECK_LOOKAHEAD = 10;
 	static const float TARGET_REPLAN_DELAY = 1.0; // seconds
+
+	// Flow fields whose tiles changed are rebuilt, and their agents replan below.
+	for (int i = 0; i < m_maxFlowFields; ++i)
+	{
+		dtCrowdFlowFieldSlot& slot = m_flowFields[i];
+		if (slot.agentCount && !slot.dirty && !slot.field->isValid())
+			slot.dirty = true;
+	}
 	
 	for (int i = 0; i < nagents; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
+		const int idx = agents[i];
+		dtCrowdAgent* ag = &m_agents[idx];
+		float* npos = &m_agentArrays.npos[idx*3];
 		
-		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+		if (m_agentArrays.state[idx] != DT_CROWDAGENT_STATE_WALKING || m_agentArrays.lod[idx] == DT_CROWDAGENT_LOD_SLEEPING)
 			continue;
 			
 		ag->targetReplanTime += dt;
@@ -954,10 +1653,9 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 		bool replan = false;
 
 		// First check that the current location is valid.
-		const int idx = getAgentIndex(ag);
 		float agentPos[3];
 		dtPolyRef agentRef = ag->corridor.getFirstPoly();
-		dtVcopy(agentPos, ag->npos);
+		dtVcopy(agentPos, npos);
 		if (!m_navquery->isValidPolyRef(agentRef, &m_filters[ag->params.queryFilterType]))
 		{
 			// Current location is not valid, try to reposition.
@@ -965,7 +1663,7 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 			float nearest[3];
 			dtVcopy(nearest, agentPos);
 			agentRef = 0;
-			m_navquery->findNearestPoly(ag->npos, m_agentPlacementHalfExtents, &m_filters[ag->params.queryFilterType], &agentRef, nearest);
+			m_navquery->findNearestPoly(npos, m_agentPlacementHalfExtents, &m_filters[ag->params.queryFilterType], &agentRef, nearest);
 			dtVcopy(agentPos, nearest);
 
 			if (!agentRef)
@@ -974,7 +1672,7 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 				ag->corridor.reset(0, agentPos);
 				ag->partial = false;
 				ag->boundary.reset();
-				ag->state = DT_CROWDAGENT_STATE_INVALID;
+				m_agentArrays.state[idx] = DT_CROWDAGENT_STATE_INVALID;
 				continue;
 			}
 
@@ -983,7 +1681,7 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 			ag->corridor.fixPathStart(agentRef, agentPos);
 //			ag->corridor.trimInvalidPath(agentRef, agentPos, m_navquery, &m_filter);
 			ag->boundary.reset();
-			dtVcopy(ag->npos, agentPos);
+			dtVcopy(npos, agentPos);
 
 			replan = true;
 		}
@@ -998,6 +1696,7 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 			if (!m_navquery->isValidPolyRef(ag->targetRef, &m_filters[ag->params.queryFilterType]))
 			{
 				// Current target is not valid, try to reposition.
+				releaseFlowField(idx);
 				float nearest[3];
 				dtVcopy(nearest, ag->targetPos);
 				ag->targetRef = 0;
@@ -1020,8 +1719,16 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 			// Fix current path.
 //			ag->corridor.trimInvalidPath(agentRef, agentPos, m_navquery, &m_filter);
 //			ag->boundary.reset();
+			// The shared flow field may lead through the same invalid polygons.
+			if (m_agentFlowField[idx] != -1)
+				m_flowFields[m_agentFlowField[idx]].dirty = true;
 			replan = true;
 		}
+
+		// Paths read from a flow field that is rebuilt may lead through polygons that no longer exist.
+		if (ag->targetState == DT_CROWDAGENT_TARGET_VALID && m_agentFlowField[idx] != -1 &&
+			m_flowFields[m_agentFlowField[idx]].dirty)
+			replan = true;
 		
 		// If the end of the path is near and it is not the requested location, replan.
 		if (ag->targetState == DT_CROWDAGENT_TARGET_VALID)
@@ -1043,14 +1750,176 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 	}
 }
 	
-void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
+/// @par
+///
+/// Overlapping walking agents are pushed apart by their neighbours found in the update. Each iteration computes the
+/// displacements of all agents before applying any of them, so the result does not depend on the order of the agents.
+/// The agents are sorted along a Morton curve of their proximity grid cells and gathered into compact arrays, and each
+/// neighbour slot is a loop over all agents reading the neighbours from nearby sorted positions.
+void dtCrowd::resolveCollisions(const int* agents, const int nagents)
+{
+	static const float COLLISION_RESOLVE_FACTOR = 0.7f;
+
+	const dtCrowdAgentArrays& arrays = m_agentArrays;
+	dtCrowdCollisionData& col = *m_collision;
+	const int maxNeighbours = m_maxNeighbours;
+	m_collisionIterationCount = 0;
+	if (!nagents)
+		return;
+
+	// Sort the agents by the Morton codes of their grid cells.
+	float minx = FLT_MAX, minz = FLT_MAX;
+	for (int i = 0; i < nagents; ++i)
+	{
+		const float* p = &arrays.npos[agents[i]*3];
+		minx = dtMin(minx, p[0]);
+		minz = dtMin(minz, p[2]);
+	}
+	const float ics = 1.0f / m_grid->getCellSize();
+	for (int i = 0; i < nagents; ++i)
+	{
+		const int idx = agents[i];
+		const float* p = &arrays.npos[idx*3];
+		const unsigned int cx = (unsigned int)dtMin((p[0] - minx) * ics, 65535.0f);
+		const unsigned int cz = (unsigned int)dtMin((p[2] - minz) * ics, 65535.0f);
+		col.keys[i] = spreadBits(cx) | (spreadBits(cz) << 1);
+		col.order[i] = idx;
+	}
+	const int* order = &col.order[radixSortByKey(col.keys, col.order, nagents)];
+
+	// Gather the agents in sorted order.
+	for (int i = 0; i < nagents; ++i)
+		col.sorted[order[i]] = i;
+	for (int i = 0; i < nagents; ++i)
+	{
+		const int idx = order[i];
+		col.x[i] = arrays.npos[idx*3+0];
+		col.z[i] = arrays.npos[idx*3+2];
+		col.radius[i] = arrays.radius[idx];
+		col.dvelx[i] = arrays.dvel[idx*3+0];
+		col.dvelz[i] = arrays.dvel[idx*3+2];
+		col.walking[i] = arrays.state[idx] == DT_CROWDAGENT_STATE_WALKING ? 1 : 0;
+
+		// Only the neighbours of walking agents are current.
+		const int nneis = col.walking[i] ? arrays.nneis[idx] : 0;
+		const dtCrowdNeighbour* neis = &arrays.neis[idx*m_maxNeighbours];
+		for (int j = 0; j < maxNeighbours; ++j)
+			col.neis[j*nagents+i] = j < nneis ? col.sorted[neis[j].idx] : i;
+	}
+
+	const int iterations = m_collisionParams.iterations;
+	const int maxIterations = m_collisionParams.maxIterations;
+	const float tolerance = m_collisionParams.overlapTolerance;
+	for (int iter = 0; iter < maxIterations; ++iter)
+	{
+		for (int i = 0; i < nagents; ++i)
+		{
+			col.dispx[i] = 0;
+			col.dispz[i] = 0;
+			col.weight[i] = 0;
+		}
+
+		bool overlapping = false;
+		for (int j = 0; j < maxNeighbours; ++j)
+		{
+			const int* neis = &col.neis[j*nagents];
+			for (int i = 0; i < nagents; ++i)
+			{
+				const int k = neis[i];
+				const float diffx = col.x[i] - col.x[k];
+				const float diffz = col.z[i] - col.z[k];
+				const float radii = col.radius[i] + col.radius[k];
+				const float distSqr = diffx*diffx + diffz*diffz;
+				if (k == i || distSqr > dtSqr(radii))
+					continue;
+				const float dist = dtMathSqrtf(distSqr);
+				const float pen = radii - dist;
+				overlapping |= pen > radii*tolerance;
+
+				float dx = diffx;
+				float dz = diffz;
+				float scale;
+				if (dist < 0.0001f)
+				{
+					// Agents on top of each other, try to choose diverging separation directions.
+					const bool first = order[i] > order[k];
+					dx = first ? -col.dvelz[i] : col.dvelz[i];
+					dz = first ? col.dvelx[i] : -col.dvelx[i];
+					scale = 0.01f;
+				}
+				else
+				{
+					scale = (1.0f/dist) * (pen*0.5f) * COLLISION_RESOLVE_FACTOR;
+				}
+				col.dispx[i] += dx*scale;
+				col.dispz[i] += dz*scale;
+				col.weight[i] += 1.0f;
+			}
+		}
+
+		// Extra iterations only run while the agents overlap more than the tolerance.
+		// The displacements of the skipped iteration are not applied, so clear them.
+		if (iter >= iterations && !overlapping)
+		{
+			for (int i = 0; i < nagents; ++i)
+			{
+				col.dispx[i] = 0;
+				col.dispz[i] = 0;
+			}
+			break;
+		}
+
+		for (int i = 0; i < nagents; ++i)
+		{
+			const float w = col.weight[i];
+			const float iw = w > 0.0001f ? 1.0f / w : 1.0f;
+			col.dispx[i] = w > 0.0001f ? col.dispx[i] * iw : col.dispx[i];
+			col.dispz[i] = w > 0.0001f ? col.dispz[i] * iw : col.dispz[i];
+			col.x[i] = col.walking[i] ? col.x[i] + col.dispx[i] : col.x[i];
+			col.z[i] = col.walking[i] ? col.z[i] + col.dispz[i] : col.z[i];
+		}
+		m_collisionIterationCount++;
+	}
+
+	// Scatter the resolved positions.
+	for (int i = 0; i < nagents; ++i)
+	{
+		if (!col.walking[i])
+			continue;
+		const int idx = order[i];
+		arrays.npos[idx*3+0] = col.x[i];
+		arrays.npos[idx*3+2] = col.z[i];
+		dtVset(&arrays.disp[idx*3], col.dispx[i], 0, col.dispz[i]);
+	}
+}
+
+/// Records the time since the start of a phase, which is also the start of the next one.
+static void endPhase(dtCrowdUpdateProfile* profile, const int phase, double& start)
+{
+	if (!profile)
+		return;
+	const double now = profile->clock->getTime();
+	profile->phaseTimes[phase] = now - start;
+	start = now;
+}
+
+void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug, dtCrowdUpdateProfile* profile)
 {
+	double phaseStart = profile ? profile->clock->getTime() : 0;
 	m_velocitySampleCount = 0;
 	
 	const int debugIdx = debug ? debug->idx : -1;
 	
-	dtCrowdAgent** agents = m_activeAgents;
-	int nagents = getActiveAgents(agents, m_maxAgents);
+	pullEditedAgents();
+
+	const dtCrowdAgentArrays& arrays = m_agentArrays;
+	int* agents = m_activeAgents;
+	int nagents = collectActiveAgents(agents);
+
+	// Choose the level of detail of the agents. The frame only matters modulo the refresh interval,
+	// wrapping it keeps (idx + m_lodFrame) from overflowing.
+	m_lodFrame = (m_lodFrame + 1) % m_lodParams.interval;
+	updateLod(agents, nagents);
 
 	// Check that all agents still have valid paths.
 	checkPathValidity(agents, nagents, dt);
@@ -1060,58 +1929,81 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 
 	// Optimize path topology.
 	updateTopologyOptimization(agents, nagents, dt);
+	endPhase(profile, DT_CROWD_PHASE_PATHS, phaseStart);
 	
 	// Register agents to proximity grid.
 	m_grid->clear();
 	for (int i = 0; i < nagents; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
-		const float* p = ag->npos;
-		const float r = ag->params.radius;
-		m_grid->addItem((unsigned short)i, p[0]-r, p[2]-r, p[0]+r, p[2]+r);
+		const int idx = agents[i];
+		const float* p = &arrays.npos[idx*3];
+		const float r = arrays.radius[idx];
+		m_grid->addItem((unsigned short)idx, p[0]-r, p[2]-r, p[0]+r, p[2]+r);
 	}
 	
 	// Get nearby navmesh segments and agents to collide with.
 	for (int i = 0; i < nagents; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
-		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+		const int idx = agents[i];
+		if (arrays.state[idx] != DT_CROWDAGENT_STATE_WALKING)
+			continue;
+		const unsigned char lod = arrays.lod[idx];
+		if (lod == DT_CROWDAGENT_LOD_CORRIDOR || lod == DT_CROWDAGENT_LOD_SLEEPING)
+		{
+			arrays.nneis[idx] = 0;
 			continue;
+		}
+		if (!isLodRefresh(idx))
+		{
+			// Keep the neighbours found at the last refresh that are still in the crowd.
+			dtCrowdNeighbour* neis = &arrays.neis[idx*m_maxNeighbours];
+			int nneis = 0;
+			for (int j = 0; j < arrays.nneis[idx]; ++j)
+			{
+				if (arrays.active[neis[j].idx])
+					neis[nneis++] = neis[j];
+			}
+			arrays.nneis[idx] = nneis;
+			continue;
+		}
+		dtCrowdAgent* ag = &m_agents[idx];
+		const float* npos = &arrays.npos[idx*3];
+		const float collisionQueryRange = arrays.collisionQueryRange[idx];
 
 		// Update the collision boundary after certain distance has been passed or
 		// if it has become invalid.
-		const float updateThr = ag->params.collisionQueryRange*0.25f;
-		if (dtVdist2DSqr(ag->npos, ag->boundary.getCenter()) > dtSqr(updateThr) ||
+		const float updateThr = collisionQueryRange*0.25f;
+		if (dtVdist2DSqr(npos, ag->boundary.getCenter()) > dtSqr(updateThr) ||
 			!ag->boundary.isValid(m_navquery, &m_filters[ag->params.queryFilterType]))
 		{
-			ag->boundary.update(ag->corridor.getFirstPoly(), ag->npos, ag->params.collisionQueryRange,
+			ag->boundary.update(ag->corridor.getFirstPoly(), npos, collisionQueryRange,
 								m_navquery, &m_filters[ag->params.queryFilterType]);
 		}
 		// Query neighbour agents
-		ag->nneis = getNeighbours(ag->npos, ag->params.height, ag->params.collisionQueryRange,
-								  ag, ag->neis, DT_CROWDAGENT_MAX_NEIGHBOURS,
-								  agents, nagents, m_grid);
-		for (int j = 0; j < ag->nneis; j++)
-			ag->neis[j].idx = getAgentIndex(agents[ag->neis[j].idx]);
+		arrays.nneis[idx] = getNeighbours(npos, arrays.height[idx], collisionQueryRange,
+										  idx, &arrays.neis[idx*m_maxNeighbours], m_maxNeighbours,
+										  arrays, m_grid, m_neighbourQueryIds, m_maxNeighbourQuery);
 	}
 	
+	endPhase(profile, DT_CROWD_PHASE_NEIGHBOURS, phaseStart);
+
 	// Find next corner to steer to.
 	for (int i = 0; i < nagents; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
-		
-		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+		const int idx = agents[i];
+		if (arrays.state[idx] != DT_CROWDAGENT_STATE_WALKING || arrays.lod[idx] == DT_CROWDAGENT_LOD_SLEEPING)
 			continue;
+		dtCrowdAgent* ag = &m_agents[idx];
 		if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
 			continue;
 		
 		// Find corners for steering
 		ag->ncorners = ag->corridor.findCorners(ag->cornerVerts, ag->cornerFlags, ag->cornerPolys,
-												DT_CROWDAGENT_MAX_CORNERS, m_navquery, &m_filters[ag->params.queryFilterType]);
+												m_maxCorners, m_navquery, &m_filters[ag->params.queryFilterType]);
 		
 		// Check to see if the corner after the next corner is directly visible,
 		// and short cut to there.
-		if ((ag->params.updateFlags & DT_CROWD_OPTIMIZE_VIS) && ag->ncorners > 0)
+		if ((arrays.updateFlags[idx] & DT_CROWD_OPTIMIZE_VIS) && ag->ncorners > 0 && isLodRefresh(idx))
 		{
 			const float* target = &ag->cornerVerts[dtMin(1,ag->ncorners-1)*3];
 			ag->corridor.optimizePathVisibility(target, ag->params.pathOptimizationRange, m_navquery, &m_filters[ag->params.queryFilterType]);
@@ -1137,19 +2029,18 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 	// Trigger off-mesh connections (depends on corners).
 	for (int i = 0; i < nagents; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
-		
-		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+		const int idx = agents[i];
+		if (arrays.state[idx] != DT_CROWDAGENT_STATE_WALKING || arrays.lod[idx] == DT_CROWDAGENT_LOD_SLEEPING)
 			continue;
+		dtCrowdAgent* ag = &m_agents[idx];
 		if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
 			continue;
 		
 		// Check 
-		const float triggerRadius = ag->params.radius*2.25f;
-		if (overOffmeshConnection(ag, triggerRadius))
+		const float triggerRadius = arrays.radius[idx]*2.25f;
+		if (overOffmeshConnection(ag, &arrays.npos[idx*3], triggerRadius))
 		{
 			// Prepare to off-mesh connection.
-			const int idx = (int)(ag - m_agents);
 			dtCrowdAgentAnimation* anim = &m_agentAnims[idx];
 			
 			// Adjust the path over the off-mesh connection.
@@ -1157,15 +2048,15 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 			if (ag->corridor.moveOverOffmeshConnection(ag->cornerPolys[ag->ncorners-1], refs,
 													   anim->startPos, anim->endPos, m_navquery))
 			{
-				dtVcopy(anim->initPos, ag->npos);
+				dtVcopy(anim->initPos, &arrays.npos[idx*3]);
 				anim->polyRef = refs[1];
 				anim->active = true;
 				anim->t = 0.0f;
 				anim->tmax = (dtVdist2D(anim->startPos, anim->endPos) / ag->params.maxSpeed) * 0.5f;
 				
-				ag->state = DT_CROWDAGENT_STATE_OFFMESH;
+				arrays.state[idx] = DT_CROWDAGENT_STATE_OFFMESH;
 				ag->ncorners = 0;
-				ag->nneis = 0;
+				arrays.nneis[idx] = 0;
 				continue;
 			}
 			else
@@ -1178,52 +2069,63 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 	// Calculate steering.
 	for (int i = 0; i < nagents; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
-
-		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+		const int idx = agents[i];
+		if (arrays.state[idx] != DT_CROWDAGENT_STATE_WALKING)
 			continue;
+		dtCrowdAgent* ag = &m_agents[idx];
+		if (arrays.lod[idx] == DT_CROWDAGENT_LOD_SLEEPING)
+		{
+			// Sleeping agents stop where they are.
+			arrays.desiredSpeed[idx] = 0;
+			dtVset(&arrays.dvel[idx*3], 0,0,0);
+			dtVset(&arrays.nvel[idx*3], 0,0,0);
+			dtVset(&arrays.vel[idx*3], 0,0,0);
+			continue;
+		}
 		if (ag->targetState == DT_CROWDAGENT_TARGET_NONE)
 			continue;
 		
+		const float* npos = &arrays.npos[idx*3];
 		float dvel[3] = {0,0,0};
 
 		if (ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
 		{
 			dtVcopy(dvel, ag->targetPos);
-			ag->desiredSpeed = dtVlen(ag->targetPos);
+			arrays.desiredSpeed[idx] = dtVlen(ag->targetPos);
 		}
 		else
 		{
 			// Calculate steering direction.
-			if (ag->params.updateFlags & DT_CROWD_ANTICIPATE_TURNS)
-				calcSmoothSteerDirection(ag, dvel);
+			if (arrays.updateFlags[idx] & DT_CROWD_ANTICIPATE_TURNS)
+				calcSmoothSteerDirection(ag, npos, dvel);
 			else
-				calcStraightSteerDirection(ag, dvel);
+				calcStraightSteerDirection(ag, npos, dvel);
 			
 			// Calculate speed scale, which tells the agent to slowdown at the end of the path.
-			const float slowDownRadius = ag->params.radius*2;	// TODO: make less hacky.
-			const float speedScale = getDistanceToGoal(ag, slowDownRadius) / slowDownRadius;
+			const float slowDownRadius = arrays.radius[idx]*2;	// TODO: make less hacky.
+			const float speedScale = getDistanceToGoal(ag, npos, slowDownRadius) / slowDownRadius;
 				
-			ag->desiredSpeed = ag->params.maxSpeed;
-			dtVscale(dvel, dvel, ag->desiredSpeed * speedScale);
+			arrays.desiredSpeed[idx] = ag->params.maxSpeed;
+			dtVscale(dvel, dvel, arrays.desiredSpeed[idx] * speedScale);
 		}
 
 		// Separation
-		if (ag->params.updateFlags & DT_CROWD_SEPARATION)
+		if (arrays.updateFlags[idx] & DT_CROWD_SEPARATION)
 		{
-			const float separationDist = ag->params.collisionQueryRange; 
+			const float separationDist = arrays.collisionQueryRange[idx]; 
 			const float invSeparationDist = 1.0f / separationDist; 
 			const float separationWeight = ag->params.separationWeight;
 			
 			float w = 0;
 			float disp[3] = {0,0,0};
 			
-			for (int j = 0; j < ag->nneis; ++j)
+			const dtCrowdNeighbour* neis = &arrays.neis[idx*m_maxNeighbours];
+			for (int j = 0; j < arrays.nneis[idx]; ++j)
 			{
-				const dtCrowdAgent* nei = &m_agents[ag->neis[j].idx];
+				const float* neiPos = &arrays.npos[neis[j].idx*3];
 				
 				float diff[3];
-				dtVsub(diff, ag->npos, nei->npos);
+				dtVsub(diff, npos, neiPos);
 				diff[1] = 0;
 				
 				const float distSqr = dtVlenSqr(diff);
@@ -1244,40 +2146,52 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 				dtVmad(dvel, dvel, disp, 1.0f/w);
 				// Clamp desired velocity to desired speed.
 				const float speedSqr = dtVlenSqr(dvel);
-				const float desiredSqr = dtSqr(ag->desiredSpeed);
+				const float desiredSqr = dtSqr(arrays.desiredSpeed[idx]);
 				if (speedSqr > desiredSqr)
 					dtVscale(dvel, dvel, desiredSqr/speedSqr);
 			}
 		}
 		
 		// Set the desired velocity.
-		dtVcopy(ag->dvel, dvel);
+		dtVcopy(&arrays.dvel[idx*3], dvel);
 	}
 	
+	endPhase(profile, DT_CROWD_PHASE_STEERING, phaseStart);
+
 	// Velocity planning.	
 	for (int i = 0; i < nagents; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
+		const int idx = agents[i];
+		if (arrays.state[idx] != DT_CROWDAGENT_STATE_WALKING)
+			continue;
+		const unsigned char lod = arrays.lod[idx];
+		if (lod == DT_CROWDAGENT_LOD_SLEEPING)
+			continue;
 		
-		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+		const bool avoid = (arrays.updateFlags[idx] & DT_CROWD_OBSTACLE_AVOIDANCE) && lod != DT_CROWDAGENT_LOD_CORRIDOR;
+		// Reduced agents keep the velocity sampled at their last refresh.
+		if (avoid && !isLodRefresh(idx))
 			continue;
 		
-		if (ag->params.updateFlags & DT_CROWD_OBSTACLE_AVOIDANCE)
+		if (avoid)
 		{
+			const dtCrowdAgent* ag = &m_agents[idx];
+			const float* npos = &arrays.npos[idx*3];
 			m_obstacleQuery->reset();
 			
 			// Add neighbours as obstacles.
-			for (int j = 0; j < ag->nneis; ++j)
+			const dtCrowdNeighbour* neis = &arrays.neis[idx*m_maxNeighbours];
+			for (int j = 0; j < arrays.nneis[idx]; ++j)
 			{
-				const dtCrowdAgent* nei = &m_agents[ag->neis[j].idx];
-				m_obstacleQuery->addCircle(nei->npos, nei->params.radius, nei->vel, nei->dvel);
+				const int nei = neis[j].idx;
+				m_obstacleQuery->addCircle(&arrays.npos[nei*3], arrays.radius[nei], &arrays.vel[nei*3], &arrays.dvel[nei*3]);
 			}
 
 			// Append neighbour segments as obstacles.
 			for (int j = 0; j < ag->boundary.getSegmentCount(); ++j)
 			{
 				const float* s = ag->boundary.getSegment(j);
-				if (dtTriArea2D(ag->npos, s, s+3) < 0.0f)
+				if (dtTriArea2D(npos, s, s+3) < 0.0f)
 					continue;
 				m_obstacleQuery->addSegment(s, s+3);
 			}
@@ -1294,114 +2208,49 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 				
 			if (adaptive)
 			{
-				ns = m_obstacleQuery->sampleVelocityAdaptive(ag->npos, ag->params.radius, ag->desiredSpeed,
-															 ag->vel, ag->dvel, ag->nvel, params, vod);
+				ns = m_obstacleQuery->sampleVelocityAdaptive(npos, arrays.radius[idx], arrays.desiredSpeed[idx],
+															 &arrays.vel[idx*3], &arrays.dvel[idx*3], &arrays.nvel[idx*3], params, vod);
 			}
 			else
 			{
-				ns = m_obstacleQuery->sampleVelocityGrid(ag->npos, ag->params.radius, ag->desiredSpeed,
-														 ag->vel, ag->dvel, ag->nvel, params, vod);
+				ns = m_obstacleQuery->sampleVelocityGrid(npos, arrays.radius[idx], arrays.desiredSpeed[idx],
+														 &arrays.vel[idx*3], &arrays.dvel[idx*3], &arrays.nvel[idx*3], params, vod);
 			}
 			m_velocitySampleCount += ns;
 		}
 		else
 		{
 			// If not using velocity planning, new velocity is directly the desired velocity.
-			dtVcopy(ag->nvel, ag->dvel);
+			dtVcopy(&arrays.nvel[idx*3], &arrays.dvel[idx*3]);
 		}
 	}
 
+	endPhase(profile, DT_CROWD_PHASE_AVOIDANCE, phaseStart);
+
 	// Integrate.
-	for (int i = 0; i < nagents; ++i)
-	{
-		dtCrowdAgent* ag = agents[i];
-		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
-			continue;
-		integrate(ag, dt);
-	}
+	integrate(arrays, m_maxAgents, dt);
 	
 	// Handle collisions.
-	static const float COLLISION_RESOLVE_FACTOR = 0.7f;
-	
-	for (int iter = 0; iter < 4; ++iter)
-	{
-		for (int i = 0; i < nagents; ++i)
-		{
-			dtCrowdAgent* ag = agents[i];
-			const int idx0 = getAgentIndex(ag);
-			
-			if (ag->state != DT_CROWDAGENT_STATE_WALKING)
-				continue;
-
-			dtVset(ag->disp, 0,0,0);
-			
-			float w = 0;
-
-			for (int j = 0; j < ag->nneis; ++j)
-			{
-				const dtCrowdAgent* nei = &m_agents[ag->neis[j].idx];
-				const int idx1 = getAgentIndex(nei);
-
-				float diff[3];
-				dtVsub(diff, ag->npos, nei->npos);
-				diff[1] = 0;
-				
-				float dist = dtVlenSqr(diff);
-				if (dist > dtSqr(ag->params.radius + nei->params.radius))
-					continue;
-				dist = dtMathSqrtf(dist);
-				float pen = (ag->params.radius + nei->params.radius) - dist;
-				if (dist < 0.0001f)
-				{
-					// Agents on top of each other, try to choose diverging separation directions.
-					if (idx0 > idx1)
-						dtVset(diff, -ag->dvel[2],0,ag->dvel[0]);
-					else
-						dtVset(diff, ag->dvel[2],0,-ag->dvel[0]);
-					pen = 0.01f;
-				}
-				else
-				{
-					pen = (1.0f/dist) * (pen*0.5f) * COLLISION_RESOLVE_FACTOR;
-				}
-				
-				dtVmad(ag->disp, ag->disp, diff, pen);			
-				
-				w += 1.0f;
-			}
-			
-			if (w > 0.0001f)
-			{
-				const float iw = 1.0f / w;
-				dtVscale(ag->disp, ag->disp, iw);
-			}
-		}
-		
-		for (int i = 0; i < nagents; ++i)
-		{
-			dtCrowdAgent* ag = agents[i];
-			if (ag->state != DT_CROWDAGENT_STATE_WALKING)
-				continue;
-			
-			dtVadd(ag->npos, ag->npos, ag->disp);
-		}
-	}
+	resolveCollisions(agents, nagents);
+	endPhase(profile, DT_CROWD_PHASE_COLLISIONS, phaseStart);
 	
 	for (int i = 0; i < nagents; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
-		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+		const int idx = agents[i];
+		if (arrays.state[idx] != DT_CROWDAGENT_STATE_WALKING || arrays.lod[idx] == DT_CROWDAGENT_LOD_SLEEPING)
 			continue;
+		dtCrowdAgent* ag = &m_agents[idx];
+		float* npos = &arrays.npos[idx*3];
 		
 		// Move along navmesh.
-		ag->corridor.movePosition(ag->npos, m_navquery, &m_filters[ag->params.queryFilterType]);
+		ag->corridor.movePosition(npos, m_navquery, &m_filters[ag->params.queryFilterType]);
 		// Get valid constrained position back.
-		dtVcopy(ag->npos, ag->corridor.getPos());
+		dtVcopy(npos, ag->corridor.getPos());
 
 		// If not using path, truncate the corridor to just one poly.
 		if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
 		{
-			ag->corridor.reset(ag->corridor.getFirstPoly(), ag->npos);
+			ag->corridor.reset(ag->corridor.getFirstPoly(), npos);
 			ag->partial = false;
 		}
 
@@ -1410,8 +2259,7 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 	// Update agents using off-mesh connection.
 	for (int i = 0; i < nagents; ++i)
 	{
-		dtCrowdAgent* ag = agents[i];
-		const int idx = (int)(ag - m_agents);
+		const int idx = agents[i];
 		dtCrowdAgentAnimation* anim = &m_agentAnims[idx];
 		if (!anim->active)
 			continue;
@@ -1423,27 +2271,28 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 			// Reset animation
 			anim->active = false;
 			// Prepare agent for walking.
-			ag->state = DT_CROWDAGENT_STATE_WALKING;
+			arrays.state[idx] = DT_CROWDAGENT_STATE_WALKING;
 			continue;
 		}
 		
 		// Update position
+		float* npos = &arrays.npos[idx*3];
 		const float ta = anim->tmax*0.15f;
 		const float tb = anim->tmax;
 		if (anim->t < ta)
 		{
 			const float u = tween(anim->t, 0.0, ta);
-			dtVlerp(ag->npos, anim->initPos, anim->startPos, u);
+			dtVlerp(npos, anim->initPos, anim->startPos, u);
 		}
 		else
 		{
 			const float u = tween(anim->t, ta, tb);
-			dtVlerp(ag->npos, anim->startPos, anim->endPos, u);
+			dtVlerp(npos, anim->startPos, anim->endPos, u);
 		}
 			
 		// Update velocity.
-		dtVset(ag->vel, 0,0,0);
-		dtVset(ag->dvel, 0,0,0);
+		dtVset(&arrays.vel[idx*3], 0,0,0);
+		dtVset(&arrays.dvel[idx*3], 0,0,0);
 	}
-	
+	endPhase(profile, DT_CROWD_PHASE_MOVEMENT, phaseStart);
 }
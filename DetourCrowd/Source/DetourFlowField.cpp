@@ -0,0 +1,392 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <string.h>
+#include <float.h>
+#include <new>
+#include "DetourFlowField.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+#include "DetourCommon.h"
+#include "DetourAlloc.h"
+
+
+dtFlowField* dtAllocFlowField()
+{
+	void* mem = dtAlloc(sizeof(dtFlowField), DT_ALLOC_PERM);
+	if (!mem) return 0;
+	return new(mem) dtFlowField;
+}
+
+void dtFreeFlowField(dtFlowField* ptr)
+{
+	if (!ptr) return;
+	ptr->~dtFlowField();
+	dtFree(ptr);
+}
+
+
+#ifdef DT_POLYREF64
+inline unsigned int hashFlowFieldRef(dtPolyRef a)
+{
+	a = (~a) + (a << 18);
+	a = a ^ (a >> 31);
+	a = a * 21;
+	a = a ^ (a >> 11);
+	a = a + (a << 6);
+	a = a ^ (a >> 22);
+	return (unsigned int)a;
+}
+#else
+inline unsigned int hashFlowFieldRef(dtPolyRef a)
+{
+	a += ~(a<<15);
+	a ^=  (a>>10);
+	a +=  (a<<3);
+	a ^=  (a>>6);
+	a += ~(a<<11);
+	a ^=  (a>>16);
+	return (unsigned int)a;
+}
+#endif
+
+/// Returns true if the polygon has a link to the other polygon.
+static bool isLinked(const dtNavMesh* nav, dtPolyRef from, dtPolyRef to)
+{
+	const dtMeshTile* tile = 0;
+	const dtPoly* poly = 0;
+	if (dtStatusFailed(nav->getTileAndPolyByRef(from, &tile, &poly)))
+		return false;
+	for (unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
+	{
+		if (tile->links[i].ref == to)
+			return true;
+	}
+	return false;
+}
+
+/// Grows an array to hold at least the given number of items, keeping the first items.
+template<class T>
+static bool reserveItems(T*& items, int& capacity, const int count, const int keep)
+{
+	if (count <= capacity)
+		return true;
+	const int newCapacity = dtMax(count, capacity*2);
+	T* newItems = (T*)dtAlloc(sizeof(T)*newCapacity, DT_ALLOC_PERM);
+	if (!newItems)
+		return false;
+	if (keep)
+		memcpy(newItems, items, sizeof(T)*keep);
+	dtFree(items);
+	items = newItems;
+	capacity = newCapacity;
+	return true;
+}
+
+dtFlowField::dtFlowField() :
+	m_navquery(0),
+	m_goalRef(0),
+	m_polys(0),
+	m_parents(0),
+	m_costs(0),
+	m_next(0),
+	m_npolys(0),
+	m_maxPolys(0),
+	m_tiles(0),
+	m_ntiles(0),
+	m_maxTiles(0),
+	m_tileLocs(0),
+	m_ntileLocs(0),
+	m_maxTileLocs(0),
+	m_buckets(0),
+	m_bucketMask(0)
+{
+	dtVset(m_goalPos, 0,0,0);
+}
+
+dtFlowField::~dtFlowField()
+{
+	purge();
+}
+
+void dtFlowField::purge()
+{
+	dtFreeNavMeshQuery(m_navquery);
+	m_navquery = 0;
+	dtFree(m_polys);
+	m_polys = 0;
+	dtFree(m_parents);
+	m_parents = 0;
+	dtFree(m_costs);
+	m_costs = 0;
+	dtFree(m_next);
+	m_next = 0;
+	dtFree(m_tiles);
+	m_tiles = 0;
+	m_ntiles = 0;
+	m_maxTiles = 0;
+	dtFree(m_tileLocs);
+	m_tileLocs = 0;
+	m_ntileLocs = 0;
+	m_maxTileLocs = 0;
+	dtFree(m_buckets);
+	m_buckets = 0;
+	m_npolys = 0;
+	m_maxPolys = 0;
+	m_bucketMask = 0;
+	m_goalRef = 0;
+}
+
+bool dtFlowField::init(const int maxPolys, const dtNavMesh* nav)
+{
+	purge();
+
+	// The search nodes are indexed with 16 bits.
+	if (maxPolys <= 0 || maxPolys > 65535)
+		return false;
+
+	m_navquery = dtAllocNavMeshQuery();
+	if (!m_navquery)
+		return false;
+	if (dtStatusFailed(m_navquery->init(nav, maxPolys)))
+		return false;
+
+	m_maxPolys = maxPolys;
+	m_polys = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*m_maxPolys, DT_ALLOC_PERM);
+	if (!m_polys)
+		return false;
+	m_parents = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*m_maxPolys, DT_ALLOC_PERM);
+	if (!m_parents)
+		return false;
+	m_costs = (float*)dtAlloc(sizeof(float)*m_maxPolys, DT_ALLOC_PERM);
+	if (!m_costs)
+		return false;
+	m_next = (int*)dtAlloc(sizeof(int)*m_maxPolys, DT_ALLOC_PERM);
+	if (!m_next)
+		return false;
+
+	// Keep the hash at most half full.
+	const int bucketCount = (int)dtNextPow2((unsigned int)m_maxPolys*2);
+	m_buckets = (int*)dtAlloc(sizeof(int)*bucketCount, DT_ALLOC_PERM);
+	if (!m_buckets)
+		return false;
+	m_bucketMask = bucketCount-1;
+	memset(m_buckets, 0xff, sizeof(int)*bucketCount);
+
+	return true;
+}
+
+void dtFlowField::reset()
+{
+	if (m_npolys)
+		memset(m_buckets, 0xff, sizeof(int)*(m_bucketMask+1));
+	m_npolys = 0;
+	m_ntiles = 0;
+	m_ntileLocs = 0;
+	m_goalRef = 0;
+}
+
+int dtFlowField::findPoly(dtPolyRef ref) const
+{
+	if (!m_npolys || !ref)
+		return -1;
+	unsigned int bucket = hashFlowFieldRef(ref) & m_bucketMask;
+	while (m_buckets[bucket] != -1)
+	{
+		const int idx = m_buckets[bucket];
+		if (m_polys[idx] == ref)
+			return idx;
+		bucket = (bucket+1) & m_bucketMask;
+	}
+	return -1;
+}
+
+/// @par
+///
+/// The search runs outward from the goal, so the costs are those of moving from the goal to each polygon.
+/// They match the costs towards the goal for filters whose costs do not depend on the direction of travel.
+///
+/// Polygons that can only reach the goal by using an off-mesh connection against its direction are left out,
+/// and so are polygons beyond #getMaxPolys(). Agents on them need to find their own paths.
+dtStatus dtFlowField::build(dtPolyRef goalRef, const float* goalPos, const dtQueryFilter* filter)
+{
+	reset();
+	if (!m_navquery)
+		return DT_FAILURE;
+
+	int nfound = 0;
+	dtStatus status = m_navquery->findPolysAroundCircle(goalRef, goalPos, FLT_MAX, filter,
+														m_polys, m_parents, m_costs, &nfound, m_maxPolys);
+	if (dtStatusFailed(status))
+		return status;
+
+	m_goalRef = goalRef;
+	dtVcopy(m_goalPos, goalPos);
+
+	// Polygons are reached after the polygon they were reached from, so the next polygon
+	// towards the goal is always in the field already.
+	const dtNavMesh* nav = m_navquery->getAttachedNavMesh();
+	for (int i = 0; i < nfound; ++i)
+	{
+		const dtPolyRef ref = m_polys[i];
+		const dtPolyRef parentRef = m_parents[i];
+		int next = -1;
+		if (parentRef)
+		{
+			next = findPoly(parentRef);
+			if (next == -1)
+				continue;
+			// Off-mesh connections may only be entered from their start unless they are bidirectional.
+			const dtMeshTile* parentTile = 0;
+			const dtPoly* parentPoly = 0;
+			nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
+			if (parentPoly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION && !isLinked(nav, ref, parentRef))
+				continue;
+		}
+
+		const int idx = m_npolys++;
+		m_polys[idx] = ref;
+		m_parents[idx] = parentRef;
+		m_costs[idx] = m_costs[i];
+		m_next[idx] = next;
+
+		unsigned int bucket = hashFlowFieldRef(ref) & m_bucketMask;
+		while (m_buckets[bucket] != -1)
+			bucket = (bucket+1) & m_bucketMask;
+		m_buckets[bucket] = idx;
+	}
+
+	if (!recordTiles())
+	{
+		reset();
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+
+	if (status & DT_BUFFER_TOO_SMALL)
+		status = (status & ~DT_BUFFER_TOO_SMALL) | DT_OUT_OF_NODES;
+	return status;
+}
+
+/// Records the tiles at the grid locations under and next to the polygons. Tiles are connected to the tiles next
+/// to them, so these are the tiles whose changes may change the paths.
+bool dtFlowField::recordTiles()
+{
+	static const int MAX_LAYERS = 32;
+	const dtNavMesh* nav = m_navquery->getAttachedNavMesh();
+
+	// The tiles under the polygons.
+	m_ntiles = 0;
+	const dtMeshTile* prevTile = 0;
+	for (int i = 0; i < m_npolys; ++i)
+	{
+		const dtMeshTile* tile = 0;
+		const dtPoly* poly = 0;
+		nav->getTileAndPolyByRefUnsafe(m_polys[i], &tile, &poly);
+		if (tile == prevTile)
+			continue;
+		prevTile = tile;
+		const dtTileRef tileRef = nav->getTileRef(tile);
+		int j = 0;
+		while (j < m_ntiles && m_tiles[j] != tileRef)
+			j++;
+		if (j < m_ntiles)
+			continue;
+		if (!reserveItems(m_tiles, m_maxTiles, m_ntiles+1, m_ntiles))
+			return false;
+		m_tiles[m_ntiles++] = tileRef;
+	}
+
+	// Their grid locations and those next to them.
+	m_ntileLocs = 0;
+	for (int i = 0; i < m_ntiles; ++i)
+	{
+		const dtMeshTile* tile = nav->getTileByRef(m_tiles[i]);
+		for (int dy = -1; dy <= 1; ++dy)
+		{
+			for (int dx = -1; dx <= 1; ++dx)
+			{
+				const int x = tile->header->x + dx;
+				const int y = tile->header->y + dy;
+				int j = 0;
+				while (j < m_ntileLocs && (m_tileLocs[j*2+0] != x || m_tileLocs[j*2+1] != y))
+					j++;
+				if (j < m_ntileLocs)
+					continue;
+				if (!reserveItems(m_tileLocs, m_maxTileLocs, (m_ntileLocs+1)*2, m_ntileLocs*2))
+					return false;
+				m_tileLocs[m_ntileLocs*2+0] = x;
+				m_tileLocs[m_ntileLocs*2+1] = y;
+				m_ntileLocs++;
+			}
+		}
+	}
+
+	// All layers of the tiles at those locations.
+	m_ntiles = 0;
+	const dtMeshTile* tiles[MAX_LAYERS];
+	for (int i = 0; i < m_ntileLocs; ++i)
+	{
+		const int n = nav->getTilesAt(m_tileLocs[i*2+0], m_tileLocs[i*2+1], tiles, MAX_LAYERS);
+		if (!reserveItems(m_tiles, m_maxTiles, m_ntiles+n, m_ntiles))
+			return false;
+		for (int j = 0; j < n; ++j)
+			m_tiles[m_ntiles++] = nav->getTileRef(tiles[j]);
+	}
+
+	return true;
+}
+
+/// @par
+///
+/// A removed or replaced tile no longer matches its recorded reference, and an added tile makes more tiles at the
+/// recorded grid locations than were recorded.
+bool dtFlowField::isValid() const
+{
+	static const int MAX_LAYERS = 32;
+	if (!m_navquery)
+		return false;
+	const dtNavMesh* nav = m_navquery->getAttachedNavMesh();
+	for (int i = 0; i < m_ntiles; ++i)
+	{
+		if (!nav->getTileByRef(m_tiles[i]))
+			return false;
+	}
+	int ntiles = 0;
+	const dtMeshTile* tiles[MAX_LAYERS];
+	for (int i = 0; i < m_ntileLocs; ++i)
+		ntiles += nav->getTilesAt(m_tileLocs[i*2+0], m_tileLocs[i*2+1], tiles, MAX_LAYERS);
+	return ntiles == m_ntiles;
+}
+
+int dtFlowField::getPath(dtPolyRef startRef, dtPolyRef* path, const int maxPath) const
+{
+	int idx = findPoly(startRef);
+	int n = 0;
+	while (idx != -1 && n < maxPath)
+	{
+		path[n++] = m_polys[idx];
+		idx = m_next[idx];
+	}
+	return n;
+}
+
+float dtFlowField::getCost(dtPolyRef ref) const
+{
+	const int idx = findPoly(ref);
+	return idx != -1 ? m_costs[idx] : -1.0f;
+}
@@ -96,9 +96,13 @@ void dtLocalBoundary::update(dtPolyRef ref, const float* pos, const float collis
 	
 	dtVcopy(m_center, pos);
 	
-	// First query non-overlapping polygons.
-	navquery->findLocalNeighbourhood(ref, pos, collisionQueryRange,
-									 filter, m_polys, 0, &m_npolys, MAX_LOCAL_POLYS);
+	// First query non-overlapping polygons, updating the polygons found last time if there are any.
+	if (m_npolys > 0)
+		navquery->updateLocalNeighbourhood(ref, pos, collisionQueryRange,
+										   filter, m_polys, &m_npolys, MAX_LOCAL_POLYS);
+	else
+		navquery->findLocalNeighbourhood(ref, pos, collisionQueryRange,
+										 filter, m_polys, 0, &m_npolys, MAX_LOCAL_POLYS);
 	
 	// Secondly, store all polygon edges.
 	m_nsegs = 0;
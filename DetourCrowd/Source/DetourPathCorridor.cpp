@@ -197,16 +197,145 @@ may be needed.  E.g. If you move the target, check #getLastPoly() to see if it i
 
 */
 
+// The smallest pooled buffer, large enough to link the free buffers.
+static const int MIN_POOL_CAPACITY = 8;
+// The chunk header holding the link to the next chunk, keeping the buffers aligned.
+static const int POOL_CHUNK_HEADER_SIZE = 16;
+
+dtPathPool::dtPathPool() :
+	m_nclasses(0),
+	m_chunks(0),
+	m_maxPath(0),
+	m_chunkSize(0),
+	m_usedSize(0),
+	m_reservedSize(0)
+{
+	memset(m_capacities, 0, sizeof(m_capacities));
+	memset(m_freeLists, 0, sizeof(m_freeLists));
+}
+
+dtPathPool::~dtPathPool()
+{
+	purge();
+}
+
+void dtPathPool::purge()
+{
+	while (m_chunks)
+	{
+		void* next;
+		memcpy(&next, m_chunks, sizeof(next));
+		dtFree(m_chunks);
+		m_chunks = next;
+	}
+	memset(m_freeLists, 0, sizeof(m_freeLists));
+	m_nclasses = 0;
+	m_maxPath = 0;
+	m_usedSize = 0;
+	m_reservedSize = 0;
+}
+
+bool dtPathPool::init(const int maxPath, const int chunkSize)
+{
+	purge();
+	
+	if (maxPath < 1 || chunkSize < 1)
+		return false;
+	
+	// Power of two capacities up to the largest, which holds the maximum path rounded
+	// up so that every buffer stays aligned for the free list links.
+	int capacity = MIN_POOL_CAPACITY;
+	while (capacity < maxPath && m_nclasses < MAX_SIZE_CLASSES-1)
+	{
+		m_capacities[m_nclasses++] = capacity;
+		capacity *= 2;
+	}
+	m_capacities[m_nclasses++] = (maxPath + MIN_POOL_CAPACITY-1) & ~(MIN_POOL_CAPACITY-1);
+	
+	m_maxPath = maxPath;
+	m_chunkSize = chunkSize;
+	
+	return true;
+}
+
+int dtPathPool::getSizeClass(const int size) const
+{
+	for (int i = 0; i < m_nclasses-1; ++i)
+	{
+		if (size <= m_capacities[i])
+			return i;
+	}
+	return m_nclasses-1;
+}
+
+int dtPathPool::getCapacity(const int size) const
+{
+	return m_nclasses ? m_capacities[getSizeClass(size)] : 0;
+}
+
+dtPolyRef* dtPathPool::alloc(const int size, int* capacity)
+{
+	if (size > m_maxPath || !m_nclasses)
+		return 0;
+	
+	const int c = getSizeClass(size);
+	const int cap = m_capacities[c];
+	if (!m_freeLists[c])
+	{
+		// Carve a new chunk into free buffers.
+		const int count = dtMax(1, m_chunkSize / cap);
+		unsigned char* chunk = (unsigned char*)dtAlloc(POOL_CHUNK_HEADER_SIZE + sizeof(dtPolyRef)*cap*count, DT_ALLOC_PERM);
+		if (!chunk)
+			return 0;
+		memcpy(chunk, &m_chunks, sizeof(m_chunks));
+		m_chunks = chunk;
+		
+		dtPolyRef* bufs = (dtPolyRef*)(chunk + POOL_CHUNK_HEADER_SIZE);
+		for (int i = count-1; i >= 0; --i)
+		{
+			dtPolyRef* buf = bufs + i*cap;
+			memcpy(buf, &m_freeLists[c], sizeof(dtPolyRef*));
+			m_freeLists[c] = buf;
+		}
+		m_reservedSize += cap*count;
+	}
+	
+	dtPolyRef* buf = m_freeLists[c];
+	memcpy(&m_freeLists[c], buf, sizeof(dtPolyRef*));
+	m_usedSize += cap;
+	*capacity = cap;
+	return buf;
+}
+
+/// @par
+///
+/// Any size the buffer can hold that rounds up to its capacity, such as the size it was allocated for,
+/// can be passed as @p capacity.
+void dtPathPool::free(dtPolyRef* buf, const int capacity)
+{
+	if (!buf)
+		return;
+	const int c = getSizeClass(capacity);
+	memcpy(buf, &m_freeLists[c], sizeof(dtPolyRef*));
+	m_freeLists[c] = buf;
+	m_usedSize -= m_capacities[c];
+}
+
 dtPathCorridor::dtPathCorridor() :
 	m_path(0),
 	m_npath(0),
-	m_maxPath(0)
+	m_maxPath(0),
+	m_capacity(0),
+	m_pool(0)
 {
 }
 
 dtPathCorridor::~dtPathCorridor()
 {
-	dtFree(m_path);
+	if (m_pool)
+		m_pool->free(m_path, m_capacity);
+	else
+		dtFree(m_path);
 }
 
 /// @par
@@ -220,6 +349,50 @@ bool dtPathCorridor::init(const int maxPath)
 		return false;
 	m_npath = 0;
 	m_maxPath = maxPath;
+	m_capacity = maxPath;
+	return true;
+}
+
+/// @par
+///
+/// The path buffer grows as the path gets longer, up to the maximum path size of the pool.
+/// If the pool runs out of memory, the path is clipped to the buffer it has.
+///
+/// @warning Cannot be called more than once.
+bool dtPathCorridor::init(dtPathPool* pool)
+{
+	dtAssert(!m_path);
+	int capacity = 0;
+	m_path = pool->alloc(1, &capacity);
+	if (!m_path)
+		return false;
+	m_pool = pool;
+	m_npath = 0;
+	m_maxPath = pool->getMaxPath();
+	m_capacity = dtMin(capacity, m_maxPath);
+	return true;
+}
+
+/// Makes the path buffer hold at least @p size polygons, up to the maximum path size. A pooled
+/// buffer is moved to the smallest buffer that fits if @p shrink is set. Returns false if the
+/// buffer could not grow.
+bool dtPathCorridor::reserve(const int size, const bool shrink)
+{
+	const int n = dtMin(size, m_maxPath);
+	if (!m_pool)
+		return n <= m_capacity;
+	const int capacity = dtMin(m_pool->getCapacity(n), m_maxPath);
+	if (capacity == m_capacity || (capacity < m_capacity && !shrink))
+		return true;
+	
+	int newCapacity = 0;
+	dtPolyRef* path = m_pool->alloc(n, &newCapacity);
+	if (!path)
+		return n <= m_capacity;
+	memcpy(path, m_path, sizeof(dtPolyRef)*dtMin(m_npath, n));
+	m_pool->free(m_path, m_capacity);
+	m_path = path;
+	m_capacity = dtMin(newCapacity, m_maxPath);
 	return true;
 }
 
@@ -230,6 +403,7 @@ bool dtPathCorridor::init(const int maxPath)
 void dtPathCorridor::reset(dtPolyRef ref, const float* pos)
 {
 	dtAssert(m_path);
+	reserve(1, true);
 	dtVcopy(m_pos, pos);
 	dtVcopy(m_target, pos);
 	m_path[0] = ref;
@@ -336,7 +510,8 @@ void dtPathCorridor::optimizePathVisibility(const float* next, const float pathO
 	navquery->raycast(m_path[0], m_pos, goal, filter, &t, norm, res, &nres, MAX_RES);
 	if (nres > 1 && t > 0.99f)
 	{
-		m_npath = dtMergeCorridorStartShortcut(m_path, m_npath, m_maxPath, res, nres);
+		reserve(m_npath + nres);
+		m_npath = dtMergeCorridorStartShortcut(m_path, m_npath, m_capacity, res, nres);
 	}
 }
 
@@ -370,7 +545,8 @@ bool dtPathCorridor::optimizePathTopology(dtNavMeshQuery* navquery, const dtQuer
 	
 	if (dtStatusSucceed(status) && nres > 0)
 	{
-		m_npath = dtMergeCorridorStartShortcut(m_path, m_npath, m_maxPath, res, nres);
+		reserve(m_npath + nres);
+		m_npath = dtMergeCorridorStartShortcut(m_path, m_npath, m_capacity, res, nres);
 		return true;
 	}
 	
@@ -449,7 +625,8 @@ bool dtPathCorridor::movePosition(const float* npos, dtNavMeshQuery* navquery, c
 	dtStatus status = navquery->moveAlongSurface(m_path[0], m_pos, npos, filter,
 												 result, visited, &nvisited, MAX_VISITED);
 	if (dtStatusSucceed(status)) {
-		m_npath = dtMergeCorridorStartMoved(m_path, m_npath, m_maxPath, visited, nvisited);
+		reserve(m_npath + nvisited);
+		m_npath = dtMergeCorridorStartMoved(m_path, m_npath, m_capacity, visited, nvisited);
 		
 		// Adjust the position to stay on top of the navmesh.
 		float h = m_pos[1];
@@ -488,7 +665,8 @@ bool dtPathCorridor::moveTargetPosition(const float* npos, dtNavMeshQuery* navqu
 												 result, visited, &nvisited, MAX_VISITED);
 	if (dtStatusSucceed(status))
 	{
-		m_npath = dtMergeCorridorEndMoved(m_path, m_npath, m_maxPath, visited, nvisited);
+		reserve(m_npath + nvisited);
+		m_npath = dtMergeCorridorEndMoved(m_path, m_npath, m_capacity, visited, nvisited);
 		// TODO: should we do that?
 		// Adjust the position to stay on top of the navmesh.
 		/*	float h = m_target[1];
@@ -514,9 +692,13 @@ void dtPathCorridor::setCorridor(const float* target, const dtPolyRef* path, con
 	dtAssert(npath > 0);
 	dtAssert(npath <= m_maxPath);
 	
+	// The buffer is fitted to the new path, which is clipped if the buffer could not grow.
+	m_npath = 0;
+	reserve(npath, true);
+	const int n = dtMin(npath, m_capacity);
 	dtVcopy(m_target, target);
-	memcpy(m_path, path, sizeof(dtPolyRef)*npath);
-	m_npath = npath;
+	memcpy(m_path, path, sizeof(dtPolyRef)*n);
+	m_npath = n;
 }
 
 bool dtPathCorridor::fixPathStart(dtPolyRef safeRef, const float* safePos)
@@ -524,6 +706,7 @@ bool dtPathCorridor::fixPathStart(dtPolyRef safeRef, const float* safePos)
 	dtAssert(m_path);
 
 	dtVcopy(m_pos, safePos);
+	reserve(3);
 	if (m_npath < 3 && m_npath > 0)
 	{
 		m_path[2] = m_path[m_npath-1];
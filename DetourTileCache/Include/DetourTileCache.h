@@ -1,6 +1,7 @@
 #ifndef DETOURTILECACHE_H
 #define DETOURTILECACHE_H
 
+#include "DetourClock.h"
 #include "DetourStatus.h"
 
 typedef unsigned int dtObstacleRef;
@@ -36,7 +37,8 @@ enum ObstacleType
 {
 	DT_OBSTACLE_CYLINDER,
 	DT_OBSTACLE_BOX, // AABB
-	DT_OBSTACLE_ORIENTED_BOX // OBB
+	DT_OBSTACLE_ORIENTED_BOX, // OBB
+	DT_OBSTACLE_CONVEX // Convex prism
 };
 
 struct dtObstacleCylinder
@@ -59,6 +61,18 @@ struct dtObstacleOrientedBox
 	float rotAux[ 2 ]; //{ cos(0.5f*angle)*sin(-0.5f*angle); cos(0.5f*angle)*cos(0.5f*angle) - 0.5 }
 };
 
+/// The maximum number of vertices of a convex obstacle.
+static const int DT_MAX_CONVEX_OBSTACLE_VERTS = 12;
+
+/// The outline of a convex obstacle is kept outside of the obstacle, so that the
+/// obstacle union stays small. (See: dtTileCache::getObstacleConvexVerts)
+struct dtObstacleConvex
+{
+	float hmin;
+	float hmax;
+	int nverts;
+};
+
 static const int DT_MAX_TOUCHED_TILES = 8;
 struct dtTileCacheObstacle
 {
@@ -67,6 +81,7 @@ struct dtTileCacheObstacle
 		dtObstacleCylinder cylinder;
 		dtObstacleBox box;
 		dtObstacleOrientedBox orientedBox;
+		dtObstacleConvex convex;
 	};
 
 	dtCompressedTileRef touched[DT_MAX_TOUCHED_TILES];
@@ -76,7 +91,8 @@ struct dtTileCacheObstacle
 	unsigned char state;
 	unsigned char ntouched;
 	unsigned char npending;
-	dtTileCacheObstacle* next;
+	unsigned char request;					///< Unprocessed request of the obstacle. (Managed by the tile cache.)
+	dtTileCacheObstacle* next;				///< Next free obstacle, or next obstacle with a request. (Managed by the tile cache.)
 };
 
 struct dtTileCacheParams
@@ -98,6 +114,27 @@ struct dtTileCacheMeshProcess
 	virtual void process(struct dtNavMeshCreateParams* params, unsigned char* polyAreas, unsigned short* polyFlags) = 0;
 };
 
+/// Describes the work done by a budgeted tile cache update. All times are in microseconds.
+struct dtTileCacheUpdateStats
+{
+	int tilesBuilt;				///< Number of tiles rebuilt by the update.
+	int tilesQueued;			///< Number of tiles still waiting to be rebuilt.
+	bool requestsHeld;			///< Whether obstacle requests are held back by an open batch.
+	float timeUsed;				///< Time spent in the update.
+	float estimatedBacklog;		///< Estimated time to rebuild the queued tiles.
+};
+
+/// Describes the use of the decompressed layer cache. (See: dtTileCache::setLayerCacheSize)
+struct dtTileCacheLayerCacheStats
+{
+	int hits;					///< Number of rebuilds that reused a cached layer.
+	int misses;					///< Number of rebuilds that decompressed the layer.
+	int evictions;				///< Number of layers evicted to make room for others.
+	int layerCount;				///< Number of layers in the cache.
+	int usedBytes;				///< Memory used by the cached layers.
+	int maxBytes;				///< Memory the cache may use.
+};
+
 class dtTileCache
 {
 public:
@@ -114,6 +151,12 @@ public:
 	inline int getObstacleCount() const { return m_params.maxObstacles; }
 	inline const dtTileCacheObstacle* getObstacle(const int i) const { return &m_obstacles[i]; }
 	
+	/// Returns the outline of a convex obstacle on the xz-plane. [(x, z) * dtObstacleConvex::nverts]
+	inline const float* getObstacleConvexVerts(const dtTileCacheObstacle* ob) const
+	{
+		return &m_convexVerts[(ob - m_obstacles) * DT_MAX_CONVEX_OBSTACLE_VERTS * 2];
+	}
+	
 	const dtTileCacheObstacle* getObstacleByRef(dtObstacleRef ref);
 	
 	dtObstacleRef getObstacleRef(const dtTileCacheObstacle* obmin) const;
@@ -142,19 +185,88 @@ public:
 	// Box obstacle: can be rotated in Y.
 	dtStatus addBoxObstacle(const float* center, const float* halfExtents, const float yRadians, dtObstacleRef* result);
 	
+	/// Adds a convex prism obstacle, carved in a single pass per tile.
+	///  @param[in]		verts		The outline of the prism. The y-values are ignored. [(x, y, z) * @p nverts]
+	///  @param[in]		nverts		The number of vertices. [Limits: 3 <= value <= #DT_MAX_CONVEX_OBSTACLE_VERTS]
+	///  @param[in]		hmin		The height of the base of the prism.
+	///  @param[in]		hmax		The height of the top of the prism. [Limit: >= @p hmin]
+	///  @param[out]	result		The reference of the obstacle. [opt]
+	/// @return The status flags for the operation.
+	dtStatus addConvexObstacle(const float* verts, const int nverts, const float hmin, const float hmax, dtObstacleRef* result);
+	
 	dtStatus removeObstacle(const dtObstacleRef ref);
 	
+	/// Moves an existing obstacle without changing its reference or shape.
+	/// Repeated moves before the obstacle is processed are merged into one.
+	///  @param[in]		ref		The reference of the obstacle.
+	///  @param[in]		pos		The new position. The base of a cylinder, or the center of a box or of the
+	///  						bounds of a convex obstacle. [(x, y, z)]
+	/// @return The status flags for the operation.
+	dtStatus moveObstacle(const dtObstacleRef ref, const float* pos);
+	
+	/// Starts a batch of obstacle changes. Requests made until the matching
+	/// #commitObstacleBatch are held back by #update and queued together, so
+	/// the tiles touched by several changes are rebuilt once. Batches can be nested.
+	/// @note A batch only groups the requests. The touched tiles are still rebuilt
+	/// a few per #update, so the navigation mesh can show part of the batch for
+	/// some frames.
+	void beginObstacleBatch();
+	
+	/// Ends the batch started by #beginObstacleBatch. The requests of the
+	/// outermost batch are queued by the next #update.
+	/// @return The status flags for the operation.
+	dtStatus commitObstacleBatch();
+	
+	/// Returns true if a batch of obstacle changes is open.
+	inline bool isObstacleBatchOpen() const { return m_batchDepth > 0; }
+	
+	/// Sets how long a changed tile waits before it is rebuilt. Every change to the tile
+	/// restarts the wait, so a burst of changes causes a single rebuild.
+	///  @param[in]		delay		The time without changes before the tile is rebuilt. [Limit: >= 0]
+	///  @param[in]		maxDelay	The longest time a tile waits after its first change. [Limit: >= @p delay]
+	void setTileRebuildDelay(const float delay, const float maxDelay);
+	
 	dtStatus queryTiles(const float* bmin, const float* bmax,
 						dtCompressedTileRef* results, int* resultCount, const int maxResults) const;
 	
 	/// Updates the tile cache by rebuilding tiles touched by unfinished obstacle requests.
-	///  @param[in]		dt			The time step size. Currently not used.
+	///  @param[in]		dt			The time step size. Advances the tile rebuild delays.
 	///  @param[in]		navmesh		The mesh to affect when rebuilding tiles.
 	///  @param[out]	upToDate	Whether the tile cache is fully up to date with obstacle requests and tile rebuilds.
 	///  							If the tile cache is up to date another (immediate) call to update will have no effect;
 	///  							otherwise another call will continue processing obstacle requests and tile rebuilds.
 	dtStatus update(const float dt, class dtNavMesh* navmesh, bool* upToDate = 0);
 	
+	/// Updates the tile cache, rebuilding tiles until the next one is expected to miss the deadline.
+	/// The cost of each tile is estimated from its previous rebuilds. At least one tile is rebuilt per call.
+	///  @param[in]		dt			The time step size. Advances the tile rebuild delays.
+	///  @param[in]		navmesh		The mesh to affect when rebuilding tiles.
+	///  @param[in]		clock		The clock measuring the rebuilds.
+	///  @param[in]		deadline	The time of @p clock by which the update should return. [Units: us]
+	///  @param[out]	stats		The work done and the remaining backlog. [opt]
+	///  @param[out]	upToDate	Whether the tile cache is fully up to date with obstacle requests and tile rebuilds. [opt]
+	/// @return The status flags for the operation.
+	dtStatus update(const float dt, class dtNavMesh* navmesh, dtClock* clock, const double deadline,
+					dtTileCacheUpdateStats* stats = 0, bool* upToDate = 0);
+	
+	/// Sets the memory used to keep the decompressed layers of recently rebuilt tiles.
+	/// Rebuilding a tile whose layer is cached copies the layer instead of decompressing it.
+	/// The least recently used layers are evicted when the cache is full. The cache is disabled by default.
+	///  @param[in]		maxBytes	The memory the cache may use. Zero disables the cache. [Limit: >= 0]
+	/// @return The status flags for the operation.
+	dtStatus setLayerCacheSize(const int maxBytes);
+	
+	/// Gets the use of the decompressed layer cache.
+	///  @param[out]	stats		The statistics of the cache.
+	void getLayerCacheStats(dtTileCacheLayerCacheStats* stats) const;
+	
+	/// Returns the estimated time to rebuild the tiles waiting in the update queue. [Units: us]
+	/// Tiles are estimated from the budgeted updates; zero until one has run.
+	float getEstimatedBacklog() const;
+
+	/// Returns the number of tiles waiting to be rebuilt.
+	inline int getUpdateQueueSize() const { return m_nupdate; }
+	
 	dtStatus buildNavMeshTilesAt(const int tx, const int ty, class dtNavMesh* navmesh);
 	
 	dtStatus buildNavMeshTile(const dtCompressedTileRef ref, class dtNavMesh* navmesh);
@@ -212,16 +324,87 @@ private:
 
 	enum ObstacleRequestAction
 	{
+		REQUEST_NONE,
 		REQUEST_ADD,
-		REQUEST_REMOVE
+		REQUEST_REMOVE,
+		REQUEST_MOVE
 	};
+
+	/// Links an obstacle to one of the tiles it touches. The links of obstacle i are
+	/// at [i*DT_MAX_TOUCHED_TILES, (i+1)*DT_MAX_TOUCHED_TILES), matching dtTileCacheObstacle::touched.
+	struct ObstacleTileLink
+	{
+		int next;							///< Next link of the tile, or -1.
+		int prev;							///< Previous link of the tile, -1 if first, or -2 if not linked.
+	};
+
+	/// Allocates an obstacle and queues a request to add it.
+	dtTileCacheObstacle* allocObstacle();
+
+	/// Queues a request for the obstacle, replacing its unprocessed request.
+	void queueRequest(dtTileCacheObstacle* ob, const int action);
+
+	/// Queues the tile to be rebuilt, unless it already is, and restarts its rebuild delay.
+	void queueTileUpdate(const dtCompressedTileRef ref);
+
+	/// Adds the obstacle to the obstacle lists of the tiles it touches.
+	void linkObstacleTiles(dtTileCacheObstacle* ob);
+
+	/// Removes the obstacle from the obstacle lists of the tiles it touches.
+	void unlinkObstacleTiles(dtTileCacheObstacle* ob);
+	
+	/// Finds, links and queues the tiles touched by the obstacle.
+	void touchObstacleTiles(dtTileCacheObstacle* ob);
+	
+	/// Moves the shape of the obstacle to the position.
+	void setObstaclePosition(dtTileCacheObstacle* ob, const float* pos);
+	
+	/// Returns true if the queued tile has waited long enough to be rebuilt.
+	bool isTileUpdateDue(const int idx) const;
+	
+	/// Processes the obstacle requests, unless a batch is open.
+	void processRequests();
+	
+	/// Removes the first due tile from the update queue and returns its index, or -1 if none is due.
+	int popTileUpdate();
+	
+	/// Puts a tile back to the front of the update queue.
+	void pushTileUpdateFront(const int idx);
+	
+	/// Rebuilds the tile and updates the obstacles waiting for it.
+	dtStatus rebuildTile(const int idx, class dtNavMesh* navmesh);
+	
+	/// Returns the estimated time to rebuild the tile. [Units: us]
+	float getEstimatedTileCost(const int idx) const;
 	
-	struct ObstacleRequest
+	/// A decompressed layer kept in the layer cache, linked in least recently used order.
+	struct LayerCacheEntry
 	{
-		int action;
-		dtObstacleRef ref;
+		struct dtTileCacheLayer* layer;		///< The unmodified layer, or null if the tile is not cached.
+		int size;							///< Size of the layer allocation.
+		int prev;							///< More recently used tile, or -1.
+		int next;							///< Less recently used tile, or -1.
 	};
 	
+	/// Decompresses the layer of the tile, or copies it from the layer cache.
+	/// The layer is allocated from the tile cache allocator.
+	dtStatus loadTileLayer(const int idx, struct dtTileCacheLayer** layer);
+	
+	/// Frees the cached layer of the tile, if any.
+	void evictCachedLayer(const int idx);
+	
+	/// Unlinks a cached layer from the least recently used list.
+	void unlinkCachedLayer(const int idx);
+	
+	/// Links a cached layer as the most recently used one.
+	void linkCachedLayer(const int idx);
+
+	/// Removes a handled tile from the pending list of the obstacle and finishes the obstacle request when done.
+	void removePendingTile(dtTileCacheObstacle* ob, const dtCompressedTileRef ref);
+
+	/// Returns the obstacle to the free list.
+	void freeObstacle(dtTileCacheObstacle* ob);
+	
 	int m_tileLutSize;						///< Tile hash lookup size (must be pot).
 	int m_tileLutMask;						///< Tile hash lookup mask.
 	
@@ -241,13 +424,35 @@ private:
 	dtTileCacheObstacle* m_obstacles;
 	dtTileCacheObstacle* m_nextFreeObstacle;
 	
-	static const int MAX_REQUESTS = 64;
-	ObstacleRequest m_reqs[MAX_REQUESTS];
-	int m_nreqs;
+	dtTileCacheObstacle* m_reqHead;			///< First obstacle with an unprocessed request.
+	dtTileCacheObstacle* m_reqTail;			///< Last obstacle with an unprocessed request.
+	
+	int* m_tileObstacles;					///< First obstacle link of each tile, or -1. [Size: maxTiles]
+	ObstacleTileLink* m_obstacleLinks;		///< Links from obstacles to touched tiles. [Size: maxObstacles * DT_MAX_TOUCHED_TILES]
+	
+	int* m_update;							///< Ring buffer of tile indices waiting to be rebuilt. [Size: maxTiles]
+	unsigned char* m_updateQueued;			///< Whether a tile index is in the update queue. [Size: maxTiles]
+	int m_updateHead;						///< Position of the first tile in the update queue.
+	int m_nupdate;							///< Number of tiles in the update queue.
+	
+	float* m_obstacleMoves;					///< Target positions of unprocessed move requests. [Size: maxObstacles * 3]
+	float* m_convexVerts;					///< Outlines of the convex obstacles, allocated with the first one. [Size: maxObstacles * #DT_MAX_CONVEX_OBSTACLE_VERTS * 2]
+	int m_batchDepth;						///< Number of open obstacle batches.
+	
+	double m_updateTime;					///< Sum of the time steps passed to update.
+	double* m_tileQueueTime;				///< Time each queued tile was first queued. [Size: maxTiles]
+	double* m_tileChangeTime;				///< Time each queued tile was last changed. [Size: maxTiles]
+	float m_rebuildDelay;					///< Time without changes before a tile is rebuilt.
+	float m_maxRebuildDelay;				///< Longest time a tile waits to be rebuilt.
+	
+	float* m_tileBuildCost;					///< Smoothed rebuild time of each tile, or 0 if unknown. [Size: maxTiles]
+	float m_avgTileBuildCost;				///< Smoothed rebuild time over all tiles.
+	float m_tileBuildCostDev;				///< Smoothed deviation of the rebuild times from the average.
 	
-	static const int MAX_UPDATE = 64;
-	dtCompressedTileRef m_update[MAX_UPDATE];
-	int m_nupdate;
+	LayerCacheEntry* m_layerCache;			///< Cached layer of each tile. [Size: maxTiles, or null if never enabled]
+	int m_layerCacheHead;					///< Most recently used cached tile, or -1.
+	int m_layerCacheTail;					///< Least recently used cached tile, or -1.
+	dtTileCacheLayerCacheStats m_layerCacheStats;
 };
 
 dtTileCache* dtAllocTileCache();
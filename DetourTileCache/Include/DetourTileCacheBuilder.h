@@ -118,6 +118,13 @@ dtStatus dtDecompressTileCacheLayer(dtTileCacheAlloc* alloc, dtTileCacheCompress
 									unsigned char* compressed, const int compressedSize,
 									dtTileCacheLayer** layerOut);
 
+/// Returns the size of the single allocation holding a decompressed layer.
+int dtGetTileCacheLayerSize(const dtTileCacheLayerHeader* header);
+
+/// Copies a decompressed layer into a single allocation, which is freed with #dtFreeTileCacheLayer.
+dtStatus dtCloneTileCacheLayer(dtTileCacheAlloc* alloc, const dtTileCacheLayer& layer,
+							   dtTileCacheLayer** layerOut);
+
 dtTileCacheContourSet* dtAllocTileCacheContourSet(dtTileCacheAlloc* alloc);
 void dtFreeTileCacheContourSet(dtTileCacheAlloc* alloc, dtTileCacheContourSet* cset);
 
@@ -133,6 +140,14 @@ dtStatus dtMarkBoxArea(dtTileCacheLayer& layer, const float* orig, const float c
 dtStatus dtMarkBoxArea(dtTileCacheLayer& layer, const float* orig, const float cs, const float ch,
 					   const float* center, const float* halfExtents, const float* rotAux, const unsigned char areaId);
 
+/// Marks the cells of the layer touched by a convex prism, one row span at a time.
+///  @param[in]		verts		The outline of the prism. [(x, z) * @p nverts]
+///  @param[in]		nverts		The number of vertices.
+///  @param[in]		hmin		The height of the base of the prism.
+///  @param[in]		hmax		The height of the top of the prism.
+dtStatus dtMarkConvexArea(dtTileCacheLayer& layer, const float* orig, const float cs, const float ch,
+						  const float* verts, const int nverts, const float hmin, const float hmax, const unsigned char areaId);
+
 dtStatus dtBuildTileCacheRegions(dtTileCacheAlloc* alloc,
 								 dtTileCacheLayer& layer,
 								 const int walkableClimb);
@@ -23,13 +23,16 @@ void dtFreeTileCache(dtTileCache* tc)
 	dtFree(tc);
 }
 
-static bool contains(const dtCompressedTileRef* a, const int n, const dtCompressedTileRef v)
+static const int DT_OBSTACLE_LINK_DETACHED = -2;
+
+/// Allocates the layers kept in the layer cache, which outlive the tile builds.
+struct dtLayerCacheAlloc : public dtTileCacheAlloc
 {
-	for (int i = 0; i < n; ++i)
-		if (a[i] == v)
-			return true;
-	return false;
-}
+	virtual void* alloc(const size_t size)
+	{
+		return dtAlloc(size, DT_ALLOC_PERM);
+	}
+};
 
 inline int computeTileHash(int x, int y, const int mask)
 {
@@ -73,15 +76,38 @@ dtTileCache::dtTileCache() :
 	m_tmproc(0),
 	m_obstacles(0),
 	m_nextFreeObstacle(0),
-	m_nreqs(0),
-	m_nupdate(0)
+	m_reqHead(0),
+	m_reqTail(0),
+	m_tileObstacles(0),
+	m_obstacleLinks(0),
+	m_update(0),
+	m_updateQueued(0),
+	m_updateHead(0),
+	m_nupdate(0),
+	m_obstacleMoves(0),
+	m_convexVerts(0),
+	m_batchDepth(0),
+	m_updateTime(0.0),
+	m_tileQueueTime(0),
+	m_tileChangeTime(0),
+	m_rebuildDelay(0.0f),
+	m_maxRebuildDelay(0.0f),
+	m_tileBuildCost(0),
+	m_avgTileBuildCost(0.0f),
+	m_tileBuildCostDev(0.0f),
+	m_layerCache(0),
+	m_layerCacheHead(-1),
+	m_layerCacheTail(-1)
 {
 	memset(&m_params, 0, sizeof(m_params));
-	memset(m_reqs, 0, sizeof(ObstacleRequest) * MAX_REQUESTS);
+	memset(&m_layerCacheStats, 0, sizeof(m_layerCacheStats));
 }
 	
 dtTileCache::~dtTileCache()
 {
+	setLayerCacheSize(0);
+	dtFree(m_layerCache);
+	m_layerCache = 0;
 	for (int i = 0; i < m_params.maxTiles; ++i)
 	{
 		if (m_tiles[i].flags & DT_COMPRESSEDTILE_FREE_DATA)
@@ -96,7 +122,26 @@ dtTileCache::~dtTileCache()
 	m_posLookup = 0;
 	dtFree(m_tiles);
 	m_tiles = 0;
-	m_nreqs = 0;
+	dtFree(m_tileObstacles);
+	m_tileObstacles = 0;
+	dtFree(m_obstacleLinks);
+	m_obstacleLinks = 0;
+	dtFree(m_update);
+	m_update = 0;
+	dtFree(m_updateQueued);
+	m_updateQueued = 0;
+	dtFree(m_obstacleMoves);
+	m_obstacleMoves = 0;
+	dtFree(m_convexVerts);
+	m_convexVerts = 0;
+	dtFree(m_tileQueueTime);
+	m_tileQueueTime = 0;
+	dtFree(m_tileChangeTime);
+	m_tileChangeTime = 0;
+	dtFree(m_tileBuildCost);
+	m_tileBuildCost = 0;
+	m_reqHead = 0;
+	m_reqTail = 0;
 	m_nupdate = 0;
 }
 
@@ -123,7 +168,9 @@ dtStatus dtTileCache::init(const dtTileCacheParams* params,
 	m_talloc = talloc;
 	m_tcomp = tcomp;
 	m_tmproc = tmproc;
-	m_nreqs = 0;
+	m_reqHead = 0;
+	m_reqTail = 0;
+	m_batchDepth = 0;
 	memcpy(&m_params, params, sizeof(m_params));
 	
 	// Alloc space for obstacles.
@@ -139,6 +186,20 @@ dtStatus dtTileCache::init(const dtTileCacheParams* params,
 		m_nextFreeObstacle = &m_obstacles[i];
 	}
 	
+	// Alloc space for the links from obstacles to the tiles they touch.
+	const int maxLinks = m_params.maxObstacles * DT_MAX_TOUCHED_TILES;
+	m_obstacleLinks = (ObstacleTileLink*)dtAlloc(sizeof(ObstacleTileLink)*maxLinks, DT_ALLOC_PERM);
+	if (!m_obstacleLinks)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	for (int i = 0; i < maxLinks; ++i)
+	{
+		m_obstacleLinks[i].next = -1;
+		m_obstacleLinks[i].prev = DT_OBSTACLE_LINK_DETACHED;
+	}
+	m_obstacleMoves = (float*)dtAlloc(sizeof(float)*3*m_params.maxObstacles, DT_ALLOC_PERM);
+	if (!m_obstacleMoves)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	
 	// Init tiles
 	m_tileLutSize = dtNextPow2(m_params.maxTiles/4);
 	if (!m_tileLutSize) m_tileLutSize = 1;
@@ -152,6 +213,26 @@ dtStatus dtTileCache::init(const dtTileCacheParams* params,
 		return DT_FAILURE | DT_OUT_OF_MEMORY;
 	memset(m_tiles, 0, sizeof(dtCompressedTile)*m_params.maxTiles);
 	memset(m_posLookup, 0, sizeof(dtCompressedTile*)*m_tileLutSize);
+	
+	// Per tile obstacle lists and update queue.
+	m_tileObstacles = (int*)dtAlloc(sizeof(int)*m_params.maxTiles, DT_ALLOC_PERM);
+	m_update = (int*)dtAlloc(sizeof(int)*m_params.maxTiles, DT_ALLOC_PERM);
+	m_updateQueued = (unsigned char*)dtAlloc(sizeof(unsigned char)*m_params.maxTiles, DT_ALLOC_PERM);
+	m_tileQueueTime = (double*)dtAlloc(sizeof(double)*m_params.maxTiles, DT_ALLOC_PERM);
+	m_tileChangeTime = (double*)dtAlloc(sizeof(double)*m_params.maxTiles, DT_ALLOC_PERM);
+	m_tileBuildCost = (float*)dtAlloc(sizeof(float)*m_params.maxTiles, DT_ALLOC_PERM);
+	if (!m_tileObstacles || !m_update || !m_updateQueued || !m_tileQueueTime || !m_tileChangeTime || !m_tileBuildCost)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	memset(m_tileBuildCost, 0, sizeof(float)*m_params.maxTiles);
+	m_avgTileBuildCost = 0.0f;
+	m_tileBuildCostDev = 0.0f;
+	for (int i = 0; i < m_params.maxTiles; ++i)
+		m_tileObstacles[i] = -1;
+	memset(m_updateQueued, 0, sizeof(unsigned char)*m_params.maxTiles);
+	m_updateHead = 0;
+	m_nupdate = 0;
+	m_updateTime = 0.0;
+	
 	m_nextFreeTile = 0;
 	for (int i = m_params.maxTiles-1; i >= 0; --i)
 	{
@@ -283,6 +364,7 @@ dtStatus dtTileCache::addTile(unsigned char* data, const int dataSize, unsigned
 	tile->compressed = tile->data + headerSize;
 	tile->compressedSize = tile->dataSize - headerSize;
 	tile->flags = flags;
+	m_tileBuildCost[tile - m_tiles] = 0.0f;
 	
 	if (result)
 		*result = getTileRef(tile);
@@ -320,6 +402,23 @@ dtStatus dtTileCache::removeTile(dtCompressedTileRef ref, unsigned char** data,
 		cur = cur->next;
 	}
 	
+	evictCachedLayer((int)tileIndex);
+	
+	// Detach obstacles from the tile. Their requests no longer wait for it.
+	const dtCompressedTileRef oldRef = getTileRef(tile);
+	int link = m_tileObstacles[tileIndex];
+	m_tileObstacles[tileIndex] = -1;
+	while (link != -1)
+	{
+		const int next = m_obstacleLinks[link].next;
+		m_obstacleLinks[link].next = -1;
+		m_obstacleLinks[link].prev = DT_OBSTACLE_LINK_DETACHED;
+		dtTileCacheObstacle* ob = &m_obstacles[link / DT_MAX_TOUCHED_TILES];
+		if (ob->state == DT_OBSTACLE_PROCESSING || ob->state == DT_OBSTACLE_REMOVING)
+			removePendingTile(ob, oldRef);
+		link = next;
+	}
+	
 	// Reset tile.
 	if (tile->flags & DT_COMPRESSEDTILE_FREE_DATA)
 	{
@@ -358,127 +457,339 @@ dtStatus dtTileCache::removeTile(dtCompressedTileRef ref, unsigned char** data,
 
 dtStatus dtTileCache::addObstacle(const float* pos, const float radius, const float height, dtObstacleRef* result)
 {
-	if (m_nreqs >= MAX_REQUESTS)
-		return DT_FAILURE | DT_BUFFER_TOO_SMALL;
-	
-	dtTileCacheObstacle* ob = 0;
-	if (m_nextFreeObstacle)
-	{
-		ob = m_nextFreeObstacle;
-		m_nextFreeObstacle = ob->next;
-		ob->next = 0;
-	}
+	dtTileCacheObstacle* ob = allocObstacle();
 	if (!ob)
 		return DT_FAILURE | DT_OUT_OF_MEMORY;
 	
-	unsigned short salt = ob->salt;
-	memset(ob, 0, sizeof(dtTileCacheObstacle));
-	ob->salt = salt;
-	ob->state = DT_OBSTACLE_PROCESSING;
 	ob->type = DT_OBSTACLE_CYLINDER;
 	dtVcopy(ob->cylinder.pos, pos);
 	ob->cylinder.radius = radius;
 	ob->cylinder.height = height;
 	
-	ObstacleRequest* req = &m_reqs[m_nreqs++];
-	memset(req, 0, sizeof(ObstacleRequest));
-	req->action = REQUEST_ADD;
-	req->ref = getObstacleRef(ob);
-	
 	if (result)
-		*result = req->ref;
+		*result = getObstacleRef(ob);
 	
 	return DT_SUCCESS;
 }
 
 dtStatus dtTileCache::addBoxObstacle(const float* bmin, const float* bmax, dtObstacleRef* result)
 {
-	if (m_nreqs >= MAX_REQUESTS)
-		return DT_FAILURE | DT_BUFFER_TOO_SMALL;
-	
-	dtTileCacheObstacle* ob = 0;
-	if (m_nextFreeObstacle)
-	{
-		ob = m_nextFreeObstacle;
-		m_nextFreeObstacle = ob->next;
-		ob->next = 0;
-	}
+	dtTileCacheObstacle* ob = allocObstacle();
 	if (!ob)
 		return DT_FAILURE | DT_OUT_OF_MEMORY;
 	
-	unsigned short salt = ob->salt;
-	memset(ob, 0, sizeof(dtTileCacheObstacle));
-	ob->salt = salt;
-	ob->state = DT_OBSTACLE_PROCESSING;
 	ob->type = DT_OBSTACLE_BOX;
 	dtVcopy(ob->box.bmin, bmin);
 	dtVcopy(ob->box.bmax, bmax);
 	
-	ObstacleRequest* req = &m_reqs[m_nreqs++];
-	memset(req, 0, sizeof(ObstacleRequest));
-	req->action = REQUEST_ADD;
-	req->ref = getObstacleRef(ob);
-	
 	if (result)
-		*result = req->ref;
+		*result = getObstacleRef(ob);
 	
 	return DT_SUCCESS;
 }
 
 dtStatus dtTileCache::addBoxObstacle(const float* center, const float* halfExtents, const float yRadians, dtObstacleRef* result)
 {
-	if (m_nreqs >= MAX_REQUESTS)
-		return DT_FAILURE | DT_BUFFER_TOO_SMALL;
-
-	dtTileCacheObstacle* ob = 0;
-	if (m_nextFreeObstacle)
-	{
-		ob = m_nextFreeObstacle;
-		m_nextFreeObstacle = ob->next;
-		ob->next = 0;
-	}
+	dtTileCacheObstacle* ob = allocObstacle();
 	if (!ob)
 		return DT_FAILURE | DT_OUT_OF_MEMORY;
 
-	unsigned short salt = ob->salt;
-	memset(ob, 0, sizeof(dtTileCacheObstacle));
-	ob->salt = salt;
-	ob->state = DT_OBSTACLE_PROCESSING;
 	ob->type = DT_OBSTACLE_ORIENTED_BOX;
 	dtVcopy(ob->orientedBox.center, center);
 	dtVcopy(ob->orientedBox.halfExtents, halfExtents);
 
-	float coshalf= cosf(0.5f*yRadians);
-	float sinhalf = sinf(-0.5f*yRadians);
+	float coshalf= dtMathCosf(0.5f*yRadians);
+	float sinhalf = dtMathSinf(-0.5f*yRadians);
 	ob->orientedBox.rotAux[0] = coshalf*sinhalf;
 	ob->orientedBox.rotAux[1] = coshalf*coshalf - 0.5f;
 
-	ObstacleRequest* req = &m_reqs[m_nreqs++];
-	memset(req, 0, sizeof(ObstacleRequest));
-	req->action = REQUEST_ADD;
-	req->ref = getObstacleRef(ob);
-
 	if (result)
-		*result = req->ref;
+		*result = getObstacleRef(ob);
 
 	return DT_SUCCESS;
 }
 
+dtStatus dtTileCache::addConvexObstacle(const float* verts, const int nverts, const float hmin, const float hmax, dtObstacleRef* result)
+{
+	if (!verts || nverts < 3 || nverts > DT_MAX_CONVEX_OBSTACLE_VERTS || hmin > hmax)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	// The outlines are only allocated when convex obstacles are used.
+	if (!m_convexVerts)
+	{
+		m_convexVerts = (float*)dtAlloc(sizeof(float)*DT_MAX_CONVEX_OBSTACLE_VERTS*2*m_params.maxObstacles, DT_ALLOC_PERM);
+		if (!m_convexVerts)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+	
+	dtTileCacheObstacle* ob = allocObstacle();
+	if (!ob)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	
+	ob->type = DT_OBSTACLE_CONVEX;
+	float* outline = &m_convexVerts[(ob - m_obstacles) * DT_MAX_CONVEX_OBSTACLE_VERTS * 2];
+	for (int i = 0; i < nverts; ++i)
+	{
+		outline[i*2+0] = verts[i*3+0];
+		outline[i*2+1] = verts[i*3+2];
+	}
+	ob->convex.nverts = nverts;
+	ob->convex.hmin = hmin;
+	ob->convex.hmax = hmax;
+	
+	if (result)
+		*result = getObstacleRef(ob);
+	
+	return DT_SUCCESS;
+}
+
 dtStatus dtTileCache::removeObstacle(const dtObstacleRef ref)
 {
 	if (!ref)
 		return DT_SUCCESS;
-	if (m_nreqs >= MAX_REQUESTS)
-		return DT_FAILURE | DT_BUFFER_TOO_SMALL;
 	
-	ObstacleRequest* req = &m_reqs[m_nreqs++];
-	memset(req, 0, sizeof(ObstacleRequest));
-	req->action = REQUEST_REMOVE;
-	req->ref = ref;
+	unsigned int idx = decodeObstacleIdObstacle(ref);
+	if ((int)idx >= m_params.maxObstacles)
+		return DT_SUCCESS;
+	dtTileCacheObstacle* ob = &m_obstacles[idx];
+	if (ob->salt != decodeObstacleIdSalt(ref) || ob->state == DT_OBSTACLE_EMPTY)
+		return DT_SUCCESS;
+	
+	// The obstacle is already being removed.
+	if (ob->state == DT_OBSTACLE_REMOVING || ob->request == REQUEST_REMOVE)
+		return DT_SUCCESS;
+	
+	queueRequest(ob, REQUEST_REMOVE);
 	
 	return DT_SUCCESS;
 }
 
+dtStatus dtTileCache::moveObstacle(const dtObstacleRef ref, const float* pos)
+{
+	if (!ref)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	unsigned int idx = decodeObstacleIdObstacle(ref);
+	if ((int)idx >= m_params.maxObstacles)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	dtTileCacheObstacle* ob = &m_obstacles[idx];
+	if (ob->salt != decodeObstacleIdSalt(ref) || ob->state == DT_OBSTACLE_EMPTY)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	// Cannot move an obstacle that is being removed.
+	if (ob->state == DT_OBSTACLE_REMOVING || ob->request == REQUEST_REMOVE)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	// The obstacle has not touched any tiles yet, move it directly.
+	if (ob->request == REQUEST_ADD)
+	{
+		setObstaclePosition(ob, pos);
+		return DT_SUCCESS;
+	}
+	
+	// Keep the current shape until the move is processed, tiles rebuilt
+	// before then must not see it half way.
+	dtVcopy(&m_obstacleMoves[idx*3], pos);
+	queueRequest(ob, REQUEST_MOVE);
+	
+	return DT_SUCCESS;
+}
+
+void dtTileCache::beginObstacleBatch()
+{
+	m_batchDepth++;
+}
+
+dtStatus dtTileCache::commitObstacleBatch()
+{
+	if (m_batchDepth <= 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	m_batchDepth--;
+	return DT_SUCCESS;
+}
+
+void dtTileCache::setTileRebuildDelay(const float delay, const float maxDelay)
+{
+	m_rebuildDelay = dtMax(delay, 0.0f);
+	m_maxRebuildDelay = dtMax(maxDelay, m_rebuildDelay);
+}
+
+dtTileCacheObstacle* dtTileCache::allocObstacle()
+{
+	dtTileCacheObstacle* ob = m_nextFreeObstacle;
+	if (!ob)
+		return 0;
+	m_nextFreeObstacle = ob->next;
+	
+	unsigned short salt = ob->salt;
+	memset(ob, 0, sizeof(dtTileCacheObstacle));
+	ob->salt = salt;
+	ob->state = DT_OBSTACLE_PROCESSING;
+	queueRequest(ob, REQUEST_ADD);
+	
+	return ob;
+}
+
+void dtTileCache::queueRequest(dtTileCacheObstacle* ob, const int action)
+{
+	if (ob->request == REQUEST_NONE)
+	{
+		ob->next = 0;
+		if (m_reqTail)
+			m_reqTail->next = ob;
+		else
+			m_reqHead = ob;
+		m_reqTail = ob;
+	}
+	ob->request = (unsigned char)action;
+}
+
+void dtTileCache::queueTileUpdate(const dtCompressedTileRef ref)
+{
+	const unsigned int idx = decodeTileIdTile(ref);
+	m_tileChangeTime[idx] = m_updateTime;
+	if (m_updateQueued[idx])
+		return;
+	m_updateQueued[idx] = 1;
+	m_tileQueueTime[idx] = m_updateTime;
+	m_update[(m_updateHead + m_nupdate) % m_params.maxTiles] = (int)idx;
+	m_nupdate++;
+}
+
+void dtTileCache::linkObstacleTiles(dtTileCacheObstacle* ob)
+{
+	const int base = (int)(ob - m_obstacles) * DT_MAX_TOUCHED_TILES;
+	for (int i = 0; i < (int)ob->ntouched; ++i)
+	{
+		const int link = base + i;
+		int& first = m_tileObstacles[decodeTileIdTile(ob->touched[i])];
+		m_obstacleLinks[link].prev = -1;
+		m_obstacleLinks[link].next = first;
+		if (first != -1)
+			m_obstacleLinks[first].prev = link;
+		first = link;
+	}
+}
+
+void dtTileCache::unlinkObstacleTiles(dtTileCacheObstacle* ob)
+{
+	const int base = (int)(ob - m_obstacles) * DT_MAX_TOUCHED_TILES;
+	for (int i = 0; i < (int)ob->ntouched; ++i)
+	{
+		ObstacleTileLink& link = m_obstacleLinks[base + i];
+		if (link.prev == DT_OBSTACLE_LINK_DETACHED)
+			continue;
+		if (link.prev != -1)
+			m_obstacleLinks[link.prev].next = link.next;
+		else
+			m_tileObstacles[decodeTileIdTile(ob->touched[i])] = link.next;
+		if (link.next != -1)
+			m_obstacleLinks[link.next].prev = link.prev;
+		link.next = -1;
+		link.prev = DT_OBSTACLE_LINK_DETACHED;
+	}
+}
+
+void dtTileCache::touchObstacleTiles(dtTileCacheObstacle* ob)
+{
+	// Find touched tiles.
+	float bmin[3], bmax[3];
+	getObstacleBounds(ob, bmin, bmax);
+	
+	int ntouched = 0;
+	queryTiles(bmin, bmax, ob->touched, &ntouched, DT_MAX_TOUCHED_TILES);
+	ob->ntouched = (unsigned char)ntouched;
+	linkObstacleTiles(ob);
+	// Add tiles to update list.
+	ob->npending = 0;
+	for (int j = 0; j < ob->ntouched; ++j)
+	{
+		queueTileUpdate(ob->touched[j]);
+		ob->pending[ob->npending++] = ob->touched[j];
+	}
+	ob->state = ob->npending ? DT_OBSTACLE_PROCESSING : DT_OBSTACLE_PROCESSED;
+}
+
+void dtTileCache::setObstaclePosition(dtTileCacheObstacle* ob, const float* pos)
+{
+	if (ob->type == DT_OBSTACLE_CYLINDER)
+	{
+		dtVcopy(ob->cylinder.pos, pos);
+	}
+	else if (ob->type == DT_OBSTACLE_BOX)
+	{
+		float half[3];
+		dtVsub(half, ob->box.bmax, ob->box.bmin);
+		dtVscale(half, half, 0.5f);
+		dtVsub(ob->box.bmin, pos, half);
+		dtVadd(ob->box.bmax, pos, half);
+	}
+	else if (ob->type == DT_OBSTACLE_ORIENTED_BOX)
+	{
+		dtVcopy(ob->orientedBox.center, pos);
+	}
+	else if (ob->type == DT_OBSTACLE_CONVEX)
+	{
+		float bmin[3], bmax[3], offset[3];
+		getObstacleBounds(ob, bmin, bmax);
+		for (int i = 0; i < 3; ++i)
+			offset[i] = pos[i] - (bmin[i] + bmax[i])*0.5f;
+		float* outline = &m_convexVerts[(ob - m_obstacles) * DT_MAX_CONVEX_OBSTACLE_VERTS * 2];
+		for (int i = 0; i < ob->convex.nverts; ++i)
+		{
+			outline[i*2+0] += offset[0];
+			outline[i*2+1] += offset[2];
+		}
+		ob->convex.hmin += offset[1];
+		ob->convex.hmax += offset[1];
+	}
+}
+
+bool dtTileCache::isTileUpdateDue(const int idx) const
+{
+	return m_updateTime - m_tileChangeTime[idx] >= m_rebuildDelay ||
+		   m_updateTime - m_tileQueueTime[idx] >= m_maxRebuildDelay;
+}
+
+void dtTileCache::removePendingTile(dtTileCacheObstacle* ob, const dtCompressedTileRef ref)
+{
+	// Remove handled tile from pending list.
+	for (int j = 0; j < (int)ob->npending; j++)
+	{
+		if (ob->pending[j] == ref)
+		{
+			ob->pending[j] = ob->pending[(int)ob->npending-1];
+			ob->npending--;
+			break;
+		}
+	}
+	
+	// If all pending tiles processed, change state.
+	if (ob->npending == 0)
+	{
+		if (ob->state == DT_OBSTACLE_PROCESSING)
+			ob->state = DT_OBSTACLE_PROCESSED;
+		else if (ob->state == DT_OBSTACLE_REMOVING)
+			freeObstacle(ob);
+	}
+}
+
+void dtTileCache::freeObstacle(dtTileCacheObstacle* ob)
+{
+	dtAssert(ob->request == REQUEST_NONE);
+	unlinkObstacleTiles(ob);
+	ob->state = DT_OBSTACLE_EMPTY;
+	ob->ntouched = 0;
+	ob->npending = 0;
+	// Update salt, salt should never be zero.
+	ob->salt = (ob->salt+1) & ((1<<16)-1);
+	if (ob->salt == 0)
+		ob->salt++;
+	// Return obstacle to free list.
+	ob->next = m_nextFreeObstacle;
+	m_nextFreeObstacle = ob;
+}
+
 dtStatus dtTileCache::queryTiles(const float* bmin, const float* bmax,
 								 dtCompressedTileRef* results, int* resultCount, const int maxResults) const 
 {
@@ -520,120 +831,320 @@ dtStatus dtTileCache::queryTiles(const float* bmin, const float* bmax,
 	return DT_SUCCESS;
 }
 
-dtStatus dtTileCache::update(const float /*dt*/, dtNavMesh* navmesh,
-							 bool* upToDate)
+void dtTileCache::processRequests()
 {
-	if (m_nupdate == 0)
+	// Process requests, unless they are held back by a batch.
+	while (m_reqHead && m_batchDepth == 0)
 	{
-		// Process requests.
-		for (int i = 0; i < m_nreqs; ++i)
+		dtTileCacheObstacle* ob = m_reqHead;
+		m_reqHead = ob->next;
+		ob->next = 0;
+		const int action = ob->request;
+		ob->request = REQUEST_NONE;
+		
+		if (action == REQUEST_ADD)
 		{
-			ObstacleRequest* req = &m_reqs[i];
-			
-			unsigned int idx = decodeObstacleIdObstacle(req->ref);
-			if ((int)idx >= m_params.maxObstacles)
-				continue;
-			dtTileCacheObstacle* ob = &m_obstacles[idx];
-			unsigned int salt = decodeObstacleIdSalt(req->ref);
-			if (ob->salt != salt)
-				continue;
-			
-			if (req->action == REQUEST_ADD)
+			touchObstacleTiles(ob);
+		}
+		else if (action == REQUEST_MOVE)
+		{
+			// Rebuild the tiles the obstacle leaves, then the ones it enters.
+			// Tiles in both are queued only once.
+			const int base = (int)(ob - m_obstacles) * DT_MAX_TOUCHED_TILES;
+			for (int j = 0; j < ob->ntouched; ++j)
 			{
-				// Find touched tiles.
-				float bmin[3], bmax[3];
-				getObstacleBounds(ob, bmin, bmax);
-
-				int ntouched = 0;
-				queryTiles(bmin, bmax, ob->touched, &ntouched, DT_MAX_TOUCHED_TILES);
-				ob->ntouched = (unsigned char)ntouched;
-				// Add tiles to update list.
-				ob->npending = 0;
-				for (int j = 0; j < ob->ntouched; ++j)
-				{
-					if (m_nupdate < MAX_UPDATE)
-					{
-						if (!contains(m_update, m_nupdate, ob->touched[j]))
-							m_update[m_nupdate++] = ob->touched[j];
-						ob->pending[ob->npending++] = ob->touched[j];
-					}
-				}
+				if (m_obstacleLinks[base + j].prev != DT_OBSTACLE_LINK_DETACHED)
+					queueTileUpdate(ob->touched[j]);
 			}
-			else if (req->action == REQUEST_REMOVE)
+			unlinkObstacleTiles(ob);
+			setObstaclePosition(ob, &m_obstacleMoves[(ob - m_obstacles)*3]);
+			touchObstacleTiles(ob);
+		}
+		else if (action == REQUEST_REMOVE)
+		{
+			// Prepare to remove obstacle.
+			ob->state = DT_OBSTACLE_REMOVING;
+			// Add tiles that still exist to update list.
+			const int base = (int)(ob - m_obstacles) * DT_MAX_TOUCHED_TILES;
+			ob->npending = 0;
+			for (int j = 0; j < ob->ntouched; ++j)
 			{
-				// Prepare to remove obstacle.
-				ob->state = DT_OBSTACLE_REMOVING;
-				// Add tiles to update list.
-				ob->npending = 0;
-				for (int j = 0; j < ob->ntouched; ++j)
-				{
-					if (m_nupdate < MAX_UPDATE)
-					{
-						if (!contains(m_update, m_nupdate, ob->touched[j]))
-							m_update[m_nupdate++] = ob->touched[j];
-						ob->pending[ob->npending++] = ob->touched[j];
-					}
-				}
+				if (m_obstacleLinks[base + j].prev == DT_OBSTACLE_LINK_DETACHED)
+					continue;
+				queueTileUpdate(ob->touched[j]);
+				ob->pending[ob->npending++] = ob->touched[j];
 			}
+			if (ob->npending == 0)
+				freeObstacle(ob);
 		}
+	}
+	if (!m_reqHead)
+		m_reqTail = 0;
+}
+
+int dtTileCache::popTileUpdate()
+{
+	// Tiles still waiting for their rebuild delay go to the back of the queue.
+	for (int n = m_nupdate; n > 0; --n)
+	{
+		const int idx = m_update[m_updateHead];
+		m_updateHead = (m_updateHead + 1) % m_params.maxTiles;
+		m_nupdate--;
 		
-		m_nreqs = 0;
+		// Skip tiles removed after they were queued.
+		const dtCompressedTile* tile = &m_tiles[idx];
+		if (tile->header && !isTileUpdateDue(idx))
+		{
+			m_update[(m_updateHead + m_nupdate) % m_params.maxTiles] = idx;
+			m_nupdate++;
+			continue;
+		}
+		m_updateQueued[idx] = 0;
+		if (!tile->header)
+			continue;
+		return idx;
 	}
+	return -1;
+}
+
+void dtTileCache::pushTileUpdateFront(const int idx)
+{
+	m_updateHead = (m_updateHead + m_params.maxTiles - 1) % m_params.maxTiles;
+	m_update[m_updateHead] = idx;
+	m_updateQueued[idx] = 1;
+	m_nupdate++;
+}
+
+dtStatus dtTileCache::rebuildTile(const int idx, dtNavMesh* navmesh)
+{
+	// Build mesh
+	const dtCompressedTileRef ref = getTileRef(&m_tiles[idx]);
+	dtStatus status = buildNavMeshTile(ref, navmesh);
 	
-	dtStatus status = DT_SUCCESS;
-	// Process updates
-	if (m_nupdate)
+	// Update states of the obstacles touching the tile.
+	int link = m_tileObstacles[idx];
+	while (link != -1)
 	{
-		// Build mesh
-		const dtCompressedTileRef ref = m_update[0];
-		status = buildNavMeshTile(ref, navmesh);
-		m_nupdate--;
-		if (m_nupdate > 0)
-			memmove(m_update, m_update+1, m_nupdate*sizeof(dtCompressedTileRef));
+		const int next = m_obstacleLinks[link].next;
+		dtTileCacheObstacle* ob = &m_obstacles[link / DT_MAX_TOUCHED_TILES];
+		if (ob->state == DT_OBSTACLE_PROCESSING || ob->state == DT_OBSTACLE_REMOVING)
+			removePendingTile(ob, ref);
+		link = next;
+	}
+	
+	return status;
+}
+
+float dtTileCache::getEstimatedTileCost(const int idx) const
+{
+	// Tiles not built yet are expected to cost the average plus its typical deviation.
+	return m_tileBuildCost[idx] > 0.0f ? m_tileBuildCost[idx] : m_avgTileBuildCost + m_tileBuildCostDev;
+}
+
+dtStatus dtTileCache::setLayerCacheSize(const int maxBytes)
+{
+	if (maxBytes < 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	if (maxBytes > 0 && !m_layerCache)
+	{
+		if (!m_tiles)
+			return DT_FAILURE | DT_INVALID_PARAM;
+		m_layerCache = (LayerCacheEntry*)dtAlloc(sizeof(LayerCacheEntry)*m_params.maxTiles, DT_ALLOC_PERM);
+		if (!m_layerCache)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		memset(m_layerCache, 0, sizeof(LayerCacheEntry)*m_params.maxTiles);
+		m_layerCacheHead = -1;
+		m_layerCacheTail = -1;
+	}
+	
+	m_layerCacheStats.maxBytes = maxBytes;
+	while (m_layerCacheTail != -1 && m_layerCacheStats.usedBytes > maxBytes)
+	{
+		evictCachedLayer(m_layerCacheTail);
+		m_layerCacheStats.evictions++;
+	}
+	
+	return DT_SUCCESS;
+}
+
+void dtTileCache::getLayerCacheStats(dtTileCacheLayerCacheStats* stats) const
+{
+	*stats = m_layerCacheStats;
+}
+
+dtStatus dtTileCache::loadTileLayer(const int idx, dtTileCacheLayer** layer)
+{
+	const dtCompressedTile* tile = &m_tiles[idx];
+	if (!m_layerCacheStats.maxBytes)
+		return dtDecompressTileCacheLayer(m_talloc, m_tcomp, tile->data, tile->dataSize, layer);
+	
+	LayerCacheEntry& entry = m_layerCache[idx];
+	if (entry.layer)
+	{
+		m_layerCacheStats.hits++;
+		unlinkCachedLayer(idx);
+		linkCachedLayer(idx);
+		return dtCloneTileCacheLayer(m_talloc, *entry.layer, layer);
+	}
+	
+	m_layerCacheStats.misses++;
+	dtStatus status = dtDecompressTileCacheLayer(m_talloc, m_tcomp, tile->data, tile->dataSize, layer);
+	if (dtStatusFailed(status))
+		return status;
+	
+	// Keep a copy of the layer before obstacles are carved into it.
+	const int size = dtGetTileCacheLayerSize((*layer)->header);
+	if (size > m_layerCacheStats.maxBytes)
+		return status;
+	while (m_layerCacheTail != -1 && m_layerCacheStats.usedBytes + size > m_layerCacheStats.maxBytes)
+	{
+		evictCachedLayer(m_layerCacheTail);
+		m_layerCacheStats.evictions++;
+	}
+	dtLayerCacheAlloc alloc;
+	if (dtStatusFailed(dtCloneTileCacheLayer(&alloc, **layer, &entry.layer)))
+	{
+		// The cache is an optimization, the build goes on without it.
+		entry.layer = 0;
+		return status;
+	}
+	entry.size = size;
+	linkCachedLayer(idx);
+	m_layerCacheStats.usedBytes += size;
+	m_layerCacheStats.layerCount++;
+	
+	return status;
+}
+
+void dtTileCache::evictCachedLayer(const int idx)
+{
+	if (!m_layerCache || !m_layerCache[idx].layer)
+		return;
+	LayerCacheEntry& entry = m_layerCache[idx];
+	unlinkCachedLayer(idx);
+	dtLayerCacheAlloc alloc;
+	dtFreeTileCacheLayer(&alloc, entry.layer);
+	entry.layer = 0;
+	m_layerCacheStats.usedBytes -= entry.size;
+	m_layerCacheStats.layerCount--;
+	entry.size = 0;
+}
+
+void dtTileCache::unlinkCachedLayer(const int idx)
+{
+	LayerCacheEntry& entry = m_layerCache[idx];
+	if (entry.prev != -1)
+		m_layerCache[entry.prev].next = entry.next;
+	else
+		m_layerCacheHead = entry.next;
+	if (entry.next != -1)
+		m_layerCache[entry.next].prev = entry.prev;
+	else
+		m_layerCacheTail = entry.prev;
+	entry.prev = -1;
+	entry.next = -1;
+}
+
+void dtTileCache::linkCachedLayer(const int idx)
+{
+	LayerCacheEntry& entry = m_layerCache[idx];
+	entry.prev = -1;
+	entry.next = m_layerCacheHead;
+	if (m_layerCacheHead != -1)
+		m_layerCache[m_layerCacheHead].prev = idx;
+	else
+		m_layerCacheTail = idx;
+	m_layerCacheHead = idx;
+}
+
+float dtTileCache::getEstimatedBacklog() const
+{
+	float cost = 0.0f;
+	for (int i = 0; i < m_nupdate; ++i)
+		cost += getEstimatedTileCost(m_update[(m_updateHead + i) % m_params.maxTiles]);
+	return cost;
+}
 
-		// Update obstacle states.
-		for (int i = 0; i < m_params.maxObstacles; ++i)
+dtStatus dtTileCache::update(const float dt, dtNavMesh* navmesh,
+							 bool* upToDate)
+{
+	m_updateTime += dt;
+	
+	processRequests();
+	
+	dtStatus status = DT_SUCCESS;
+	const int idx = popTileUpdate();
+	if (idx != -1)
+		status = rebuildTile(idx, navmesh);
+	
+	if (upToDate)
+		*upToDate = m_nupdate == 0 && m_reqHead == 0;
+
+	return status;
+}
+
+dtStatus dtTileCache::update(const float dt, dtNavMesh* navmesh, dtClock* clock, const double deadline,
+							 dtTileCacheUpdateStats* stats, bool* upToDate)
+{
+	if (!clock)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	m_updateTime += dt;
+	
+	const double start = clock->getTime();
+	processRequests();
+	
+	dtStatus status = DT_SUCCESS;
+	int built = 0;
+	double now = clock->getTime();
+	while (m_nupdate)
+	{
+		const int idx = popTileUpdate();
+		if (idx == -1)
+			break;
+		
+		// Stop before a tile that would not finish in time. The first tile is always
+		// built so that the cache keeps making progress with any budget.
+		if (built > 0 && now + getEstimatedTileCost(idx) > deadline)
 		{
-			dtTileCacheObstacle* ob = &m_obstacles[i];
-			if (ob->state == DT_OBSTACLE_PROCESSING || ob->state == DT_OBSTACLE_REMOVING)
-			{
-				// Remove handled tile from pending list.
-				for (int j = 0; j < (int)ob->npending; j++)
-				{
-					if (ob->pending[j] == ref)
-					{
-						ob->pending[j] = ob->pending[(int)ob->npending-1];
-						ob->npending--;
-						break;
-					}
-				}
-				
-				// If all pending tiles processed, change state.
-				if (ob->npending == 0)
-				{
-					if (ob->state == DT_OBSTACLE_PROCESSING)
-					{
-						ob->state = DT_OBSTACLE_PROCESSED;
-					}
-					else if (ob->state == DT_OBSTACLE_REMOVING)
-					{
-						ob->state = DT_OBSTACLE_EMPTY;
-						// Update salt, salt should never be zero.
-						ob->salt = (ob->salt+1) & ((1<<16)-1);
-						if (ob->salt == 0)
-							ob->salt++;
-						// Return obstacle to free list.
-						ob->next = m_nextFreeObstacle;
-						m_nextFreeObstacle = ob;
-					}
-				}
-			}
+			pushTileUpdateFront(idx);
+			break;
+		}
+		
+		status = rebuildTile(idx, navmesh);
+		built++;
+		
+		// Learn the cost of the tile.
+		const double end = clock->getTime();
+		const float cost = dtMax((float)(end - now), 1e-3f);
+		m_tileBuildCost[idx] = m_tileBuildCost[idx] > 0.0f ? m_tileBuildCost[idx]*0.75f + cost*0.25f : cost;
+		if (m_avgTileBuildCost > 0.0f)
+		{
+			m_tileBuildCostDev = m_tileBuildCostDev*0.9f + dtAbs(cost - m_avgTileBuildCost)*0.1f;
+			m_avgTileBuildCost = m_avgTileBuildCost*0.9f + cost*0.1f;
 		}
+		else
+		{
+			m_avgTileBuildCost = cost;
+		}
+		now = end;
+		
+		if (dtStatusFailed(status))
+			break;
+	}
+	
+	if (stats)
+	{
+		stats->tilesBuilt = built;
+		stats->tilesQueued = m_nupdate;
+		stats->requestsHeld = m_reqHead != 0;
+		stats->timeUsed = (float)(now - start);
+		stats->estimatedBacklog = getEstimatedBacklog();
 	}
 	
 	if (upToDate)
-		*upToDate = m_nupdate == 0 && m_nreqs == 0;
-
+		*upToDate = m_nupdate == 0 && m_reqHead == 0;
+	
 	return status;
 }
 
@@ -660,7 +1171,7 @@ dtStatus dtTileCache::buildNavMeshTile(const dtCompressedTileRef ref, dtNavMesh*
 	dtAssert(m_tcomp);
 	
 	unsigned int idx = decodeTileIdTile(ref);
-	if (idx > (unsigned int)m_params.maxTiles)
+	if (idx >= (unsigned int)m_params.maxTiles)
 		return DT_FAILURE | DT_INVALID_PARAM;
 	const dtCompressedTile* tile = &m_tiles[idx];
 	unsigned int salt = decodeTileIdSalt(ref);
@@ -674,33 +1185,35 @@ dtStatus dtTileCache::buildNavMeshTile(const dtCompressedTileRef ref, dtNavMesh*
 	dtStatus status;
 	
 	// Decompress tile layer data. 
-	status = dtDecompressTileCacheLayer(m_talloc, m_tcomp, tile->data, tile->dataSize, &bc.layer);
+	status = loadTileLayer((int)idx, &bc.layer);
 	if (dtStatusFailed(status))
 		return status;
 	
-	// Rasterize obstacles.
-	for (int i = 0; i < m_params.maxObstacles; ++i)
+	// Rasterize obstacles touching the tile.
+	for (int link = m_tileObstacles[idx]; link != -1; link = m_obstacleLinks[link].next)
 	{
-		const dtTileCacheObstacle* ob = &m_obstacles[i];
+		const dtTileCacheObstacle* ob = &m_obstacles[link / DT_MAX_TOUCHED_TILES];
 		if (ob->state == DT_OBSTACLE_EMPTY || ob->state == DT_OBSTACLE_REMOVING)
 			continue;
-		if (contains(ob->touched, ob->ntouched, ref))
+		if (ob->type == DT_OBSTACLE_CYLINDER)
 		{
-			if (ob->type == DT_OBSTACLE_CYLINDER)
-			{
-				dtMarkCylinderArea(*bc.layer, tile->header->bmin, m_params.cs, m_params.ch,
-							    ob->cylinder.pos, ob->cylinder.radius, ob->cylinder.height, 0);
-			}
-			else if (ob->type == DT_OBSTACLE_BOX)
-			{
-				dtMarkBoxArea(*bc.layer, tile->header->bmin, m_params.cs, m_params.ch,
-					ob->box.bmin, ob->box.bmax, 0);
-			}
-			else if (ob->type == DT_OBSTACLE_ORIENTED_BOX)
-			{
-				dtMarkBoxArea(*bc.layer, tile->header->bmin, m_params.cs, m_params.ch,
-					ob->orientedBox.center, ob->orientedBox.halfExtents, ob->orientedBox.rotAux, 0);
-			}
+			dtMarkCylinderArea(*bc.layer, tile->header->bmin, m_params.cs, m_params.ch,
+						    ob->cylinder.pos, ob->cylinder.radius, ob->cylinder.height, 0);
+		}
+		else if (ob->type == DT_OBSTACLE_BOX)
+		{
+			dtMarkBoxArea(*bc.layer, tile->header->bmin, m_params.cs, m_params.ch,
+				ob->box.bmin, ob->box.bmax, 0);
+		}
+		else if (ob->type == DT_OBSTACLE_ORIENTED_BOX)
+		{
+			dtMarkBoxArea(*bc.layer, tile->header->bmin, m_params.cs, m_params.ch,
+				ob->orientedBox.center, ob->orientedBox.halfExtents, ob->orientedBox.rotAux, 0);
+		}
+		else if (ob->type == DT_OBSTACLE_CONVEX)
+		{
+			dtMarkConvexArea(*bc.layer, tile->header->bmin, m_params.cs, m_params.ch,
+				getObstacleConvexVerts(ob), ob->convex.nverts, ob->convex.hmin, ob->convex.hmax, 0);
 		}
 	}
 	
@@ -822,4 +1335,21 @@ void dtTileCache::getObstacleBounds(const struct dtTileCacheObstacle* ob, float*
 		bmin[2] = orientedBox.center[2] - maxr;
 		bmax[2] = orientedBox.center[2] + maxr;
 	}
+	else if (ob->type == DT_OBSTACLE_CONVEX)
+	{
+		const dtObstacleConvex &convex = ob->convex;
+		const float* verts = getObstacleConvexVerts(ob);
+
+		bmin[0] = bmax[0] = verts[0];
+		bmin[2] = bmax[2] = verts[1];
+		for (int i = 1; i < convex.nverts; ++i)
+		{
+			bmin[0] = dtMin(bmin[0], verts[i*2+0]);
+			bmax[0] = dtMax(bmax[0], verts[i*2+0]);
+			bmin[2] = dtMin(bmin[2], verts[i*2+1]);
+			bmax[2] = dtMax(bmax[2], verts[i*2+1]);
+		}
+		bmin[1] = convex.hmin;
+		bmax[1] = convex.hmax;
+	}
 }
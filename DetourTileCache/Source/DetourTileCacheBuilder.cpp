@@ -22,6 +22,7 @@
 #include "DetourAssert.h"
 #include "DetourTileCacheBuilder.h"
 #include <string.h>
+#include <float.h>
 
 dtTileCacheAlloc::~dtTileCacheAlloc()
 {
@@ -2080,6 +2081,88 @@ dtStatus dtMarkBoxArea(dtTileCacheLayer& layer, const float* orig, const float c
 	return DT_SUCCESS;
 }
 
+dtStatus dtMarkConvexArea(dtTileCacheLayer& layer, const float* orig, const float cs, const float ch,
+						  const float* verts, const int nverts, const float hmin, const float hmax, const unsigned char areaId)
+{
+	const int w = (int)layer.header->width;
+	const int h = (int)layer.header->height;
+	const float ics = 1.0f/cs;
+	const float ich = 1.0f/ch;
+
+	float vminz = verts[1], vmaxz = verts[1];
+	for (int i = 1; i < nverts; ++i)
+	{
+		vminz = dtMin(vminz, verts[i*2+1]);
+		vmaxz = dtMax(vmaxz, verts[i*2+1]);
+	}
+	int minz = (int)floorf((vminz-orig[2])*ics);
+	int maxz = (int)floorf((vmaxz-orig[2])*ics);
+	const int miny = (int)floorf((hmin-orig[1])*ich);
+	const int maxy = (int)floorf((hmax-orig[1])*ich);
+
+	if (maxz < 0) return DT_SUCCESS;
+	if (minz >= h) return DT_SUCCESS;
+
+	if (minz < 0) minz = 0;
+	if (maxz >= h) maxz = h-1;
+
+	for (int z = minz; z <= maxz; ++z)
+	{
+		// Find the extent of the outline within the row of cells.
+		const float z0 = orig[2] + z*cs;
+		const float z1 = z0 + cs;
+		float xmin = FLT_MAX, xmax = -FLT_MAX;
+		for (int i = 0, j = nverts-1; i < nverts; j = i++)
+		{
+			const float* vi = &verts[i*2];
+			const float* vj = &verts[j*2];
+			if (vi[1] >= z0 && vi[1] <= z1)
+			{
+				xmin = dtMin(xmin, vi[0]);
+				xmax = dtMax(xmax, vi[0]);
+			}
+			const float ez0 = dtMin(vi[1], vj[1]);
+			const float ez1 = dtMax(vi[1], vj[1]);
+			if (ez1 - ez0 < 1e-6f)
+				continue;
+			const float dxdz = (vj[0] - vi[0]) / (vj[1] - vi[1]);
+			if (z0 > ez0 && z0 < ez1)
+			{
+				const float x = vi[0] + (z0 - vi[1])*dxdz;
+				xmin = dtMin(xmin, x);
+				xmax = dtMax(xmax, x);
+			}
+			if (z1 > ez0 && z1 < ez1)
+			{
+				const float x = vi[0] + (z1 - vi[1])*dxdz;
+				xmin = dtMin(xmin, x);
+				xmax = dtMax(xmax, x);
+			}
+		}
+		if (xmin > xmax)
+			continue;
+
+		int minx = (int)floorf((xmin-orig[0])*ics);
+		int maxx = (int)floorf((xmax-orig[0])*ics);
+		if (maxx < 0 || minx >= w)
+			continue;
+		if (minx < 0) minx = 0;
+		if (maxx >= w) maxx = w-1;
+
+		const unsigned char* heights = &layer.heights[z*w];
+		unsigned char* areas = &layer.areas[z*w];
+		for (int x = minx; x <= maxx; ++x)
+		{
+			const int y = heights[x];
+			if (y < miny || y > maxy)
+				continue;
+			areas[x] = areaId;
+		}
+	}
+
+	return DT_SUCCESS;
+}
+
 dtStatus dtBuildTileCacheLayer(dtTileCacheCompressor* comp,
 							   dtTileCacheLayerHeader* header,
 							   const unsigned char* heights,
@@ -2161,7 +2244,7 @@ dtStatus dtDecompressTileCacheLayer(dtTileCacheAlloc* alloc, dtTileCacheCompress
 	const int layerSize = dtAlign4(sizeof(dtTileCacheLayer));
 	const int headerSize = dtAlign4(sizeof(dtTileCacheLayerHeader));
 	const int gridSize = (int)compressedHeader->width * (int)compressedHeader->height;
-	const int bufferSize = layerSize + headerSize + gridSize*4;
+	const int bufferSize = dtGetTileCacheLayerSize(compressedHeader);
 	
 	unsigned char* buffer = (unsigned char*)alloc->alloc(bufferSize);
 	if (!buffer)
@@ -2196,6 +2279,52 @@ dtStatus dtDecompressTileCacheLayer(dtTileCacheAlloc* alloc, dtTileCacheCompress
 	return DT_SUCCESS;
 }
 
+int dtGetTileCacheLayerSize(const dtTileCacheLayerHeader* header)
+{
+	const int layerSize = dtAlign4(sizeof(dtTileCacheLayer));
+	const int headerSize = dtAlign4(sizeof(dtTileCacheLayerHeader));
+	const int gridSize = (int)header->width * (int)header->height;
+	return layerSize + headerSize + gridSize*4;
+}
+
+dtStatus dtCloneTileCacheLayer(dtTileCacheAlloc* alloc, const dtTileCacheLayer& src,
+							   dtTileCacheLayer** layerOut)
+{
+	dtAssert(alloc);
+	
+	if (!layerOut || !src.header)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	const int layerSize = dtAlign4(sizeof(dtTileCacheLayer));
+	const int headerSize = dtAlign4(sizeof(dtTileCacheLayerHeader));
+	const int gridSize = (int)src.header->width * (int)src.header->height;
+	const int bufferSize = dtGetTileCacheLayerSize(src.header);
+	
+	unsigned char* buffer = (unsigned char*)alloc->alloc(bufferSize);
+	if (!buffer)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	
+	dtTileCacheLayer* layer = (dtTileCacheLayer*)buffer;
+	dtTileCacheLayerHeader* header = (dtTileCacheLayerHeader*)(buffer + layerSize);
+	unsigned char* grids = buffer + layerSize + headerSize;
+	
+	memcpy(header, src.header, sizeof(dtTileCacheLayerHeader));
+	layer->header = header;
+	layer->regCount = src.regCount;
+	layer->heights = grids;
+	layer->areas = grids + gridSize;
+	layer->cons = grids + gridSize*2;
+	layer->regs = grids + gridSize*3;
+	memcpy(layer->heights, src.heights, gridSize);
+	memcpy(layer->areas, src.areas, gridSize);
+	memcpy(layer->cons, src.cons, gridSize);
+	memcpy(layer->regs, src.regs, gridSize);
+	
+	*layerOut = layer;
+	
+	return DT_SUCCESS;
+}
+
 
 
 bool dtTileCacheHeaderSwapEndian(unsigned char* data, const int dataSize)
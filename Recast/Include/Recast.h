@@ -98,6 +98,11 @@ enum rcTimerLabel
 	RC_MAX_TIMERS
 };
 
+/// A task run by #rcContext::runTasks.
+///  @param[in]		userData	The data passed to #rcContext::runTasks.
+///  @param[in]		taskIndex	The index of the task. [Limit: 0 <= value < taskCount]
+typedef void (*rcTaskFunc)(void* userData, int taskIndex);
+
 /// Provides an interface for optional logging and performance tracking of the Recast 
 /// build process.
 /// 
@@ -116,7 +121,7 @@ class rcContext
 public:
 	/// Constructor.
 	///  @param[in]		state	TRUE if the logging and performance timers should be enabled.  [Default: true]
-	inline rcContext(bool state = true) : m_logEnabled(state), m_timerEnabled(state) {}
+	inline rcContext(bool state = true) : m_logEnabled(state), m_timerEnabled(state), m_arena(0) {}
 	virtual ~rcContext() {}
 
 	/// Enables or disables logging.
@@ -158,6 +163,21 @@ public:
 	/// @return The accumulated time of the timer, or -1 if timers are disabled or the timer has never been started.
 	inline int getAccumulatedTime(const rcTimerLabel label) const { return m_timerEnabled ? doGetAccumulatedTime(label) : -1; }
 
+	/// Sets the arena serving the temporary allocations of builds using this context. (See: #rcArenaScope)
+	/// The context does not own the arena. Contexts used on different threads need different arenas.
+	///  @param[in]		arena	The arena, or null to allocate temporaries with #rcAlloc.
+	inline void setArena(class rcArena* arena) { m_arena = arena; }
+
+	/// Returns the arena serving the temporary allocations of builds using this context, or null.
+	inline class rcArena* getArena() const { return m_arena; }
+
+	/// Runs independent tasks of a build step and returns once all of them have finished.
+	/// Tasks must not use the context, so the log and timers need not be thread safe.
+	///  @param[in]		taskCount	The number of tasks.
+	///  @param[in]		task		The function running a task.
+	///  @param[in]		userData	The data passed to each task.
+	inline void runTasks(const int taskCount, rcTaskFunc task, void* userData) { doRunTasks(taskCount, task, userData); }
+
 protected:
 	/// Clears all log entries.
 	virtual void doResetLog();
@@ -183,12 +203,22 @@ protected:
 	/// @param[in]		label	The category of the timer.
 	/// @return The accumulated time of the timer, or -1 if timers are disabled or the timer has never been started.
 	virtual int doGetAccumulatedTime(const rcTimerLabel label) const { rcIgnoreUnused(label); return -1; }
+
+	/// Runs the tasks one after another on the calling thread.
+	/// Override to spread the tasks over worker threads; they may run in any order.
+	///  @param[in]		taskCount	The number of tasks.
+	///  @param[in]		task		The function running a task.
+	///  @param[in]		userData	The data passed to each task.
+	virtual void doRunTasks(const int taskCount, rcTaskFunc task, void* userData);
 	
 	/// True if logging is enabled.
 	bool m_logEnabled;
 
 	/// True if the performance timers are enabled.
 	bool m_timerEnabled;
+
+	/// The arena serving temporary allocations, or null.
+	class rcArena* m_arena;
 };
 
 /// A helper to first start a timer and then stop it when this helper goes out of scope.
@@ -211,6 +241,39 @@ private:
 	const rcTimerLabel m_label;
 };
 
+/// Serves the temporary allocations of the calling thread from the arena of the context while in scope,
+/// and releases them in bulk when the outermost scope of the arena ends. Typically one scope surrounds
+/// the build of a tile. Temporary allocations must not outlive the scope.
+///
+/// Example:
+/// @code
+/// rcArena arena;
+/// ctx->setArena(&arena);
+/// for (each tile)
+/// {
+/// 	rcArenaScope scope(ctx);
+/// 	// Build the tile...
+/// }
+/// @endcode
+class rcArenaScope
+{
+public:
+	/// Makes the arena of the context the arena of the calling thread.
+	///  @param[in]		ctx		The context to use. Nothing changes if it has no arena. [opt]
+	explicit rcArenaScope(rcContext* ctx);
+
+	/// Restores the previous arena of the thread, resetting the arena of the context if this is its outermost scope.
+	~rcArenaScope();
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	rcArenaScope(const rcArenaScope&);
+	rcArenaScope& operator=(const rcArenaScope&);
+
+	class rcArena* m_arena;
+	class rcArena* m_prev;
+};
+
 /// Specifies a configuration to use when performing Recast builds.
 /// @ingroup recast
 struct rcConfig
@@ -851,6 +914,38 @@ bool rcCreateHeightfield(rcContext* context, rcHeightfield& heightfield, int siz
 						 const float* minBounds, const float* maxBounds,
 						 float cellSize, float cellHeight);
 
+/// Reinitializes a heightfield for another build, keeping its memory.
+/// All spans are removed and returned to the span pools of the heightfield. The span column
+/// array is reused when it is large enough. Can also be used on a heightfield that was never created.
+///
+/// @see rcCreateHeightfield
+/// @ingroup recast
+///
+/// @param[in,out]	context		The build context to use during the operation.
+/// @param[in,out]	heightfield	The heightfield to reinitialize.
+/// @param[in]		sizeX		The width of the field along the x-axis. [Limit: >= 0] [Units: vx]
+/// @param[in]		sizeZ		The height of the field along the z-axis. [Limit: >= 0] [Units: vx]
+/// @param[in]		minBounds	The minimum bounds of the field's AABB. [(x, y, z)] [Units: wu]
+/// @param[in]		maxBounds	The maximum bounds of the field's AABB. [(x, y, z)] [Units: wu]
+/// @param[in]		cellSize	The xz-plane cell size to use for the field. [Limit: > 0] [Units: wu]
+/// @param[in]		cellHeight	The y-axis cell size to use for field. [Limit: > 0] [Units: wu]
+/// @returns True if the operation completed successfully.
+bool rcResetHeightfield(rcContext* context, rcHeightfield& heightfield, int sizeX, int sizeZ,
+						const float* minBounds, const float* maxBounds,
+						float cellSize, float cellHeight);
+
+/// Moves the spans of the heightfield so that each column is contiguous in memory and
+/// the columns follow each other in row order.
+/// Rasterization scatters the spans of a column over the span pools. Packing them after
+/// rasterization lets the filters and the compact heightfield build read the spans linearly.
+/// The span lists keep working as before, so spans may still be added afterwards.
+///
+/// @ingroup recast
+/// @param[in,out]	context		The build context to use during the operation.
+/// @param[in,out]	heightfield	The heightfield to pack.
+/// @returns True if the operation completed successfully. The heightfield is unchanged on failure.
+bool rcPackHeightfieldSpans(rcContext* context, rcHeightfield& heightfield);
+
 /// Sets the area id of all triangles with a slope below the specified value
 /// to #RC_WALKABLE_AREA.
 ///
@@ -1072,6 +1167,9 @@ int rcGetHeightFieldSpanCount(rcContext* context, const rcHeightfield& heightfie
 /// Various filters may be applied, then the distance field and regions built.
 /// E.g: #rcBuildDistanceField and #rcBuildRegions
 ///
+/// The grid is split into blocks of rows that are built as tasks of #rcContext::runTasks,
+/// so a context running tasks on worker threads builds large heightfields in parallel.
+///
 /// See the #rcConfig documentation for more information on the configuration parameters.
 ///
 /// @see rcAllocCompactHeightfield, rcHeightfield, rcCompactHeightfield, rcConfig
@@ -64,6 +64,91 @@ void* rcAlloc(size_t size, rcAllocHint hint);
 /// @see rcAlloc, rcAllocSetCustom
 void rcFree(void* ptr);
 
+/// A linear allocator for the temporary allocations of a build.
+/// Blocks are carved from large chunks and released together by #reset, which replaces the
+/// many small allocations of a tile build with a few chunk allocations. The chunks are allocated
+/// with the functions set by #rcAllocSetCustom. An arena must only be used by one thread at a time.
+/// @see rcArenaScope, rcContext::setArena
+class rcArena
+{
+public:
+	/// Constructs an empty arena.
+	///  @param[in]		chunkSize	The minimum size of the chunks allocated by the arena. [Units: bytes]
+	explicit rcArena(size_t chunkSize = 256*1024);
+	~rcArena();
+
+	/// Allocates a 16 byte aligned block.
+	///  @param[in]		size		The size of the block. [Units: bytes]
+	/// @return The block, or null if the allocation failed.
+	void* alloc(size_t size);
+
+	/// Releases the block if it was the last one allocated. Other blocks are released by #reset.
+	///  @param[in]		ptr			A block allocated by the arena.
+	void free(void* ptr);
+
+	/// Returns true if the pointer points to the memory of the arena.
+	bool owns(const void* ptr) const;
+
+	/// Releases all blocks. The memory is kept, merged into a single chunk, for the next build.
+	void reset();
+
+	/// Releases all blocks and the memory of the arena.
+	void purge();
+
+	/// Sets the high water mark to the current use.
+	void resetHighWaterMark() { m_highWater = m_used; }
+
+	/// Returns the memory used by the allocated blocks. [Units: bytes]
+	size_t getUsedSize() const { return m_used; }
+
+	/// Returns the largest memory use since construction or #resetHighWaterMark. [Units: bytes]
+	size_t getHighWaterMark() const { return m_highWater; }
+
+	/// Returns the memory held by the chunks of the arena. [Units: bytes]
+	size_t getCapacity() const { return m_capacity; }
+
+	/// Returns the number of blocks allocated since construction.
+	int getAllocCount() const { return m_allocCount; }
+
+	/// Returns the number of chunks held by the arena.
+	int getChunkCount() const { return m_chunkCount; }
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	rcArena(const rcArena&);
+	rcArena& operator=(const rcArena&);
+
+	struct Chunk
+	{
+		Chunk* next;
+		size_t size;
+		size_t used;
+	};
+
+	/// Allocates a chunk able to hold a block of the size and appends it to the chunk list.
+	Chunk* addChunk(size_t size);
+
+	size_t m_chunkSize;
+	Chunk* m_first;				///< First chunk.
+	Chunk* m_current;			///< Chunk blocks are allocated from. Later chunks are empty.
+	void* m_last;				///< Last allocated block, or null if it was released.
+	size_t m_used;
+	size_t m_highWater;
+	size_t m_capacity;
+	int m_allocCount;
+	int m_chunkCount;
+};
+
+/// Sets the arena serving the #RC_ALLOC_TEMP allocations of #rcAlloc on the calling thread.
+/// #rcFree releases blocks owned by the arena through it. Other allocations are not affected.
+///  @param[in]		arena	The arena, or null to use the allocation functions.
+/// @return The previous arena of the calling thread.
+/// @see rcArenaScope
+rcArena* rcSetThreadArena(rcArena* arena);
+
+/// Returns the arena serving the temporary allocations of the calling thread, or null.
+rcArena* rcGetThreadArena();
+
 /// An implementation of operator new usable for placement new. The default one is part of STL (which we don't use).
 /// rcNewTag is a dummy type used to differentiate our operator from the STL one, in case users import both Recast
 /// and STL.
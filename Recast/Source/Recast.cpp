@@ -83,6 +83,31 @@ void rcContext::doResetLog()
 	// Defined out of line to fix the weak v-tables warning
 }
 
+void rcContext::doRunTasks(const int taskCount, rcTaskFunc task, void* userData)
+{
+	for (int i = 0; i < taskCount; ++i)
+	{
+		task(userData, i);
+	}
+}
+
+rcArenaScope::rcArenaScope(rcContext* ctx) :
+	m_arena(ctx ? ctx->getArena() : 0),
+	m_prev(rcGetThreadArena())
+{
+	if (m_arena)
+		rcSetThreadArena(m_arena);
+}
+
+rcArenaScope::~rcArenaScope()
+{
+	if (!m_arena)
+		return;
+	rcSetThreadArena(m_prev);
+	if (m_prev != m_arena)
+		m_arena->reset();
+}
+
 rcHeightfield* rcAllocHeightfield()
 {
 	return rcNew<rcHeightfield>(RC_ALLOC_PERM);
@@ -324,6 +349,49 @@ bool rcCreateHeightfield(rcContext* context, rcHeightfield& heightfield, int siz
 	return true;
 }
 
+bool rcResetHeightfield(rcContext* context, rcHeightfield& heightfield, int sizeX, int sizeZ,
+                        const float* minBounds, const float* maxBounds,
+                        float cellSize, float cellHeight)
+{
+	rcIgnoreUnused(context);
+
+	// Return every span to the free list.
+	rcSpan* freeList = NULL;
+	for (rcSpanPool* pool = heightfield.pools; pool; pool = pool->next)
+	{
+		for (int i = RC_SPANS_PER_POOL - 1; i >= 0; --i)
+		{
+			pool->items[i].next = freeList;
+			freeList = &pool->items[i];
+		}
+	}
+	heightfield.freelist = freeList;
+
+	// Reuse the span column array when it is large enough.
+	const int oldSize = heightfield.width * heightfield.height;
+	const int newSize = sizeX * sizeZ;
+	if (!heightfield.spans || newSize > oldSize)
+	{
+		rcFree(heightfield.spans);
+		heightfield.spans = (rcSpan**)rcAlloc(sizeof(rcSpan*) * newSize, RC_ALLOC_PERM);
+		if (!heightfield.spans)
+		{
+			heightfield.width = 0;
+			heightfield.height = 0;
+			return false;
+		}
+	}
+
+	heightfield.width = sizeX;
+	heightfield.height = sizeZ;
+	rcVcopy(heightfield.bmin, minBounds);
+	rcVcopy(heightfield.bmax, maxBounds);
+	heightfield.cs = cellSize;
+	heightfield.ch = cellHeight;
+	memset(heightfield.spans, 0, sizeof(rcSpan*) * newSize);
+	return true;
+}
+
 static void calcTriNormal(const float* v0, const float* v1, const float* v2, float* faceNormal)
 {
 	float e0[3], e1[3];
@@ -400,69 +468,71 @@ int rcGetHeightFieldSpanCount(rcContext* context, const rcHeightfield& heightfie
 	return spanCount;
 }
 
-bool rcBuildCompactHeightfield(rcContext* context, const int walkableHeight, const int walkableClimb,
-                               const rcHeightfield& heightfield, rcCompactHeightfield& compactHeightfield)
+namespace
 {
-	rcAssert(context);
+/// The number of columns in a block of rows built by one task of rcBuildCompactHeightfield.
+const int COMPACT_TASK_COLUMNS = 4096;
 
-	rcScopedTimer timer(context, RC_TIMER_BUILD_COMPACTHEIGHTFIELD);
+/// The shared state of the tasks building a compact heightfield.
+struct CompactHeightfieldTasks
+{
+	const rcHeightfield* heightfield;
+	rcCompactHeightfield* compactHeightfield;
+	int walkableHeight;
+	int walkableClimb;
+	int rowsPerTask;
+	int* blockSpans;		///< The span count of each block, then the index of its first span.
+	int* blockMaxLayers;	///< The largest out of range layer index found by each block.
+};
 
-	const int xSize = heightfield.width;
-	const int zSize = heightfield.height;
-	const int spanCount = rcGetHeightFieldSpanCount(context, heightfield);
+/// Counts the walkable spans in a block of rows.
+void countCompactSpans(void* userData, int taskIndex)
+{
+	CompactHeightfieldTasks& tasks = *(CompactHeightfieldTasks*)userData;
+	const rcHeightfield& heightfield = *tasks.heightfield;
+	const int zMin = taskIndex * tasks.rowsPerTask;
+	const int zMax = rcMin(zMin + tasks.rowsPerTask, heightfield.height);
 
-	// Fill in header.
-	compactHeightfield.width = xSize;
-	compactHeightfield.height = zSize;
-	compactHeightfield.spanCount = spanCount;
-	compactHeightfield.walkableHeight = walkableHeight;
-	compactHeightfield.walkableClimb = walkableClimb;
-	compactHeightfield.maxRegions = 0;
-	rcVcopy(compactHeightfield.bmin, heightfield.bmin);
-	rcVcopy(compactHeightfield.bmax, heightfield.bmax);
-	compactHeightfield.bmax[1] += walkableHeight * heightfield.ch;
-	compactHeightfield.cs = heightfield.cs;
-	compactHeightfield.ch = heightfield.ch;
-	compactHeightfield.cells = (rcCompactCell*)rcAlloc(sizeof(rcCompactCell) * xSize * zSize, RC_ALLOC_PERM);
-	if (!compactHeightfield.cells)
-	{
-		context->log(RC_LOG_ERROR, "rcBuildCompactHeightfield: Out of memory 'chf.cells' (%d)", xSize * zSize);
-		return false;
-	}
-	memset(compactHeightfield.cells, 0, sizeof(rcCompactCell) * xSize * zSize);
-	compactHeightfield.spans = (rcCompactSpan*)rcAlloc(sizeof(rcCompactSpan) * spanCount, RC_ALLOC_PERM);
-	if (!compactHeightfield.spans)
-	{
-		context->log(RC_LOG_ERROR, "rcBuildCompactHeightfield: Out of memory 'chf.spans' (%d)", spanCount);
-		return false;
-	}
-	memset(compactHeightfield.spans, 0, sizeof(rcCompactSpan) * spanCount);
-	compactHeightfield.areas = (unsigned char*)rcAlloc(sizeof(unsigned char) * spanCount, RC_ALLOC_PERM);
-	if (!compactHeightfield.areas)
+	int spanCount = 0;
+	for (int columnIndex = zMin * heightfield.width, end = zMax * heightfield.width; columnIndex < end; ++columnIndex)
 	{
-		context->log(RC_LOG_ERROR, "rcBuildCompactHeightfield: Out of memory 'chf.areas' (%d)", spanCount);
-		return false;
+		for (const rcSpan* span = heightfield.spans[columnIndex]; span != NULL; span = span->next)
+		{
+			if (span->area != RC_NULL_AREA)
+			{
+				spanCount++;
+			}
+		}
 	}
-	memset(compactHeightfield.areas, RC_NULL_AREA, sizeof(unsigned char) * spanCount);
+	tasks.blockSpans[taskIndex] = spanCount;
+}
+
+/// Fills in the cells and spans of a block of rows, starting at the first span index of the block.
+void fillCompactSpans(void* userData, int taskIndex)
+{
+	CompactHeightfieldTasks& tasks = *(CompactHeightfieldTasks*)userData;
+	const rcHeightfield& heightfield = *tasks.heightfield;
+	rcCompactHeightfield& compactHeightfield = *tasks.compactHeightfield;
+	const int zMin = taskIndex * tasks.rowsPerTask;
+	const int zMax = rcMin(zMin + tasks.rowsPerTask, heightfield.height);
 
 	const int MAX_HEIGHT = 0xffff;
 
-	// Fill in cells and spans.
-	int currentCellIndex = 0;
-	const int numColumns = xSize * zSize;
-	for (int columnIndex = 0; columnIndex < numColumns; ++columnIndex)
+	int currentCellIndex = tasks.blockSpans[taskIndex];
+	for (int columnIndex = zMin * heightfield.width, end = zMax * heightfield.width; columnIndex < end; ++columnIndex)
 	{
 		const rcSpan* span = heightfield.spans[columnIndex];
-			
+
 		// If there are no spans at this cell, just leave the data to index=0, count=0.
+		rcCompactCell& cell = compactHeightfield.cells[columnIndex];
+		cell.index = 0;
+		cell.count = 0;
 		if (span == NULL)
 		{
 			continue;
 		}
-			
-		rcCompactCell& cell = compactHeightfield.cells[columnIndex];
+
 		cell.index = currentCellIndex;
-		cell.count = 0;
 
 		for (; span != NULL; span = span->next)
 		{
@@ -470,20 +540,35 @@ bool rcBuildCompactHeightfield(rcContext* context, const int walkableHeight, con
 			{
 				const int bot = (int)span->smax;
 				const int top = span->next ? (int)span->next->smin : MAX_HEIGHT;
-				compactHeightfield.spans[currentCellIndex].y = (unsigned short)rcClamp(bot, 0, 0xffff);
-				compactHeightfield.spans[currentCellIndex].h = (unsigned char)rcClamp(top - bot, 0, 0xff);
+				rcCompactSpan& compactSpan = compactHeightfield.spans[currentCellIndex];
+				compactSpan.y = (unsigned short)rcClamp(bot, 0, 0xffff);
+				compactSpan.reg = 0;
+				compactSpan.con = 0;
+				compactSpan.h = (unsigned char)rcClamp(top - bot, 0, 0xff);
 				compactHeightfield.areas[currentCellIndex] = span->area;
 				currentCellIndex++;
 				cell.count++;
 			}
 		}
 	}
-	
-	// Find neighbour connections.
+}
+
+/// Finds the neighbour connections of the spans in a block of rows.
+void connectCompactSpans(void* userData, int taskIndex)
+{
+	CompactHeightfieldTasks& tasks = *(CompactHeightfieldTasks*)userData;
+	rcCompactHeightfield& compactHeightfield = *tasks.compactHeightfield;
+	const int walkableHeight = tasks.walkableHeight;
+	const int walkableClimb = tasks.walkableClimb;
+	const int xSize = compactHeightfield.width;
+	const int zSize = compactHeightfield.height;
+	const int zMin = taskIndex * tasks.rowsPerTask;
+	const int zMax = rcMin(zMin + tasks.rowsPerTask, zSize);
+
 	const int MAX_LAYERS = RC_NOT_CONNECTED - 1;
 	int maxLayerIndex = 0;
 	const int zStride = xSize; // for readability
-	for (int z = 0; z < zSize; ++z)
+	for (int z = zMin; z < zMax; ++z)
 	{
 		for (int x = 0; x < xSize; ++x)
 		{
@@ -531,7 +616,93 @@ bool rcBuildCompactHeightfield(rcContext* context, const int walkableHeight, con
 			}
 		}
 	}
+	tasks.blockMaxLayers[taskIndex] = maxLayerIndex;
+}
+} // anonymous namespace
+
+bool rcBuildCompactHeightfield(rcContext* context, const int walkableHeight, const int walkableClimb,
+                               const rcHeightfield& heightfield, rcCompactHeightfield& compactHeightfield)
+{
+	rcAssert(context);
+
+	rcScopedTimer timer(context, RC_TIMER_BUILD_COMPACTHEIGHTFIELD);
+
+	const int xSize = heightfield.width;
+	const int zSize = heightfield.height;
+
+	// Each task handles a block of rows. The spans of a block follow those of the previous
+	// blocks, so the span counts of the blocks give the index of the first span of each block.
+	const int rowsPerTask = rcMax(1, COMPACT_TASK_COLUMNS / rcMax(1, xSize));
+	const int taskCount = (zSize + rowsPerTask - 1) / rowsPerTask;
+	rcScopedDelete<int> blockData((int*)rcAlloc(sizeof(int) * rcMax(1, taskCount) * 2, RC_ALLOC_TEMP));
+	if (!blockData)
+	{
+		context->log(RC_LOG_ERROR, "rcBuildCompactHeightfield: Out of memory 'blockData' (%d)", taskCount * 2);
+		return false;
+	}
+
+	CompactHeightfieldTasks tasks;
+	tasks.heightfield = &heightfield;
+	tasks.compactHeightfield = &compactHeightfield;
+	tasks.walkableHeight = walkableHeight;
+	tasks.walkableClimb = walkableClimb;
+	tasks.rowsPerTask = rowsPerTask;
+	tasks.blockSpans = blockData;
+	tasks.blockMaxLayers = tasks.blockSpans + taskCount;
+
+	context->runTasks(taskCount, countCompactSpans, &tasks);
+
+	int spanCount = 0;
+	for (int i = 0; i < taskCount; ++i)
+	{
+		const int blockSpanCount = tasks.blockSpans[i];
+		tasks.blockSpans[i] = spanCount;
+		spanCount += blockSpanCount;
+	}
 
+	// Fill in header.
+	compactHeightfield.width = xSize;
+	compactHeightfield.height = zSize;
+	compactHeightfield.spanCount = spanCount;
+	compactHeightfield.walkableHeight = walkableHeight;
+	compactHeightfield.walkableClimb = walkableClimb;
+	compactHeightfield.maxRegions = 0;
+	rcVcopy(compactHeightfield.bmin, heightfield.bmin);
+	rcVcopy(compactHeightfield.bmax, heightfield.bmax);
+	compactHeightfield.bmax[1] += walkableHeight * heightfield.ch;
+	compactHeightfield.cs = heightfield.cs;
+	compactHeightfield.ch = heightfield.ch;
+	compactHeightfield.cells = (rcCompactCell*)rcAlloc(sizeof(rcCompactCell) * xSize * zSize, RC_ALLOC_PERM);
+	if (!compactHeightfield.cells)
+	{
+		context->log(RC_LOG_ERROR, "rcBuildCompactHeightfield: Out of memory 'chf.cells' (%d)", xSize * zSize);
+		return false;
+	}
+	compactHeightfield.spans = (rcCompactSpan*)rcAlloc(sizeof(rcCompactSpan) * spanCount, RC_ALLOC_PERM);
+	if (!compactHeightfield.spans)
+	{
+		context->log(RC_LOG_ERROR, "rcBuildCompactHeightfield: Out of memory 'chf.spans' (%d)", spanCount);
+		return false;
+	}
+	compactHeightfield.areas = (unsigned char*)rcAlloc(sizeof(unsigned char) * spanCount, RC_ALLOC_PERM);
+	if (!compactHeightfield.areas)
+	{
+		context->log(RC_LOG_ERROR, "rcBuildCompactHeightfield: Out of memory 'chf.areas' (%d)", spanCount);
+		return false;
+	}
+
+	// Fill in cells and spans. Every cell and span is written, so the arrays need no clearing.
+	context->runTasks(taskCount, fillCompactSpans, &tasks);
+
+	// Find neighbour connections once all the spans of the neighbouring blocks are in place.
+	context->runTasks(taskCount, connectCompactSpans, &tasks);
+
+	const int MAX_LAYERS = RC_NOT_CONNECTED - 1;
+	int maxLayerIndex = 0;
+	for (int i = 0; i < taskCount; ++i)
+	{
+		maxLayerIndex = rcMax(maxLayerIndex, tasks.blockMaxLayers[i]);
+	}
 	if (maxLayerIndex > MAX_LAYERS)
 	{
 		context->log(RC_LOG_ERROR, "rcBuildCompactHeightfield: Heightfield has too many layers %d (max: %d)",
@@ -37,8 +37,162 @@ void rcAllocSetCustom(rcAllocFunc* allocFunc, rcFreeFunc* freeFunc)
 	sRecastFreeFunc = freeFunc ? freeFunc : rcFreeDefault;
 }
 
+
+#if defined(_MSC_VER)
+#define RC_THREAD_LOCAL __declspec(thread)
+#else
+#define RC_THREAD_LOCAL __thread
+#endif
+
+static RC_THREAD_LOCAL rcArena* sThreadArena = 0;
+
+rcArena* rcSetThreadArena(rcArena* arena)
+{
+	rcArena* prev = sThreadArena;
+	sThreadArena = arena;
+	return prev;
+}
+
+rcArena* rcGetThreadArena()
+{
+	return sThreadArena;
+}
+
+static const size_t RC_ARENA_ALIGN = 16;
+
+static size_t rcArenaAlign(size_t size)
+{
+	return (size + RC_ARENA_ALIGN-1) & ~(RC_ARENA_ALIGN-1);
+}
+
+rcArena::rcArena(size_t chunkSize) :
+	m_chunkSize(chunkSize),
+	m_first(0),
+	m_current(0),
+	m_last(0),
+	m_used(0),
+	m_highWater(0),
+	m_capacity(0),
+	m_allocCount(0),
+	m_chunkCount(0)
+{
+}
+
+rcArena::~rcArena()
+{
+	purge();
+}
+
+rcArena::Chunk* rcArena::addChunk(size_t size)
+{
+	const size_t headerSize = rcArenaAlign(sizeof(Chunk));
+	const size_t chunkSize = size > m_chunkSize ? size : m_chunkSize;
+	Chunk* chunk = (Chunk*)sRecastAllocFunc(headerSize + chunkSize, RC_ALLOC_PERM);
+	if (!chunk)
+		return 0;
+	chunk->next = 0;
+	chunk->size = chunkSize;
+	chunk->used = 0;
+
+	Chunk** tail = &m_first;
+	while (*tail)
+		tail = &(*tail)->next;
+	*tail = chunk;
+	m_capacity += chunkSize;
+	m_chunkCount++;
+	return chunk;
+}
+
+void* rcArena::alloc(size_t size)
+{
+	size = rcArenaAlign(size ? size : 1);
+
+	// Find the first chunk with room, later chunks are empty.
+	Chunk* chunk = m_current ? m_current : m_first;
+	while (chunk && chunk->size - chunk->used < size)
+		chunk = chunk->next;
+	if (!chunk)
+	{
+		chunk = addChunk(size);
+		if (!chunk)
+			return 0;
+	}
+	m_current = chunk;
+
+	unsigned char* ptr = (unsigned char*)chunk + rcArenaAlign(sizeof(Chunk)) + chunk->used;
+	chunk->used += size;
+	m_used += size;
+	if (m_used > m_highWater)
+		m_highWater = m_used;
+	m_allocCount++;
+	m_last = ptr;
+	return ptr;
+}
+
+void rcArena::free(void* ptr)
+{
+	if (!ptr || ptr != m_last)
+		return;
+	unsigned char* data = (unsigned char*)m_current + rcArenaAlign(sizeof(Chunk));
+	const size_t used = (size_t)((unsigned char*)ptr - data);
+	m_used -= m_current->used - used;
+	m_current->used = used;
+	m_last = 0;
+}
+
+bool rcArena::owns(const void* ptr) const
+{
+	const unsigned char* p = (const unsigned char*)ptr;
+	for (const Chunk* chunk = m_first; chunk; chunk = chunk->next)
+	{
+		const unsigned char* data = (const unsigned char*)chunk + rcArenaAlign(sizeof(Chunk));
+		if (p >= data && p < data + chunk->size)
+			return true;
+	}
+	return false;
+}
+
+void rcArena::reset()
+{
+	// Merge the chunks so that the next build of the same size needs a single chunk.
+	if (m_chunkCount > 1)
+	{
+		const size_t capacity = m_capacity;
+		purge();
+		addChunk(capacity);
+	}
+	for (Chunk* chunk = m_first; chunk; chunk = chunk->next)
+		chunk->used = 0;
+	m_current = m_first;
+	m_last = 0;
+	m_used = 0;
+}
+
+void rcArena::purge()
+{
+	Chunk* chunk = m_first;
+	while (chunk)
+	{
+		Chunk* next = chunk->next;
+		sRecastFreeFunc(chunk);
+		chunk = next;
+	}
+	m_first = 0;
+	m_current = 0;
+	m_last = 0;
+	m_used = 0;
+	m_capacity = 0;
+	m_chunkCount = 0;
+}
+
 void* rcAlloc(size_t size, rcAllocHint hint)
 {
+	if (hint == RC_ALLOC_TEMP && sThreadArena)
+	{
+		void* ptr = sThreadArena->alloc(size);
+		if (ptr)
+			return ptr;
+	}
 	return sRecastAllocFunc(size, hint);
 }
 
@@ -46,6 +200,9 @@ void rcFree(void* ptr)
 {
 	if (ptr != NULL)
 	{
-		sRecastFreeFunc(ptr);
+		if (sThreadArena && sThreadArena->owns(ptr))
+			sThreadArena->free(ptr);
+		else
+			sRecastFreeFunc(ptr);
 	}
 }
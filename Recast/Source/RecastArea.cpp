@@ -19,6 +19,7 @@
 #include "Recast.h"
 #include "RecastAlloc.h"
 #include "RecastAssert.h"
+#include "RecastDenseColumns.h"
 
 #include <string.h> // for memcpy and memset
 
@@ -72,6 +73,438 @@ static bool pointInPoly(int numVerts, const float* verts, const float* point)
 	return inPoly;
 }
 
+/// Returns the boundary distance of a span at (x, z) in the layered storage of #erodeDenseWalkableArea:
+/// the first span of each column is in the grid, the other spans are in the span indexed array.
+inline unsigned char& layeredDistance(const rcCompactHeightfield& compactHeightfield, unsigned char* gridDistance,
+                                      unsigned char* spanDistance, const int x, const int z, const int layer)
+{
+	if (layer == 0)
+	{
+		return gridDistance[(x + 1) + (z + 1) * (compactHeightfield.width + 2)];
+	}
+	return spanDistance[(int)compactHeightfield.cells[x + z * compactHeightfield.width].index + layer];
+}
+
+/// Generic chamfer step of #erodeDenseWalkableArea for a span of a column that is not dense.
+/// Updates the distance from the neighbours in the two directions and the diagonal that follows each of them.
+static void updateLayeredDistance(const rcCompactHeightfield& compactHeightfield, unsigned char* gridDistance,
+                                  unsigned char* spanDistance, const int x, const int z, const int layer,
+                                  const int dirA, const int dirB)
+{
+	const int xSize = compactHeightfield.width;
+	const rcCompactSpan& span = compactHeightfield.spans[(int)compactHeightfield.cells[x + z * xSize].index + layer];
+	unsigned char& distance = layeredDistance(compactHeightfield, gridDistance, spanDistance, x, z, layer);
+	int newDistance = distance;
+
+	const int dirs[2] = { dirA, dirB };
+	for (int dirIndex = 0; dirIndex < 2; ++dirIndex)
+	{
+		const int dir = dirs[dirIndex];
+		const int aConnection = rcGetCon(span, dir);
+		if (aConnection == RC_NOT_CONNECTED)
+		{
+			continue;
+		}
+		const int aX = x + rcGetDirOffsetX(dir);
+		const int aZ = z + rcGetDirOffsetY(dir);
+		newDistance = rcMin(newDistance, layeredDistance(compactHeightfield, gridDistance, spanDistance, aX, aZ, aConnection) + 2);
+
+		const rcCompactSpan& aSpan = compactHeightfield.spans[(int)compactHeightfield.cells[aX + aZ * xSize].index + aConnection];
+		const int dir2 = (dir + 3) & 0x3;
+		const int bConnection = rcGetCon(aSpan, dir2);
+		if (bConnection == RC_NOT_CONNECTED)
+		{
+			continue;
+		}
+		const int bX = aX + rcGetDirOffsetX(dir2);
+		const int bZ = aZ + rcGetDirOffsetY(dir2);
+		newDistance = rcMin(newDistance, layeredDistance(compactHeightfield, gridDistance, spanDistance, bX, bZ, bConnection) + 3);
+	}
+	distance = (unsigned char)newDistance;
+}
+
+/// Checks if a span is at the boundary of the walkable area, meaning that it is not walkable
+/// or is missing a walkable neighbour in one of the 4 cardinal directions.
+static bool isWalkableBoundary(const rcCompactHeightfield& compactHeightfield, const int x, const int z, const int spanIndex)
+{
+	if (compactHeightfield.areas[spanIndex] == RC_NULL_AREA)
+	{
+		return true;
+	}
+	const rcCompactSpan& span = compactHeightfield.spans[spanIndex];
+	for (int direction = 0; direction < 4; ++direction)
+	{
+		const int neighborConnection = rcGetCon(span, direction);
+		if (neighborConnection == RC_NOT_CONNECTED)
+		{
+			return true;
+		}
+		const int neighborX = x + rcGetDirOffsetX(direction);
+		const int neighborZ = z + rcGetDirOffsetY(direction);
+		const int neighborSpanIndex = (int)compactHeightfield.cells[neighborX + neighborZ * compactHeightfield.width].index + neighborConnection;
+		if (compactHeightfield.areas[neighborSpanIndex] == RC_NULL_AREA)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/// Adds to a distance, saturating at 255. Distances of 255 never lower a neighbour, as in the generic path.
+inline unsigned char addClamped(const unsigned char distance, const unsigned char add)
+{
+	return (unsigned char)(rcMin(distance, (unsigned char)(0xff - add)) + add);
+}
+
+/// Erodes the walkable area with the dense columns processed as image stencils over grid rows.
+/// Gives the same result as the generic path of #rcErodeWalkableArea.
+///
+/// Each chamfer pass is split per row into a stencil over the previous row, which has no dependency
+/// between the cells of the row, and a running minimum along the row. Columns that are not dense
+/// take the generic step in the running minimum, in the same order as the generic path.
+static bool erodeDenseWalkableArea(rcContext* context, const int erosionRadius, rcCompactHeightfield& compactHeightfield)
+{
+	const int xSize = compactHeightfield.width;
+	const int zSize = compactHeightfield.height;
+	const int gridStride = xSize + 2;
+	const int gridSize = gridStride * (zSize + 2);
+
+	unsigned char* spanDistance = (unsigned char*)rcAlloc(sizeof(unsigned char) * compactHeightfield.spanCount, RC_ALLOC_TEMP);
+	if (!spanDistance)
+	{
+		context->log(RC_LOG_ERROR, "erodeWalkableArea: Out of memory 'dist' (%d).", compactHeightfield.spanCount);
+		return false;
+	}
+	unsigned char* grids = (unsigned char*)rcAlloc(sizeof(unsigned char) * gridSize * 4, RC_ALLOC_TEMP);
+	if (!grids)
+	{
+		context->log(RC_LOG_ERROR, "erodeWalkableArea: Out of memory 'grids' (%d).", gridSize * 4);
+		rcFree(spanDistance);
+		return false;
+	}
+	unsigned char* connections = grids;
+	unsigned char* dense = grids + gridSize;
+	unsigned char* areas = grids + gridSize * 2;
+	unsigned char* gridDistance = grids + gridSize * 3;
+	rcGatherDenseColumns(compactHeightfield, connections, dense, areas);
+
+	// Mark boundary cells.
+	memset(gridDistance, 0, sizeof(unsigned char) * gridSize);
+	for (int z = 0; z < zSize; ++z)
+	{
+		const int rowStart = 1 + (z + 1) * gridStride;
+		const unsigned char* con = connections + rowStart;
+		const unsigned char* area = areas + rowStart;
+		unsigned char* row = gridDistance + rowStart;
+		for (int x = 0; x < xSize; ++x)
+		{
+			const bool interior = (con[x] == 0xf) &
+				(area[x] != RC_NULL_AREA) &
+				(area[x - 1] != RC_NULL_AREA) &
+				(area[x + 1] != RC_NULL_AREA) &
+				(area[x - gridStride] != RC_NULL_AREA) &
+				(area[x + gridStride] != RC_NULL_AREA);
+			row[x] = interior ? 0xff : 0;
+		}
+		for (int x = 0; x < xSize; ++x)
+		{
+			if (dense[rowStart + x])
+			{
+				continue;
+			}
+			const rcCompactCell& cell = compactHeightfield.cells[x + z * xSize];
+			for (int layer = 0; layer < (int)cell.count; ++layer)
+			{
+				const bool boundary = isWalkableBoundary(compactHeightfield, x, z, (int)cell.index + layer);
+				layeredDistance(compactHeightfield, gridDistance, spanDistance, x, z, layer) = boundary ? 0 : 0xff;
+			}
+		}
+	}
+
+	// Pass 1
+	for (int z = 0; z < zSize; ++z)
+	{
+		const int rowStart = 1 + (z + 1) * gridStride;
+		const unsigned char* con = connections + rowStart;
+		const unsigned char* conAbove = con - gridStride;
+		const unsigned char* isDense = dense + rowStart;
+		unsigned char* row = gridDistance + rowStart;
+		const unsigned char* above = row - gridStride;
+		for (int x = 0; x < xSize; ++x)
+		{
+			// (0,-1), (1,-1) and (-1,-1). Written without branches, so that the compiler can vectorize the loop.
+			const unsigned char fromAbove = addClamped(above[x], 2);
+			const unsigned char fromAboveRight = addClamped(above[x + 1], 3);
+			const unsigned char fromAboveLeft = addClamped(above[x - 1], 3);
+			unsigned char distance = row[x];
+			distance = (con[x] & 8) ? rcMin(distance, fromAbove) : distance;
+			distance = (con[x] & (conAbove[x] << 1) & 8) ? rcMin(distance, fromAboveRight) : distance;
+			distance = ((con[x] << 3) & con[x - 1] & 8) ? rcMin(distance, fromAboveLeft) : distance;
+			row[x] = isDense[x] ? distance : row[x];
+		}
+		for (int x = 0; x < xSize; ++x)
+		{
+			if (isDense[x])
+			{
+				// (-1,0)
+				if ((con[x] & 1) && row[x - 1] + 2 < row[x])
+				{
+					row[x] = (unsigned char)(row[x - 1] + 2);
+				}
+				continue;
+			}
+			const rcCompactCell& cell = compactHeightfield.cells[x + z * xSize];
+			for (int layer = 0; layer < (int)cell.count; ++layer)
+			{
+				updateLayeredDistance(compactHeightfield, gridDistance, spanDistance, x, z, layer, 0, 3);
+			}
+		}
+	}
+
+	// Pass 2
+	for (int z = zSize - 1; z >= 0; --z)
+	{
+		const int rowStart = 1 + (z + 1) * gridStride;
+		const unsigned char* con = connections + rowStart;
+		const unsigned char* conBelow = con + gridStride;
+		const unsigned char* isDense = dense + rowStart;
+		unsigned char* row = gridDistance + rowStart;
+		const unsigned char* below = row + gridStride;
+		for (int x = 0; x < xSize; ++x)
+		{
+			// (0,1), (-1,1) and (1,1)
+			const unsigned char fromBelow = addClamped(below[x], 2);
+			const unsigned char fromBelowLeft = addClamped(below[x - 1], 3);
+			const unsigned char fromBelowRight = addClamped(below[x + 1], 3);
+			unsigned char distance = row[x];
+			distance = (con[x] & 2) ? rcMin(distance, fromBelow) : distance;
+			distance = (con[x] & (conBelow[x] << 1) & 2) ? rcMin(distance, fromBelowLeft) : distance;
+			distance = (con[x] & (con[x + 1] << 1) & 4) ? rcMin(distance, fromBelowRight) : distance;
+			row[x] = isDense[x] ? distance : row[x];
+		}
+		for (int x = xSize - 1; x >= 0; --x)
+		{
+			if (isDense[x])
+			{
+				// (1,0)
+				if ((con[x] & 4) && row[x + 1] + 2 < row[x])
+				{
+					row[x] = (unsigned char)(row[x + 1] + 2);
+				}
+				continue;
+			}
+			const rcCompactCell& cell = compactHeightfield.cells[x + z * xSize];
+			for (int layer = 0; layer < (int)cell.count; ++layer)
+			{
+				updateLayeredDistance(compactHeightfield, gridDistance, spanDistance, x, z, layer, 2, 1);
+			}
+		}
+	}
+
+	const unsigned char minBoundaryDistance = (unsigned char)(erosionRadius * 2);
+	for (int z = 0; z < zSize; ++z)
+	{
+		for (int x = 0; x < xSize; ++x)
+		{
+			const rcCompactCell& cell = compactHeightfield.cells[x + z * xSize];
+			if (cell.count == 0)
+			{
+				continue;
+			}
+			if (gridDistance[(x + 1) + (z + 1) * gridStride] < minBoundaryDistance)
+			{
+				compactHeightfield.areas[cell.index] = RC_NULL_AREA;
+			}
+			for (int spanIndex = (int)cell.index + 1, maxSpanIndex = (int)(cell.index + cell.count); spanIndex < maxSpanIndex; ++spanIndex)
+			{
+				if (spanDistance[spanIndex] < minBoundaryDistance)
+				{
+					compactHeightfield.areas[spanIndex] = RC_NULL_AREA;
+				}
+			}
+		}
+	}
+
+	rcFree(grids);
+	rcFree(spanDistance);
+
+	return true;
+}
+
+/// Sorts two values for the median sorting network.
+inline void sortPair(unsigned char& a, unsigned char& b)
+{
+	const unsigned char minValue = rcMin(a, b);
+	b = rcMax(a, b);
+	a = minValue;
+}
+
+/// Median of the area ids around a span of a column that is not dense. Same as the generic path of #rcMedianFilterWalkableArea.
+static unsigned char medianNeighborArea(const rcCompactHeightfield& compactHeightfield, const int x, const int z, const int spanIndex)
+{
+	const int zStride = compactHeightfield.width;
+	const rcCompactSpan& span = compactHeightfield.spans[spanIndex];
+
+	unsigned char neighborAreas[9];
+	for (int neighborIndex = 0; neighborIndex < 9; ++neighborIndex)
+	{
+		neighborAreas[neighborIndex] = compactHeightfield.areas[spanIndex];
+	}
+
+	for (int dir = 0; dir < 4; ++dir)
+	{
+		if (rcGetCon(span, dir) == RC_NOT_CONNECTED)
+		{
+			continue;
+		}
+
+		const int aX = x + rcGetDirOffsetX(dir);
+		const int aZ = z + rcGetDirOffsetY(dir);
+		const int aIndex = (int)compactHeightfield.cells[aX + aZ * zStride].index + rcGetCon(span, dir);
+		if (compactHeightfield.areas[aIndex] != RC_NULL_AREA)
+		{
+			neighborAreas[dir * 2 + 0] = compactHeightfield.areas[aIndex];
+		}
+
+		const rcCompactSpan& aSpan = compactHeightfield.spans[aIndex];
+		const int dir2 = (dir + 1) & 0x3;
+		const int neighborConnection2 = rcGetCon(aSpan, dir2);
+		if (neighborConnection2 != RC_NOT_CONNECTED)
+		{
+			const int bX = aX + rcGetDirOffsetX(dir2);
+			const int bZ = aZ + rcGetDirOffsetY(dir2);
+			const int bIndex = (int)compactHeightfield.cells[bX + bZ * zStride].index + neighborConnection2;
+			if (compactHeightfield.areas[bIndex] != RC_NULL_AREA)
+			{
+				neighborAreas[dir * 2 + 1] = compactHeightfield.areas[bIndex];
+			}
+		}
+	}
+	insertSort(neighborAreas, 9);
+	return neighborAreas[4];
+}
+
+/// Applies the median filter with the dense columns processed as image stencils over grid rows.
+/// Gives the same result as the generic path of #rcMedianFilterWalkableArea.
+///
+/// Each row gathers the nine area ids around its cells into nine row buffers, and a sorting network
+/// selects the medians of all cells of the row at once. Columns that are not dense are filtered span by span.
+static bool medianFilterDenseWalkableArea(rcContext* context, rcCompactHeightfield& compactHeightfield)
+{
+	const int xSize = compactHeightfield.width;
+	const int zSize = compactHeightfield.height;
+	const int gridStride = xSize + 2;
+	const int gridSize = gridStride * (zSize + 2);
+
+	unsigned char* filteredAreas = (unsigned char*)rcAlloc(sizeof(unsigned char) * compactHeightfield.spanCount, RC_ALLOC_TEMP);
+	if (!filteredAreas)
+	{
+		context->log(RC_LOG_ERROR, "medianFilterWalkableArea: Out of memory 'areas' (%d).", compactHeightfield.spanCount);
+		return false;
+	}
+	const int gridsSize = gridSize * 3 + xSize * 10;
+	unsigned char* grids = (unsigned char*)rcAlloc(sizeof(unsigned char) * gridsSize, RC_ALLOC_TEMP);
+	if (!grids)
+	{
+		context->log(RC_LOG_ERROR, "medianFilterWalkableArea: Out of memory 'grids' (%d).", gridsSize);
+		rcFree(filteredAreas);
+		return false;
+	}
+	unsigned char* connections = grids;
+	unsigned char* dense = grids + gridSize;
+	unsigned char* areas = grids + gridSize * 2;
+	// The nine area ids around each cell of a row, followed by their medians.
+	unsigned char* neighborAreas = grids + gridSize * 3;
+	unsigned char* medians = neighborAreas + xSize * 9;
+	rcGatherDenseColumns(compactHeightfield, connections, dense, areas);
+
+	// Grid offsets of the neighbour in each direction.
+	const int dirOffsets[4] = { -1, gridStride, 1, -gridStride };
+
+	for (int z = 0; z < zSize; ++z)
+	{
+		const int rowStart = 1 + (z + 1) * gridStride;
+		const unsigned char* con = connections + rowStart;
+		const unsigned char* area = areas + rowStart;
+
+		// Missing neighbours and neighbours with a null area count as the area of the cell itself.
+		memcpy(neighborAreas + xSize * 8, area, sizeof(unsigned char) * xSize);
+		for (int dir = 0; dir < 4; ++dir)
+		{
+			const int dir2 = (dir + 1) & 0x3;
+			const int offset = dirOffsets[dir];
+			const int offset2 = dirOffsets[dir2];
+			unsigned char* straight = neighborAreas + xSize * (dir * 2 + 0);
+			unsigned char* diagonal = neighborAreas + xSize * (dir * 2 + 1);
+			const unsigned char dirBit = (unsigned char)(1 << dir);
+			const unsigned char dir2Bit = (unsigned char)(1 << dir2);
+			// The values are read up front, so that the selects compile without branches and the loops vectorize.
+			for (int x = 0; x < xSize; ++x)
+			{
+				const unsigned char self = area[x];
+				const unsigned char a = area[x + offset];
+				const bool connected = (con[x] & dirBit) != 0;
+				straight[x] = (connected & (a != RC_NULL_AREA)) ? a : self;
+			}
+			for (int x = 0; x < xSize; ++x)
+			{
+				const unsigned char self = area[x];
+				const unsigned char b = area[x + offset + offset2];
+				const bool connected2 = ((con[x] & dirBit) != 0) & ((con[x + offset] & dir2Bit) != 0);
+				diagonal[x] = (connected2 & (b != RC_NULL_AREA)) ? b : self;
+			}
+		}
+
+		for (int x = 0; x < xSize; ++x)
+		{
+			unsigned char p0 = neighborAreas[x];
+			unsigned char p1 = neighborAreas[x + xSize];
+			unsigned char p2 = neighborAreas[x + xSize * 2];
+			unsigned char p3 = neighborAreas[x + xSize * 3];
+			unsigned char p4 = neighborAreas[x + xSize * 4];
+			unsigned char p5 = neighborAreas[x + xSize * 5];
+			unsigned char p6 = neighborAreas[x + xSize * 6];
+			unsigned char p7 = neighborAreas[x + xSize * 7];
+			unsigned char p8 = neighborAreas[x + xSize * 8];
+			sortPair(p1, p2); sortPair(p4, p5); sortPair(p7, p8);
+			sortPair(p0, p1); sortPair(p3, p4); sortPair(p6, p7);
+			sortPair(p1, p2); sortPair(p4, p5); sortPair(p7, p8);
+			sortPair(p0, p3); sortPair(p5, p8); sortPair(p4, p7);
+			sortPair(p3, p6); sortPair(p1, p4); sortPair(p2, p5);
+			sortPair(p4, p7); sortPair(p4, p2); sortPair(p6, p4);
+			sortPair(p4, p2);
+			medians[x] = p4;
+		}
+
+		for (int x = 0; x < xSize; ++x)
+		{
+			const rcCompactCell& cell = compactHeightfield.cells[x + z * xSize];
+			for (int spanIndex = (int)cell.index, maxSpanIndex = (int)(cell.index + cell.count); spanIndex < maxSpanIndex; ++spanIndex)
+			{
+				if (compactHeightfield.areas[spanIndex] == RC_NULL_AREA)
+				{
+					filteredAreas[spanIndex] = RC_NULL_AREA;
+				}
+				else if (dense[rowStart + x])
+				{
+					filteredAreas[spanIndex] = medians[x];
+				}
+				else
+				{
+					filteredAreas[spanIndex] = medianNeighborArea(compactHeightfield, x, z, spanIndex);
+				}
+			}
+		}
+	}
+
+	memcpy(compactHeightfield.areas, filteredAreas, sizeof(unsigned char) * compactHeightfield.spanCount);
+
+	rcFree(grids);
+	rcFree(filteredAreas);
+
+	return true;
+}
+
 bool rcErodeWalkableArea(rcContext* context, const int erosionRadius, rcCompactHeightfield& compactHeightfield)
 {
 	rcAssert(context != NULL);
@@ -82,6 +515,12 @@ bool rcErodeWalkableArea(rcContext* context, const int erosionRadius, rcCompactH
 
 	rcScopedTimer timer(context, RC_TIMER_ERODE_AREA);
 
+	// Columns with a single span, which is most terrain, are eroded as a dense image.
+	if (rcCountSingleSpanColumns(compactHeightfield) * 2 >= compactHeightfield.spanCount)
+	{
+		return erodeDenseWalkableArea(context, erosionRadius, compactHeightfield);
+	}
+
 	unsigned char* distanceToBoundary = (unsigned char*)rcAlloc(sizeof(unsigned char) * compactHeightfield.spanCount,
 	                                                            RC_ALLOC_TEMP);
 	if (!distanceToBoundary)
@@ -296,6 +735,11 @@ bool rcMedianFilterWalkableArea(rcContext* context, rcCompactHeightfield& compac
 
 	rcScopedTimer timer(context, RC_TIMER_MEDIAN_AREA);
 
+	if (rcCountSingleSpanColumns(compactHeightfield) * 2 >= compactHeightfield.spanCount)
+	{
+		return medianFilterDenseWalkableArea(context, compactHeightfield);
+	}
+
 	unsigned char* areas = (unsigned char*)rcAlloc(sizeof(unsigned char) * compactHeightfield.spanCount, RC_ALLOC_TEMP);
 	if (!areas)
 	{
@@ -0,0 +1,95 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include "Recast.h"
+#include "RecastDenseColumns.h"
+
+#include <string.h> // for memset
+
+int rcCountSingleSpanColumns(const rcCompactHeightfield& compactHeightfield)
+{
+	const int cellCount = compactHeightfield.width * compactHeightfield.height;
+	int singleCount = 0;
+	for (int cellIndex = 0; cellIndex < cellCount; ++cellIndex)
+	{
+		singleCount += compactHeightfield.cells[cellIndex].count == 1 ? 1 : 0;
+	}
+	return singleCount;
+}
+
+void rcGatherDenseColumns(const rcCompactHeightfield& compactHeightfield,
+                          unsigned char* connections, unsigned char* dense, unsigned char* areas)
+{
+	const int xSize = compactHeightfield.width;
+	const int zSize = compactHeightfield.height;
+	const int gridStride = xSize + 2;
+	const int gridSize = gridStride * (zSize + 2);
+
+	// Set while gathering when the first span of a column only connects to first spans.
+	const unsigned char FIRST_SPANS_ONLY = 0x10;
+
+	memset(connections, 0, sizeof(unsigned char) * gridSize);
+	memset(dense, 0, sizeof(unsigned char) * gridSize);
+	memset(areas, RC_NULL_AREA, sizeof(unsigned char) * gridSize);
+
+	for (int z = 0; z < zSize; ++z)
+	{
+		for (int x = 0; x < xSize; ++x)
+		{
+			const rcCompactCell& cell = compactHeightfield.cells[x + z * xSize];
+			if (cell.count == 0)
+			{
+				continue;
+			}
+			const rcCompactSpan& span = compactHeightfield.spans[cell.index];
+			unsigned char mask = 0;
+			bool firstSpansOnly = true;
+			for (int dir = 0; dir < 4; ++dir)
+			{
+				const int neighborConnection = rcGetCon(span, dir);
+				mask |= (unsigned char)((neighborConnection == 0) << dir);
+				firstSpansOnly &= neighborConnection == 0 || neighborConnection == RC_NOT_CONNECTED;
+			}
+			const int gridIndex = (x + 1) + (z + 1) * gridStride;
+			connections[gridIndex] = (unsigned char)(mask | (firstSpansOnly ? FIRST_SPANS_ONLY : 0));
+			areas[gridIndex] = compactHeightfield.areas[cell.index];
+			dense[gridIndex] = (unsigned char)(cell.count == 1 && firstSpansOnly);
+		}
+	}
+
+	// A column stays dense if all of its connected neighbours only connect to first spans.
+	for (int z = 0; z < zSize; ++z)
+	{
+		const int rowStart = 1 + (z + 1) * gridStride;
+		const unsigned char* con = connections + rowStart;
+		unsigned char* isDense = dense + rowStart;
+		for (int x = 0; x < xSize; ++x)
+		{
+			const unsigned char neighborsFirstSpansOnly = (unsigned char)(
+				((con[x - 1] & FIRST_SPANS_ONLY) >> 4) |
+				((con[x + gridStride] & FIRST_SPANS_ONLY) >> 3) |
+				((con[x + 1] & FIRST_SPANS_ONLY) >> 2) |
+				((con[x - gridStride] & FIRST_SPANS_ONLY) >> 1));
+			isDense[x] &= (unsigned char)((con[x] & 0xf & ~neighborsFirstSpansOnly) == 0);
+		}
+	}
+	for (int gridIndex = 0; gridIndex < gridSize; ++gridIndex)
+	{
+		connections[gridIndex] &= 0xf;
+	}
+}
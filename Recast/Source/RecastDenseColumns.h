@@ -0,0 +1,44 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef RECAST_DENSE_COLUMNS_H
+#define RECAST_DENSE_COLUMNS_H
+
+// Internal helpers shared by the dense column paths of RecastArea.cpp and RecastRegion.cpp.
+
+struct rcCompactHeightfield;
+
+/// Returns the number of columns of the compact heightfield that have exactly one span.
+int rcCountSingleSpanColumns(const rcCompactHeightfield& compactHeightfield);
+
+/// Gathers the first span of each column into grids with a one cell border, so that filters
+/// can run as dense image stencils over the columns with a single span.
+///
+/// Bit @p dir of a connection mask is set when the first span of the column is connected to the first
+/// span of the neighbour column in that direction. A column is dense when it has a single span, and
+/// neither it nor its connected neighbours connect to a span above the first one of a column. All
+/// neighbours of a dense column, including the diagonal ones, can then be read from the grids.
+///
+/// @param[in]	compactHeightfield	The compact heightfield.
+/// @param[out]	connections			The connection masks. [Size: (width + 2) * (height + 2)]
+/// @param[out]	dense				1 for dense columns, 0 for the others. [Size: (width + 2) * (height + 2)]
+/// @param[out]	areas				The area id of the first span of each column. [Size: (width + 2) * (height + 2)]
+void rcGatherDenseColumns(const rcCompactHeightfield& compactHeightfield,
+                          unsigned char* connections, unsigned char* dense, unsigned char* areas);
+
+#endif // RECAST_DENSE_COLUMNS_H
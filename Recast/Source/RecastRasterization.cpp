@@ -204,6 +204,137 @@ bool rcAddSpan(rcContext* context, rcHeightfield& heightfield,
 	return true;
 }
 
+bool rcPackHeightfieldSpans(rcContext* context, rcHeightfield& heightfield)
+{
+	rcAssert(context);
+
+	const int columnCount = heightfield.width * heightfield.height;
+
+	// Count the spans and find how many pools the packed layout needs. A column is moved
+	// to the next pool when it does not fit in the current one.
+	int spanCount = 0;
+	int poolsNeeded = 0;
+	int poolUsed = RC_SPANS_PER_POOL;
+	for (int i = 0; i < columnCount; ++i)
+	{
+		int count = 0;
+		for (const rcSpan* span = heightfield.spans[i]; span; span = span->next)
+		{
+			count++;
+		}
+		spanCount += count;
+		if (count > 0 && poolUsed + count > RC_SPANS_PER_POOL && count <= RC_SPANS_PER_POOL)
+		{
+			poolsNeeded++;
+			poolUsed = 0;
+		}
+		poolUsed += count;
+		while (poolUsed > RC_SPANS_PER_POOL)
+		{
+			poolsNeeded++;
+			poolUsed -= RC_SPANS_PER_POOL;
+		}
+	}
+	if (spanCount == 0)
+	{
+		return true;
+	}
+
+	// Copy the spans out in column order. The next pointer marks spans that have a span above them.
+	rcScopedDelete<rcSpan> packed((rcSpan*)rcAlloc(sizeof(rcSpan) * spanCount, RC_ALLOC_TEMP));
+	if (!packed)
+	{
+		context->log(RC_LOG_ERROR, "rcPackHeightfieldSpans: Out of memory 'packed' (%d).", spanCount);
+		return false;
+	}
+	int n = 0;
+	for (int i = 0; i < columnCount; ++i)
+	{
+		for (const rcSpan* span = heightfield.spans[i]; span; span = span->next)
+		{
+			packed[n] = *span;
+			packed[n].next = span->next ? &packed[n] : NULL;
+			n++;
+		}
+	}
+
+	// Make sure there are enough pools before anything is overwritten.
+	int poolCount = 0;
+	for (const rcSpanPool* pool = heightfield.pools; pool; pool = pool->next)
+	{
+		poolCount++;
+	}
+	for (; poolCount < poolsNeeded; ++poolCount)
+	{
+		rcSpanPool* pool = (rcSpanPool*)rcAlloc(sizeof(rcSpanPool), RC_ALLOC_PERM);
+		if (pool == NULL)
+		{
+			context->log(RC_LOG_ERROR, "rcPackHeightfieldSpans: Out of memory 'pool'.");
+			return false;
+		}
+		pool->next = heightfield.pools;
+		heightfield.pools = pool;
+	}
+
+	// Write the columns back into the pools. Skipped slots go to the free list.
+	rcSpan* freeList = NULL;
+	rcSpanPool* pool = heightfield.pools;
+	int used = 0;
+	n = 0;
+	for (int i = 0; i < columnCount; ++i)
+	{
+		if (!heightfield.spans[i])
+		{
+			continue;
+		}
+		int count = 1;
+		while (packed[n + count - 1].next)
+		{
+			count++;
+		}
+		if (used + count > RC_SPANS_PER_POOL && count <= RC_SPANS_PER_POOL)
+		{
+			for (; used < RC_SPANS_PER_POOL; ++used)
+			{
+				pool->items[used].next = freeList;
+				freeList = &pool->items[used];
+			}
+		}
+		rcSpan* previous = NULL;
+		for (int j = 0; j < count; ++j, ++n)
+		{
+			if (used == RC_SPANS_PER_POOL)
+			{
+				pool = pool->next;
+				used = 0;
+			}
+			rcSpan* span = &pool->items[used++];
+			*span = packed[n];
+			span->next = NULL;
+			if (previous)
+			{
+				previous->next = span;
+			}
+			else
+			{
+				heightfield.spans[i] = span;
+			}
+			previous = span;
+		}
+	}
+	for (; pool; pool = pool->next, used = 0)
+	{
+		for (; used < RC_SPANS_PER_POOL; ++used)
+		{
+			pool->items[used].next = freeList;
+			freeList = &pool->items[used];
+		}
+	}
+	heightfield.freelist = freeList;
+
+	return true;
+}
+
 enum rcAxis
 {
 	RC_AXIS_X = 0,
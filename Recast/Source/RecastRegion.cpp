@@ -24,6 +24,7 @@
 #include "Recast.h"
 #include "RecastAlloc.h"
 #include "RecastAssert.h"
+#include "RecastDenseColumns.h"
 
 namespace
 {
@@ -249,6 +250,296 @@ static unsigned short* boxBlur(rcCompactHeightfield& chf, int thr,
 }
 
 
+/// Returns the distance of a span at (x, y): the first span of each column is in the grid,
+/// the other spans are in the span indexed array.
+inline unsigned short& layeredDist(const rcCompactHeightfield& chf, unsigned short* grid, unsigned short* dist,
+								   const int x, const int y, const int layer)
+{
+	if (layer == 0)
+		return grid[(x+1)+(y+1)*(chf.width+2)];
+	return dist[(int)chf.cells[x+y*chf.width].index + layer];
+}
+
+/// Generic chamfer step of calculateDenseDistanceField for a span of a column that is not dense.
+/// Updates the distance from the neighbours in the two directions and the diagonal that follows each of them.
+static void updateLayeredDist(const rcCompactHeightfield& chf, unsigned short* grid, unsigned short* dist,
+							  const int x, const int y, const int layer, const int dirA, const int dirB)
+{
+	const int w = chf.width;
+	const rcCompactSpan& s = chf.spans[(int)chf.cells[x+y*w].index + layer];
+	unsigned short& d = layeredDist(chf, grid, dist, x, y, layer);
+	int nd = d;
+	
+	const int dirs[2] = { dirA, dirB };
+	for (int k = 0; k < 2; ++k)
+	{
+		const int dir = dirs[k];
+		const int acon = rcGetCon(s, dir);
+		if (acon == RC_NOT_CONNECTED)
+			continue;
+		const int ax = x + rcGetDirOffsetX(dir);
+		const int ay = y + rcGetDirOffsetY(dir);
+		nd = rcMin(nd, layeredDist(chf, grid, dist, ax, ay, acon)+2);
+		
+		const rcCompactSpan& as = chf.spans[(int)chf.cells[ax+ay*w].index + acon];
+		const int dir2 = (dir+3) & 0x3;
+		const int bcon = rcGetCon(as, dir2);
+		if (bcon == RC_NOT_CONNECTED)
+			continue;
+		const int bx = ax + rcGetDirOffsetX(dir2);
+		const int by = ay + rcGetDirOffsetY(dir2);
+		nd = rcMin(nd, layeredDist(chf, grid, dist, bx, by, bcon)+3);
+	}
+	d = (unsigned short)nd;
+}
+
+/// Checks if a span has a neighbour of another area, or is missing one, in the 4 cardinal directions.
+static bool isAreaBoundary(const rcCompactHeightfield& chf, const int x, const int y, const int i)
+{
+	const rcCompactSpan& s = chf.spans[i];
+	const unsigned char area = chf.areas[i];
+	for (int dir = 0; dir < 4; ++dir)
+	{
+		if (rcGetCon(s, dir) == RC_NOT_CONNECTED)
+			return true;
+		const int ax = x + rcGetDirOffsetX(dir);
+		const int ay = y + rcGetDirOffsetY(dir);
+		const int ai = (int)chf.cells[ax+ay*chf.width].index + rcGetCon(s, dir);
+		if (chf.areas[ai] != area)
+			return true;
+	}
+	return false;
+}
+
+/// Adds to a distance, saturating at 0xffff. Distances of 0xffff never lower a neighbour, as in calculateDistanceField.
+inline unsigned short addClamped(const unsigned short d, const unsigned short add)
+{
+	return (unsigned short)(rcMin(d, (unsigned short)(0xffff - add)) + add);
+}
+
+/// Same as calculateDistanceField, with the dense columns processed as image stencils over grid rows.
+/// Each pass is split per row into a stencil over the previous row, which has no dependency between
+/// the cells of the row, and a running minimum along the row. Columns that are not dense take the
+/// generic step in the running minimum, in the same order as calculateDistanceField.
+/// The distances of first spans are left in the grid, the others in @p dist.
+static void calculateDenseDistanceField(rcCompactHeightfield& chf, const unsigned char* cons, const unsigned char* dense,
+										const unsigned char* areas, unsigned short* grid, unsigned short* dist,
+										unsigned short& maxDist)
+{
+	const int w = chf.width;
+	const int h = chf.height;
+	const int gw = w+2;
+	const int gsize = gw*(h+2);
+	
+	// Mark boundary cells.
+	memset(grid, 0, sizeof(unsigned short)*gsize);
+	for (int y = 0; y < h; ++y)
+	{
+		const int rs = 1+(y+1)*gw;
+		const unsigned char* con = cons + rs;
+		const unsigned char* area = areas + rs;
+		unsigned short* row = grid + rs;
+		for (int x = 0; x < w; ++x)
+		{
+			const bool interior = (con[x] == 0xf) &
+				(area[x-1] == area[x]) & (area[x+1] == area[x]) &
+				(area[x-gw] == area[x]) & (area[x+gw] == area[x]);
+			row[x] = interior ? 0xffff : 0;
+		}
+		for (int x = 0; x < w; ++x)
+		{
+			if (dense[rs+x])
+				continue;
+			const rcCompactCell& c = chf.cells[x+y*w];
+			for (int layer = 0; layer < (int)c.count; ++layer)
+				layeredDist(chf, grid, dist, x, y, layer) = isAreaBoundary(chf, x, y, (int)c.index + layer) ? 0 : 0xffff;
+		}
+	}
+	
+	// Pass 1
+	for (int y = 0; y < h; ++y)
+	{
+		const int rs = 1+(y+1)*gw;
+		const unsigned char* con = cons + rs;
+		const unsigned char* conAbove = con - gw;
+		const unsigned char* isDense = dense + rs;
+		unsigned short* row = grid + rs;
+		const unsigned short* above = row - gw;
+		for (int x = 0; x < w; ++x)
+		{
+			// (0,-1), (1,-1) and (-1,-1). Written without branches, so that the compiler can vectorize the loop.
+			const unsigned short fromAbove = addClamped(above[x], 2);
+			const unsigned short fromAboveRight = addClamped(above[x+1], 3);
+			const unsigned short fromAboveLeft = addClamped(above[x-1], 3);
+			unsigned short d = row[x];
+			d = (con[x] & 8) ? rcMin(d, fromAbove) : d;
+			d = (con[x] & (conAbove[x] << 1) & 8) ? rcMin(d, fromAboveRight) : d;
+			d = ((con[x] << 3) & con[x-1] & 8) ? rcMin(d, fromAboveLeft) : d;
+			row[x] = isDense[x] ? d : row[x];
+		}
+		for (int x = 0; x < w; ++x)
+		{
+			if (isDense[x])
+			{
+				// (-1,0)
+				if ((con[x] & 1) && row[x-1]+2 < row[x])
+					row[x] = (unsigned short)(row[x-1]+2);
+				continue;
+			}
+			const rcCompactCell& c = chf.cells[x+y*w];
+			for (int layer = 0; layer < (int)c.count; ++layer)
+				updateLayeredDist(chf, grid, dist, x, y, layer, 0, 3);
+		}
+	}
+	
+	// Pass 2
+	for (int y = h-1; y >= 0; --y)
+	{
+		const int rs = 1+(y+1)*gw;
+		const unsigned char* con = cons + rs;
+		const unsigned char* conBelow = con + gw;
+		const unsigned char* isDense = dense + rs;
+		unsigned short* row = grid + rs;
+		const unsigned short* below = row + gw;
+		for (int x = 0; x < w; ++x)
+		{
+			// (0,1), (-1,1) and (1,1)
+			const unsigned short fromBelow = addClamped(below[x], 2);
+			const unsigned short fromBelowLeft = addClamped(below[x-1], 3);
+			const unsigned short fromBelowRight = addClamped(below[x+1], 3);
+			unsigned short d = row[x];
+			d = (con[x] & 2) ? rcMin(d, fromBelow) : d;
+			d = (con[x] & (conBelow[x] << 1) & 2) ? rcMin(d, fromBelowLeft) : d;
+			d = (con[x] & (con[x+1] << 1) & 4) ? rcMin(d, fromBelowRight) : d;
+			row[x] = isDense[x] ? d : row[x];
+		}
+		for (int x = w-1; x >= 0; --x)
+		{
+			if (isDense[x])
+			{
+				// (1,0)
+				if ((con[x] & 4) && row[x+1]+2 < row[x])
+					row[x] = (unsigned short)(row[x+1]+2);
+				continue;
+			}
+			const rcCompactCell& c = chf.cells[x+y*w];
+			for (int layer = 0; layer < (int)c.count; ++layer)
+				updateLayeredDist(chf, grid, dist, x, y, layer, 2, 1);
+		}
+	}
+	
+	maxDist = 0;
+	for (int y = 0; y < h; ++y)
+	{
+		for (int x = 0; x < w; ++x)
+		{
+			const rcCompactCell& c = chf.cells[x+y*w];
+			if (c.count == 0)
+				continue;
+			maxDist = rcMax(grid[(x+1)+(y+1)*gw], maxDist);
+			for (int i = (int)c.index+1, ni = (int)(c.index+c.count); i < ni; ++i)
+				maxDist = rcMax(dist[i], maxDist);
+		}
+	}
+}
+
+/// Same as boxBlur, reading the distances left by calculateDenseDistanceField.
+/// The blurred distance of every span is written to @p dst.
+static void boxBlurDense(rcCompactHeightfield& chf, const unsigned char* cons, const unsigned char* dense, int thr,
+						 unsigned short* grid, unsigned short* dist, unsigned short* dst, unsigned int* rowSums)
+{
+	const int w = chf.width;
+	const int h = chf.height;
+	const int gw = w+2;
+	
+	thr *= 2;
+	
+	// Grid offsets of the neighbour in each direction.
+	const int offsets[4] = { -1, gw, 1, -gw };
+	
+	for (int y = 0; y < h; ++y)
+	{
+		const int rs = 1+(y+1)*gw;
+		const unsigned short* row = grid + rs;
+		const unsigned char* con = cons + rs;
+		
+		// Sum the 3x3 neighbourhood of the cells of the row, with missing neighbours counting as the cell itself.
+		// The values are read up front, so that the selects compile without branches and the loops vectorize.
+		for (int x = 0; x < w; ++x)
+			rowSums[x] = row[x];
+		for (int dir = 0; dir < 4; ++dir)
+		{
+			const int dir2 = (dir+1) & 0x3;
+			const int offset = offsets[dir];
+			const int offset2 = offsets[dir2];
+			const unsigned char dirBit = (unsigned char)(1 << dir);
+			const unsigned char dir2Bit = (unsigned char)(1 << dir2);
+			for (int x = 0; x < w; ++x)
+			{
+				const unsigned int cd = row[x];
+				const unsigned int ad = row[x+offset];
+				const unsigned int bd = row[x+offset+offset2];
+				const bool connected = (con[x] & dirBit) != 0;
+				const bool connected2 = (con[x+offset] & dir2Bit) != 0;
+				const unsigned int d2 = connected2 ? bd : cd;
+				rowSums[x] += connected ? ad + d2 : cd*2;
+			}
+		}
+		
+		for (int x = 0; x < w; ++x)
+		{
+			const rcCompactCell& c = chf.cells[x+y*w];
+			if (dense[rs+x])
+			{
+				const int cd = (int)row[x];
+				dst[c.index] = cd <= thr ? (unsigned short)cd : (unsigned short)((rowSums[x]+5)/9);
+				continue;
+			}
+			for (int layer = 0; layer < (int)c.count; ++layer)
+			{
+				const rcCompactSpan& s = chf.spans[c.index+layer];
+				const int cd = (int)layeredDist(chf, grid, dist, x, y, layer);
+				if (cd <= thr)
+				{
+					dst[c.index+layer] = (unsigned short)cd;
+					continue;
+				}
+				
+				int d = cd;
+				for (int dir = 0; dir < 4; ++dir)
+				{
+					if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+					{
+						const int ax = x + rcGetDirOffsetX(dir);
+						const int ay = y + rcGetDirOffsetY(dir);
+						const int acon = rcGetCon(s, dir);
+						d += (int)layeredDist(chf, grid, dist, ax, ay, acon);
+						
+						const rcCompactSpan& as = chf.spans[(int)chf.cells[ax+ay*w].index + acon];
+						const int dir2 = (dir+1) & 0x3;
+						if (rcGetCon(as, dir2) != RC_NOT_CONNECTED)
+						{
+							const int ax2 = ax + rcGetDirOffsetX(dir2);
+							const int ay2 = ay + rcGetDirOffsetY(dir2);
+							d += (int)layeredDist(chf, grid, dist, ax2, ay2, rcGetCon(as, dir2));
+						}
+						else
+						{
+							d += cd;
+						}
+					}
+					else
+					{
+						d += cd*2;
+					}
+				}
+				dst[c.index+layer] = (unsigned short)((d+5)/9);
+			}
+		}
+	}
+}
+
+
 static bool floodRegion(int x, int y, int i,
 						unsigned short level, unsigned short r,
 						rcCompactHeightfield& chf,
@@ -1287,6 +1578,53 @@ bool rcBuildDistanceField(rcContext* ctx, rcCompactHeightfield& chf)
 	
 	unsigned short maxDist = 0;
 
+	// Columns with a single span, which is most terrain, are processed as a dense image.
+	if (rcCountSingleSpanColumns(chf)*2 >= chf.spanCount)
+	{
+		const int gsize = (chf.width+2)*(chf.height+2);
+		unsigned char* grids = (unsigned char*)rcAlloc(sizeof(unsigned char)*gsize*3, RC_ALLOC_TEMP);
+		unsigned short* grid = (unsigned short*)rcAlloc(sizeof(unsigned short)*gsize, RC_ALLOC_TEMP);
+		unsigned int* rowSums = (unsigned int*)rcAlloc(sizeof(unsigned int)*chf.width, RC_ALLOC_TEMP);
+		if (!grids || !grid || !rowSums)
+		{
+			ctx->log(RC_LOG_ERROR, "rcBuildDistanceField: Out of memory 'grid' (%d).", gsize);
+			rcFree(rowSums);
+			rcFree(grid);
+			rcFree(grids);
+			rcFree(dst);
+			rcFree(src);
+			return false;
+		}
+		unsigned char* cons = grids;
+		unsigned char* dense = grids + gsize;
+		unsigned char* areas = grids + gsize*2;
+		rcGatherDenseColumns(chf, cons, dense, areas);
+		
+		{
+			rcScopedTimer timerDist(ctx, RC_TIMER_BUILD_DISTANCEFIELD_DIST);
+			
+			calculateDenseDistanceField(chf, cons, dense, areas, grid, src, maxDist);
+			chf.maxDistance = maxDist;
+		}
+		
+		{
+			rcScopedTimer timerBlur(ctx, RC_TIMER_BUILD_DISTANCEFIELD_BLUR);
+			
+			boxBlurDense(chf, cons, dense, 1, grid, src, dst, rowSums);
+			rcSwap(src, dst);
+			
+			// Store distance.
+			chf.dist = src;
+		}
+		
+		rcFree(rowSums);
+		rcFree(grid);
+		rcFree(grids);
+		rcFree(dst);
+		
+		return true;
+	}
+
 	{
 		rcScopedTimer timerDist(ctx, RC_TIMER_BUILD_DISTANCEFIELD_DIST);
 
@@ -0,0 +1,184 @@
+#include <string.h>
+#include <string>
+#include <thread>
+
+#include "catch2/catch_all.hpp"
+
+#include "Recast.h"
+#include "RecastDump.h"
+#include "RecastProfile.h"
+
+#include "../Detour/NavMeshTestUtils.h"
+
+namespace
+{
+struct StringIO : public duFileIO
+{
+	std::string text;
+	bool isWriting() const override { return true; }
+	bool isReading() const override { return false; }
+	bool write(const void* ptr, const size_t size) override { text.append((const char*)ptr, size); return true; }
+	bool read(void*, const size_t) override { return false; }
+};
+
+/// Builds the distance field and regions of a test tile inside a total stage.
+void buildProfiledTile(duProfileContext& ctx, const int tx, const int ty)
+{
+	TestWorldParams params;
+	rcConfig cfg;
+	initTestTileConfig(params, tx, ty, cfg);
+
+	ctx.setTile(tx, ty);
+	ctx.startTimer(RC_TIMER_TOTAL);
+	{
+		rcCompactHeightfield chf;
+		REQUIRE(rasterizeTestTile(&ctx, params, cfg, chf));
+		REQUIRE(rcBuildDistanceField(&ctx, chf));
+		REQUIRE(rcBuildRegions(&ctx, chf, cfg.borderSize, cfg.minRegionArea, cfg.mergeRegionArea));
+	}
+	ctx.stopTimer(RC_TIMER_TOTAL);
+}
+
+const duProfileEvent* findEvent(const duProfileContext& ctx, const rcTimerLabel label)
+{
+	for (int i = 0; i < ctx.getEventCount(); ++i)
+	{
+		if (ctx.getEvent(i).label == label)
+		{
+			return &ctx.getEvent(i);
+		}
+	}
+	return 0;
+}
+}
+
+TEST_CASE("duProfileContext", "[recast, profile]")
+{
+	TestStepClock clock(1.0, 1.0);
+	duProfileContext ctx(&clock, 7);
+
+	SECTION("Stages are recorded with nesting and tile")
+	{
+		buildProfiledTile(ctx, 1, 2);
+
+		const duProfileEvent* total = findEvent(ctx, RC_TIMER_TOTAL);
+		const duProfileEvent* field = findEvent(ctx, RC_TIMER_BUILD_DISTANCEFIELD);
+		const duProfileEvent* blur = findEvent(ctx, RC_TIMER_BUILD_DISTANCEFIELD_BLUR);
+		REQUIRE(total);
+		REQUIRE(field);
+		REQUIRE(blur);
+		REQUIRE(&ctx.getEvent(0) == total);
+
+		REQUIRE(total->depth == 0);
+		REQUIRE(field->depth == 1);
+		REQUIRE(blur->depth == 2);
+		REQUIRE(field->start > total->start);
+		REQUIRE(blur->start + blur->duration < field->start + field->duration);
+		REQUIRE(field->start + field->duration < total->start + total->duration);
+
+		for (int i = 0; i < ctx.getEventCount(); ++i)
+		{
+			const duProfileEvent& e = ctx.getEvent(i);
+			REQUIRE(e.threadId == 7);
+			REQUIRE(e.tileX == 1);
+			REQUIRE(e.tileY == 2);
+			REQUIRE(e.duration > 0);
+			REQUIRE(e.allocCount == 0);
+		}
+
+		// Accumulated times are kept for duLogBuildTimes.
+		REQUIRE(ctx.getAccumulatedTime(RC_TIMER_BUILD_DISTANCEFIELD) == (int)field->duration);
+		REQUIRE(ctx.getAccumulatedTime(RC_TIMER_BUILD_LAYERS) == -1);
+
+		const int eventCount = ctx.getEventCount();
+		buildProfiledTile(ctx, 3, 0);
+		REQUIRE(ctx.getEventCount() == eventCount * 2);
+		REQUIRE(ctx.getEvent(eventCount).tileX == 3);
+		REQUIRE(ctx.getAccumulatedTime(RC_TIMER_TOTAL) > (int)total->duration);
+
+		ctx.clearEvents();
+		REQUIRE(ctx.getEventCount() == 0);
+	}
+
+	SECTION("Allocations are attributed to the stages")
+	{
+		duProfileContext::enableAllocationTracking();
+		{
+			rcCompactHeightfield chf;
+			rcHeightfield hf;
+			const float bmin[3] = { 0, 0, 0 };
+			const float bmax[3] = { 20, 20, 20 };
+			REQUIRE(rcCreateHeightfield(&ctx, hf, 20, 20, bmin, bmax, 1, 1));
+			for (int z = 0; z < 20; ++z)
+			{
+				for (int x = 0; x < 20; ++x)
+				{
+					REQUIRE(rcAddSpan(&ctx, hf, x, z, 0, 2, RC_WALKABLE_AREA, 1));
+				}
+			}
+			ctx.startTimer(RC_TIMER_TOTAL);
+			REQUIRE(rcBuildCompactHeightfield(&ctx, 2, 1, hf, chf));
+			REQUIRE(rcBuildDistanceField(&ctx, chf));
+			ctx.stopTimer(RC_TIMER_TOTAL);
+		}
+		duProfileContext::disableAllocationTracking();
+
+		const duProfileEvent* total = findEvent(ctx, RC_TIMER_TOTAL);
+		const duProfileEvent* compact = findEvent(ctx, RC_TIMER_BUILD_COMPACTHEIGHTFIELD);
+		const duProfileEvent* field = findEvent(ctx, RC_TIMER_BUILD_DISTANCEFIELD);
+		REQUIRE(compact->allocCount >= 3);
+		REQUIRE(compact->peakBytes >= 400 * (sizeof(rcCompactSpan) + sizeof(rcCompactCell) + 1));
+		REQUIRE(field->allocCount > 0);
+		REQUIRE(total->allocCount >= compact->allocCount + field->allocCount);
+		REQUIRE(total->peakBytes >= compact->peakBytes + 400 * sizeof(unsigned short));
+	}
+
+	SECTION("Each thread counts its own allocations")
+	{
+		TestStepClock otherClock(1.0, 1.0);
+		duProfileContext other(&otherClock, 8);
+
+		duProfileContext::enableAllocationTracking();
+		std::thread worker([&]() { buildProfiledTile(other, 1, 1); });
+		buildProfiledTile(ctx, 1, 1);
+		worker.join();
+		duProfileContext::disableAllocationTracking();
+
+		REQUIRE(ctx.getEventCount() == other.getEventCount());
+		for (int i = 0; i < ctx.getEventCount(); ++i)
+		{
+			REQUIRE(ctx.getEvent(i).label == other.getEvent(i).label);
+			REQUIRE(ctx.getEvent(i).allocCount == other.getEvent(i).allocCount);
+			REQUIRE(ctx.getEvent(i).peakBytes == other.getEvent(i).peakBytes);
+			REQUIRE(other.getEvent(i).threadId == 8);
+		}
+		REQUIRE(findEvent(ctx, RC_TIMER_TOTAL)->allocCount > 0);
+	}
+
+	SECTION("Export")
+	{
+		TestStepClock otherClock(1.0, 1.0);
+		duProfileContext other(&otherClock, 8);
+		buildProfiledTile(ctx, 0, 1);
+		buildProfiledTile(other, 2, 3);
+		const duProfileContext* contexts[2] = { &ctx, &other };
+
+		StringIO csv;
+		REQUIRE(duWriteProfileCsv(contexts, 2, &csv));
+		int lines = 0;
+		for (size_t i = 0; i < csv.text.size(); ++i)
+		{
+			lines += csv.text[i] == '\n' ? 1 : 0;
+		}
+		REQUIRE(lines == 1 + ctx.getEventCount() + other.getEventCount());
+		REQUIRE(csv.text.compare(0, 10, "thread,til") == 0);
+		REQUIRE(csv.text.find("\n8,2,3,1,Build Distance Field,") != std::string::npos);
+
+		StringIO trace;
+		REQUIRE(duWriteProfileChromeTrace(contexts, 2, &trace));
+		REQUIRE(trace.text.compare(0, 16, "{\"traceEvents\":[") == 0);
+		REQUIRE(trace.text.find("{\"name\":\"Total\",\"cat\":\"recast\",\"ph\":\"X\",\"pid\":1,\"tid\":7,\"ts\":1.000,") != std::string::npos);
+		REQUIRE(trace.text.find("\"args\":{\"tileX\":2,\"tileY\":3,\"depth\":0,") != std::string::npos);
+		REQUIRE(trace.text.compare(trace.text.size() - 4, 4, "\n]}\n") == 0);
+	}
+}
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <vector>
+
+#include "catch2/catch_all.hpp"
+
+#include "DetourAlloc.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+
+#include "NavMeshTestUtils.h"
+
+namespace
+{
+struct QuadTile
+{
+	unsigned char* data;
+	int dataSize;
+	int x;
+	int y;
+};
+
+void benchTileLookup(const char* name, const int lookupType)
+{
+	TestWorldParams params;
+	params.tilesX = 64;
+	params.tilesZ = 64;
+	params.tileSize = 8.0f;
+	params.tileLookup = lookupType;
+	dtNavMesh* nav = allocTestNavMesh(params);
+	REQUIRE(nav != nullptr);
+
+	// The navmesh does not own the data so that it can be added again after removal.
+	std::vector<QuadTile> tiles;
+	for (int y = 0; y < params.tilesZ; ++y)
+	{
+		for (int x = 0; x < params.tilesX; ++x)
+		{
+			QuadTile tile;
+			tile.data = buildTestQuadTileData(params, x, y, 0, &tile.dataSize);
+			REQUIRE(tile.data != nullptr);
+			tile.x = x;
+			tile.y = y;
+			tiles.push_back(tile);
+		}
+	}
+	const int tileCount = (int)tiles.size();
+
+	const int loops = 5;
+	int64_t addNanos = 0;
+	int64_t removeNanos = 0;
+	std::vector<dtTileRef> refs(tileCount);
+	for (int loop = 0; loop < loops; ++loop)
+	{
+		int64_t begin = testNowNanos();
+		for (int i = 0; i < tileCount; ++i)
+			nav->addTile(tiles[i].data, tiles[i].dataSize, 0, 0, &refs[i]);
+		addNanos += testNowNanos() - begin;
+
+		if (loop == loops - 1)
+			break;
+
+		begin = testNowNanos();
+		for (int i = 0; i < tileCount; ++i)
+			nav->removeTile(refs[i], nullptr, nullptr);
+		removeNanos += testNowNanos() - begin;
+	}
+
+	// Random tile lookups.
+	const int lookupCount = 1000000;
+	std::vector<int> coords(lookupCount * 2);
+	unsigned int seed = 42;
+	for (int i = 0; i < lookupCount; ++i)
+	{
+		coords[i*2+0] = (int)(testRand(seed) * params.tilesX);
+		coords[i*2+1] = (int)(testRand(seed) * params.tilesZ);
+	}
+	int found = 0;
+	int64_t begin = testNowNanos();
+	for (int i = 0; i < lookupCount; ++i)
+	{
+		if (nav->getTileAt(coords[i*2+0], coords[i*2+1], 0))
+			found++;
+	}
+	const int64_t lookupNanos = testNowNanos() - begin;
+	REQUIRE(found == lookupCount);
+
+	// Queries which visit the neighbour tiles.
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(nav, 2048)));
+	dtQueryFilter filter;
+	const float worldSize = params.tilesX * nav->getParams()->tileWidth;
+	const float halfExtents[3] = { 6.0f, 2.0f, 6.0f };
+	const int queryCount = 200000;
+	std::vector<float> centers(queryCount * 3);
+	for (int i = 0; i < queryCount; ++i)
+	{
+		centers[i*3+0] = testRand(seed) * worldSize;
+		centers[i*3+1] = 0.0f;
+		centers[i*3+2] = testRand(seed) * worldSize;
+	}
+	begin = testNowNanos();
+	for (int i = 0; i < queryCount; ++i)
+	{
+		dtPolyRef ref = 0;
+		float pt[3];
+		query.findNearestPoly(&centers[i*3], halfExtents, &filter, &ref, pt);
+	}
+	const int64_t queryNanos = testNowNanos() - begin;
+
+	char label[64];
+	snprintf(label, sizeof(label), "%s_addTile:", name);
+	printf("BM_%-35s %10.2f nanos/tile\n", label, addNanos / ((double)tileCount * loops));
+	snprintf(label, sizeof(label), "%s_removeTile:", name);
+	printf("BM_%-35s %10.2f nanos/tile\n", label, removeNanos / ((double)tileCount * (loops - 1)));
+	snprintf(label, sizeof(label), "%s_getTileAt:", name);
+	printf("BM_%-35s %10.2f nanos/lookup\n", label, lookupNanos / (double)lookupCount);
+	snprintf(label, sizeof(label), "%s_findNearestPoly:", name);
+	printf("BM_%-35s %10.2f nanos/query\n", label, queryNanos / (double)queryCount);
+
+	dtFreeNavMesh(nav);
+	for (int i = 0; i < tileCount; ++i)
+		dtFree(tiles[i].data);
+}
+}
+
+TEST_CASE("Bench_dtNavMeshTileLookup")
+{
+	benchTileLookup("TileLookup_Hash", DT_TILE_LOOKUP_HASH);
+	benchTileLookup("TileLookup_Grid", DT_TILE_LOOKUP_GRID);
+}
@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <vector>
+
+#include "catch2/catch_all.hpp"
+
+#include "DetourCommon.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+#include "DetourNavMeshQuery.inl"
+
+#include "NavMeshTestUtils.h"
+
+namespace
+{
+/// The default filter logic behind a virtual interface, as with DT_VIRTUAL_QUERYFILTER.
+class BenchVirtualFilter
+{
+public:
+	virtual ~BenchVirtualFilter() {}
+	virtual bool passFilter(const dtPolyRef ref, const dtMeshTile* tile, const dtPoly* poly) const = 0;
+	virtual float getCost(const float* pa, const float* pb,
+						  const dtPolyRef prevRef, const dtMeshTile* prevTile, const dtPoly* prevPoly,
+						  const dtPolyRef curRef, const dtMeshTile* curTile, const dtPoly* curPoly,
+						  const dtPolyRef nextRef, const dtMeshTile* nextTile, const dtPoly* nextPoly) const = 0;
+};
+
+/// The default filter logic known at compile time.
+class BenchInlineFilter
+{
+public:
+	float areaCost[DT_MAX_AREAS];
+	unsigned short includeFlags;
+	unsigned short excludeFlags;
+
+	BenchInlineFilter() : includeFlags(0xffff), excludeFlags(0)
+	{
+		for (int i = 0; i < DT_MAX_AREAS; ++i)
+			areaCost[i] = 1.0f;
+	}
+
+	bool passFilter(const dtPolyRef /*ref*/, const dtMeshTile* /*tile*/, const dtPoly* poly) const
+	{
+		return (poly->flags & includeFlags) != 0 && (poly->flags & excludeFlags) == 0;
+	}
+
+	float getCost(const float* pa, const float* pb,
+				  const dtPolyRef /*prevRef*/, const dtMeshTile* /*prevTile*/, const dtPoly* /*prevPoly*/,
+				  const dtPolyRef /*curRef*/, const dtMeshTile* /*curTile*/, const dtPoly* curPoly,
+				  const dtPolyRef /*nextRef*/, const dtMeshTile* /*nextTile*/, const dtPoly* /*nextPoly*/) const
+	{
+		return dtVdist(pa, pb) * areaCost[curPoly->getArea()];
+	}
+};
+
+class BenchVirtualFilterImpl : public BenchVirtualFilter
+{
+public:
+	BenchInlineFilter impl;
+
+	bool passFilter(const dtPolyRef ref, const dtMeshTile* tile, const dtPoly* poly) const
+	{
+		return impl.passFilter(ref, tile, poly);
+	}
+	float getCost(const float* pa, const float* pb,
+				  const dtPolyRef prevRef, const dtMeshTile* prevTile, const dtPoly* prevPoly,
+				  const dtPolyRef curRef, const dtMeshTile* curTile, const dtPoly* curPoly,
+				  const dtPolyRef nextRef, const dtMeshTile* nextTile, const dtPoly* nextPoly) const
+	{
+		return impl.getCost(pa, pb, prevRef, prevTile, prevPoly, curRef, curTile, curPoly, nextRef, nextTile, nextPoly);
+	}
+};
+
+template<class TFilter>
+int64_t benchFindPathAndRaycast(dtNavMeshQuery& query, const TFilter* filter,
+								const std::vector<dtPolyRef>& refs, const std::vector<float>& points, const int loops)
+{
+	const int count = (int)refs.size() / 2;
+	dtPolyRef path[512];
+	int64_t begin = testNowNanos();
+	for (int loop = 0; loop < loops; ++loop)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			int pathCount = 0;
+			query.findPathT(refs[i*2], refs[i*2+1], &points[i*6], &points[i*6+3], filter, path, &pathCount, 512);
+			dtRaycastHit hit;
+			hit.path = path;
+			hit.maxPath = 512;
+			query.raycastT(refs[i*2], &points[i*6], &points[i*6+3], filter, DT_RAYCAST_USE_COSTS, &hit);
+		}
+	}
+	return testNowNanos() - begin;
+}
+}
+
+TEST_CASE("Bench_findNearestPolyBatch")
+{
+	TestWorldParams worldParams;
+	worldParams.tilesX = 8;
+	worldParams.tilesZ = 8;
+	dtNavMesh* nav = buildTestNavMesh(worldParams);
+	REQUIRE(nav != nullptr);
+
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(nav, 2048)));
+	dtQueryFilter filter;
+
+	const float worldSize = worldParams.tilesX * nav->getParams()->tileWidth;
+	const int count = 20000;
+	const int loops = 5;
+
+	std::vector<float> centers(count * 3);
+	std::vector<float> extents(count * 3);
+	unsigned int seed = 42;
+	for (int i = 0; i < count; ++i)
+	{
+		centers[i*3+0] = testRand(seed) * worldSize;
+		centers[i*3+1] = testRand(seed) * 1.0f;
+		centers[i*3+2] = testRand(seed) * worldSize;
+		extents[i*3+0] = 2.0f;
+		extents[i*3+1] = 4.0f;
+		extents[i*3+2] = 2.0f;
+	}
+
+	std::vector<dtPolyRef> refs(count);
+	std::vector<float> points(count * 3);
+
+	int64_t begin = testNowNanos();
+	for (int loop = 0; loop < loops; ++loop)
+	{
+		for (int i = 0; i < count; ++i)
+			query.findNearestPoly(&centers[i*3], &extents[i*3], &filter, &refs[i], &points[i*3]);
+	}
+	const int64_t singleNanos = testNowNanos() - begin;
+
+	begin = testNowNanos();
+	for (int loop = 0; loop < loops; ++loop)
+		query.findNearestPolyBatch(&centers[0], &extents[0], count, &filter, &refs[0], &points[0], nullptr);
+	const int64_t batchNanos = testNowNanos() - begin;
+
+	const double n = (double)count * loops;
+	printf("BM_%-35s %10.2f nanos/point\n", "findNearestPoly_Single:", singleNanos / n);
+	printf("BM_%-35s %10.2f nanos/point\n", "findNearestPoly_Batch:", batchNanos / n);
+
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("Bench_findPathPolyLinkRanges")
+{
+	const char* names[2] = { "findPath_Standard:", "findPath_PolyLinkRanges:" };
+	for (int layout = 0; layout < 2; ++layout)
+	{
+		TestWorldParams worldParams;
+		worldParams.tilesX = 8;
+		worldParams.tilesZ = 8;
+		worldParams.navMeshFlags = layout == 1 ? DT_NAVMESH_POLY_LINK_RANGES : 0;
+		dtNavMesh* nav = buildTestNavMesh(worldParams);
+		REQUIRE(nav != nullptr);
+
+		dtNavMeshQuery query;
+		REQUIRE(dtStatusSucceed(query.init(nav, 4096)));
+		dtQueryFilter filter;
+
+		const float worldSize = worldParams.tilesX * nav->getParams()->tileWidth;
+		const float halfExtents[3] = { 2.0f, 4.0f, 2.0f };
+		const int count = 500;
+		std::vector<dtPolyRef> refs(count * 2);
+		std::vector<float> points(count * 6);
+		unsigned int seed = 42;
+		for (int i = 0; i < count * 2; ++i)
+		{
+			const float center[3] = { testRand(seed) * worldSize, 0.0f, testRand(seed) * worldSize };
+			query.findNearestPoly(center, halfExtents, &filter, &refs[i], &points[i*3]);
+		}
+
+		const int loops = 5;
+		dtPolyRef path[512];
+		int64_t begin = testNowNanos();
+		for (int loop = 0; loop < loops; ++loop)
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				int pathCount = 0;
+				query.findPath(refs[i*2], refs[i*2+1], &points[i*6], &points[i*6+3], &filter, path, &pathCount, 512);
+			}
+		}
+		const int64_t nanos = testNowNanos() - begin;
+		printf("BM_%-35s %10.2f nanos/path\n", names[layout], nanos / ((double)count * loops));
+
+		dtFreeNavMesh(nav);
+	}
+}
+
+TEST_CASE("Bench_queryFilterDispatch")
+{
+	TestWorldParams worldParams;
+	worldParams.tilesX = 8;
+	worldParams.tilesZ = 8;
+	dtNavMesh* nav = buildTestNavMesh(worldParams);
+	REQUIRE(nav != nullptr);
+
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(nav, 4096)));
+	dtQueryFilter filter;
+	BenchInlineFilter inlineFilter;
+	BenchVirtualFilterImpl virtualFilterImpl;
+	const BenchVirtualFilter* virtualFilter = &virtualFilterImpl;
+
+	const float worldSize = worldParams.tilesX * nav->getParams()->tileWidth;
+	const float halfExtents[3] = { 2.0f, 4.0f, 2.0f };
+	const int count = 500;
+	std::vector<dtPolyRef> refs(count * 2);
+	std::vector<float> points(count * 6);
+	unsigned int seed = 42;
+	for (int i = 0; i < count * 2; ++i)
+	{
+		const float center[3] = { testRand(seed) * worldSize, 0.0f, testRand(seed) * worldSize };
+		query.findNearestPoly(center, halfExtents, &filter, &refs[i], &points[i*3]);
+	}
+
+	const int loops = 5;
+	const int64_t virtualNanos = benchFindPathAndRaycast(query, virtualFilter, refs, points, loops);
+	const int64_t defaultNanos = benchFindPathAndRaycast(query, &filter, refs, points, loops);
+	const int64_t templatedNanos = benchFindPathAndRaycast(query, &inlineFilter, refs, points, loops);
+
+	const double n = (double)count * loops;
+	printf("BM_%-35s %10.2f nanos/query\n", "queryFilter_Virtual:", virtualNanos / n);
+#ifdef DT_VIRTUAL_QUERYFILTER
+	printf("BM_%-35s %10.2f nanos/query\n", "queryFilter_Default(virtual):", defaultNanos / n);
+#else
+	printf("BM_%-35s %10.2f nanos/query\n", "queryFilter_Default:", defaultNanos / n);
+#endif
+	printf("BM_%-35s %10.2f nanos/query\n", "queryFilter_Templated:", templatedNanos / n);
+
+	dtFreeNavMesh(nav);
+}
@@ -0,0 +1,393 @@
+#include "NavMeshTestUtils.h"
+
+#include <math.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "Recast.h"
+#include "DetourAlloc.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshBuilder.h"
+
+namespace
+{
+const float kCellSize = 0.3f;
+const float kCellHeight = 0.2f;
+const float kAgentHeight = 2.0f;
+const float kAgentRadius = 0.6f;
+const float kAgentClimb = 0.9f;
+const float kPillarSpacing = 6.0f;
+const float kPillarHalfSize = 0.75f;
+const float kPillarHeight = 3.0f;
+
+void addQuad(std::vector<float>& verts, std::vector<int>& tris,
+			 const float* a, const float* b, const float* c, const float* d)
+{
+	const int base = (int)verts.size() / 3;
+	verts.insert(verts.end(), a, a + 3);
+	verts.insert(verts.end(), b, b + 3);
+	verts.insert(verts.end(), c, c + 3);
+	verts.insert(verts.end(), d, d + 3);
+	const int idx[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+	tris.insert(tris.end(), idx, idx + 6);
+}
+
+void addBox(std::vector<float>& verts, std::vector<int>& tris, const float* bmin, const float* bmax)
+{
+	const float v[8][3] = {
+		{ bmin[0], bmin[1], bmin[2] }, { bmax[0], bmin[1], bmin[2] },
+		{ bmax[0], bmin[1], bmax[2] }, { bmin[0], bmin[1], bmax[2] },
+		{ bmin[0], bmax[1], bmin[2] }, { bmax[0], bmax[1], bmin[2] },
+		{ bmax[0], bmax[1], bmax[2] }, { bmin[0], bmax[1], bmax[2] },
+	};
+	addQuad(verts, tris, v[4], v[7], v[6], v[5]); // top
+	addQuad(verts, tris, v[0], v[4], v[5], v[1]);
+	addQuad(verts, tris, v[1], v[5], v[6], v[2]);
+	addQuad(verts, tris, v[2], v[6], v[7], v[3]);
+	addQuad(verts, tris, v[3], v[7], v[4], v[0]);
+}
+}
+
+void buildTestGeometry(const TestWorldParams& params, const float* bmin, const float* bmax,
+					   std::vector<float>& verts, std::vector<int>& tris)
+{
+	// Ground, counter-clockwise when seen from above so the normal points up.
+	const float g0[3] = { bmin[0], 0.0f, bmin[2] };
+	const float g1[3] = { bmin[0], 0.0f, bmax[2] };
+	const float g2[3] = { bmax[0], 0.0f, bmax[2] };
+	const float g3[3] = { bmax[0], 0.0f, bmin[2] };
+	addQuad(verts, tris, g0, g1, g2, g3);
+
+	if (!params.pillars)
+		return;
+
+	const float worldX = params.tilesX * params.tileSize;
+	const float worldZ = params.tilesZ * params.tileSize;
+	for (float z = kPillarSpacing * 0.5f; z < worldZ; z += kPillarSpacing)
+	{
+		for (float x = kPillarSpacing * 0.5f; x < worldX; x += kPillarSpacing)
+		{
+			if (x + kPillarHalfSize < bmin[0] || x - kPillarHalfSize > bmax[0] ||
+				z + kPillarHalfSize < bmin[2] || z - kPillarHalfSize > bmax[2])
+				continue;
+			const float pmin[3] = { x - kPillarHalfSize, 0.0f, z - kPillarHalfSize };
+			const float pmax[3] = { x + kPillarHalfSize, kPillarHeight, z + kPillarHalfSize };
+			addBox(verts, tris, pmin, pmax);
+		}
+	}
+}
+
+void initTestTileConfig(const TestWorldParams& params, int tx, int ty, rcConfig& cfg)
+{
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.cs = kCellSize;
+	cfg.ch = kCellHeight;
+	cfg.walkableSlopeAngle = 45.0f;
+	cfg.walkableHeight = (int)ceilf(kAgentHeight / cfg.ch);
+	cfg.walkableClimb = (int)floorf(kAgentClimb / cfg.ch);
+	cfg.walkableRadius = (int)ceilf(kAgentRadius / cfg.cs);
+	cfg.maxEdgeLen = (int)(12.0f / cfg.cs);
+	cfg.maxSimplificationError = 1.3f;
+	cfg.minRegionArea = 8 * 8;
+	cfg.mergeRegionArea = 20 * 20;
+	cfg.maxVertsPerPoly = DT_VERTS_PER_POLYGON;
+	cfg.tileSize = (int)(params.tileSize / cfg.cs);
+	cfg.borderSize = cfg.walkableRadius + 3;
+	cfg.width = cfg.tileSize + cfg.borderSize * 2;
+	cfg.height = cfg.tileSize + cfg.borderSize * 2;
+	cfg.detailSampleDist = cfg.cs * 6.0f;
+	cfg.detailSampleMaxError = cfg.ch * 1.0f;
+
+	const float tileWorld = cfg.tileSize * cfg.cs;
+	cfg.bmin[0] = tx * tileWorld - cfg.borderSize * cfg.cs;
+	cfg.bmin[1] = -1.0f;
+	cfg.bmin[2] = ty * tileWorld - cfg.borderSize * cfg.cs;
+	cfg.bmax[0] = (tx + 1) * tileWorld + cfg.borderSize * cfg.cs;
+	cfg.bmax[1] = kPillarHeight + 1.0f;
+	cfg.bmax[2] = (ty + 1) * tileWorld + cfg.borderSize * cfg.cs;
+}
+
+bool rasterizeTestTile(rcContext* ctx, const TestWorldParams& params, const rcConfig& cfg, rcCompactHeightfield& chf)
+{
+	// Clamp the ground to the world so that the outer tiles get a proper border.
+	const float tileWorld = cfg.tileSize * cfg.cs;
+	float worldMin[3] = { 0.0f, 0.0f, 0.0f };
+	float worldMax[3] = { params.tilesX * tileWorld, 0.0f, params.tilesZ * tileWorld };
+	float geomMin[3], geomMax[3];
+	rcVcopy(geomMin, cfg.bmin);
+	rcVcopy(geomMax, cfg.bmax);
+	rcVmax(geomMin, worldMin);
+	rcVmin(geomMax, worldMax);
+
+	std::vector<float> verts;
+	std::vector<int> tris;
+	buildTestGeometry(params, geomMin, geomMax, verts, tris);
+	const int nverts = (int)verts.size() / 3;
+	const int ntris = (int)tris.size() / 3;
+
+	rcHeightfield* solid = rcAllocHeightfield();
+	std::vector<unsigned char> areas(ntris, 0);
+
+	bool ok = rcCreateHeightfield(ctx, *solid, cfg.width, cfg.height, cfg.bmin, cfg.bmax, cfg.cs, cfg.ch);
+	if (ok)
+	{
+		rcMarkWalkableTriangles(ctx, cfg.walkableSlopeAngle, &verts[0], nverts, &tris[0], ntris, &areas[0]);
+		ok = rcRasterizeTriangles(ctx, &verts[0], nverts, &tris[0], &areas[0], ntris, *solid, cfg.walkableClimb);
+	}
+	if (ok)
+	{
+		rcFilterLowHangingWalkableObstacles(ctx, cfg.walkableClimb, *solid);
+		rcFilterLedgeSpans(ctx, cfg.walkableHeight, cfg.walkableClimb, *solid);
+		rcFilterWalkableLowHeightSpans(ctx, cfg.walkableHeight, *solid);
+		ok = rcBuildCompactHeightfield(ctx, cfg.walkableHeight, cfg.walkableClimb, *solid, chf);
+	}
+	ok = ok && rcErodeWalkableArea(ctx, cfg.walkableRadius, chf);
+
+	rcFreeHeightField(solid);
+	return ok;
+}
+
+unsigned char* buildTestTileData(const TestWorldParams& params, int tx, int ty, int* dataSize)
+{
+	rcContext ctx(false);
+
+	rcConfig cfg;
+	initTestTileConfig(params, tx, ty, cfg);
+
+	unsigned char* navData = 0;
+	int navDataSize = 0;
+
+	rcCompactHeightfield* chf = rcAllocCompactHeightfield();
+	rcContourSet* cset = rcAllocContourSet();
+	rcPolyMesh* pmesh = rcAllocPolyMesh();
+	rcPolyMeshDetail* dmesh = rcAllocPolyMeshDetail();
+
+	bool ok = rasterizeTestTile(&ctx, params, cfg, *chf);
+	ok = ok && rcBuildDistanceField(&ctx, *chf);
+	ok = ok && rcBuildRegions(&ctx, *chf, cfg.borderSize, cfg.minRegionArea, cfg.mergeRegionArea);
+	ok = ok && rcBuildContours(&ctx, *chf, cfg.maxSimplificationError, cfg.maxEdgeLen, *cset);
+	ok = ok && cset->nconts > 0;
+	ok = ok && rcBuildPolyMesh(&ctx, *cset, cfg.maxVertsPerPoly, *pmesh);
+	ok = ok && rcBuildPolyMeshDetail(&ctx, *pmesh, *chf, cfg.detailSampleDist, cfg.detailSampleMaxError, *dmesh);
+
+	if (ok && pmesh->npolys > 0)
+	{
+		for (int i = 0; i < pmesh->npolys; ++i)
+			pmesh->flags[i] = 1;
+
+		dtNavMeshCreateParams createParams;
+		memset(&createParams, 0, sizeof(createParams));
+		createParams.verts = pmesh->verts;
+		createParams.vertCount = pmesh->nverts;
+		createParams.polys = pmesh->polys;
+		createParams.polyAreas = pmesh->areas;
+		createParams.polyFlags = pmesh->flags;
+		createParams.polyCount = pmesh->npolys;
+		createParams.nvp = pmesh->nvp;
+		createParams.detailMeshes = dmesh->meshes;
+		createParams.detailVerts = dmesh->verts;
+		createParams.detailVertsCount = dmesh->nverts;
+		createParams.detailTris = dmesh->tris;
+		createParams.detailTriCount = dmesh->ntris;
+		createParams.walkableHeight = kAgentHeight;
+		createParams.walkableRadius = kAgentRadius;
+		createParams.walkableClimb = kAgentClimb;
+		createParams.tileX = tx;
+		createParams.tileY = ty;
+		rcVcopy(createParams.bmin, pmesh->bmin);
+		rcVcopy(createParams.bmax, pmesh->bmax);
+		createParams.cs = cfg.cs;
+		createParams.ch = cfg.ch;
+		createParams.buildBvTree = true;
+
+		if (!dtCreateNavMeshData(&createParams, &navData, &navDataSize))
+		{
+			navData = 0;
+			navDataSize = 0;
+		}
+	}
+
+	rcFreeCompactHeightfield(chf);
+	rcFreeContourSet(cset);
+	rcFreePolyMesh(pmesh);
+	rcFreePolyMeshDetail(dmesh);
+
+	*dataSize = navDataSize;
+	return navData;
+}
+
+unsigned char* buildTestQuadTileData(const TestWorldParams& params, int tx, int ty, int layer, int* dataSize)
+{
+	return buildTestGridTileData(params, tx, ty, layer, 1, 1, 0, 0, dataSize);
+}
+
+unsigned char* buildTestGridTileData(const TestWorldParams& params, int tx, int ty, int layer, int gridX, int gridZ,
+									 const float* offMeshConVerts, int offMeshConCount, int* dataSize)
+{
+	const unsigned short n = (unsigned short)(params.tileSize / kCellSize);
+	const int nvp = DT_VERTS_PER_POLYGON;
+
+	std::vector<unsigned short> verts;
+	for (int k = 0; k <= gridZ; ++k)
+	{
+		for (int i = 0; i <= gridX; ++i)
+		{
+			verts.push_back((unsigned short)(i * n / gridX));
+			verts.push_back(0);
+			verts.push_back((unsigned short)(k * n / gridZ));
+		}
+	}
+
+	// Edges go along x-, z+, x+ and z-, the edges at the tile border are portals to the neighbour tiles.
+	const int polyCount = gridX * gridZ;
+	std::vector<unsigned short> polys(polyCount * nvp * 2, 0xffff);
+	for (int k = 0; k < gridZ; ++k)
+	{
+		for (int i = 0; i < gridX; ++i)
+		{
+			unsigned short* p = &polys[(i + k * gridX) * nvp * 2];
+			p[0] = (unsigned short)(i + k * (gridX + 1));
+			p[1] = (unsigned short)(i + (k + 1) * (gridX + 1));
+			p[2] = (unsigned short)(i + 1 + (k + 1) * (gridX + 1));
+			p[3] = (unsigned short)(i + 1 + k * (gridX + 1));
+			p[nvp + 0] = i > 0 ? (unsigned short)(i - 1 + k * gridX) : (unsigned short)(0x8000 | 0);
+			p[nvp + 1] = k + 1 < gridZ ? (unsigned short)(i + (k + 1) * gridX) : (unsigned short)(0x8000 | 1);
+			p[nvp + 2] = i + 1 < gridX ? (unsigned short)(i + 1 + k * gridX) : (unsigned short)(0x8000 | 2);
+			p[nvp + 3] = k > 0 ? (unsigned short)(i + (k - 1) * gridX) : (unsigned short)(0x8000 | 3);
+		}
+	}
+	const std::vector<unsigned short> polyFlags(polyCount, 1);
+	const std::vector<unsigned char> polyAreas(polyCount, 0);
+
+	const std::vector<float> offMeshConRads(offMeshConCount + 1, 0.5f);
+	const std::vector<unsigned char> offMeshConDirs(offMeshConCount + 1, DT_OFFMESH_CON_BIDIR);
+	const std::vector<unsigned char> offMeshConAreas(offMeshConCount + 1, 0);
+	const std::vector<unsigned short> offMeshConFlags(offMeshConCount + 1, 1);
+	std::vector<unsigned int> offMeshConUserIDs(offMeshConCount + 1, 0);
+	for (int i = 0; i < offMeshConCount; ++i)
+		offMeshConUserIDs[i] = (unsigned int)i;
+
+	dtNavMeshCreateParams createParams;
+	memset(&createParams, 0, sizeof(createParams));
+	createParams.verts = &verts[0];
+	createParams.vertCount = (int)verts.size() / 3;
+	createParams.polys = &polys[0];
+	createParams.polyFlags = &polyFlags[0];
+	createParams.polyAreas = &polyAreas[0];
+	createParams.polyCount = polyCount;
+	createParams.nvp = nvp;
+	createParams.offMeshConVerts = offMeshConVerts;
+	createParams.offMeshConRad = &offMeshConRads[0];
+	createParams.offMeshConDir = &offMeshConDirs[0];
+	createParams.offMeshConAreas = &offMeshConAreas[0];
+	createParams.offMeshConFlags = &offMeshConFlags[0];
+	createParams.offMeshConUserID = &offMeshConUserIDs[0];
+	createParams.offMeshConCount = offMeshConCount;
+	createParams.walkableHeight = kAgentHeight;
+	createParams.walkableRadius = kAgentRadius;
+	createParams.walkableClimb = kAgentClimb;
+	createParams.tileX = tx;
+	createParams.tileY = ty;
+	createParams.tileLayer = layer;
+	createParams.bmin[0] = tx * n * kCellSize;
+	createParams.bmin[1] = layer * 10.0f;
+	createParams.bmin[2] = ty * n * kCellSize;
+	createParams.bmax[0] = (tx + 1) * n * kCellSize;
+	createParams.bmax[1] = layer * 10.0f + 1.0f;
+	createParams.bmax[2] = (ty + 1) * n * kCellSize;
+	createParams.cs = kCellSize;
+	createParams.ch = kCellHeight;
+	createParams.buildBvTree = true;
+
+	unsigned char* navData = 0;
+	if (!dtCreateNavMeshData(&createParams, &navData, dataSize))
+		return 0;
+	return navData;
+}
+
+dtNavMesh* allocTestNavMesh(const TestWorldParams& params)
+{
+	dtNavMesh* nav = dtAllocNavMesh();
+	if (!nav)
+		return 0;
+
+	const int tileCells = (int)(params.tileSize / kCellSize);
+
+	dtNavMeshParams navParams;
+	memset(&navParams, 0, sizeof(navParams));
+	navParams.tileWidth = tileCells * kCellSize;
+	navParams.tileHeight = tileCells * kCellSize;
+	navParams.maxTiles = params.tilesX * params.tilesZ + params.spareTiles;
+	navParams.maxPolys = 1 << 10;
+
+	dtTileLookupParams lookupParams;
+	memset(&lookupParams, 0, sizeof(lookupParams));
+	lookupParams.type = params.tileLookup;
+	lookupParams.gridWidth = params.tilesX;
+	lookupParams.gridHeight = params.tilesZ;
+
+	if (dtStatusFailed(nav->init(&navParams, params.navMeshFlags, &lookupParams)))
+	{
+		dtFreeNavMesh(nav);
+		return 0;
+	}
+	return nav;
+}
+
+dtNavMesh* buildTestNavMesh(const TestWorldParams& params)
+{
+	dtNavMesh* nav = allocTestNavMesh(params);
+	if (!nav)
+		return 0;
+
+	for (int ty = 0; ty < params.tilesZ; ++ty)
+	{
+		for (int tx = 0; tx < params.tilesX; ++tx)
+		{
+			int dataSize = 0;
+			unsigned char* data = buildTestTileData(params, tx, ty, &dataSize);
+			if (!data)
+				continue;
+			if (dtStatusFailed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)))
+				dtFree(data);
+		}
+	}
+
+	return nav;
+}
+
+float testRand(unsigned int& seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return (float)(seed >> 8) / (float)(1u << 24);
+}
+
+void TestTaskContext::doRunTasks(const int taskCount, rcTaskFunc task, void* userData)
+{
+	std::atomic<int> next(0);
+	std::vector<std::thread> workers;
+	for (int i = 0; i < m_threadCount; ++i)
+	{
+		workers.emplace_back([&]()
+		{
+			for (int taskIndex = next++; taskIndex < taskCount; taskIndex = next++)
+			{
+				task(userData, taskIndex);
+			}
+		});
+	}
+	for (size_t i = 0; i < workers.size(); ++i)
+	{
+		workers[i].join();
+	}
+	m_taskCount += taskCount;
+}
+
+int64_t testNowNanos()
+{
+	return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,100 @@
+#ifndef NAVMESHTESTUTILS_H
+#define NAVMESHTESTUTILS_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "Recast.h"
+#include "DetourClock.h"
+
+class dtNavMesh;
+
+/// Describes the procedural world used by the Detour tests and benchmarks.
+/// The world is a flat ground plane at y = 0 covering tilesX * tilesZ tiles,
+/// optionally strewn with box pillars on a regular grid.
+struct TestWorldParams
+{
+	int tilesX;
+	int tilesZ;
+	float tileSize;		///< Tile size in world units.
+	bool pillars;		///< Add box pillars that carve holes into the navmesh.
+	int navMeshFlags;	///< Flags passed to dtNavMesh::init. (See: #dtNavMeshInitFlags)
+	int spareTiles;		///< Tile slots allocated in addition to the tiles of the world.
+	int tileLookup;		///< Tile lookup of the navmesh. A grid covers exactly the tiles of the world. (See: #dtTileLookupType)
+
+	TestWorldParams() : tilesX(4), tilesZ(4), tileSize(16.0f), pillars(true), navMeshFlags(0), spareTiles(0), tileLookup(0) {}
+};
+
+/// Appends the triangles of the test world that overlap the bounds. The ground is at y = 0.
+void buildTestGeometry(const TestWorldParams& params, const float* bmin, const float* bmax,
+					   std::vector<float>& verts, std::vector<int>& tris);
+
+/// Initializes the Recast build configuration of a tile of the test world, including its border.
+void initTestTileConfig(const TestWorldParams& params, int tx, int ty, struct rcConfig& cfg);
+
+/// Rasterizes, filters and erodes a tile of the test world.
+bool rasterizeTestTile(class rcContext* ctx, const TestWorldParams& params, const struct rcConfig& cfg,
+					   struct rcCompactHeightfield& chf);
+
+/// Builds tile data for a single tile of the test world using the full Recast pipeline.
+/// Returns null if the tile has no walkable surface. The returned data is allocated with dtAlloc.
+unsigned char* buildTestTileData(const TestWorldParams& params, int tx, int ty, int* dataSize);
+
+/// Builds tile data holding a single square polygon covering the tile, without running Recast.
+/// Layers are stacked 10 units apart. The returned data is allocated with dtAlloc.
+unsigned char* buildTestQuadTileData(const TestWorldParams& params, int tx, int ty, int layer, int* dataSize);
+
+/// Builds tile data holding a grid of square polygons covering the tile, without running Recast.
+/// The off-mesh connections are bidirectional. [(start x, y, z, end x, y, z) * @p offMeshConCount] [opt]
+/// The returned data is allocated with dtAlloc.
+unsigned char* buildTestGridTileData(const TestWorldParams& params, int tx, int ty, int layer, int gridX, int gridZ,
+									 const float* offMeshConVerts, int offMeshConCount, int* dataSize);
+
+/// Initializes an empty navigation mesh matching the tiles of the test world.
+/// Free with dtFreeNavMesh.
+dtNavMesh* allocTestNavMesh(const TestWorldParams& params);
+
+/// Builds a tiled navigation mesh over the test world with every tile added.
+/// The navmesh owns its tile data. Free with dtFreeNavMesh.
+dtNavMesh* buildTestNavMesh(const TestWorldParams& params);
+
+/// A Recast context running the tasks of a build step on worker threads.
+class TestTaskContext : public rcContext
+{
+public:
+	explicit TestTaskContext(int threadCount) : rcContext(false), m_threadCount(threadCount), m_taskCount(0) {}
+
+	/// The number of tasks run so far.
+	int getTaskCount() const { return m_taskCount; }
+
+protected:
+	void doRunTasks(const int taskCount, rcTaskFunc task, void* userData) override;
+
+private:
+	int m_threadCount;
+	int m_taskCount;
+};
+
+/// Deterministic pseudo random number in [0..1) used to generate test inputs.
+float testRand(unsigned int& seed);
+
+/// Returns monotonic process CPU time in nanoseconds, used by the benchmarks.
+int64_t testNowNanos();
+
+/// A clock advancing by a fixed step every time it is read, so that time budgets are deterministic.
+struct TestStepClock : public dtClock
+{
+	double now;		///< The time returned by the next reading.
+	double step;
+
+	explicit TestStepClock(const double step = 1.0, const double now = 0.0) : now(now), step(step) {}
+	double getTime() override { const double t = now; now += step; return t; }
+};
+
+/// Reads #testNowNanos in microseconds, used by the benchmarks.
+struct TestBenchClock : public dtClock
+{
+	double getTime() override { return testNowNanos() / 1000.0; }
+};
+
+#endif // NAVMESHTESTUTILS_H
@@ -1,6 +1,9 @@
+#include <math.h>
+
 #include "catch2/catch_all.hpp"
 
 #include "DetourCommon.h"
+#include "DetourMath.h"
 
 TEST_CASE("dtRandomPointInConvexPoly")
 {
@@ -31,3 +34,25 @@ TEST_CASE("dtRandomPointInConvexPoly")
 		REQUIRE(out[2] == Catch::Approx(0));
 	}
 }
+
+TEST_CASE("dtMath trigonometry")
+{
+	// With DT_DETERMINISTIC these are computed without the math library, and must stay close to it.
+	for (int i = -2000; i <= 2000; ++i)
+	{
+		const float a = i * 0.005f;
+		REQUIRE(fabs(dtMathSinf(a) - sin((double)a)) < 1e-6);
+		REQUIRE(fabs(dtMathCosf(a) - cos((double)a)) < 1e-6);
+	}
+	for (int i = -20; i <= 20; ++i)
+	{
+		for (int j = -20; j <= 20; ++j)
+		{
+			if (i == 0 && j == 0)
+				continue;
+			const float y = i * 0.37f;
+			const float x = j * 0.29f;
+			REQUIRE(fabs(dtMathAtan2f(y, x) - atan2((double)y, (double)x)) < 1e-6);
+		}
+	}
+}
@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <vector>
+
+#include "catch2/catch_all.hpp"
+
+#include "DetourAlloc.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+
+#include "NavMeshTestUtils.h"
+
+namespace
+{
+dtStatus addQuadTile(dtNavMesh* nav, const TestWorldParams& params, int tx, int ty, int layer)
+{
+	int dataSize = 0;
+	unsigned char* data = buildTestQuadTileData(params, tx, ty, layer, &dataSize);
+	if (!data)
+		return DT_FAILURE;
+	const dtStatus status = nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0);
+	if (dtStatusFailed(status))
+		dtFree(data);
+	return status;
+}
+}
+
+TEST_CASE("dtNavMesh tile lookup")
+{
+	TestWorldParams hashParams;
+	hashParams.pillars = false;
+	hashParams.tileLookup = DT_TILE_LOOKUP_HASH;
+	TestWorldParams gridParams = hashParams;
+	gridParams.tileLookup = DT_TILE_LOOKUP_GRID;
+
+	SECTION("Grid and hash lookups find the same tiles")
+	{
+		dtNavMesh* hashNav = buildTestNavMesh(hashParams);
+		dtNavMesh* gridNav = buildTestNavMesh(gridParams);
+		REQUIRE(hashNav != nullptr);
+		REQUIRE(gridNav != nullptr);
+
+		for (int y = -1; y <= hashParams.tilesZ; ++y)
+		{
+			for (int x = -1; x <= hashParams.tilesX; ++x)
+			{
+				const bool inside = x >= 0 && y >= 0 && x < hashParams.tilesX && y < hashParams.tilesZ;
+				const dtMeshTile* hashTile = hashNav->getTileAt(x, y, 0);
+				const dtMeshTile* gridTile = gridNav->getTileAt(x, y, 0);
+				REQUIRE((hashTile != nullptr) == inside);
+				REQUIRE((gridTile != nullptr) == inside);
+				if (!inside)
+					continue;
+				REQUIRE(hashTile->header->x == x);
+				REQUIRE(hashTile->header->y == y);
+				REQUIRE(gridTile->header->x == x);
+				REQUIRE(gridTile->header->y == y);
+				REQUIRE(hashNav->getTileRefAt(x, y, 0) == gridNav->getTileRefAt(x, y, 0));
+			}
+		}
+
+		// Tiles are connected the same way.
+		const float worldSize = hashParams.tilesX * hashNav->getParams()->tileWidth;
+		const float start[3] = { 1.0f, 0.0f, 1.0f };
+		const float end[3] = { worldSize - 1.0f, 0.0f, worldSize - 1.0f };
+		const float halfExtents[3] = { 2.0f, 2.0f, 2.0f };
+		dtQueryFilter filter;
+		std::vector<dtPolyRef> paths[2];
+		dtNavMesh* navs[2] = { hashNav, gridNav };
+		for (int i = 0; i < 2; ++i)
+		{
+			dtNavMeshQuery query;
+			REQUIRE(dtStatusSucceed(query.init(navs[i], 2048)));
+			dtPolyRef startRef = 0, endRef = 0;
+			float startPos[3], endPos[3];
+			REQUIRE(dtStatusSucceed(query.findNearestPoly(start, halfExtents, &filter, &startRef, startPos)));
+			REQUIRE(dtStatusSucceed(query.findNearestPoly(end, halfExtents, &filter, &endRef, endPos)));
+			dtPolyRef path[256];
+			int pathCount = 0;
+			const dtStatus status = query.findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 256);
+			REQUIRE(dtStatusSucceed(status));
+			REQUIRE(!dtStatusDetail(status, DT_PARTIAL_RESULT));
+			paths[i].assign(path, path + pathCount);
+		}
+		REQUIRE(paths[0] == paths[1]);
+
+		dtFreeNavMesh(hashNav);
+		dtFreeNavMesh(gridNav);
+	}
+
+	SECTION("Grid rejects tiles outside of its range")
+	{
+		dtNavMesh* nav = allocTestNavMesh(gridParams);
+		REQUIRE(nav != nullptr);
+		REQUIRE(dtStatusSucceed(addQuadTile(nav, gridParams, 0, 0, 0)));
+		REQUIRE(dtStatusDetail(addQuadTile(nav, gridParams, -1, 0, 0), DT_INVALID_PARAM));
+		REQUIRE(dtStatusDetail(addQuadTile(nav, gridParams, 0, gridParams.tilesZ, 0), DT_INVALID_PARAM));
+		REQUIRE(nav->getTileAt(-1, 0, 0) == nullptr);
+		dtFreeNavMesh(nav);
+	}
+
+	SECTION("Layers share a location")
+	{
+		dtNavMesh* navs[2] = { allocTestNavMesh(hashParams), allocTestNavMesh(gridParams) };
+		for (int i = 0; i < 2; ++i)
+		{
+			dtNavMesh* nav = navs[i];
+			REQUIRE(nav != nullptr);
+			for (int layer = 0; layer < 3; ++layer)
+				REQUIRE(dtStatusSucceed(addQuadTile(nav, hashParams, 1, 2, layer)));
+			REQUIRE(dtStatusDetail(addQuadTile(nav, hashParams, 1, 2, 1), DT_ALREADY_OCCUPIED));
+
+			const dtMeshTile* tiles[4];
+			REQUIRE(nav->getTilesAt(1, 2, tiles, 4) == 3);
+			REQUIRE(nav->getTilesAt(2, 1, tiles, 4) == 0);
+
+			REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(1, 2, 1), nullptr, nullptr)));
+			REQUIRE(nav->getTilesAt(1, 2, tiles, 4) == 2);
+			REQUIRE(nav->getTileAt(1, 2, 0) != nullptr);
+			REQUIRE(nav->getTileAt(1, 2, 1) == nullptr);
+			REQUIRE(nav->getTileAt(1, 2, 2) != nullptr);
+			dtFreeNavMesh(nav);
+		}
+	}
+
+	SECTION("Hash reuses locations of removed tiles")
+	{
+		// Streaming through many more locations than there are tiles forces the hash to be rebuilt.
+		TestWorldParams params = hashParams;
+		params.tilesX = 2;
+		params.tilesZ = 2;
+		dtNavMesh* nav = allocTestNavMesh(params);
+		REQUIRE(nav != nullptr);
+
+		const int window = 3;
+		const int count = 500;
+		for (int i = 0; i < count; ++i)
+		{
+			const int x = (i * 7919) % 1000 - 500;
+			const int y = -(i * 104729) % 997;
+			REQUIRE(dtStatusSucceed(addQuadTile(nav, params, x, y, 0)));
+			REQUIRE(nav->getTileAt(x, y, 0) != nullptr);
+			if (i >= window)
+			{
+				const int px = ((i - window) * 7919) % 1000 - 500;
+				const int py = -((i - window) * 104729) % 997;
+				REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(px, py, 0), nullptr, nullptr)));
+				REQUIRE(nav->getTileAt(px, py, 0) == nullptr);
+			}
+		}
+
+		for (int i = count - window; i < count; ++i)
+		{
+			const int x = (i * 7919) % 1000 - 500;
+			const int y = -(i * 104729) % 997;
+			REQUIRE(nav->getTileAt(x, y, 0) != nullptr);
+		}
+		dtFreeNavMesh(nav);
+	}
+}
+
+TEST_CASE("dtNavMesh polygon link ranges")
+{
+	TestWorldParams plainParams;
+	TestWorldParams rangeParams;
+	rangeParams.navMeshFlags = DT_NAVMESH_POLY_LINK_RANGES;
+
+	dtNavMesh* plainNav = buildTestNavMesh(plainParams);
+	dtNavMesh* rangeNav = buildTestNavMesh(rangeParams);
+	REQUIRE(plainNav != nullptr);
+	REQUIRE(rangeNav != nullptr);
+
+	SECTION("Polygon links stay within their reserved ranges")
+	{
+		int ranged = 0;
+		int shared = 0;
+		for (int i = 0; i < rangeNav->getMaxTiles(); ++i)
+		{
+			const dtMeshTile* tile = static_cast<const dtNavMesh*>(rangeNav)->getTile(i);
+			if (!tile->header)
+				continue;
+			REQUIRE(tile->linkRanges != nullptr);
+			for (int ip = 0; ip < tile->header->polyCount; ++ip)
+			{
+				const dtPoly* poly = &tile->polys[ip];
+				const dtPolyLinkRange& range = tile->linkRanges[ip];
+				for (unsigned int k = poly->firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
+				{
+					if (k >= range.base && k < range.base + range.count)
+						ranged++;
+					else
+						shared++;
+				}
+			}
+		}
+		REQUIRE(ranged > 0);
+		REQUIRE(shared == 0);
+
+		const dtMeshTile* tile = static_cast<const dtNavMesh*>(plainNav)->getTile(0);
+		REQUIRE(tile->linkRanges == nullptr);
+	}
+
+	SECTION("Queries return the same results")
+	{
+		const float worldSize = plainParams.tilesX * plainNav->getParams()->tileWidth;
+		const float halfExtents[3] = { 2.0f, 4.0f, 2.0f };
+		dtQueryFilter filter;
+		dtNavMeshQuery plainQuery, rangeQuery;
+		REQUIRE(dtStatusSucceed(plainQuery.init(plainNav, 2048)));
+		REQUIRE(dtStatusSucceed(rangeQuery.init(rangeNav, 2048)));
+
+		unsigned int seed = 7;
+		for (int i = 0; i < 50; ++i)
+		{
+			const float a[3] = { testRand(seed) * worldSize, 0.0f, testRand(seed) * worldSize };
+			const float b[3] = { testRand(seed) * worldSize, 0.0f, testRand(seed) * worldSize };
+			dtPolyRef refs[2][2];
+			float pos[2][2][3];
+			dtNavMeshQuery* queries[2] = { &plainQuery, &rangeQuery };
+			std::vector<dtPolyRef> paths[2];
+			for (int j = 0; j < 2; ++j)
+			{
+				queries[j]->findNearestPoly(a, halfExtents, &filter, &refs[j][0], pos[j][0]);
+				queries[j]->findNearestPoly(b, halfExtents, &filter, &refs[j][1], pos[j][1]);
+				if (!refs[j][0] || !refs[j][1])
+					continue;
+				dtPolyRef path[256];
+				int pathCount = 0;
+				queries[j]->findPath(refs[j][0], refs[j][1], pos[j][0], pos[j][1], &filter, path, &pathCount, 256);
+				paths[j].assign(path, path + pathCount);
+			}
+			REQUIRE(refs[0][0] == refs[1][0]);
+			REQUIRE(refs[0][1] == refs[1][1]);
+			REQUIRE(paths[0] == paths[1]);
+		}
+	}
+
+	SECTION("Links are reserved again after a neighbour tile is replaced")
+	{
+		const dtTileRef tileRef = rangeNav->getTileRefAt(1, 1, 0);
+		REQUIRE(tileRef != 0);
+		REQUIRE(dtStatusSucceed(rangeNav->removeTile(tileRef, nullptr, nullptr)));
+		int dataSize = 0;
+		unsigned char* data = buildTestTileData(rangeParams, 1, 1, &dataSize);
+		REQUIRE(data != nullptr);
+		REQUIRE(dtStatusSucceed(rangeNav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, nullptr)));
+
+		for (int i = 0; i < rangeNav->getMaxTiles(); ++i)
+		{
+			const dtMeshTile* tile = static_cast<const dtNavMesh*>(rangeNav)->getTile(i);
+			if (!tile->header)
+				continue;
+			REQUIRE(tile->linkRanges != nullptr);
+			for (int ip = 0; ip < tile->header->polyCount; ++ip)
+			{
+				const dtPolyLinkRange& range = tile->linkRanges[ip];
+				for (unsigned int k = tile->polys[ip].firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
+				{
+					REQUIRE(k >= range.base);
+					REQUIRE(k < range.base + range.count);
+				}
+			}
+		}
+	}
+
+	dtFreeNavMesh(plainNav);
+	dtFreeNavMesh(rangeNav);
+}
+
+TEST_CASE("dtNavMesh polygon link ranges next to finer tiles")
+{
+	// The right polygon of a tile split in two borders tiles with four polygons across its right and
+	// bottom portal edges, and off-mesh connections from the right neighbour land on it. It needs more
+	// links than it reserved and than the tile has left unreserved, but not more than the tile has.
+	TestWorldParams params;
+	params.pillars = false;
+	TestWorldParams rangeParams = params;
+	rangeParams.navMeshFlags = DT_NAVMESH_POLY_LINK_RANGES;
+	dtNavMesh* navs[2] = { allocTestNavMesh(params), allocTestNavMesh(rangeParams) };
+	REQUIRE(navs[0] != nullptr);
+	REQUIRE(navs[1] != nullptr);
+
+	const float tileWidth = navs[0]->getParams()->tileWidth;
+	const float origin[3] = { tileWidth, 0.0f, tileWidth };
+	const int offMeshConCount = 6;
+	float offMeshConVerts[offMeshConCount*6];
+	for (int i = 0; i < offMeshConCount; ++i)
+	{
+		const float z = origin[2] + (i + 0.5f) * tileWidth / offMeshConCount;
+		float* v = &offMeshConVerts[i*6];
+		v[0] = origin[0] + tileWidth + 1.0f; v[1] = 0.0f; v[2] = z;
+		v[3] = origin[0] + tileWidth * 0.75f; v[4] = 0.0f; v[5] = z;
+	}
+
+	for (int i = 0; i < 2; ++i)
+	{
+		const int tiles[3][4] = { { 1, 1, 2, 1 }, { 2, 1, 1, 4 }, { 1, 0, 8, 1 } };
+		for (int j = 0; j < 3; ++j)
+		{
+			int dataSize = 0;
+			unsigned char* data = buildTestGridTileData(params, tiles[j][0], tiles[j][1], 0, tiles[j][2], tiles[j][3],
+														j == 1 ? offMeshConVerts : nullptr, j == 1 ? offMeshConCount : 0,
+														&dataSize);
+			REQUIRE(data != nullptr);
+			const dtStatus status = navs[i]->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, nullptr);
+			REQUIRE(dtStatusSucceed(status));
+			REQUIRE(!dtStatusDetail(status, DT_OUT_OF_MEMORY));
+		}
+	}
+
+	SECTION("Polygons have the same links")
+	{
+		const dtNavMesh* plainNav = navs[0];
+		const dtNavMesh* rangeNav = navs[1];
+		const dtMeshTile* tile = rangeNav->getTileAt(1, 1, 0);
+		REQUIRE(tile != nullptr);
+		// Internal link, four links across each connected portal and the off-mesh connections.
+		int linkCount = 0;
+		for (unsigned int k = tile->polys[1].firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
+			linkCount++;
+		REQUIRE(linkCount == 1 + 2*4 + offMeshConCount);
+
+		for (int i = 0; i < plainNav->getMaxTiles(); ++i)
+		{
+			const dtMeshTile* a = plainNav->getTile(i);
+			const dtMeshTile* b = rangeNav->getTile(i);
+			REQUIRE((a->header == nullptr) == (b->header == nullptr));
+			if (!a->header)
+				continue;
+			for (int ip = 0; ip < a->header->polyCount; ++ip)
+			{
+				std::vector<dtPolyRef> linksA, linksB;
+				for (unsigned int k = a->polys[ip].firstLink; k != DT_NULL_LINK; k = a->links[k].next)
+					linksA.push_back(a->links[k].ref);
+				for (unsigned int k = b->polys[ip].firstLink; k != DT_NULL_LINK; k = b->links[k].next)
+					linksB.push_back(b->links[k].ref);
+				std::sort(linksA.begin(), linksA.end());
+				std::sort(linksB.begin(), linksB.end());
+				REQUIRE(linksA == linksB);
+			}
+		}
+	}
+
+	SECTION("Borrowed links are returned when a neighbour tile is replaced")
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			REQUIRE(dtStatusSucceed(navs[1]->removeTile(navs[1]->getTileRefAt(2, 1, 0), nullptr, nullptr)));
+			int dataSize = 0;
+			unsigned char* data = buildTestGridTileData(params, 2, 1, 0, 1, 4, offMeshConVerts, offMeshConCount, &dataSize);
+			REQUIRE(data != nullptr);
+			const dtStatus status = navs[1]->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, nullptr);
+			REQUIRE(dtStatusSucceed(status));
+			REQUIRE(!dtStatusDetail(status, DT_OUT_OF_MEMORY));
+		}
+		const dtMeshTile* tile = static_cast<const dtNavMesh*>(navs[1])->getTileAt(1, 1, 0);
+		int linkCount = 0;
+		for (unsigned int k = tile->polys[1].firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
+			linkCount++;
+		REQUIRE(linkCount == 1 + 2*4 + offMeshConCount);
+	}
+
+	SECTION("Paths are the same")
+	{
+		const float halfExtents[3] = { 1.0f, 1.0f, 1.0f };
+		dtQueryFilter filter;
+		dtNavMeshQuery queries[2];
+		REQUIRE(dtStatusSucceed(queries[0].init(navs[0], 512)));
+		REQUIRE(dtStatusSucceed(queries[1].init(navs[1], 512)));
+
+		unsigned int seed = 11;
+		for (int i = 0; i < 50; ++i)
+		{
+			// Points in the tiles around the split tile, which is at (1, 1).
+			float points[2][3];
+			for (int j = 0; j < 2; ++j)
+			{
+				const int tileIndex = (int)(testRand(seed) * 3.0f) % 3;
+				const float tileOrigins[3][2] = { { 1, 1 }, { 2, 1 }, { 1, 0 } };
+				points[j][0] = (tileOrigins[tileIndex][0] + 0.05f + testRand(seed) * 0.9f) * tileWidth;
+				points[j][1] = 0.0f;
+				points[j][2] = (tileOrigins[tileIndex][1] + 0.05f + testRand(seed) * 0.9f) * tileWidth;
+			}
+			std::vector<dtPolyRef> paths[2];
+			for (int j = 0; j < 2; ++j)
+			{
+				dtPolyRef startRef = 0;
+				dtPolyRef endRef = 0;
+				float startPos[3];
+				float endPos[3];
+				queries[j].findNearestPoly(points[0], halfExtents, &filter, &startRef, startPos);
+				queries[j].findNearestPoly(points[1], halfExtents, &filter, &endRef, endPos);
+				REQUIRE(startRef);
+				REQUIRE(endRef);
+				dtPolyRef path[64];
+				int pathCount = 0;
+				REQUIRE(dtStatusSucceed(queries[j].findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 64)));
+				paths[j].assign(path, path + pathCount);
+			}
+			REQUIRE(paths[0] == paths[1]);
+			REQUIRE(paths[0].back() != 0);
+		}
+	}
+
+	dtFreeNavMesh(navs[0]);
+	dtFreeNavMesh(navs[1]);
+}
@@ -0,0 +1,223 @@
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch_all.hpp"
+
+#include "DetourAlloc.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+
+#include "NavMeshTestUtils.h"
+
+namespace
+{
+struct TileSource
+{
+	std::vector<unsigned char> data;
+	int x;
+	int y;
+};
+
+unsigned char* copyTileData(const TileSource& source)
+{
+	unsigned char* data = (unsigned char*)dtAlloc(source.data.size(), DT_ALLOC_PERM);
+	memcpy(data, &source.data[0], source.data.size());
+	return data;
+}
+}
+
+TEST_CASE("dtNavMesh concurrent reads")
+{
+	TestWorldParams worldParams;
+	worldParams.navMeshFlags = DT_NAVMESH_CONCURRENT_READS;
+	worldParams.spareTiles = 4;
+	dtNavMesh* nav = buildTestNavMesh(worldParams);
+	REQUIRE(nav != nullptr);
+	REQUIRE(nav->isConcurrent());
+
+	const float worldSize = worldParams.tilesX * nav->getParams()->tileWidth;
+	const float center[3] = { worldSize * 0.25f, 0.0f, worldSize * 0.25f };
+	const float halfExtents[3] = { 2.0f, 2.0f, 2.0f };
+	dtQueryFilter filter;
+
+	SECTION("Readers are limited")
+	{
+		std::vector<int> readers;
+		for (int i = 0; i < DT_MAX_NAVMESH_READERS; ++i)
+		{
+			const int reader = nav->allocReader();
+			REQUIRE(reader >= 0);
+			readers.push_back(reader);
+		}
+		REQUIRE(nav->allocReader() == -1);
+
+		dtNavMeshQuery query;
+		REQUIRE(dtStatusFailed(query.init(nav, 256)));
+
+		nav->freeReader(readers.back());
+		REQUIRE(dtStatusSucceed(query.init(nav, 256)));
+		for (int i = 0; i < DT_MAX_NAVMESH_READERS - 1; ++i)
+			nav->freeReader(readers[i]);
+
+		dtNavMesh plain;
+		dtNavMeshParams params;
+		memset(&params, 0, sizeof(params));
+		params.tileWidth = 1.0f;
+		params.tileHeight = 1.0f;
+		params.maxTiles = 1;
+		params.maxPolys = 1;
+		REQUIRE(dtStatusSucceed(plain.init(&params)));
+		REQUIRE(!plain.isConcurrent());
+		REQUIRE(plain.allocReader() == -1);
+	}
+
+	SECTION("Removed tiles stay readable until readers leave")
+	{
+		dtNavMeshQuery query;
+		REQUIRE(dtStatusSucceed(query.init(nav, 256)));
+		dtPolyRef ref = 0;
+		REQUIRE(dtStatusSucceed(query.findNearestPoly(center, halfExtents, &filter, &ref, nullptr)));
+		REQUIRE(ref != 0);
+
+		const dtMeshTile* tile = nullptr;
+		const dtPoly* poly = nullptr;
+		REQUIRE(dtStatusSucceed(nav->getTileAndPolyByRef(ref, &tile, &poly)));
+		const int x = tile->header->x;
+		const int y = tile->header->y;
+
+		const int reader = nav->allocReader();
+		REQUIRE(reader >= 0);
+		nav->beginRead(reader);
+		nav->beginRead(reader);
+		REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(x, y, 0), nullptr, nullptr)));
+
+		// The tile is gone for new lookups, but its memory is still in place.
+		REQUIRE(!nav->isValidPolyRef(ref));
+		REQUIRE(nav->getTileAt(x, y, 0) == nullptr);
+		REQUIRE(tile->header != nullptr);
+		REQUIRE(tile->header->x == x);
+		REQUIRE(nav->reclaimRetired() == 1);
+
+		// Leaving a nested section keeps the tile alive.
+		nav->endRead(reader);
+		REQUIRE(nav->reclaimRetired() == 1);
+		nav->endRead(reader);
+		REQUIRE(nav->reclaimRetired() == 0);
+		REQUIRE(tile->header == nullptr);
+		nav->freeReader(reader);
+	}
+
+	SECTION("Queries run while tiles are replaced")
+	{
+		std::vector<TileSource> sources;
+		for (int ty = 0; ty < worldParams.tilesZ; ++ty)
+		{
+			for (int tx = 0; tx < worldParams.tilesX; ++tx)
+			{
+				TileSource source;
+				int dataSize = 0;
+				unsigned char* data = buildTestTileData(worldParams, tx, ty, &dataSize);
+				REQUIRE(data != nullptr);
+				source.data.assign(data, data + dataSize);
+				source.x = tx;
+				source.y = ty;
+				dtFree(data);
+				sources.push_back(source);
+			}
+		}
+
+		const int readerCount = 4;
+		std::atomic<bool> done(false);
+		std::atomic<int> failures(0);
+		std::atomic<int> queries(0);
+		std::vector<std::thread> readers;
+		for (int r = 0; r < readerCount; ++r)
+		{
+			readers.push_back(std::thread([&, r]()
+			{
+				dtNavMeshQuery query;
+				if (dtStatusFailed(query.init(nav, 2048)))
+				{
+					failures++;
+					return;
+				}
+				unsigned int seed = 100 + r;
+				dtPolyRef path[256];
+				float straight[64*3];
+				while (!done.load())
+				{
+					float a[3] = { testRand(seed) * worldSize, 0.0f, testRand(seed) * worldSize };
+					float b[3] = { testRand(seed) * worldSize, 0.0f, testRand(seed) * worldSize };
+					dtPolyRef startRef = 0, endRef = 0;
+					float startPos[3], endPos[3];
+					query.findNearestPoly(a, halfExtents, &filter, &startRef, startPos);
+					query.findNearestPoly(b, halfExtents, &filter, &endRef, endPos);
+					if (!startRef || !endRef)
+						continue;
+
+					int pathCount = 0;
+					const dtStatus status = query.findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 256);
+					if (dtStatusSucceed(status) && pathCount > 0)
+					{
+						int straightCount = 0;
+						query.findStraightPath(startPos, endPos, path, pathCount, straight, nullptr, nullptr, &straightCount, 64);
+					}
+
+					float t = 0;
+					float hitNormal[3];
+					int hitCount = 0;
+					query.raycast(startRef, startPos, endPos, &filter, &t, hitNormal, path, &hitCount, 256);
+					queries++;
+				}
+			}));
+		}
+
+		// Replace tiles while the readers are running.
+		unsigned int seed = 42;
+		const int replaceCount = 200;
+		for (int i = 0; i < replaceCount; ++i)
+		{
+			const TileSource& source = sources[(int)(testRand(seed) * sources.size()) % sources.size()];
+			const dtTileRef ref = nav->getTileRefAt(source.x, source.y, 0);
+			REQUIRE(ref != 0);
+			REQUIRE(dtStatusSucceed(nav->removeTile(ref, nullptr, nullptr)));
+
+			unsigned char* data = copyTileData(source);
+			dtStatus status = nav->addTile(data, (int)source.data.size(), DT_TILE_FREE_DATA, 0, nullptr);
+			while (dtStatusDetail(status, DT_OUT_OF_MEMORY))
+			{
+				// All tile slots are waiting for readers to leave.
+				std::this_thread::yield();
+				status = nav->addTile(data, (int)source.data.size(), DT_TILE_FREE_DATA, 0, nullptr);
+			}
+			REQUIRE(dtStatusSucceed(status));
+		}
+
+		done = true;
+		for (size_t i = 0; i < readers.size(); ++i)
+			readers[i].join();
+
+		REQUIRE(failures.load() == 0);
+		REQUIRE(queries.load() > 0);
+		REQUIRE(nav->reclaimRetired() == 0);
+
+		// The mesh is fully connected again.
+		dtNavMeshQuery query;
+		REQUIRE(dtStatusSucceed(query.init(nav, 2048)));
+		const float farCorner[3] = { worldSize * 0.75f, 0.0f, worldSize * 0.75f };
+		dtPolyRef startRef = 0, endRef = 0;
+		float startPos[3], endPos[3];
+		REQUIRE(dtStatusSucceed(query.findNearestPoly(center, halfExtents, &filter, &startRef, startPos)));
+		REQUIRE(dtStatusSucceed(query.findNearestPoly(farCorner, halfExtents, &filter, &endRef, endPos)));
+		dtPolyRef path[256];
+		int pathCount = 0;
+		const dtStatus status = query.findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 256);
+		REQUIRE(dtStatusSucceed(status));
+		REQUIRE(!dtStatusDetail(status, DT_PARTIAL_RESULT));
+		REQUIRE(path[pathCount-1] == endRef);
+	}
+
+	dtFreeNavMesh(nav);
+}
@@ -0,0 +1,339 @@
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+#include "catch2/catch_all.hpp"
+
+#include "DetourCommon.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+#include "DetourNavMeshQuery.inl"
+
+#include "NavMeshTestUtils.h"
+
+TEST_CASE("dtNavMeshQuery::findNearestPolyBatch")
+{
+	TestWorldParams worldParams;
+	dtNavMesh* nav = buildTestNavMesh(worldParams);
+	REQUIRE(nav != nullptr);
+
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(nav, 2048)));
+	dtQueryFilter filter;
+
+	const float worldSize = worldParams.tilesX * nav->getParams()->tileWidth;
+
+	SECTION("Matches findNearestPoly for every point")
+	{
+		const int count = 2000;
+		std::vector<float> centers(count * 3);
+		std::vector<float> extents(count * 3);
+		unsigned int seed = 1234;
+		for (int i = 0; i < count; ++i)
+		{
+			// Include points outside of the world and boxes spanning several tiles.
+			centers[i*3+0] = -4.0f + testRand(seed) * (worldSize + 8.0f);
+			centers[i*3+1] = -1.0f + testRand(seed) * 4.0f;
+			centers[i*3+2] = -4.0f + testRand(seed) * (worldSize + 8.0f);
+			const float radius = (i % 7 == 0) ? 12.0f : 1.0f + testRand(seed);
+			extents[i*3+0] = radius;
+			extents[i*3+1] = 2.0f;
+			extents[i*3+2] = radius;
+		}
+
+		std::vector<dtPolyRef> refs(count, 0);
+		std::vector<float> points(count * 3, 0.0f);
+		bool* overPolyArray = new bool[count];
+		REQUIRE(dtStatusSucceed(query.findNearestPolyBatch(&centers[0], &extents[0], count, &filter,
+														   &refs[0], &points[0], overPolyArray)));
+
+		int found = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			dtPolyRef ref = 0;
+			float pt[3] = { 0, 0, 0 };
+			bool over = false;
+			REQUIRE(dtStatusSucceed(query.findNearestPoly(&centers[i*3], &extents[i*3], &filter, &ref, pt, &over)));
+			REQUIRE(refs[i] == ref);
+			if (!ref)
+				continue;
+			found++;
+			REQUIRE(points[i*3+0] == pt[0]);
+			REQUIRE(points[i*3+1] == pt[1]);
+			REQUIRE(points[i*3+2] == pt[2]);
+			REQUIRE(overPolyArray[i] == over);
+		}
+		delete [] overPolyArray;
+
+		// Most of the points should hit the mesh, otherwise the test is not meaningful.
+		REQUIRE(found > count / 2);
+	}
+
+	SECTION("Respects the filter")
+	{
+		const float center[3] = { worldSize * 0.5f, 0.0f, worldSize * 0.5f };
+		const float extents[3] = { 2.0f, 2.0f, 2.0f };
+		dtQueryFilter excludeAll;
+		excludeAll.setIncludeFlags(0);
+		dtPolyRef ref = 1;
+		REQUIRE(dtStatusSucceed(query.findNearestPolyBatch(center, extents, 1, &excludeAll, &ref, nullptr, nullptr)));
+		REQUIRE(ref == 0);
+	}
+
+	SECTION("Handles empty and invalid input")
+	{
+		dtPolyRef ref = 0;
+		REQUIRE(dtStatusSucceed(query.findNearestPolyBatch(nullptr, nullptr, 0, &filter, &ref, nullptr, nullptr)) == false);
+
+		const float center[3] = { 1.0f, 0.0f, 1.0f };
+		const float extents[3] = { 1.0f, 1.0f, 1.0f };
+		REQUIRE(dtStatusSucceed(query.findNearestPolyBatch(center, extents, 0, &filter, &ref, nullptr, nullptr)));
+
+		const float badCenter[3] = { 1.0f, NAN, 1.0f };
+		REQUIRE(dtStatusFailed(query.findNearestPolyBatch(badCenter, extents, 1, &filter, &ref, nullptr, nullptr)));
+		REQUIRE(dtStatusFailed(query.findNearestPolyBatch(center, extents, 1, nullptr, &ref, nullptr, nullptr)));
+		REQUIRE(dtStatusFailed(query.findNearestPolyBatch(center, extents, 1, &filter, nullptr, nullptr, nullptr)));
+	}
+
+	dtFreeNavMesh(nav);
+}
+
+namespace
+{
+/// Mirrors the default dtQueryFilter without deriving from it.
+struct PlainFilter
+{
+	dtPolyRef blocked;
+
+	PlainFilter() : blocked(0) {}
+
+	bool passFilter(const dtPolyRef ref, const dtMeshTile* /*tile*/, const dtPoly* poly) const
+	{
+		return ref != blocked && poly->flags != 0;
+	}
+
+	float getCost(const float* pa, const float* pb,
+				  const dtPolyRef /*prevRef*/, const dtMeshTile* /*prevTile*/, const dtPoly* /*prevPoly*/,
+				  const dtPolyRef /*curRef*/, const dtMeshTile* /*curTile*/, const dtPoly* /*curPoly*/,
+				  const dtPolyRef /*nextRef*/, const dtMeshTile* /*nextTile*/, const dtPoly* /*nextPoly*/) const
+	{
+		return dtVdist(pa, pb);
+	}
+};
+}
+
+TEST_CASE("dtNavMeshQuery templated filters")
+{
+	TestWorldParams worldParams;
+	dtNavMesh* nav = buildTestNavMesh(worldParams);
+	REQUIRE(nav != nullptr);
+
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(nav, 2048)));
+	dtQueryFilter filter;
+	PlainFilter plainFilter;
+
+	const float worldSize = worldParams.tilesX * nav->getParams()->tileWidth;
+	const float halfExtents[3] = { 2.0f, 4.0f, 2.0f };
+
+	SECTION("findPath and raycast match the default filter")
+	{
+		unsigned int seed = 99;
+		int compared = 0;
+		for (int i = 0; i < 50; ++i)
+		{
+			const float a[3] = { testRand(seed) * worldSize, 0.0f, testRand(seed) * worldSize };
+			const float b[3] = { testRand(seed) * worldSize, 0.0f, testRand(seed) * worldSize };
+			dtPolyRef startRef = 0, endRef = 0;
+			float startPos[3], endPos[3];
+			query.findNearestPoly(a, halfExtents, &filter, &startRef, startPos);
+			query.findNearestPoly(b, halfExtents, &filter, &endRef, endPos);
+			if (!startRef || !endRef)
+				continue;
+
+			dtPolyRef path[256], plainPath[256];
+			int pathCount = 0, plainPathCount = 0;
+			const dtStatus status = query.findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 256);
+			const dtStatus plainStatus = query.findPathT(startRef, endRef, startPos, endPos, &plainFilter, plainPath, &plainPathCount, 256);
+			REQUIRE(status == plainStatus);
+			REQUIRE(std::vector<dtPolyRef>(path, path + pathCount) == std::vector<dtPolyRef>(plainPath, plainPath + plainPathCount));
+
+			dtRaycastHit hit, plainHit;
+			hit.path = path;
+			hit.maxPath = 256;
+			plainHit.path = plainPath;
+			plainHit.maxPath = 256;
+			query.raycast(startRef, startPos, endPos, &filter, DT_RAYCAST_USE_COSTS, &hit);
+			query.raycastT(startRef, startPos, endPos, &plainFilter, DT_RAYCAST_USE_COSTS, &plainHit);
+			REQUIRE(hit.t == plainHit.t);
+			REQUIRE(hit.pathCost == plainHit.pathCost);
+			REQUIRE(std::vector<dtPolyRef>(path, path + hit.pathCount) == std::vector<dtPolyRef>(plainPath, plainPath + plainHit.pathCount));
+			compared++;
+		}
+		REQUIRE(compared > 0);
+	}
+
+	SECTION("Custom filters are applied")
+	{
+		const float a[3] = { 1.0f, 0.0f, 1.0f };
+		const float b[3] = { worldSize - 1.0f, 0.0f, worldSize - 1.0f };
+		dtPolyRef startRef = 0, endRef = 0;
+		float startPos[3], endPos[3];
+		REQUIRE(dtStatusSucceed(query.findNearestPoly(a, halfExtents, &filter, &startRef, startPos)));
+		REQUIRE(dtStatusSucceed(query.findNearestPoly(b, halfExtents, &filter, &endRef, endPos)));
+
+		dtPolyRef path[256];
+		int pathCount = 0;
+		REQUIRE(dtStatusSucceed(query.findPathT(startRef, endRef, startPos, endPos, &plainFilter, path, &pathCount, 256)));
+		REQUIRE(pathCount > 2);
+
+		// Blocking a polygon in the middle of the path forces a detour.
+		plainFilter.blocked = path[pathCount / 2];
+		dtPolyRef detour[256];
+		int detourCount = 0;
+		REQUIRE(dtStatusSucceed(query.findPathT(startRef, endRef, startPos, endPos, &plainFilter, detour, &detourCount, 256)));
+		for (int i = 0; i < detourCount; ++i)
+			REQUIRE(detour[i] != plainFilter.blocked);
+
+		float t = 0;
+		float hitNormal[3];
+		REQUIRE(dtStatusFailed(query.raycastT(startRef, startPos, endPos, (const PlainFilter*)nullptr, &t, hitNormal, nullptr, nullptr, 0)));
+	}
+
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtNavMeshQuery::updateLocalNeighbourhood")
+{
+	TestWorldParams worldParams;
+	dtNavMesh* nav = buildTestNavMesh(worldParams);
+	REQUIRE(nav != nullptr);
+
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(nav, 2048)));
+	dtQueryFilter filter;
+
+	const float worldSize = worldParams.tilesX * nav->getParams()->tileWidth;
+	const float halfExtents[3] = { 2, 4, 2 };
+	const float radius = 3.0f;
+	const int maxPolys = 64;
+
+	SECTION("Covers the polygons found by findLocalNeighbourhood after short moves")
+	{
+		unsigned int seed = 99;
+		for (int i = 0; i < 200; ++i)
+		{
+			const float start[3] = { 2.0f + testRand(seed) * (worldSize - 4.0f), 0, 2.0f + testRand(seed) * (worldSize - 4.0f) };
+			dtPolyRef ref = 0;
+			float pos[3];
+			query.findNearestPoly(start, halfExtents, &filter, &ref, pos);
+			REQUIRE(ref);
+
+			dtPolyRef polys[maxPolys];
+			int npolys = 0;
+			REQUIRE(dtStatusSucceed(query.findLocalNeighbourhood(ref, pos, radius, &filter, polys, 0, &npolys, maxPolys)));
+
+			const float angle = testRand(seed) * 6.28f;
+			for (int step = 0; step < 4; ++step)
+			{
+				const float target[3] = { pos[0] + cosf(angle) * radius * 0.25f, pos[1], pos[2] + sinf(angle) * radius * 0.25f };
+				dtPolyRef visited[16];
+				int nvisited = 0;
+				REQUIRE(dtStatusSucceed(query.moveAlongSurface(ref, pos, target, &filter, pos, visited, &nvisited, 16)));
+				ref = visited[nvisited - 1];
+
+				const dtStatus status = query.updateLocalNeighbourhood(ref, pos, radius, &filter, polys, &npolys, maxPolys);
+				REQUIRE(dtStatusSucceed(status));
+				REQUIRE(!dtStatusDetail(status, DT_BUFFER_TOO_SMALL));
+				REQUIRE(polys[0] == ref);
+
+				dtPolyRef expected[maxPolys];
+				int nexpected = 0;
+				REQUIRE(dtStatusSucceed(query.findLocalNeighbourhood(ref, pos, radius, &filter, expected, 0, &nexpected, maxPolys)));
+				for (int j = 0; j < nexpected; ++j)
+				{
+					REQUIRE(std::find(polys, polys + npolys, expected[j]) != polys + npolys);
+				}
+				for (int j = 1; j < npolys; ++j)
+				{
+					REQUIRE(std::find(polys, polys + j, polys[j]) == polys + j);
+				}
+			}
+		}
+	}
+
+	SECTION("Removes polygons the circle does not touch anymore")
+	{
+		const float start[3] = { 6.0f, 0, 2.0f };
+		dtPolyRef ref = 0;
+		float pos[3];
+		query.findNearestPoly(start, halfExtents, &filter, &ref, pos);
+		dtPolyRef polys[maxPolys];
+		int npolys = 0;
+		REQUIRE(dtStatusSucceed(query.findLocalNeighbourhood(ref, pos, radius, &filter, polys, 0, &npolys, maxPolys)));
+
+		// A jump across the world keeps none of the polygons.
+		const float far[3] = { worldSize - 6.0f, 0, worldSize - 2.0f };
+		query.findNearestPoly(far, halfExtents, &filter, &ref, pos);
+		REQUIRE(dtStatusSucceed(query.updateLocalNeighbourhood(ref, pos, radius, &filter, polys, &npolys, maxPolys)));
+		dtPolyRef expected[maxPolys];
+		int nexpected = 0;
+		REQUIRE(dtStatusSucceed(query.findLocalNeighbourhood(ref, pos, radius, &filter, expected, 0, &nexpected, maxPolys)));
+		REQUIRE(npolys == nexpected);
+		for (int j = 0; j < npolys; ++j)
+		{
+			REQUIRE(polys[j] == expected[j]);
+		}
+
+		// Invalid input.
+		REQUIRE(dtStatusFailed(query.updateLocalNeighbourhood(0, pos, radius, &filter, polys, &npolys, maxPolys)));
+		REQUIRE(npolys == 0);
+		REQUIRE(dtStatusFailed(query.updateLocalNeighbourhood(ref, pos, radius, &filter, polys, 0, maxPolys)));
+	}
+
+	SECTION("Drops the polygons below a bridge the agent moved onto")
+	{
+		// Two ground tiles with a bridge tile above the second one. The bridge is not connected to the ground.
+		dtNavMesh* levels = allocTestNavMesh(worldParams);
+		REQUIRE(levels != nullptr);
+		for (int layer = 0; layer < 2; ++layer)
+		{
+			int dataSize = 0;
+			unsigned char* data = buildTestQuadTileData(worldParams, 1, 0, layer, &dataSize);
+			REQUIRE(data != nullptr);
+			REQUIRE(dtStatusSucceed(levels->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+		}
+		int dataSize = 0;
+		unsigned char* data = buildTestQuadTileData(worldParams, 0, 0, 0, &dataSize);
+		REQUIRE(data != nullptr);
+		REQUIRE(dtStatusSucceed(levels->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+
+		dtNavMeshQuery levelQuery;
+		REQUIRE(dtStatusSucceed(levelQuery.init(levels, 256)));
+		const float tileWidth = levels->getParams()->tileWidth;
+		const float smallExtents[3] = { 1, 1, 1 };
+
+		const float ground[3] = { tileWidth - 1.0f, 0, 4.0f };
+		dtPolyRef ref = 0;
+		float pos[3];
+		levelQuery.findNearestPoly(ground, smallExtents, &filter, &ref, pos);
+		REQUIRE(ref);
+		dtPolyRef polys[maxPolys];
+		int npolys = 0;
+		REQUIRE(dtStatusSucceed(levelQuery.findLocalNeighbourhood(ref, pos, radius, &filter, polys, 0, &npolys, maxPolys)));
+		REQUIRE(npolys == 2);
+		const dtPolyRef groundBelow = polys[1];
+
+		const float bridge[3] = { tileWidth + 1.0f, 10.0f, 4.0f };
+		levelQuery.findNearestPoly(bridge, smallExtents, &filter, &ref, pos);
+		REQUIRE(ref);
+		REQUIRE(dtStatusSucceed(levelQuery.updateLocalNeighbourhood(ref, pos, radius, &filter, polys, &npolys, maxPolys)));
+		REQUIRE(npolys == 1);
+		REQUIRE(polys[0] == ref);
+		REQUIRE(std::find(polys, polys + npolys, groundBelow) == polys + npolys);
+
+		dtFreeNavMesh(levels);
+	}
+
+	dtFreeNavMesh(nav);
+}
@@ -0,0 +1,309 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "catch2/catch_all.hpp"
+
+#include "DetourCommon.h"
+#include "DetourCrowd.h"
+#include "DetourLocalBoundary.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+
+#include "../Detour/NavMeshTestUtils.h"
+
+namespace
+{
+/// Fills a corridor with two streams of agents walking in opposite directions.
+dtCrowd* createCorridorCrowd(dtNavMesh* nav, const TestWorldParams& params, const int agentCount,
+							 const dtCrowdCollisionParams& collision)
+{
+	dtCrowd* crowd = dtAllocCrowd();
+	REQUIRE(crowd->init(agentCount, 0.6f, nav));
+	crowd->setCollisionParams(&collision);
+
+	dtCrowdAgentParams ap;
+	memset(&ap, 0, sizeof(ap));
+	ap.height = 2.0f;
+	ap.maxAcceleration = 8.0f;
+	ap.maxSpeed = 1.5f;
+	ap.updateFlags = DT_CROWD_SEPARATION;
+	ap.separationWeight = 2.0f;
+
+	const float length = params.tilesX * params.tileSize;
+	const float width = params.tilesZ * params.tileSize;
+	unsigned int seed = 1;
+	for (int i = 0; i < agentCount; ++i)
+	{
+		ap.radius = 0.3f + 0.1f * testRand(seed);
+		ap.collisionQueryRange = ap.radius * 8.0f;
+		ap.pathOptimizationRange = ap.radius * 30.0f;
+		const float pos[3] = { 1.0f + testRand(seed) * (length - 2.0f), 0, 1.0f + testRand(seed) * (width - 2.0f) };
+		const int idx = crowd->addAgent(pos, &ap);
+		REQUIRE(idx == i);
+		const float vel[3] = { (i & 1) ? ap.maxSpeed : -ap.maxSpeed, 0, 0 };
+		REQUIRE(crowd->requestMoveVelocity(idx, vel));
+	}
+	return crowd;
+}
+
+/// Returns the time per update and the average number of collision iterations. With an observer, the agents
+/// are simulated at the level of detail chosen from their distance to it.
+double benchCorridorCrowd(dtNavMesh* nav, const TestWorldParams& params, const int agentCount,
+						  const dtCrowdCollisionParams& collision, double& iterations, const float* observer = 0)
+{
+	dtCrowd* crowd = createCorridorCrowd(nav, params, agentCount, collision);
+	if (observer)
+	{
+		REQUIRE(crowd->setLodObservers(observer, 1));
+	}
+	const float dt = 1.0f / 30.0f;
+	for (int i = 0; i < 10; ++i)
+	{
+		crowd->update(dt, 0);
+	}
+
+	const int updates = 20;
+	int iterationCount = 0;
+	const int64_t begin = testNowNanos();
+	for (int i = 0; i < updates; ++i)
+	{
+		crowd->update(dt, 0);
+		iterationCount += crowd->getCollisionIterationCount();
+	}
+	const int64_t end = testNowNanos();
+
+	dtFreeCrowd(crowd);
+	iterations = iterationCount / (double)updates;
+	return (end - begin) / (double)updates;
+}
+
+/// Sends agents spread over the world to one corner, either with individual or shared requests, and returns
+/// the time per update until every agent has a complete path. Individual paths are searched within the
+/// fixed budget, or within a time budget with 32 path requests if @p pathTime is not zero. The memory the
+/// corridor paths of the agents take at the end is returned in @p pathBytes.
+double benchSameTarget(dtNavMesh* nav, const TestWorldParams& params, const int agentCount, const bool shared,
+					   const float pathTime, int& updates, int& pathBytes)
+{
+	dtCrowd* crowd = dtAllocCrowd();
+	REQUIRE(crowd->init(agentCount, 0.6f, nav));
+	TestBenchClock clock;
+	if (pathTime > 0)
+	{
+		dtCrowdParams cp;
+		dtInitCrowdParams(&cp, agentCount, 0.6f);
+		cp.maxPathRequests = 32;
+		REQUIRE(crowd->init(&cp, nav));
+		dtCrowdBudgetParams budget = *crowd->getBudgetParams();
+		budget.pathTime = pathTime;
+		budget.clock = &clock;
+		crowd->setBudgetParams(&budget);
+	}
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 2048)));
+
+	dtCrowdAgentParams ap;
+	memset(&ap, 0, sizeof(ap));
+	ap.radius = 0.4f;
+	ap.height = 2.0f;
+	ap.maxAcceleration = 8.0f;
+	ap.maxSpeed = 3.5f;
+	ap.collisionQueryRange = ap.radius * 8.0f;
+	ap.pathOptimizationRange = ap.radius * 30.0f;
+	ap.updateFlags = DT_CROWD_SEPARATION;
+	ap.separationWeight = 2.0f;
+
+	const float size = params.tilesX * params.tileSize;
+	const float target[3] = { size - 4.0f, 0, size - 4.0f };
+	const float halfExtents[3] = { 2, 4, 2 };
+	dtQueryFilter filter;
+	dtPolyRef targetRef = 0;
+	float targetPos[3];
+	query->findNearestPoly(target, halfExtents, &filter, &targetRef, targetPos);
+	REQUIRE(targetRef);
+
+	unsigned int seed = 1;
+	for (int i = 0; i < agentCount; ++i)
+	{
+		const float pos[3] = { 1.0f + testRand(seed) * (size - 2.0f), 0, 1.0f + testRand(seed) * (size - 2.0f) };
+		const int idx = crowd->addAgent(pos, &ap);
+		REQUIRE(idx == i);
+		const bool requested = shared ? crowd->requestMoveTargetShared(idx, targetRef, targetPos) : crowd->requestMoveTarget(idx, targetRef, targetPos);
+		REQUIRE(requested);
+	}
+
+	const float dt = 1.0f / 30.0f;
+	updates = 0;
+	int64_t elapsed = 0;
+	for (bool waiting = true; waiting && updates < 10000; ++updates)
+	{
+		const int64_t begin = testNowNanos();
+		crowd->update(dt, 0);
+		elapsed += testNowNanos() - begin;
+
+		waiting = false;
+		for (int i = 0; i < agentCount && !waiting; ++i)
+		{
+			const dtCrowdAgent* ag = crowd->getAgent(i);
+			waiting = ag->targetState != DT_CROWDAGENT_TARGET_VALID || ag->corridor.getLastPoly() != targetRef;
+		}
+	}
+	pathBytes = crowd->getPathPool()->getReservedSize() * (int)sizeof(dtPolyRef);
+
+	dtFreeNavMeshQuery(query);
+	dtFreeCrowd(crowd);
+	return elapsed / (double)updates;
+}
+
+/// Walks agents in straight lines, updating their boundaries every quarter of the collision range as the crowd does,
+/// and returns the time per boundary update. Reset boundaries search their whole neighbourhood again.
+double benchBoundaryUpdates(dtNavMesh* nav, const TestWorldParams& params, const bool reset, int& segmentCount)
+{
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 2048)));
+	dtQueryFilter filter;
+
+	const int agentCount = 1000;
+	const float range = 6.0f;
+	const float size = params.tilesX * params.tileSize;
+	const float halfExtents[3] = { 2, 4, 2 };
+	std::vector<dtLocalBoundary> boundaries(agentCount);
+	std::vector<float> pos(agentCount * 3);
+	std::vector<float> dir(agentCount * 2);
+	std::vector<dtPolyRef> refs(agentCount);
+	unsigned int seed = 1;
+	for (int i = 0; i < agentCount; ++i)
+	{
+		const float start[3] = { 2.0f + testRand(seed) * (size - 4.0f), 0, 2.0f + testRand(seed) * (size - 4.0f) };
+		query->findNearestPoly(start, halfExtents, &filter, &refs[i], &pos[i * 3]);
+		REQUIRE(refs[i]);
+		const float angle = testRand(seed) * 6.28f;
+		dir[i * 2 + 0] = cosf(angle);
+		dir[i * 2 + 1] = sinf(angle);
+	}
+
+	int64_t elapsed = 0;
+	segmentCount = 0;
+	for (int step = 0; step < 40; ++step)
+	{
+		for (int i = 0; i < agentCount; ++i)
+		{
+			float* p = &pos[i * 3];
+			const float target[3] = { p[0] + dir[i * 2] * range * 0.26f, p[1], p[2] + dir[i * 2 + 1] * range * 0.26f };
+			dtPolyRef visited[16];
+			int nvisited = 0;
+			float result[3];
+			query->moveAlongSurface(refs[i], p, target, &filter, result, visited, &nvisited, 16);
+			refs[i] = visited[nvisited - 1];
+			if (dtVdist2D(result, p) < range * 0.1f)
+			{
+				// Turn at walls.
+				const float x = dir[i * 2 + 0];
+				dir[i * 2 + 0] = -dir[i * 2 + 1];
+				dir[i * 2 + 1] = x;
+			}
+			dtVcopy(p, result);
+
+			if (reset)
+				boundaries[i].reset();
+			const int64_t begin = testNowNanos();
+			boundaries[i].update(refs[i], p, range, query, &filter);
+			elapsed += testNowNanos() - begin;
+			segmentCount += boundaries[i].getSegmentCount();
+		}
+	}
+
+	dtFreeNavMeshQuery(query);
+	return elapsed / (double)(40 * agentCount);
+}
+}
+
+TEST_CASE("Bench_dtCrowd")
+{
+	// A corridor 256 by 16 units, about 60% covered by the agents.
+	TestWorldParams params;
+	params.tilesX = 16;
+	params.tilesZ = 1;
+	params.pillars = false;
+	dtNavMesh* nav = buildTestNavMesh(params);
+	REQUIRE(nav);
+	const int agentCount = 5000;
+
+	dtCrowdCollisionParams none = { 0, 0, 0.0f };
+	dtCrowdCollisionParams standard = { 4, 4, 0.05f };
+	dtCrowdCollisionParams dense = { 4, 16, 0.05f };
+	double noneIterations = 0;
+	double standardIterations = 0;
+	double denseIterations = 0;
+	const double noneNanos = benchCorridorCrowd(nav, params, agentCount, none, noneIterations);
+	const double standardNanos = benchCorridorCrowd(nav, params, agentCount, standard, standardIterations);
+	const double denseNanos = benchCorridorCrowd(nav, params, agentCount, dense, denseIterations);
+	// An observer at one end, leaving most of the corridor beyond the corridor following distance.
+	const float observer[3] = { 0, 0, params.tilesZ * params.tileSize * 0.5f };
+	double lodIterations = 0;
+	const double lodNanos = benchCorridorCrowd(nav, params, agentCount, standard, lodIterations, observer);
+	REQUIRE(standardIterations == 4.0);
+	REQUIRE(denseIterations >= 4.0);
+
+	printf("BM_%-35s %10.2f nanos/update\n", "dtCrowdCorridor5kNoCollision:", noneNanos);
+	printf("BM_%-35s %10.2f nanos/update\n", "dtCrowdCorridor5k:", standardNanos);
+	printf("BM_%-35s %10.2f nanos/update (%.1f iterations)\n", "dtCrowdCorridor5kDense:", denseNanos, denseIterations);
+	printf("BM_%-35s %10.2f nanos/update\n", "dtCrowdCorridor5kLod:", lodNanos);
+
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("Bench_dtCrowdSameTarget")
+{
+	// A world 128 by 128 units with pillars.
+	TestWorldParams params;
+	params.tilesX = 8;
+	params.tilesZ = 8;
+	dtNavMesh* nav = buildTestNavMesh(params);
+	REQUIRE(nav);
+	const int agentCount = 500;
+
+	int individualUpdates = 0;
+	int budgetUpdates = 0;
+	int sharedUpdates = 0;
+	int individualPathBytes = 0;
+	int budgetPathBytes = 0;
+	int sharedPathBytes = 0;
+	const double individualNanos = benchSameTarget(nav, params, agentCount, false, 0.0f, individualUpdates, individualPathBytes);
+	const double budgetNanos = benchSameTarget(nav, params, agentCount, false, 2000.0f, budgetUpdates, budgetPathBytes);
+	const double sharedNanos = benchSameTarget(nav, params, agentCount, true, 0.0f, sharedUpdates, sharedPathBytes);
+	// Every corridor held a buffer for the longest path before they were pooled.
+	const int fixedPathBytes = agentCount * 256 * (int)sizeof(dtPolyRef);
+	REQUIRE(budgetUpdates < individualUpdates);
+	REQUIRE(sharedUpdates == 1);
+
+	printf("BM_%-35s %10.2f nanos/update (%d updates)\n", "dtCrowdSameTarget500:", individualNanos, individualUpdates);
+	printf("BM_%-35s %10.2f nanos/update (%d updates)\n", "dtCrowdSameTarget500Budget2ms:", budgetNanos, budgetUpdates);
+	printf("BM_%-35s %10.2f nanos/update (%d updates)\n", "dtCrowdSameTarget500Shared:", sharedNanos, sharedUpdates);
+	printf("BM_%-35s %10d bytes (%d bytes unpooled)\n", "dtCrowdSameTarget500PathMemory:", individualPathBytes, fixedPathBytes);
+	printf("BM_%-35s %10d bytes (%d bytes unpooled)\n", "dtCrowdSameTarget500Budget2msPathMemory:", budgetPathBytes, fixedPathBytes);
+	printf("BM_%-35s %10d bytes (%d bytes unpooled)\n", "dtCrowdSameTarget500SharedPathMemory:", sharedPathBytes, fixedPathBytes);
+
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("Bench_dtLocalBoundary")
+{
+	TestWorldParams params;
+	params.tilesX = 8;
+	params.tilesZ = 8;
+	dtNavMesh* nav = buildTestNavMesh(params);
+	REQUIRE(nav);
+
+	int fullSegments = 0;
+	int incrementalSegments = 0;
+	const double fullNanos = benchBoundaryUpdates(nav, params, true, fullSegments);
+	const double incrementalNanos = benchBoundaryUpdates(nav, params, false, incrementalSegments);
+	REQUIRE(incrementalSegments >= fullSegments * 99 / 100);
+
+	printf("BM_%-35s %10.2f nanos/update\n", "dtLocalBoundaryUpdateFull:", fullNanos);
+	printf("BM_%-35s %10.2f nanos/update\n", "dtLocalBoundaryUpdate:", incrementalNanos);
+
+	dtFreeNavMesh(nav);
+}
@@ -0,0 +1,462 @@
+//
+// Headless crowd benchmark.
+//
+// Spawns agents on a navigation mesh, sends them to scripted random targets and steps dtCrowd::update
+// for a fixed number of ticks, reporting the time of each update phase. The agent states can be recorded
+// after every tick and compared against a later run, so that an optimization can be checked for both
+// speed and behavioural equivalence:
+//
+//   CrowdBench --agents 1000 --ticks 600 --record before.rec
+//   CrowdBench --replay before.rec
+//
+// Options:
+//   --navmesh <file>    A navigation mesh saved by RecastDemo (all tiles). A generated test world is used by default.
+//   --agents <n>        The number of agents. [Default: 500]
+//   --ticks <n>         The number of updates. [Default: 600]
+//   --seed <n>          The seed of the spawn points and targets. [Default: 1]
+//   --retarget <n>      The number of ticks after which each agent gets a new target. [Default: 150]
+//   --record <file>     Records the agent states after every tick.
+//   --replay <file>     Runs the scenario of a recording and compares the agent states with it.
+//   --tolerance <d>     The largest position and velocity difference accepted by --replay. [Default: 0]
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "DetourCommon.h"
+#include "DetourCrowd.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+
+#include "../Detour/NavMeshTestUtils.h"
+
+namespace
+{
+const int NAVMESHSET_MAGIC = 'M'<<24 | 'S'<<16 | 'E'<<8 | 'T'; //'MSET';
+const int NAVMESHSET_VERSION = 1;
+
+struct NavMeshSetHeader
+{
+	int magic;
+	int version;
+	int numTiles;
+	dtNavMeshParams params;
+};
+
+struct NavMeshTileHeader
+{
+	dtTileRef tileRef;
+	int dataSize;
+};
+
+const int RECORDING_MAGIC = 'C'<<24 | 'R'<<16 | 'E'<<8 | 'C'; //'CREC';
+const int RECORDING_VERSION = 1;
+
+/// The scenario of a recording, which a replay runs again.
+struct RecordingHeader
+{
+	int magic;
+	int version;
+	int agentCount;
+	int ticks;
+	unsigned int seed;
+	int retarget;
+	int polyCount;		///< The number of polygons of the navmesh, to catch replays on another navmesh.
+	int polyRefSize;
+};
+
+/// The state of an agent after a tick.
+struct AgentRecord
+{
+	float pos[3];
+	float vel[3];
+	unsigned long long firstPoly;
+	int targetState;
+	int active;
+};
+
+struct BenchOptions
+{
+	const char* navmeshPath;
+	int agentCount;
+	int ticks;
+	unsigned int seed;
+	int retarget;
+	const char* recordPath;
+	const char* replayPath;
+	float tolerance;
+};
+
+const char* const PHASE_NAMES[DT_CROWD_MAX_PHASES] = {
+	"CrowdBenchPaths:",
+	"CrowdBenchNeighbours:",
+	"CrowdBenchSteering:",
+	"CrowdBenchAvoidance:",
+	"CrowdBenchCollisions:",
+	"CrowdBenchMovement:",
+};
+
+unsigned int g_randomSeed = 1;
+
+float randomPointRand()
+{
+	return testRand(g_randomSeed);
+}
+
+/// Loads a navmesh saved by RecastDemo. Returns null on failure.
+dtNavMesh* loadNavMeshSet(const char* path)
+{
+	FILE* fp = fopen(path, "rb");
+	if (!fp)
+		return 0;
+
+	NavMeshSetHeader header;
+	if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != NAVMESHSET_MAGIC || header.version != NAVMESHSET_VERSION)
+	{
+		fclose(fp);
+		return 0;
+	}
+
+	dtNavMesh* mesh = dtAllocNavMesh();
+	if (!mesh || dtStatusFailed(mesh->init(&header.params)))
+	{
+		dtFreeNavMesh(mesh);
+		fclose(fp);
+		return 0;
+	}
+
+	for (int i = 0; i < header.numTiles; ++i)
+	{
+		NavMeshTileHeader tileHeader;
+		if (fread(&tileHeader, sizeof(tileHeader), 1, fp) != 1)
+			break;
+		if (!tileHeader.tileRef || !tileHeader.dataSize)
+			break;
+
+		unsigned char* data = (unsigned char*)dtAlloc(tileHeader.dataSize, DT_ALLOC_PERM);
+		if (!data)
+			break;
+		if (fread(data, tileHeader.dataSize, 1, fp) != 1 ||
+			dtStatusFailed(mesh->addTile(data, tileHeader.dataSize, DT_TILE_FREE_DATA, tileHeader.tileRef, 0)))
+		{
+			dtFree(data);
+			break;
+		}
+	}
+
+	fclose(fp);
+	return mesh;
+}
+
+int countPolys(const dtNavMesh* nav, int& tileCount)
+{
+	int polyCount = 0;
+	tileCount = 0;
+	for (int i = 0; i < nav->getMaxTiles(); ++i)
+	{
+		const dtMeshTile* tile = nav->getTile(i);
+		if (!tile->header)
+			continue;
+		tileCount++;
+		polyCount += tile->header->polyCount;
+	}
+	return polyCount;
+}
+
+bool parseOptions(int argc, char** argv, BenchOptions& options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : 0;
+		if (!value)
+		{
+			fprintf(stderr, "Missing value for %s\n", arg);
+			return false;
+		}
+		if (strcmp(arg, "--navmesh") == 0)
+			options.navmeshPath = value;
+		else if (strcmp(arg, "--agents") == 0)
+			options.agentCount = atoi(value);
+		else if (strcmp(arg, "--ticks") == 0)
+			options.ticks = atoi(value);
+		else if (strcmp(arg, "--seed") == 0)
+			options.seed = (unsigned int)strtoul(value, 0, 10);
+		else if (strcmp(arg, "--retarget") == 0)
+			options.retarget = atoi(value);
+		else if (strcmp(arg, "--record") == 0)
+			options.recordPath = value;
+		else if (strcmp(arg, "--replay") == 0)
+			options.replayPath = value;
+		else if (strcmp(arg, "--tolerance") == 0)
+			options.tolerance = (float)atof(value);
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+		++i;
+	}
+	if (options.agentCount < 1 || options.ticks < 1 || options.retarget < 1)
+	{
+		fprintf(stderr, "The agents, ticks and retarget options must be positive\n");
+		return false;
+	}
+	return true;
+}
+
+/// Picks a random point on the navmesh, returning false if there is none.
+bool findRandomTarget(const dtNavMeshQuery* query, const dtQueryFilter* filter, dtPolyRef& ref, float* pos)
+{
+	return dtStatusSucceed(query->findRandomPoint(filter, randomPointRand, &ref, pos)) && ref;
+}
+
+void initAgentParams(dtCrowdAgentParams& ap)
+{
+	memset(&ap, 0, sizeof(ap));
+	ap.radius = 0.6f;
+	ap.height = 2.0f;
+	ap.maxAcceleration = 8.0f;
+	ap.maxSpeed = 3.5f;
+	ap.collisionQueryRange = ap.radius * 12.0f;
+	ap.pathOptimizationRange = ap.radius * 30.0f;
+	ap.updateFlags = DT_CROWD_ANTICIPATE_TURNS | DT_CROWD_OPTIMIZE_VIS | DT_CROWD_OPTIMIZE_TOPO |
+		DT_CROWD_OBSTACLE_AVOIDANCE | DT_CROWD_SEPARATION;
+	ap.obstacleAvoidanceType = 3;
+	ap.separationWeight = 2.0f;
+}
+
+void recordAgents(dtCrowd* crowd, std::vector<AgentRecord>& records)
+{
+	records.resize(crowd->getAgentCount());
+	for (int i = 0; i < crowd->getAgentCount(); ++i)
+	{
+		const dtCrowdAgent* ag = crowd->getAgent(i);
+		AgentRecord& rec = records[i];
+		memset(&rec, 0, sizeof(rec));
+		rec.active = ag->active ? 1 : 0;
+		if (!ag->active)
+			continue;
+		dtVcopy(rec.pos, ag->npos);
+		dtVcopy(rec.vel, ag->vel);
+		rec.firstPoly = ag->corridor.getFirstPoly();
+		rec.targetState = ag->targetState;
+	}
+}
+
+/// Returns the largest position or velocity difference between two agent states, or infinity if
+/// they are on different polygons, in different states or either state is not finite.
+float compareAgents(const AgentRecord& a, const AgentRecord& b)
+{
+	if (a.active != b.active || a.firstPoly != b.firstPoly || a.targetState != b.targetState)
+		return HUGE_VALF;
+	const float dp = dtVdist(a.pos, b.pos);
+	const float dv = dtVdist(a.vel, b.vel);
+	if (!dtMathIsfinite(dp) || !dtMathIsfinite(dv))
+		return HUGE_VALF;
+	return dtMax(dp, dv);
+}
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions options;
+	options.navmeshPath = 0;
+	options.agentCount = 500;
+	options.ticks = 600;
+	options.seed = 1;
+	options.retarget = 150;
+	options.recordPath = 0;
+	options.replayPath = 0;
+	options.tolerance = 0;
+	if (!parseOptions(argc, argv, options))
+		return 2;
+
+	FILE* replay = 0;
+	RecordingHeader replayHeader;
+	if (options.replayPath)
+	{
+		replay = fopen(options.replayPath, "rb");
+		if (!replay || fread(&replayHeader, sizeof(replayHeader), 1, replay) != 1 ||
+			replayHeader.magic != RECORDING_MAGIC || replayHeader.version != RECORDING_VERSION)
+		{
+			fprintf(stderr, "Could not read the recording %s\n", options.replayPath);
+			return 2;
+		}
+		// The replay runs the recorded scenario.
+		options.agentCount = replayHeader.agentCount;
+		options.ticks = replayHeader.ticks;
+		options.seed = replayHeader.seed;
+		options.retarget = replayHeader.retarget;
+	}
+
+	dtNavMesh* nav = 0;
+	if (options.navmeshPath)
+	{
+		nav = loadNavMeshSet(options.navmeshPath);
+	}
+	else
+	{
+		// A world 128 by 128 units with pillars.
+		TestWorldParams params;
+		params.tilesX = 8;
+		params.tilesZ = 8;
+		nav = buildTestNavMesh(params);
+	}
+	if (!nav)
+	{
+		fprintf(stderr, "Could not load the navmesh\n");
+		return 2;
+	}
+	int tileCount = 0;
+	const int polyCount = countPolys(nav, tileCount);
+	if (replay && (replayHeader.polyCount != polyCount || replayHeader.polyRefSize != (int)sizeof(dtPolyRef)))
+	{
+		fprintf(stderr, "The recording was made on another navmesh or build\n");
+		return 2;
+	}
+
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	dtCrowd* crowd = dtAllocCrowd();
+	if (dtStatusFailed(query->init(nav, 2048)) || !crowd->init(options.agentCount, 0.6f, nav))
+	{
+		fprintf(stderr, "Could not initialize the crowd\n");
+		return 2;
+	}
+	const dtQueryFilter* filter = crowd->getFilter(0);
+
+	// Spawn the agents and send them to their first targets.
+	g_randomSeed = options.seed;
+	dtCrowdAgentParams ap;
+	initAgentParams(ap);
+	for (int i = 0; i < options.agentCount; ++i)
+	{
+		dtPolyRef ref = 0;
+		float pos[3];
+		if (!findRandomTarget(query, filter, ref, pos) || crowd->addAgent(pos, &ap) != i)
+		{
+			fprintf(stderr, "Could not add agent %d\n", i);
+			return 2;
+		}
+		if (findRandomTarget(query, filter, ref, pos))
+			crowd->requestMoveTarget(i, ref, pos);
+	}
+
+	FILE* record = 0;
+	if (options.recordPath)
+	{
+		record = fopen(options.recordPath, "wb");
+		RecordingHeader header;
+		memset(&header, 0, sizeof(header));
+		header.magic = RECORDING_MAGIC;
+		header.version = RECORDING_VERSION;
+		header.agentCount = options.agentCount;
+		header.ticks = options.ticks;
+		header.seed = options.seed;
+		header.retarget = options.retarget;
+		header.polyCount = polyCount;
+		header.polyRefSize = (int)sizeof(dtPolyRef);
+		if (!record || fwrite(&header, sizeof(header), 1, record) != 1)
+		{
+			fprintf(stderr, "Could not write the recording %s\n", options.recordPath);
+			return 2;
+		}
+	}
+
+	TestBenchClock clock;
+	dtCrowdUpdateProfile profile;
+	profile.clock = &clock;
+	double phaseTimes[DT_CROWD_MAX_PHASES] = { 0 };
+	int64_t elapsed = 0;
+
+	std::vector<AgentRecord> states;
+	std::vector<AgentRecord> recorded(options.agentCount);
+	float maxDifference = 0;
+	int firstDifferentTick = -1;
+	int firstDifferentAgent = -1;
+
+	const float dt = 1.0f / 30.0f;
+	for (int tick = 0; tick < options.ticks; ++tick)
+	{
+		// Staggered scripted targets.
+		for (int i = 0; i < options.agentCount; ++i)
+		{
+			if ((tick + i) % options.retarget != 0 || tick == 0)
+				continue;
+			dtPolyRef ref = 0;
+			float pos[3];
+			if (findRandomTarget(query, filter, ref, pos))
+				crowd->requestMoveTarget(i, ref, pos);
+		}
+
+		const int64_t begin = testNowNanos();
+		crowd->update(dt, 0, &profile);
+		elapsed += testNowNanos() - begin;
+		for (int i = 0; i < DT_CROWD_MAX_PHASES; ++i)
+			phaseTimes[i] += profile.phaseTimes[i];
+
+		if (!record && !replay)
+			continue;
+		recordAgents(crowd, states);
+		if (record && fwrite(&states[0], sizeof(AgentRecord), states.size(), record) != states.size())
+		{
+			fprintf(stderr, "Could not write the recording %s\n", options.recordPath);
+			return 2;
+		}
+		if (replay)
+		{
+			if (fread(&recorded[0], sizeof(AgentRecord), recorded.size(), replay) != recorded.size())
+			{
+				fprintf(stderr, "The recording %s ends at tick %d\n", options.replayPath, tick);
+				return 2;
+			}
+			for (int i = 0; i < options.agentCount; ++i)
+			{
+				const float difference = compareAgents(states[i], recorded[i]);
+				if (!(difference <= options.tolerance) && firstDifferentTick == -1)
+				{
+					firstDifferentTick = tick;
+					firstDifferentAgent = i;
+				}
+				maxDifference = dtMax(maxDifference, difference);
+			}
+		}
+	}
+
+	printf("CrowdBench: %d agents, %d ticks, %d tiles, %d polygons\n", options.agentCount, options.ticks, tileCount, polyCount);
+	printf("BM_%-35s %10.2f nanos/tick\n", "CrowdBenchUpdate:", elapsed / (double)options.ticks);
+	double phaseTotal = 0;
+	for (int i = 0; i < DT_CROWD_MAX_PHASES; ++i)
+		phaseTotal += phaseTimes[i];
+	for (int i = 0; i < DT_CROWD_MAX_PHASES; ++i)
+	{
+		printf("BM_%-35s %10.2f nanos/tick (%.1f%%)\n", PHASE_NAMES[i], phaseTimes[i] * 1000.0 / options.ticks,
+			   phaseTotal > 0 ? phaseTimes[i] * 100.0 / phaseTotal : 0.0);
+	}
+
+	int result = 0;
+	if (replay)
+	{
+		if (firstDifferentTick == -1)
+		{
+			printf("Replay matches %s (largest difference %g)\n", options.replayPath, maxDifference);
+		}
+		else
+		{
+			printf("Replay differs from %s at tick %d, agent %d (largest difference %g)\n",
+				   options.replayPath, firstDifferentTick, firstDifferentAgent, maxDifference);
+			result = 1;
+		}
+		fclose(replay);
+	}
+	if (record)
+		fclose(record);
+
+	dtFreeCrowd(crowd);
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+	return result;
+}
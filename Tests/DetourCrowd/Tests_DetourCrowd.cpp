@@ -0,0 +1,792 @@
+#include <string.h>
+#include <vector>
+
+#include "catch2/catch_all.hpp"
+
+#include "DetourCommon.h"
+#include "DetourCrowd.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+
+#include "../Detour/NavMeshTestUtils.h"
+
+namespace
+{
+void initTestAgentParams(dtCrowdAgentParams& params)
+{
+	memset(&params, 0, sizeof(params));
+	params.radius = 0.5f;
+	params.height = 2.0f;
+	params.maxAcceleration = 8.0f;
+	params.maxSpeed = 3.5f;
+	params.collisionQueryRange = params.radius * 12.0f;
+	params.pathOptimizationRange = params.radius * 30.0f;
+	params.updateFlags = DT_CROWD_ANTICIPATE_TURNS | DT_CROWD_OPTIMIZE_VIS | DT_CROWD_OPTIMIZE_TOPO |
+		DT_CROWD_OBSTACLE_AVOIDANCE | DT_CROWD_SEPARATION;
+	params.separationWeight = 2.0f;
+	params.obstacleAvoidanceType = 3;
+}
+
+bool requestTarget(dtCrowd* crowd, const dtNavMeshQuery* query, const int idx, const float* pos, const bool shared = false)
+{
+	const float halfExtents[3] = { 2, 4, 2 };
+	dtQueryFilter filter;
+	dtPolyRef ref = 0;
+	float nearest[3];
+	query->findNearestPoly(pos, halfExtents, &filter, &ref, nearest);
+	if (!ref)
+		return false;
+	return shared ? crowd->requestMoveTargetShared(idx, ref, nearest) : crowd->requestMoveTarget(idx, ref, nearest);
+}
+
+/// Places agents that all see each other on top of each other between four pillars, resolves their collisions in one
+/// update and returns the largest overlap relative to the sum of the radii of two agents.
+float resolveCluster(dtNavMesh* nav, const dtCrowdCollisionParams& collision, int& iterations)
+{
+	dtCrowd* crowd = dtAllocCrowd();
+	REQUIRE(crowd->init(16, 0.6f, nav));
+	crowd->setCollisionParams(&collision);
+
+	dtCrowdAgentParams ap;
+	initTestAgentParams(ap);
+	ap.updateFlags = 0;
+	const int agentCount = DT_CROWDAGENT_MAX_NEIGHBOURS + 1;
+	for (int i = 0; i < agentCount; ++i)
+	{
+		const float pos[3] = { 6.0f + (i % 3) * 0.1f, 0, 6.0f + (i / 3) * 0.1f };
+		REQUIRE(crowd->addAgent(pos, &ap) == i);
+	}
+	crowd->update(1.0f / 30.0f, 0);
+	iterations = crowd->getCollisionIterationCount();
+
+	float maxOverlap = 0;
+	const dtCrowdAgentArrays& arrays = crowd->getAgentArrays();
+	// The iteration that found no overlap left the agents in place.
+	if (iterations < collision.maxIterations)
+	{
+		for (int i = 0; i < agentCount; ++i)
+			REQUIRE(dtVlenSqr(&arrays.disp[i * 3]) == 0.0f);
+	}
+	for (int i = 0; i < agentCount; ++i)
+	{
+		for (int j = i + 1; j < agentCount; ++j)
+		{
+			const float radii = arrays.radius[i] + arrays.radius[j];
+			const float dist = dtVdist2D(&arrays.npos[i * 3], &arrays.npos[j * 3]);
+			maxOverlap = dtMax(maxOverlap, (radii - dist) / radii);
+		}
+	}
+	dtFreeCrowd(crowd);
+	return maxOverlap;
+}
+
+/// Adds agents along one side of the world walking to the other side and returns the number of updates until all of
+/// them have a complete path, and the sum of the agents waiting for an optimization over the updates. Checks the budget counters against the agent states on the way.
+int walkAcrossWorld(dtCrowd* crowd, const dtNavMeshQuery* query, const int agentCount, int& optimizationsWaiting)
+{
+	dtCrowdAgentParams ap;
+	initTestAgentParams(ap);
+	for (int i = 0; i < agentCount; ++i)
+	{
+		const float pos[3] = { 2.0f + i * 2.5f, 0, 2.0f };
+		const float target[3] = { 62.0f - i * 2.5f, 0, 62.0f };
+		REQUIRE(crowd->addAgent(pos, &ap) == i);
+		REQUIRE(requestTarget(crowd, query, i, target));
+	}
+
+	int updates = 0;
+	bool planned = false;
+	optimizationsWaiting = 0;
+	for (int step = 0; step < 60; ++step)
+	{
+		crowd->update(1.0f / 30.0f, 0);
+		const dtCrowdBudgetStats* stats = crowd->getBudgetStats();
+		REQUIRE(stats->pathIterations <= stats->pathIterationBudget);
+		REQUIRE(stats->optimizations <= stats->optimizationBudget);
+		optimizationsWaiting += stats->optimizationsWaiting;
+
+		int waiting = 0;
+		int searching = 0;
+		int valid = 0;
+		for (int i = 0; i < agentCount; ++i)
+		{
+			const unsigned char state = crowd->getAgent(i)->targetState;
+			waiting += state == DT_CROWDAGENT_TARGET_WAITING_FOR_QUEUE ? 1 : 0;
+			searching += state == DT_CROWDAGENT_TARGET_WAITING_FOR_PATH ? 1 : 0;
+			valid += state == DT_CROWDAGENT_TARGET_VALID ? 1 : 0;
+		}
+		REQUIRE(stats->pathRequestsWaiting == waiting);
+		REQUIRE(stats->pathRequestsSearching == searching);
+		REQUIRE(searching <= crowd->getPathQueue()->getMaxRequests());
+		if (!planned && valid == agentCount)
+		{
+			planned = true;
+			updates = step + 1;
+		}
+	}
+	REQUIRE(planned);
+	return updates;
+}
+
+/// Checks that the view returned by getAgent matches the per-agent arrays.
+void checkAgentView(dtCrowd* crowd, const int idx)
+{
+	const dtCrowdAgentArrays& arrays = crowd->getAgentArrays();
+	const dtCrowdAgent* ag = crowd->getAgent(idx);
+	REQUIRE(ag->active == (arrays.active[idx] != 0));
+	if (!ag->active)
+		return;
+	REQUIRE(ag->state == arrays.state[idx]);
+	REQUIRE(ag->params.updateFlags == arrays.updateFlags[idx]);
+	REQUIRE(ag->params.radius == arrays.radius[idx]);
+	REQUIRE(ag->desiredSpeed == arrays.desiredSpeed[idx]);
+	REQUIRE(ag->nneis == arrays.nneis[idx]);
+	for (int j = 0; j < 3; ++j)
+	{
+		REQUIRE(ag->npos[j] == arrays.npos[idx * 3 + j]);
+		REQUIRE(ag->vel[j] == arrays.vel[idx * 3 + j]);
+		REQUIRE(ag->dvel[j] == arrays.dvel[idx * 3 + j]);
+		REQUIRE(ag->nvel[j] == arrays.nvel[idx * 3 + j]);
+	}
+	for (int j = 0; j < ag->nneis; ++j)
+	{
+		const dtCrowdNeighbour& nei = arrays.neis[idx * crowd->getMaxNeighbours() + j];
+		REQUIRE(ag->neis[j].idx == nei.idx);
+		REQUIRE(ag->neis[j].dist == nei.dist);
+	}
+}
+
+/// Hashes the bits of the positions, velocities and corridors of the active agents with FNV-1a.
+uint64_t hashCrowdState(dtCrowd* crowd)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (int i = 0; i < crowd->getAgentCount(); ++i)
+	{
+		const dtCrowdAgent* ag = crowd->getAgent(i);
+		if (!ag->active)
+			continue;
+		unsigned char bytes[6 * sizeof(float) + 2 * sizeof(dtPolyRef) + 1];
+		memcpy(bytes, ag->npos, 3 * sizeof(float));
+		memcpy(bytes + 3 * sizeof(float), ag->vel, 3 * sizeof(float));
+		const dtPolyRef refs[2] = { ag->corridor.getFirstPoly(), ag->corridor.getLastPoly() };
+		memcpy(bytes + 6 * sizeof(float), refs, sizeof(refs));
+		bytes[sizeof(bytes) - 1] = ag->targetState;
+		for (size_t j = 0; j < sizeof(bytes); ++j)
+		{
+			hash = (hash ^ bytes[j]) * 1099511628211ULL;
+		}
+	}
+	return hash;
+}
+
+/// Runs a scripted crowd on an open world of square tiles: two groups cross each other, half of them are sent
+/// elsewhere on the way and agents leave and join. Appends the hash of the crowd state after each update.
+void runReplayScenario(dtCrowd* crowd, dtNavMesh* nav, const TestWorldParams& params, std::vector<uint64_t>& hashes)
+{
+	REQUIRE(crowd->init(40, 0.6f, nav));
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 2048)));
+
+	dtCrowdAgentParams ap;
+	initTestAgentParams(ap);
+	const float size = params.tilesX * params.tileSize;
+	unsigned int seed = 7;
+	for (int i = 0; i < 32; ++i)
+	{
+		const bool left = (i & 1) == 0;
+		const float pos[3] = { left ? 4.0f + testRand(seed) * 8.0f : size - 12.0f + testRand(seed) * 8.0f, 0, 8.0f + testRand(seed) * (size - 16.0f) };
+		const int idx = crowd->addAgent(pos, &ap);
+		REQUIRE(idx == i);
+		const float target[3] = { size - pos[0], 0, size - pos[2] };
+		REQUIRE(requestTarget(crowd, query, idx, target));
+	}
+
+	const float dt = 1.0f / 30.0f;
+	for (int tick = 0; tick < 240; ++tick)
+	{
+		if (tick == 60)
+		{
+			for (int i = 0; i < 32; i += 2)
+			{
+				const float target[3] = { size * 0.5f, 0, 4.0f + i };
+				REQUIRE(requestTarget(crowd, query, i, target));
+			}
+		}
+		if (tick == 120)
+		{
+			crowd->removeAgent(5);
+			const float pos[3] = { size * 0.5f, 0, size * 0.5f };
+			REQUIRE(crowd->addAgent(pos, &ap) == 5);
+			const float target[3] = { 4.0f, 0, 4.0f };
+			REQUIRE(requestTarget(crowd, query, 5, target));
+		}
+		crowd->update(dt, 0);
+		hashes.push_back(hashCrowdState(crowd));
+	}
+
+	dtFreeNavMeshQuery(query);
+}
+}
+
+TEST_CASE("dtCrowd", "[crowd]")
+{
+	TestWorldParams params;
+	dtNavMesh* nav = buildTestNavMesh(params);
+	REQUIRE(nav);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 2048)));
+	dtCrowd* crowd = dtAllocCrowd();
+	const int maxAgents = 32;
+	REQUIRE(crowd->init(maxAgents, 0.6f, nav));
+
+	dtCrowdAgentParams ap;
+	initTestAgentParams(ap);
+	const float dt = 1.0f / 30.0f;
+
+	SECTION("Agents reach their targets and the views match the arrays")
+	{
+		// Two rows of agents walking past each other across the world.
+		const int agentCount = 16;
+		float targets[agentCount][3];
+		for (int i = 0; i < agentCount; ++i)
+		{
+			const float x = 4.0f + (i / 2) * 7.0f;
+			const float z = (i & 1) ? 58.0f : 6.0f;
+			const float pos[3] = { x, 0, z };
+			const int idx = crowd->addAgent(pos, &ap);
+			REQUIRE(idx == i);
+			dtVset(targets[i], x, 0, 64.0f - z);
+			REQUIRE(requestTarget(crowd, query, idx, targets[i]));
+		}
+		REQUIRE(crowd->getAgentArrays().active[agentCount - 1]);
+		REQUIRE(!crowd->getAgentArrays().active[agentCount]);
+
+		for (int step = 0; step < 900; ++step)
+		{
+			crowd->update(dt, 0);
+			if (step % 100 == 0)
+			{
+				for (int i = 0; i < maxAgents; ++i)
+				{
+					checkAgentView(crowd, i);
+				}
+			}
+		}
+
+		for (int i = 0; i < agentCount; ++i)
+		{
+			const dtCrowdAgent* ag = crowd->getAgent(i);
+			REQUIRE(ag->state == DT_CROWDAGENT_STATE_WALKING);
+			REQUIRE(dtVdist2D(ag->npos, targets[i]) < 1.0f);
+		}
+
+		dtCrowdAgent* agents[maxAgents];
+		REQUIRE(crowd->getActiveAgents(agents, maxAgents) == agentCount);
+		REQUIRE(agents[3] == crowd->getAgent(3));
+	}
+
+	SECTION("Edits through getEditableAgent apply at the next update")
+	{
+		const float pos[3] = { 4.0f, 0, 6.0f };
+		const int idx = crowd->addAgent(pos, &ap);
+		REQUIRE(idx == 0);
+		const float vel[3] = { 1.0f, 0, 0 };
+		REQUIRE(crowd->requestMoveVelocity(idx, vel));
+
+		dtCrowdAgent* ag = crowd->getEditableAgent(idx);
+		ag->npos[2] = 7.0f;
+		ag->params.maxAcceleration = 0.0f;
+		REQUIRE(crowd->getAgentArrays().npos[idx * 3 + 2] == 6.0f);
+		// The pending edit is returned as is.
+		REQUIRE(crowd->getAgent(idx)->npos[2] == 7.0f);
+
+		crowd->update(dt, 0);
+		const dtCrowdAgentArrays& arrays = crowd->getAgentArrays();
+		REQUIRE(arrays.maxAcceleration[idx] == 0.0f);
+		REQUIRE(arrays.npos[idx * 3 + 0] == Catch::Approx(4.0f));
+		REQUIRE(arrays.npos[idx * 3 + 2] == Catch::Approx(7.0f));
+		REQUIRE(arrays.vel[idx * 3 + 0] == 0.0f);
+		checkAgentView(crowd, idx);
+
+		crowd->getEditableAgent(idx)->params.maxAcceleration = 8.0f;
+		crowd->update(dt, 0);
+		REQUIRE(arrays.vel[idx * 3 + 0] > 0.0f);
+		checkAgentView(crowd, idx);
+	}
+
+	SECTION("Removed agents are inactive and their slots are reused")
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			const float pos[3] = { 4.0f + i * 4.0f, 0, 6.0f };
+			REQUIRE(crowd->addAgent(pos, &ap) == i);
+		}
+		crowd->update(dt, 0);
+
+		crowd->removeAgent(1);
+		REQUIRE(!crowd->getAgentArrays().active[1]);
+		REQUIRE(!crowd->getAgent(1)->active);
+		dtCrowdAgent* agents[maxAgents];
+		REQUIRE(crowd->getActiveAgents(agents, maxAgents) == 2);
+		crowd->update(dt, 0);
+		REQUIRE(crowd->getAgentArrays().nneis[0] == 0);
+
+		const float pos[3] = { 30.0f, 0, 30.0f };
+		REQUIRE(crowd->addAgent(pos, &ap) == 1);
+		REQUIRE(crowd->getAgentArrays().active[1]);
+		REQUIRE(crowd->getAgentArrays().state[1] == DT_CROWDAGENT_STATE_WALKING);
+		checkAgentView(crowd, 1);
+	}
+
+	SECTION("Extra collision iterations run while agents overlap")
+	{
+		REQUIRE(crowd->getCollisionParams()->iterations == 4);
+		REQUIRE(crowd->getCollisionParams()->maxIterations == 4);
+
+		int iterations = 0;
+		const dtCrowdCollisionParams standard = { 4, 4, 0.05f };
+		const float standardOverlap = resolveCluster(nav, standard, iterations);
+		REQUIRE(iterations == 4);
+		REQUIRE(standardOverlap > 0.05f);
+
+		const dtCrowdCollisionParams dense = { 4, 64, 0.05f };
+		const float denseOverlap = resolveCluster(nav, dense, iterations);
+		REQUIRE(iterations > 4);
+		REQUIRE(iterations < 64);
+		REQUIRE(denseOverlap < standardOverlap);
+		REQUIRE(denseOverlap <= 0.05f);
+
+		const dtCrowdCollisionParams none = { 0, 0, 0.0f };
+		const float noneOverlap = resolveCluster(nav, none, iterations);
+		REQUIRE(iterations == 0);
+		REQUIRE(noneOverlap > standardOverlap);
+	}
+
+	SECTION("Neighbour and corner capacities are set at init")
+	{
+		REQUIRE(crowd->getMaxNeighbours() == DT_CROWDAGENT_MAX_NEIGHBOURS);
+		REQUIRE(crowd->getMaxCorners() == DT_CROWDAGENT_MAX_CORNERS);
+
+		dtCrowdParams cp;
+		dtInitCrowdParams(&cp, maxAgents, 0.6f);
+		cp.maxNeighbours = 12;
+		cp.maxCorners = 8;
+		cp.maxNeighbourQuery = 11;
+		cp.maxFlowFields = 0;
+		REQUIRE(!crowd->init(&cp, nav));
+		cp.maxNeighbourQuery = 64;
+		cp.maxCorners = 1;
+		REQUIRE(!crowd->init(&cp, nav));
+		cp.maxCorners = 8;
+		REQUIRE(crowd->init(&cp, nav));
+		REQUIRE(crowd->getMaxNeighbours() == 12);
+		REQUIRE(crowd->getMaxCorners() == 8);
+
+		// A cluster in which every agent sees all others, and an agent walking diagonally through the pillars.
+		const int clusterCount = 13;
+		for (int i = 0; i < clusterCount; ++i)
+		{
+			const float pos[3] = { 4.5f + (i % 4) * 1.0f, 0, 4.5f + (i / 4) * 1.0f };
+			REQUIRE(crowd->addAgent(pos, &ap) == i);
+		}
+		const float start[3] = { 1.0f, 0, 1.0f };
+		const int walker = crowd->addAgent(start, &ap);
+		const float target[3] = { 62.0f, 0, 62.0f };
+		REQUIRE(requestTarget(crowd, query, walker, target));
+
+		int maxCorners = 0;
+		for (int step = 0; step < 30; ++step)
+		{
+			crowd->update(dt, 0);
+			maxCorners = dtMax(maxCorners, crowd->getAgent(walker)->ncorners);
+		}
+		REQUIRE(maxCorners > DT_CROWDAGENT_MAX_CORNERS);
+		REQUIRE(maxCorners <= 8);
+
+		const dtCrowdAgentArrays& arrays = crowd->getAgentArrays();
+		int maxNeighbours = 0;
+		for (int i = 0; i < clusterCount; ++i)
+		{
+			maxNeighbours = dtMax(maxNeighbours, arrays.nneis[i]);
+			checkAgentView(crowd, i);
+		}
+		REQUIRE(maxNeighbours == 12);
+
+		cp.maxNeighbours = 2;
+		cp.maxCorners = 2;
+		REQUIRE(crowd->init(&cp, nav));
+		for (int i = 0; i < clusterCount; ++i)
+		{
+			const float pos[3] = { 4.5f + (i % 4) * 1.0f, 0, 4.5f + (i / 4) * 1.0f };
+			REQUIRE(crowd->addAgent(pos, &ap) == i);
+		}
+		const int shortWalker = crowd->addAgent(start, &ap);
+		REQUIRE(requestTarget(crowd, query, shortWalker, target));
+		for (int step = 0; step < 30; ++step)
+		{
+			crowd->update(dt, 0);
+			REQUIRE(crowd->getAgent(shortWalker)->ncorners <= 2);
+		}
+		for (int i = 0; i < clusterCount; ++i)
+		{
+			REQUIRE(crowd->getAgentArrays().nneis[i] <= 2);
+			checkAgentView(crowd, i);
+		}
+	}
+
+	SECTION("Agents moving to the same target share a flow field")
+	{
+		REQUIRE(crowd->getMaxFlowFields() == DT_CROWD_MAX_FLOW_FIELDS);
+
+		// A row of agents spread across the world walking to one corner.
+		const int agentCount = 12;
+		const float target[3] = { 60.0f, 0, 60.0f };
+		for (int i = 0; i < agentCount; ++i)
+		{
+			const float pos[3] = { 4.0f + i * 5.0f, 0, 4.0f };
+			REQUIRE(crowd->addAgent(pos, &ap) == i);
+			REQUIRE(requestTarget(crowd, query, i, target, true));
+		}
+		const float otherTarget[3] = { 4.0f, 0, 60.0f };
+		const float otherPos[3] = { 30.0f, 0, 30.0f };
+		const int other = crowd->addAgent(otherPos, &ap);
+		REQUIRE(requestTarget(crowd, query, other, otherTarget, true));
+		REQUIRE(crowd->getFlowField(0));
+		REQUIRE(crowd->getFlowField(1));
+		REQUIRE(!crowd->getFlowField(2));
+
+		// The first field is built in the first update, beyond the path search budget, and the other field waits
+		// for the updates that make up for it.
+		crowd->update(dt, 0);
+		const dtFlowField* field = crowd->getFlowField(0);
+		REQUIRE(field->getPolyCount() > crowd->getBudgetParams()->pathIterations);
+		REQUIRE(crowd->getBudgetStats()->pathIterations >= field->getPolyCount());
+		REQUIRE(crowd->getFlowField(1)->getPolyCount() == 0);
+		REQUIRE(crowd->getAgent(other)->targetState == DT_CROWDAGENT_TARGET_REQUESTING);
+		int updates = 1;
+		while (crowd->getAgent(other)->targetState == DT_CROWDAGENT_TARGET_REQUESTING)
+		{
+			crowd->update(dt, 0);
+			REQUIRE(++updates < 100);
+		}
+		REQUIRE(updates > field->getPolyCount() / crowd->getBudgetParams()->pathIterations);
+
+		// The paths are complete without using the path queue.
+		for (int i = 0; i <= agentCount; ++i)
+		{
+			const dtCrowdAgent* ag = crowd->getAgent(i);
+			REQUIRE(ag->targetState == DT_CROWDAGENT_TARGET_VALID);
+			REQUIRE(ag->corridor.getLastPoly() == ag->targetRef);
+			REQUIRE(!ag->partial);
+		}
+
+		for (int step = 0; step < 900; ++step)
+		{
+			crowd->update(dt, 0);
+		}
+		for (int i = 0; i < agentCount; ++i)
+		{
+			REQUIRE(dtVdist2D(crowd->getAgent(i)->npos, target) < 3.0f);
+		}
+		REQUIRE(dtVdist2D(crowd->getAgent(other)->npos, otherTarget) < 1.0f);
+
+		// The field is freed when its last agent changes its target.
+		for (int i = 0; i < agentCount; ++i)
+		{
+			if (i % 2)
+				crowd->removeAgent(i);
+			else
+				REQUIRE(requestTarget(crowd, query, i, otherTarget));
+		}
+		REQUIRE(!crowd->getFlowField(0));
+		REQUIRE(crowd->getFlowField(1));
+	}
+
+	SECTION("Shared flow fields are rebuilt when their tiles change")
+	{
+		const int agentCount = 4;
+		const float target[3] = { 60.0f, 0, 60.0f };
+		for (int i = 0; i < agentCount; ++i)
+		{
+			const float pos[3] = { 4.0f + i * 5.0f, 0, 4.0f };
+			REQUIRE(crowd->addAgent(pos, &ap) == i);
+			REQUIRE(requestTarget(crowd, query, i, target, true));
+		}
+		for (int step = 0; step < 30; ++step)
+		{
+			crowd->update(dt, 0);
+		}
+		const dtFlowField* field = crowd->getFlowField(0);
+		REQUIRE(field->isValid());
+
+		// Rebuild a tile on the way to the target.
+		REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(2, 2, 0), nullptr, nullptr)));
+		int dataSize = 0;
+		unsigned char* data = buildTestTileData(params, 2, 2, &dataSize);
+		REQUIRE(data);
+		REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, nullptr)));
+		REQUIRE(!field->isValid());
+
+		// The agents replan from the rebuilt field long before they reach the tile.
+		for (int step = 0; step < 30; ++step)
+		{
+			crowd->update(dt, 0);
+		}
+		REQUIRE(field->isValid());
+		for (int i = 0; i < agentCount; ++i)
+		{
+			const dtCrowdAgent* ag = crowd->getAgent(i);
+			REQUIRE(ag->targetState == DT_CROWDAGENT_TARGET_VALID);
+			REQUIRE(ag->corridor.getLastPoly() == ag->targetRef);
+			for (int j = 0; j < ag->corridor.getPathCount(); ++j)
+			{
+				REQUIRE(nav->isValidPolyRef(ag->corridor.getPath()[j]));
+			}
+		}
+
+		for (int step = 0; step < 900; ++step)
+		{
+			crowd->update(dt, 0);
+		}
+		for (int i = 0; i < agentCount; ++i)
+		{
+			REQUIRE(dtVdist2D(crowd->getAgent(i)->npos, target) < 3.0f);
+		}
+	}
+
+	SECTION("Shared requests fall back to individual paths when the flow fields are in use")
+	{
+		dtCrowdParams cp;
+		dtInitCrowdParams(&cp, maxAgents, 0.6f);
+		cp.maxFlowFields = 1;
+		cp.maxFlowFieldPolys = 0;
+		REQUIRE(!crowd->init(&cp, nav));
+		cp.maxFlowFieldPolys = DT_CROWD_MAX_FLOW_FIELD_POLYS;
+		REQUIRE(crowd->init(&cp, nav));
+
+		const float targets[2][3] = { { 60.0f, 0, 60.0f }, { 60.0f, 0, 4.0f } };
+		for (int i = 0; i < 2; ++i)
+		{
+			const float pos[3] = { 4.0f, 0, 4.0f + i * 56.0f };
+			REQUIRE(crowd->addAgent(pos, &ap) == i);
+			REQUIRE(requestTarget(crowd, query, i, targets[i], true));
+		}
+		REQUIRE(crowd->getFlowField(0)->getGoalRef() == 0);
+		crowd->update(dt, 0);
+		REQUIRE(crowd->getFlowField(0)->getGoalRef() == crowd->getAgent(0)->targetRef);
+
+		for (int step = 0; step < 900; ++step)
+		{
+			crowd->update(dt, 0);
+		}
+		for (int i = 0; i < 2; ++i)
+		{
+			REQUIRE(dtVdist2D(crowd->getAgent(i)->npos, targets[i]) < 1.0f);
+		}
+	}
+
+	SECTION("Path searches and optimizations follow the budgets")
+	{
+		const dtCrowdBudgetParams* budget = crowd->getBudgetParams();
+		REQUIRE(budget->pathIterations == 100);
+		REQUIRE(budget->optimizations == 1);
+		REQUIRE(!budget->clock);
+
+		// The fixed budgets leave agents waiting for path requests and optimizations.
+		const int agentCount = 24;
+		int fixedWaiting = 0;
+		const int fixedUpdates = walkAcrossWorld(crowd, query, agentCount, fixedWaiting);
+		REQUIRE(fixedUpdates > 3);
+		REQUIRE(fixedWaiting > agentCount);
+		REQUIRE(crowd->getBudgetStats()->pathIterationBudget == 100);
+		REQUIRE(crowd->getBudgetStats()->pathIterationCost == 0);
+
+		// A clock on which work appears expensive keeps the fixed budgets.
+		dtCrowdParams cp;
+		dtInitCrowdParams(&cp, maxAgents, 0.6f);
+		cp.maxFlowFields = 0;
+		cp.maxPathRequests = 0;
+		REQUIRE(!crowd->init(&cp, nav));
+		cp.maxPathRequests = agentCount;
+		REQUIRE(crowd->init(&cp, nav));
+		REQUIRE(crowd->getPathQueue()->getMaxRequests() == agentCount);
+
+		TestStepClock slowClock(1.0e6);
+		dtCrowdBudgetParams params = *crowd->getBudgetParams();
+		params.pathTime = 1000.0f;
+		params.optimizationTime = 1000.0f;
+		params.clock = &slowClock;
+		crowd->setBudgetParams(&params);
+		int slowWaiting = 0;
+		walkAcrossWorld(crowd, query, agentCount, slowWaiting);
+		REQUIRE(crowd->getBudgetStats()->pathIterationBudget == 100);
+		REQUIRE(crowd->getBudgetStats()->optimizationBudget == 1);
+		REQUIRE(crowd->getBudgetStats()->pathIterationCost > 0);
+
+		// A clock on which work appears cheap lets the budgets grow to finish all work.
+		REQUIRE(crowd->init(&cp, nav));
+		TestStepClock fastClock(1.0);
+		params.clock = &fastClock;
+		crowd->setBudgetParams(&params);
+		int fastWaiting = 0;
+		const int fastUpdates = walkAcrossWorld(crowd, query, agentCount, fastWaiting);
+		REQUIRE(fastUpdates < fixedUpdates);
+		REQUIRE(fastWaiting < agentCount);
+		REQUIRE(crowd->getBudgetStats()->pathIterationBudget > 100);
+		REQUIRE(crowd->getBudgetStats()->optimizationBudget > 1);
+		REQUIRE(crowd->getBudgetStats()->pathTime > 0);
+	}
+
+	SECTION("Agents far from the observers are simulated at a lower level of detail")
+	{
+		dtCrowdLodParams lodParams = *crowd->getLodParams();
+		REQUIRE(lodParams.interval == 4);
+		lodParams.reducedDistance = 12.0f;
+		lodParams.corridorDistance = 24.0f;
+		lodParams.sleepDistance = 40.0f;
+		crowd->setLodParams(&lodParams);
+		float observers[(DT_CROWD_MAX_LOD_OBSERVERS + 1) * 3] = { 0 };
+		REQUIRE(!crowd->setLodObservers(observers, DT_CROWD_MAX_LOD_OBSERVERS + 1));
+		const float observer[3] = { 4.0f, 0, 6.0f };
+		REQUIRE(crowd->setLodObservers(observer, 1));
+
+		// A row of agents walking away from the observer, spread over all levels of detail.
+		const int agentCount = 9;
+		float targets[agentCount][3];
+		float starts[agentCount][3];
+		for (int i = 0; i < agentCount; ++i)
+		{
+			const float pos[3] = { 4.0f + i * 6.5f, 0, 6.0f };
+			REQUIRE(crowd->addAgent(pos, &ap) == i);
+			dtVcopy(starts[i], crowd->getAgent(i)->npos);
+			dtVset(targets[i], pos[0], 0, 58.0f);
+			REQUIRE(requestTarget(crowd, query, i, targets[i]));
+		}
+		crowd->update(dt, 0);
+
+		const dtCrowdAgentArrays& arrays = crowd->getAgentArrays();
+		for (int i = 0; i < agentCount; ++i)
+		{
+			const float dist = dtVdist2D(starts[i], observer);
+			unsigned char lod = DT_CROWDAGENT_LOD_FULL;
+			if (dist > lodParams.sleepDistance)
+				lod = DT_CROWDAGENT_LOD_SLEEPING;
+			else if (dist > lodParams.corridorDistance)
+				lod = DT_CROWDAGENT_LOD_CORRIDOR;
+			else if (dist > lodParams.reducedDistance)
+				lod = DT_CROWDAGENT_LOD_REDUCED;
+			REQUIRE(arrays.lod[i] == lod);
+		}
+		REQUIRE(arrays.lod[0] == DT_CROWDAGENT_LOD_FULL);
+		REQUIRE(arrays.lod[agentCount - 1] == DT_CROWDAGENT_LOD_SLEEPING);
+		REQUIRE(dtVdist(&arrays.npos[(agentCount - 1) * 3], starts[agentCount - 1]) == 0.0f);
+
+		// Sleeping agents stay in place and corridor followers have no neighbours, while the others walk on.
+		for (int step = 0; step < 900; ++step)
+		{
+			float prevPos[agentCount][3];
+			for (int i = 0; i < agentCount; ++i)
+			{
+				dtVcopy(prevPos[i], &arrays.npos[i * 3]);
+			}
+			crowd->update(dt, 0);
+			for (int i = 0; i < agentCount; ++i)
+			{
+				if (arrays.lod[i] == DT_CROWDAGENT_LOD_SLEEPING)
+				{
+					REQUIRE(dtVdist(&arrays.npos[i * 3], prevPos[i]) == 0.0f);
+					REQUIRE(dtVlenSqr(&arrays.vel[i * 3]) == 0.0f);
+				}
+				if (arrays.lod[i] == DT_CROWDAGENT_LOD_CORRIDOR)
+				{
+					REQUIRE(arrays.nneis[i] == 0);
+				}
+			}
+		}
+		for (int i = 0; i < agentCount; ++i)
+		{
+			if (arrays.lod[i] != DT_CROWDAGENT_LOD_SLEEPING)
+			{
+				REQUIRE(dtVdist2D(&arrays.npos[i * 3], targets[i]) < 1.0f);
+			}
+		}
+
+		// Without observers the levels are set per agent, and woken agents walk to their targets.
+		REQUIRE(crowd->setLodObservers(0, 0));
+		crowd->setAgentLod(0, DT_CROWDAGENT_LOD_SLEEPING);
+		for (int i = 1; i < agentCount; ++i)
+		{
+			crowd->setAgentLod(i, DT_CROWDAGENT_LOD_CORRIDOR);
+		}
+		const float sleeperPos[3] = { arrays.npos[0], arrays.npos[1], arrays.npos[2] };
+		for (int step = 0; step < 900; ++step)
+		{
+			crowd->update(dt, 0);
+		}
+		REQUIRE(arrays.lod[1] == DT_CROWDAGENT_LOD_CORRIDOR);
+		REQUIRE(dtVdist(&arrays.npos[0], sleeperPos) == 0.0f);
+		for (int i = 1; i < agentCount; ++i)
+		{
+			REQUIRE(dtVdist2D(&arrays.npos[i * 3], targets[i]) < 1.0f);
+		}
+	}
+
+	SECTION("Updates report the time of each phase")
+	{
+		const float pos[3] = { 6.0f, 0, 6.0f };
+		REQUIRE(crowd->addAgent(pos, &ap) == 0);
+		const float target[3] = { 40.0f, 0, 40.0f };
+		REQUIRE(requestTarget(crowd, query, 0, target));
+
+		// Every reading of the clock marks the end of a phase.
+		TestStepClock clock(5.0);
+		dtCrowdUpdateProfile profile;
+		profile.clock = &clock;
+		crowd->update(dt, 0, &profile);
+		REQUIRE(clock.now == 5.0 * (DT_CROWD_MAX_PHASES + 1));
+		for (int i = 0; i < DT_CROWD_MAX_PHASES; ++i)
+		{
+			REQUIRE(profile.phaseTimes[i] == 5.0);
+		}
+	}
+
+	dtFreeCrowd(crowd);
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtCrowd replay", "[crowd]")
+{
+	TestWorldParams params;
+	params.pillars = false;
+	dtNavMesh* nav = allocTestNavMesh(params);
+	REQUIRE(nav);
+	for (int ty = 0; ty < params.tilesZ; ++ty)
+	{
+		for (int tx = 0; tx < params.tilesX; ++tx)
+		{
+			int dataSize = 0;
+			unsigned char* data = buildTestQuadTileData(params, tx, ty, 0, &dataSize);
+			REQUIRE(data);
+			REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+		}
+	}
+
+	// The second run reuses the crowd of the first one, which must not leak state through init.
+	dtCrowd* crowd = dtAllocCrowd();
+	std::vector<uint64_t> first;
+	std::vector<uint64_t> second;
+	runReplayScenario(crowd, nav, params, first);
+	runReplayScenario(crowd, nav, params, second);
+	REQUIRE(first.size() == 240);
+	REQUIRE(first[0] != first.back());
+	REQUIRE(first == second);
+
+#ifdef DT_DETERMINISTIC
+	// Recorded by a deterministic build; builds for every platform and compiler must reproduce it.
+	CHECK(first.back() == 0xd2d4b745eff7f9a9ULL);
+#endif
+
+	dtFreeCrowd(crowd);
+	dtFreeNavMesh(nav);
+}
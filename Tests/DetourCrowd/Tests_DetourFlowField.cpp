@@ -0,0 +1,142 @@
+#include "catch2/catch_all.hpp"
+
+#include "DetourFlowField.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+
+#include "../Detour/NavMeshTestUtils.h"
+
+namespace
+{
+dtPolyRef findPoly(const dtNavMeshQuery* query, const float* pos)
+{
+	const float halfExtents[3] = { 2, 4, 2 };
+	dtQueryFilter filter;
+	dtPolyRef ref = 0;
+	float nearest[3];
+	query->findNearestPoly(pos, halfExtents, &filter, &ref, nearest);
+	return ref;
+}
+
+bool isLinked(const dtNavMesh* nav, dtPolyRef from, dtPolyRef to)
+{
+	const dtMeshTile* tile = 0;
+	const dtPoly* poly = 0;
+	nav->getTileAndPolyByRefUnsafe(from, &tile, &poly);
+	for (unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
+	{
+		if (tile->links[i].ref == to)
+			return true;
+	}
+	return false;
+}
+}
+
+TEST_CASE("dtFlowField", "[crowd]")
+{
+	TestWorldParams params;
+	dtNavMesh* nav = buildTestNavMesh(params);
+	REQUIRE(nav);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 2048)));
+	dtQueryFilter filter;
+
+	const float goal[3] = { 60.0f, 0, 60.0f };
+	const dtPolyRef goalRef = findPoly(query, goal);
+	REQUIRE(goalRef);
+
+	dtFlowField* field = dtAllocFlowField();
+	REQUIRE(!field->init(0, nav));
+	REQUIRE(!field->init(65536, nav));
+
+	SECTION("Paths follow linked polygons to the goal at decreasing costs")
+	{
+		REQUIRE(field->init(4096, nav));
+		const dtStatus status = field->build(goalRef, goal, &filter);
+		REQUIRE(status == DT_SUCCESS);
+		REQUIRE(field->getGoalRef() == goalRef);
+		REQUIRE(field->getCost(goalRef) == 0.0f);
+		REQUIRE(field->getPolyCount() > 100);
+
+		const float starts[3][3] = { { 2.0f, 0, 2.0f }, { 60.0f, 0, 2.0f }, { 30.0f, 0, 34.0f } };
+		for (int i = 0; i < 3; ++i)
+		{
+			const dtPolyRef startRef = findPoly(query, starts[i]);
+			REQUIRE(field->contains(startRef));
+
+			dtPolyRef path[256];
+			const int npath = field->getPath(startRef, path, 256);
+			REQUIRE(npath > 1);
+			REQUIRE(path[0] == startRef);
+			REQUIRE(path[npath - 1] == goalRef);
+			for (int j = 1; j < npath; ++j)
+			{
+				REQUIRE(isLinked(nav, path[j - 1], path[j]));
+				REQUIRE(field->getCost(path[j]) < field->getCost(path[j - 1]));
+			}
+
+			// Long paths are cut short.
+			dtPolyRef shortPath[4];
+			REQUIRE(field->getPath(startRef, shortPath, 4) == 4);
+			REQUIRE(shortPath[3] == path[3]);
+		}
+
+		field->reset();
+		REQUIRE(field->getPolyCount() == 0);
+		REQUIRE(!field->contains(goalRef));
+		REQUIRE(field->getCost(goalRef) < 0.0f);
+	}
+
+	SECTION("Polygons beyond the capacity are left out")
+	{
+		REQUIRE(field->init(16, nav));
+		const dtStatus status = field->build(goalRef, goal, &filter);
+		REQUIRE(dtStatusSucceed(status));
+		REQUIRE(dtStatusDetail(status, DT_OUT_OF_NODES));
+		REQUIRE(field->getPolyCount() == 16);
+
+		dtPolyRef path[256];
+		const float start[3] = { 2.0f, 0, 2.0f };
+		REQUIRE(field->getPath(findPoly(query, start), path, 256) == 0);
+		REQUIRE(field->getPath(goalRef, path, 256) == 1);
+	}
+
+	SECTION("Changes to the tiles under and next to the field invalidate it")
+	{
+		// The field covers a few polygons of the goal tile (3, 3).
+		REQUIRE(field->init(16, nav));
+		REQUIRE(field->isValid());
+		REQUIRE(dtStatusSucceed(field->build(goalRef, goal, &filter)));
+		REQUIRE(field->isValid());
+
+		// Tiles away from the field do not matter.
+		REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(0, 0, 0), nullptr, nullptr)));
+		REQUIRE(field->isValid());
+
+		// Removing, adding and replacing a tile next to the field.
+		REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(2, 2, 0), nullptr, nullptr)));
+		REQUIRE(!field->isValid());
+		REQUIRE(dtStatusSucceed(field->build(goalRef, goal, &filter)));
+		REQUIRE(field->isValid());
+
+		int dataSize = 0;
+		unsigned char* data = buildTestTileData(params, 2, 2, &dataSize);
+		REQUIRE(data);
+		REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, nullptr)));
+		REQUIRE(!field->isValid());
+		REQUIRE(dtStatusSucceed(field->build(goalRef, goal, &filter)));
+		REQUIRE(field->isValid());
+
+		// Replacing the goal tile leaves the polygon references stale.
+		REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(3, 3, 0), nullptr, nullptr)));
+		data = buildTestTileData(params, 3, 3, &dataSize);
+		REQUIRE(data);
+		REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, nullptr)));
+		REQUIRE(!field->isValid());
+		REQUIRE(!nav->isValidPolyRef(goalRef));
+	}
+
+	dtFreeFlowField(field);
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
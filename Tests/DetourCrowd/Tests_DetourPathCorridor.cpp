@@ -1,3 +1,5 @@
+#include <vector>
+
 #include "catch2/catch_all.hpp"
 
 #include "DetourPathCorridor.h"
@@ -117,3 +119,102 @@ TEST_CASE("dtMergeCorridorStartMoved")
         CHECK_THAT(path, Catch::Matchers::RangeEquals(expectedPath));
     }
 }
+
+TEST_CASE("dtPathPool")
+{
+    dtPathPool pool;
+    REQUIRE(pool.init(100, 64));
+    CHECK(pool.getMaxPath() == 100);
+
+    SECTION("Should round sizes up to power of two capacities and the maximum path")
+    {
+        CHECK(pool.getCapacity(1) == 8);
+        CHECK(pool.getCapacity(8) == 8);
+        CHECK(pool.getCapacity(9) == 16);
+        CHECK(pool.getCapacity(64) == 64);
+        CHECK(pool.getCapacity(65) == 104);
+        CHECK(pool.getCapacity(100) == 104);
+    }
+
+    SECTION("Should reuse freed buffers")
+    {
+        int capacity = 0;
+        dtPolyRef* a = pool.alloc(5, &capacity);
+        REQUIRE(a);
+        CHECK(capacity == 8);
+        dtPolyRef* b = pool.alloc(3, &capacity);
+        REQUIRE(b);
+        CHECK(b != a);
+        CHECK(pool.getUsedSize() == 16);
+        CHECK(pool.getReservedSize() == 64);
+
+        pool.free(a, 8);
+        CHECK(pool.getUsedSize() == 8);
+        CHECK(pool.alloc(8, &capacity) == a);
+
+        dtPolyRef* c = pool.alloc(100, &capacity);
+        REQUIRE(c);
+        CHECK(capacity == 104);
+        CHECK(pool.getReservedSize() == 64 + 104);
+        pool.free(c, 100);
+        pool.free(b, 8);
+        pool.free(a, 8);
+        CHECK(pool.getUsedSize() == 0);
+    }
+
+    SECTION("Should not allocate buffers longer than the maximum path")
+    {
+        int capacity = 0;
+        CHECK(pool.alloc(101, &capacity) == 0);
+    }
+}
+
+TEST_CASE("dtPathCorridor with a path pool")
+{
+    dtPathPool pool;
+    REQUIRE(pool.init(100));
+
+    dtPathCorridor corridor;
+    REQUIRE(corridor.init(&pool));
+    CHECK(corridor.getMaxPath() == 100);
+    CHECK(corridor.getPathCapacity() == 8);
+
+    const float pos[3] = { 0, 0, 0 };
+    corridor.reset(1, pos);
+    CHECK(corridor.getPathCount() == 1);
+
+    SECTION("Should grow and shrink the path buffer with the path")
+    {
+        dtPolyRef path[100];
+        for (int i = 0; i < 100; ++i)
+            path[i] = (dtPolyRef)(i + 1);
+
+        corridor.setCorridor(pos, path, 20);
+        CHECK(corridor.getPathCount() == 20);
+        CHECK(corridor.getPathCapacity() == 32);
+        CHECK_THAT(std::vector<dtPolyRef>(corridor.getPath(), corridor.getPath() + 20),
+                   Catch::Matchers::RangeEquals(std::vector<dtPolyRef>(path, path + 20)));
+
+        corridor.setCorridor(pos, path, 100);
+        CHECK(corridor.getPathCount() == 100);
+        CHECK(corridor.getPathCapacity() == 100);
+        CHECK(corridor.getPath()[99] == 100);
+
+        corridor.setCorridor(pos, path, 3);
+        CHECK(corridor.getPathCapacity() == 8);
+
+        corridor.reset(1, pos);
+        CHECK(corridor.getPathCapacity() == 8);
+        CHECK(pool.getUsedSize() == 8);
+    }
+
+    SECTION("Should return the path buffer when destroyed")
+    {
+        {
+            dtPathCorridor other;
+            REQUIRE(other.init(&pool));
+            CHECK(pool.getUsedSize() == 16);
+        }
+        CHECK(pool.getUsedSize() == 8);
+    }
+}
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "catch2/catch_all.hpp"
+
+#include "DetourTileCache.h"
+#include "DetourTileCacheBuilder.h"
+#include "DetourCommon.h"
+
+#include "TileCacheTestUtils.h"
+
+TEST_CASE("Bench_dtTileCacheObstacles")
+{
+	TestWorldParams worldParams;
+	worldParams.tilesX = 16;
+	worldParams.tilesZ = 16;
+	worldParams.tileSize = 8.0f;
+	worldParams.pillars = false;
+	const int obstacleCount = 5000;
+	TestTileCacheWorld world;
+	REQUIRE(world.init(worldParams, obstacleCount));
+	dtTileCache* tc = world.tileCache;
+
+	const float worldSize = worldParams.tilesX * worldParams.tileSize;
+	std::vector<dtObstacleRef> refs(obstacleCount);
+	unsigned int seed = 42;
+
+	int64_t begin = testNowNanos();
+	for (int i = 0; i < obstacleCount; ++i)
+	{
+		const float pos[3] = { testRand(seed) * worldSize, 0.0f, testRand(seed) * worldSize };
+		REQUIRE(dtStatusSucceed(tc->addObstacle(pos, 0.5f, 2.0f, &refs[i])));
+	}
+	const int addUpdates = world.updateAll();
+	const int64_t addNanos = testNowNanos() - begin;
+	REQUIRE(addUpdates > 0);
+
+	begin = testNowNanos();
+	for (int i = 0; i < obstacleCount; ++i)
+		REQUIRE(dtStatusSucceed(tc->removeObstacle(refs[i])));
+	const int removeUpdates = world.updateAll();
+	const int64_t removeNanos = testNowNanos() - begin;
+	REQUIRE(removeUpdates > 0);
+
+	printf("BM_%-35s %10.2f nanos/obstacle (%d updates)\n", "TileCache_AddObstacles:", addNanos / (double)obstacleCount, addUpdates);
+	printf("BM_%-35s %10.2f nanos/obstacle (%d updates)\n", "TileCache_RemoveObstacles:", removeNanos / (double)obstacleCount, removeUpdates);
+}
+
+/// Moves the obstacles a little every frame for a number of frames and rebuilds every tile
+/// that is due. Returns the number of tiles built.
+static int benchMovingObstacles(TestTileCacheWorld& world, std::vector<dtObstacleRef>& refs,
+								bool useMove, int frames, int64_t* nanos)
+{
+	dtTileCache* tc = world.tileCache;
+	const float dt = 1.0f / 30.0f;
+	const float worldSize = world.params.tilesX * world.params.tileSize;
+	unsigned int seed = 7;
+	std::vector<float> positions(refs.size() * 3);
+	for (size_t i = 0; i < refs.size(); ++i)
+	{
+		positions[i*3+0] = testRand(seed) * (worldSize - 4.0f) + 2.0f;
+		positions[i*3+1] = 0.0f;
+		positions[i*3+2] = testRand(seed) * (worldSize - 4.0f) + 2.0f;
+		REQUIRE(dtStatusSucceed(tc->addObstacle(&positions[i*3], 0.5f, 2.0f, &refs[i])));
+	}
+	world.updateAll(1.0f);
+	world.meshProcess.processCount = 0;
+
+	const int64_t begin = testNowNanos();
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		tc->beginObstacleBatch();
+		for (size_t i = 0; i < refs.size(); ++i)
+		{
+			float* pos = &positions[i*3];
+			pos[0] += (frame & 16) ? -0.05f : 0.05f;
+			if (useMove)
+			{
+				REQUIRE(dtStatusSucceed(tc->moveObstacle(refs[i], pos)));
+			}
+			else
+			{
+				REQUIRE(dtStatusSucceed(tc->removeObstacle(refs[i])));
+				REQUIRE(dtStatusSucceed(tc->addObstacle(pos, 0.5f, 2.0f, &refs[i])));
+			}
+		}
+		REQUIRE(dtStatusSucceed(tc->commitObstacleBatch()));
+
+		// Build every tile that is due this frame.
+		int built = -1;
+		tc->update(dt, world.navMesh);
+		while (built != world.meshProcess.processCount)
+		{
+			built = world.meshProcess.processCount;
+			tc->update(0.0f, world.navMesh);
+		}
+	}
+	*nanos = testNowNanos() - begin;
+
+	for (size_t i = 0; i < refs.size(); ++i)
+		tc->removeObstacle(refs[i]);
+	world.updateAll(1.0f);
+	return world.meshProcess.processCount;
+}
+
+TEST_CASE("Bench_dtTileCacheMovingObstacles")
+{
+	TestWorldParams worldParams;
+	worldParams.tilesX = 8;
+	worldParams.tilesZ = 8;
+	worldParams.tileSize = 8.0f;
+	worldParams.pillars = false;
+	const int obstacleCount = 200;
+	const int frames = 64;
+	TestTileCacheWorld world;
+	REQUIRE(world.init(worldParams, obstacleCount * 2));
+	std::vector<dtObstacleRef> refs(obstacleCount);
+
+	int64_t readdNanos = 0, moveNanos = 0, debounceNanos = 0;
+	const int readdBuilds = benchMovingObstacles(world, refs, false, frames, &readdNanos);
+	const int moveBuilds = benchMovingObstacles(world, refs, true, frames, &moveNanos);
+	world.tileCache->setTileRebuildDelay(0.2f, 0.5f);
+	const int debounceBuilds = benchMovingObstacles(world, refs, true, frames, &debounceNanos);
+	REQUIRE(debounceBuilds < moveBuilds);
+
+	printf("BM_%-35s %10.2f nanos/frame (%d tile builds)\n", "TileCache_RemoveAddObstacles:", readdNanos / (double)frames, readdBuilds);
+	printf("BM_%-35s %10.2f nanos/frame (%d tile builds)\n", "TileCache_MoveObstacles:", moveNanos / (double)frames, moveBuilds);
+	printf("BM_%-35s %10.2f nanos/frame (%d tile builds)\n", "TileCache_MoveObstaclesDebounced:", debounceNanos / (double)frames, debounceBuilds);
+}
+
+TEST_CASE("Bench_dtMarkConvexArea")
+{
+	// A flat 128x128 layer with unit cells, and a hexagon that used to be approximated by three boxes.
+	const int size = 128;
+	dtTileCacheLayerHeader header;
+	memset(&header, 0, sizeof(header));
+	header.width = (unsigned char)size;
+	header.height = (unsigned char)size;
+	std::vector<unsigned char> heights(size * size, 10);
+	std::vector<unsigned char> areas(size * size, 1);
+	dtTileCacheLayer layer;
+	memset(&layer, 0, sizeof(layer));
+	layer.header = &header;
+	layer.heights = &heights[0];
+	layer.areas = &areas[0];
+	const float orig[3] = { 0.0f, 0.0f, 0.0f };
+
+	const float radius = 40.0f;
+	const float center[3] = { 64.0f, 10.0f, 64.0f };
+	float hexagon[6 * 2];
+	for (int i = 0; i < 6; ++i)
+	{
+		const float a = i * 3.14159265f / 3.0f;
+		hexagon[i * 2 + 0] = center[0] + cosf(a) * radius;
+		hexagon[i * 2 + 1] = center[2] + sinf(a) * radius;
+	}
+	const float halfExtents[3] = { radius, 2.0f, radius * 0.866f * 0.5f };
+	float rotAux[3][2];
+	for (int i = 0; i < 3; ++i)
+	{
+		const float a = i * 3.14159265f / 3.0f;
+		rotAux[i][0] = cosf(0.5f * a) * sinf(-0.5f * a);
+		rotAux[i][1] = cosf(0.5f * a) * cosf(0.5f * a) - 0.5f;
+	}
+
+	const int iterations = 2000;
+	int64_t begin = testNowNanos();
+	for (int it = 0; it < iterations; ++it)
+	{
+		for (int i = 0; i < 3; ++i)
+			dtMarkBoxArea(layer, orig, 1.0f, 1.0f, center, halfExtents, rotAux[i], 0);
+	}
+	const int64_t boxNanos = testNowNanos() - begin;
+
+	begin = testNowNanos();
+	for (int it = 0; it < iterations; ++it)
+		dtMarkConvexArea(layer, orig, 1.0f, 1.0f, hexagon, 6, 8.0f, 12.0f, 0);
+	const int64_t convexNanos = testNowNanos() - begin;
+	REQUIRE(areas[64 + 64 * size] == 0);
+
+	printf("BM_%-35s %10.2f nanos/carve\n", "TileCache_MarkThreeBoxes:", boxNanos / (double)iterations);
+	printf("BM_%-35s %10.2f nanos/carve\n", "TileCache_MarkConvexHexagon:", convexNanos / (double)iterations);
+}
+
+TEST_CASE("Bench_dtTileCacheBudgetedUpdate")
+{
+	TestWorldParams worldParams;
+	worldParams.tilesX = 16;
+	worldParams.tilesZ = 16;
+	worldParams.tileSize = 8.0f;
+	worldParams.pillars = false;
+	const int obstacleCount = 2000;
+	TestTileCacheWorld world;
+	REQUIRE(world.init(worldParams, obstacleCount));
+	dtTileCache* tc = world.tileCache;
+
+	const float worldSize = worldParams.tilesX * worldParams.tileSize;
+	unsigned int seed = 42;
+	for (int i = 0; i < obstacleCount; ++i)
+	{
+		const float pos[3] = { testRand(seed) * worldSize, 0.0f, testRand(seed) * worldSize };
+		REQUIRE(dtStatusSucceed(tc->addObstacle(pos, 0.5f, 2.0f, 0)));
+	}
+
+	// A 30 Hz server spending at most 2ms of each frame on the tile cache.
+	TestBenchClock clock;
+	const double budget = 2000.0;
+	int frames = 0;
+	double worstFrame = 0.0;
+	double worstOverrun = 0.0;
+	bool upToDate = false;
+	while (!upToDate)
+	{
+		dtTileCacheUpdateStats stats;
+		const double start = clock.getTime();
+		REQUIRE(dtStatusSucceed(tc->update(1.0f / 30.0f, world.navMesh, &clock, start + budget, &stats, &upToDate)));
+		const double used = clock.getTime() - start;
+		worstFrame = dtMax(worstFrame, used);
+		if (stats.tilesBuilt > 1)
+			worstOverrun = dtMax(worstOverrun, used - budget);
+		frames++;
+	}
+
+	printf("BM_%-35s %10.2f us worst frame, %.2f us worst overrun (%d frames)\n", "TileCache_BudgetedUpdate:", worstFrame, worstOverrun, frames);
+}
+
+/// Toggles a door obstacle and returns the time per rebuild.
+static double benchToggleDoor(TestTileCacheWorld& world, const int toggles)
+{
+	const float door[3] = { 24.0f, 0.0f, 24.0f };
+	const int64_t begin = testNowNanos();
+	for (int i = 0; i < toggles; ++i)
+	{
+		dtObstacleRef ref = 0;
+		REQUIRE(dtStatusSucceed(world.tileCache->addObstacle(door, 1.0f, 2.0f, &ref)));
+		world.updateAll();
+		REQUIRE(dtStatusSucceed(world.tileCache->removeObstacle(ref)));
+		world.updateAll();
+	}
+	return (testNowNanos() - begin) / (2.0 * toggles);
+}
+
+TEST_CASE("Bench_dtTileCacheLayerCache")
+{
+	TestWorldParams worldParams;
+	worldParams.pillars = false;
+	TestTileCacheWorld world;
+	REQUIRE(world.init(worldParams, 64));
+
+	const int toggles = 200;
+	const double uncached = benchToggleDoor(world, toggles);
+	REQUIRE(dtStatusSucceed(world.tileCache->setLayerCacheSize(1 << 20)));
+	const double cached = benchToggleDoor(world, toggles);
+	dtTileCacheLayerCacheStats stats;
+	world.tileCache->getLayerCacheStats(&stats);
+	REQUIRE(stats.misses == 1);
+
+	printf("BM_%-35s %10.2f nanos/rebuild\n", "TileCache_RebuildUncachedLayer:", uncached);
+	printf("BM_%-35s %10.2f nanos/rebuild (%d bytes cached)\n", "TileCache_RebuildCachedLayer:", cached, stats.usedBytes);
+}
@@ -0,0 +1,440 @@
+#include <vector>
+
+#include "catch2/catch_all.hpp"
+
+#include "DetourTileCache.h"
+
+#include "TileCacheTestUtils.h"
+
+TEST_CASE("dtTileCache obstacles")
+{
+	TestWorldParams worldParams;
+	worldParams.pillars = false;
+	TestTileCacheWorld world;
+	REQUIRE(world.init(worldParams, 1024));
+	dtTileCache* tc = world.tileCache;
+
+	const float worldSize = worldParams.tilesX * worldParams.tileSize;
+
+	SECTION("More requests than the old fixed queues hold")
+	{
+		// A grid of cylinders, several per tile, well apart from each other.
+		std::vector<dtObstacleRef> refs;
+		std::vector<float> positions;
+		for (float z = 2.0f; z < worldSize - 1.0f; z += 4.0f)
+		{
+			for (float x = 2.0f; x < worldSize - 1.0f; x += 4.0f)
+			{
+				const float pos[3] = { x, 0.0f, z };
+				dtObstacleRef ref = 0;
+				REQUIRE(dtStatusSucceed(tc->addObstacle(pos, 0.8f, 2.0f, &ref)));
+				refs.push_back(ref);
+				positions.insert(positions.end(), pos, pos + 3);
+			}
+		}
+		REQUIRE(refs.size() > 128);
+
+		// Each touched tile is queued once, no matter how many obstacles touch it.
+		tc->update(0.0f, world.navMesh);
+		REQUIRE(tc->getUpdateQueueSize() < worldParams.tilesX * worldParams.tilesZ);
+		REQUIRE(world.updateAll() > 0);
+		for (size_t i = 0; i < refs.size(); ++i)
+		{
+			const dtTileCacheObstacle* ob = tc->getObstacleByRef(refs[i]);
+			REQUIRE(ob != nullptr);
+			REQUIRE(ob->state == DT_OBSTACLE_PROCESSED);
+			REQUIRE(!world.isWalkable(&positions[i*3], 0.3f));
+		}
+
+		for (size_t i = 0; i < refs.size(); ++i)
+			REQUIRE(dtStatusSucceed(tc->removeObstacle(refs[i])));
+		REQUIRE(world.updateAll() > 0);
+		for (size_t i = 0; i < refs.size(); ++i)
+		{
+			REQUIRE(tc->getObstacleByRef(refs[i]) == nullptr);
+			REQUIRE(world.isWalkable(&positions[i*3], 0.3f));
+		}
+	}
+
+	SECTION("Removing an obstacle before it is processed")
+	{
+		const float pos[3] = { worldSize * 0.5f, 0.0f, worldSize * 0.5f };
+		dtObstacleRef ref = 0;
+		REQUIRE(dtStatusSucceed(tc->addObstacle(pos, 1.0f, 2.0f, &ref)));
+		REQUIRE(dtStatusSucceed(tc->removeObstacle(ref)));
+		REQUIRE(dtStatusSucceed(tc->removeObstacle(ref)));
+		REQUIRE(world.updateAll() == 1);
+		REQUIRE(tc->getObstacleByRef(ref) == nullptr);
+		REQUIRE(world.isWalkable(pos, 0.3f));
+	}
+
+	SECTION("Removing a tile releases the obstacles waiting for it")
+	{
+		// The obstacle sits on the corner of four tiles.
+		const float pos[3] = { worldParams.tileSize, 0.0f, worldParams.tileSize };
+		dtObstacleRef ref = 0;
+		REQUIRE(dtStatusSucceed(tc->addObstacle(pos, 1.0f, 2.0f, &ref)));
+		tc->update(0.0f, world.navMesh);
+		const dtTileCacheObstacle* ob = tc->getObstacleByRef(ref);
+		REQUIRE(ob != nullptr);
+		REQUIRE(ob->ntouched == 4);
+		REQUIRE(ob->state == DT_OBSTACLE_PROCESSING);
+
+		for (int i = 0; i < ob->npending; ++i)
+		{
+			const dtCompressedTile* tile = tc->getTileByRef(ob->pending[i]);
+			REQUIRE(tile != nullptr);
+			if (tile->header->tx == 1 && tile->header->ty == 1)
+			{
+				unsigned char* data = nullptr;
+				int dataSize = 0;
+				REQUIRE(dtStatusSucceed(tc->removeTile(ob->pending[i], &data, &dataSize)));
+				break;
+			}
+		}
+		REQUIRE(ob->npending == 2);
+		world.updateAll();
+		REQUIRE(ob->state == DT_OBSTACLE_PROCESSED);
+
+		// Removal only waits for the remaining tiles.
+		REQUIRE(dtStatusSucceed(tc->removeObstacle(ref)));
+		tc->update(0.0f, world.navMesh);
+		REQUIRE(ob->state == DT_OBSTACLE_REMOVING);
+		REQUIRE(ob->npending == 2);
+		world.updateAll();
+		REQUIRE(tc->getObstacleByRef(ref) == nullptr);
+	}
+}
+
+TEST_CASE("dtTileCache obstacle batches and moves")
+{
+	TestWorldParams worldParams;
+	worldParams.pillars = false;
+	TestTileCacheWorld world;
+	REQUIRE(world.init(worldParams, 64));
+	dtTileCache* tc = world.tileCache;
+
+	// Both positions are well inside tile (1, 1).
+	const float posA[3] = { 20.0f, 0.0f, 20.0f };
+	const float posB[3] = { 28.0f, 0.0f, 28.0f };
+
+	SECTION("Batched requests wait for the commit")
+	{
+		tc->beginObstacleBatch();
+		dtObstacleRef refA = 0, refB = 0;
+		REQUIRE(dtStatusSucceed(tc->addObstacle(posA, 1.0f, 2.0f, &refA)));
+		tc->beginObstacleBatch();
+		REQUIRE(dtStatusSucceed(tc->addObstacle(posB, 1.0f, 2.0f, &refB)));
+		REQUIRE(dtStatusSucceed(tc->commitObstacleBatch()));
+
+		bool upToDate = true;
+		tc->update(0.0f, world.navMesh, &upToDate);
+		REQUIRE(!upToDate);
+		REQUIRE(tc->getUpdateQueueSize() == 0);
+		REQUIRE(tc->getObstacleByRef(refA)->ntouched == 0);
+
+		REQUIRE(dtStatusSucceed(tc->commitObstacleBatch()));
+		REQUIRE(dtStatusFailed(tc->commitObstacleBatch()));
+		world.meshProcess.processCount = 0;
+		REQUIRE(world.updateAll() > 0);
+		REQUIRE(world.meshProcess.processCount == 1);
+		REQUIRE(!world.isWalkable(posA, 0.3f));
+		REQUIRE(!world.isWalkable(posB, 0.3f));
+	}
+
+	SECTION("Moving keeps the reference")
+	{
+		dtObstacleRef ref = 0;
+		REQUIRE(dtStatusSucceed(tc->addObstacle(posA, 1.0f, 2.0f, &ref)));
+		REQUIRE(world.updateAll() > 0);
+		REQUIRE(!world.isWalkable(posA, 0.3f));
+
+		// Crossing into the neighbour tile rebuilds both tiles.
+		const float posC[3] = { 36.0f, 0.0f, 20.0f };
+		world.meshProcess.processCount = 0;
+		REQUIRE(dtStatusSucceed(tc->moveObstacle(ref, posB)));
+		REQUIRE(dtStatusSucceed(tc->moveObstacle(ref, posC)));
+		REQUIRE(world.updateAll() > 0);
+		REQUIRE(world.meshProcess.processCount == 2);
+		const dtTileCacheObstacle* ob = tc->getObstacleByRef(ref);
+		REQUIRE(ob != nullptr);
+		REQUIRE(ob->state == DT_OBSTACLE_PROCESSED);
+		REQUIRE(world.isWalkable(posA, 0.3f));
+		REQUIRE(world.isWalkable(posB, 0.3f));
+		REQUIRE(!world.isWalkable(posC, 0.3f));
+
+		// A box moves by its center.
+		const float bmin[3] = { 18.0f, -1.0f, 18.0f };
+		const float bmax[3] = { 22.0f, 1.0f, 22.0f };
+		dtObstacleRef boxRef = 0;
+		REQUIRE(dtStatusSucceed(tc->addBoxObstacle(bmin, bmax, &boxRef)));
+		REQUIRE(dtStatusSucceed(tc->moveObstacle(boxRef, posB)));
+		REQUIRE(world.updateAll() > 0);
+		REQUIRE(world.isWalkable(posA, 0.3f));
+		REQUIRE(!world.isWalkable(posB, 0.3f));
+
+		REQUIRE(dtStatusSucceed(tc->removeObstacle(ref)));
+		REQUIRE(dtStatusFailed(tc->moveObstacle(ref, posA)));
+		REQUIRE(world.updateAll() > 0);
+		REQUIRE(tc->getObstacleByRef(ref) == nullptr);
+		REQUIRE(world.isWalkable(posC, 0.3f));
+		REQUIRE(dtStatusFailed(tc->moveObstacle(ref, posA)));
+	}
+
+	SECTION("Changes to a tile are debounced")
+	{
+		tc->setTileRebuildDelay(0.5f, 2.0f);
+		dtObstacleRef ref = 0;
+		REQUIRE(dtStatusSucceed(tc->addObstacle(posA, 1.0f, 2.0f, &ref)));
+		world.meshProcess.processCount = 0;
+
+		// Keep moving the obstacle within the tile every 0.25s.
+		for (int i = 0; i < 5; ++i)
+		{
+			const float pos[3] = { posA[0] + i, 0.0f, posA[2] };
+			REQUIRE(dtStatusSucceed(tc->moveObstacle(ref, pos)));
+			tc->update(0.25f, world.navMesh);
+		}
+		REQUIRE(world.meshProcess.processCount == 0);
+		REQUIRE(tc->getUpdateQueueSize() == 1);
+
+		// Once the tile is quiet it is built once.
+		tc->update(0.25f, world.navMesh);
+		REQUIRE(world.meshProcess.processCount == 0);
+		tc->update(0.25f, world.navMesh);
+		REQUIRE(world.meshProcess.processCount == 1);
+		REQUIRE(tc->getObstacleByRef(ref)->state == DT_OBSTACLE_PROCESSED);
+		const float last[3] = { posA[0] + 4.0f, 0.0f, posA[2] };
+		REQUIRE(!world.isWalkable(last, 0.3f));
+
+		// Constant changes are still built after the maximum delay.
+		world.meshProcess.processCount = 0;
+		for (int i = 0; i < 10; ++i)
+		{
+			const float pos[3] = { posA[0] + (i & 1), 0.0f, posA[2] };
+			REQUIRE(dtStatusSucceed(tc->moveObstacle(ref, pos)));
+			tc->update(0.25f, world.navMesh);
+		}
+		REQUIRE(world.meshProcess.processCount == 1);
+	}
+}
+
+TEST_CASE("dtTileCache convex obstacles")
+{
+	TestWorldParams worldParams;
+	worldParams.pillars = false;
+	TestTileCacheWorld world;
+	REQUIRE(world.init(worldParams, 64));
+	dtTileCache* tc = world.tileCache;
+
+	// A triangle spanning the corner of four tiles.
+	const float verts[] = {
+		12.0f, 0.0f, 12.0f,
+		24.0f, 0.0f, 14.0f,
+		14.0f, 0.0f, 24.0f,
+	};
+
+	SECTION("Obstacles do not grow with the outline")
+	{
+		STATIC_REQUIRE(sizeof(dtObstacleConvex) <= sizeof(dtObstacleOrientedBox));
+	}
+
+	SECTION("Invalid outlines are rejected")
+	{
+		REQUIRE(dtStatusFailed(tc->addConvexObstacle(verts, 2, -1.0f, 2.0f, nullptr)));
+		REQUIRE(dtStatusFailed(tc->addConvexObstacle(verts, DT_MAX_CONVEX_OBSTACLE_VERTS + 1, -1.0f, 2.0f, nullptr)));
+		REQUIRE(dtStatusFailed(tc->addConvexObstacle(verts, 3, 2.0f, -1.0f, nullptr)));
+	}
+
+	SECTION("Carves the outline only")
+	{
+		dtObstacleRef ref = 0;
+		REQUIRE(dtStatusSucceed(tc->addConvexObstacle(verts, 3, -1.0f, 2.0f, &ref)));
+		REQUIRE(world.updateAll() > 0);
+		const dtTileCacheObstacle* ob = tc->getObstacleByRef(ref);
+		REQUIRE(ob != nullptr);
+		REQUIRE(ob->ntouched == 4);
+		REQUIRE(ob->state == DT_OBSTACLE_PROCESSED);
+		const float* outline = tc->getObstacleConvexVerts(ob);
+		REQUIRE(outline[2] == verts[3]);
+		REQUIRE(outline[3] == verts[5]);
+
+		const float inside[3] = { 16.5f, 0.0f, 16.5f };
+		const float outsideHypotenuse[3] = { 22.0f, 0.0f, 22.0f };
+		const float outsideCorner[3] = { 10.0f, 0.0f, 10.0f };
+		REQUIRE(!world.isWalkable(inside, 0.3f));
+		REQUIRE(world.isWalkable(outsideHypotenuse, 0.3f));
+		REQUIRE(world.isWalkable(outsideCorner, 0.3f));
+
+		// Moving places the center of the bounds.
+		const float pos[3] = { 40.0f, 0.5f, 40.0f };
+		REQUIRE(dtStatusSucceed(tc->moveObstacle(ref, pos)));
+		REQUIRE(world.updateAll() > 0);
+		REQUIRE(world.isWalkable(inside, 0.3f));
+		REQUIRE(!world.isWalkable(pos, 0.3f));
+		float bmin[3], bmax[3];
+		tc->getObstacleBounds(ob, bmin, bmax);
+		REQUIRE(bmin[0] == Catch::Approx(34.0f));
+		REQUIRE(bmax[2] == Catch::Approx(46.0f));
+		REQUIRE(bmin[1] == Catch::Approx(-1.0f));
+	}
+
+	SECTION("Prisms above the ground do not carve")
+	{
+		REQUIRE(dtStatusSucceed(tc->addConvexObstacle(verts, 3, 4.0f, 6.0f, nullptr)));
+		REQUIRE(world.updateAll() > 0);
+		const float inside[3] = { 16.5f, 0.0f, 16.5f };
+		REQUIRE(world.isWalkable(inside, 0.3f));
+	}
+}
+
+TEST_CASE("dtTileCache budgeted update")
+{
+	TestWorldParams worldParams;
+	worldParams.pillars = false;
+	TestTileCacheWorld world;
+	REQUIRE(world.init(worldParams, 64));
+	dtTileCache* tc = world.tileCache;
+
+	// One obstacle in the middle of each tile.
+	std::vector<dtObstacleRef> refs;
+	for (int z = 0; z < worldParams.tilesZ; ++z)
+	{
+		for (int x = 0; x < worldParams.tilesX; ++x)
+		{
+			const float pos[3] = { (x + 0.5f) * worldParams.tileSize, 0.0f, (z + 0.5f) * worldParams.tileSize };
+			dtObstacleRef ref = 0;
+			REQUIRE(dtStatusSucceed(tc->addObstacle(pos, 1.0f, 2.0f, &ref)));
+			refs.push_back(ref);
+		}
+	}
+	const int tileCount = worldParams.tilesX * worldParams.tilesZ;
+
+	TestStepClock clock(0.0, 1000.0);
+	dtTileCacheUpdateStats stats;
+	bool upToDate = true;
+
+	SECTION("Requires a clock")
+	{
+		REQUIRE(dtStatusFailed(tc->update(0.0f, world.navMesh, nullptr, 0.0, &stats, &upToDate)));
+	}
+
+	SECTION("Rebuilds tiles until the budget is spent")
+	{
+		// Nothing is known about the tiles yet, a single tile is built and measured.
+		clock.step = 50.0;
+		REQUIRE(dtStatusSucceed(tc->update(0.0f, world.navMesh, &clock, clock.now, &stats, &upToDate)));
+		REQUIRE(stats.tilesBuilt == 1);
+		REQUIRE(stats.tilesQueued == tileCount - 1);
+		REQUIRE(stats.timeUsed == Catch::Approx(100.0f));
+		REQUIRE(stats.estimatedBacklog == Catch::Approx(50.0f * (tileCount - 1)));
+		REQUIRE(!upToDate);
+
+		// Three more tiles fit into 225us, including the reads of the clock.
+		REQUIRE(dtStatusSucceed(tc->update(0.0f, world.navMesh, &clock, clock.now + 225.0, &stats, &upToDate)));
+		REQUIRE(stats.tilesBuilt == 3);
+		REQUIRE(stats.tilesQueued == tileCount - 4);
+		REQUIRE(!upToDate);
+
+		// A generous deadline clears the backlog.
+		REQUIRE(dtStatusSucceed(tc->update(0.0f, world.navMesh, &clock, clock.now + 1e6, &stats, &upToDate)));
+		REQUIRE(stats.tilesBuilt == tileCount - 4);
+		REQUIRE(stats.tilesQueued == 0);
+		REQUIRE(stats.estimatedBacklog == 0.0f);
+		REQUIRE(upToDate);
+		for (size_t i = 0; i < refs.size(); ++i)
+			REQUIRE(tc->getObstacleByRef(refs[i])->state == DT_OBSTACLE_PROCESSED);
+	}
+
+	SECTION("Batches hold back the requests")
+	{
+		tc->beginObstacleBatch();
+		REQUIRE(dtStatusSucceed(tc->update(0.0f, world.navMesh, &clock, clock.now + 1e6, &stats, &upToDate)));
+		REQUIRE(stats.tilesBuilt == 0);
+		REQUIRE(stats.requestsHeld);
+		REQUIRE(!upToDate);
+		REQUIRE(dtStatusSucceed(tc->commitObstacleBatch()));
+		REQUIRE(dtStatusSucceed(tc->update(0.0f, world.navMesh, &clock, clock.now + 1e6, &stats, &upToDate)));
+		REQUIRE(stats.tilesBuilt == tileCount);
+		REQUIRE(!stats.requestsHeld);
+		REQUIRE(upToDate);
+	}
+}
+
+TEST_CASE("dtTileCache layer cache")
+{
+	TestWorldParams worldParams;
+	worldParams.pillars = false;
+	TestTileCacheWorld world;
+	REQUIRE(world.init(worldParams, 64));
+	dtTileCache* tc = world.tileCache;
+
+	dtTileCacheLayerCacheStats stats;
+	tc->getLayerCacheStats(&stats);
+	REQUIRE(stats.maxBytes == 0);
+	REQUIRE(dtStatusFailed(tc->setLayerCacheSize(-1)));
+
+	// A door in the middle of tile (1, 1) and one in tile (2, 1).
+	const float doorA[3] = { 24.0f, 0.0f, 24.0f };
+	const float doorB[3] = { 40.0f, 0.0f, 24.0f };
+	dtCompressedTileRef tiles[4];
+	REQUIRE(tc->getTilesAt(1, 1, tiles, 4) == 1);
+	const int layerSize = dtGetTileCacheLayerSize(tc->getTileByRef(tiles[0])->header);
+
+	SECTION("Toggling an obstacle decompresses the layer once")
+	{
+		REQUIRE(dtStatusSucceed(tc->setLayerCacheSize(1 << 20)));
+		world.compressor.decompressCount = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			dtObstacleRef ref = 0;
+			REQUIRE(dtStatusSucceed(tc->addObstacle(doorA, 1.0f, 2.0f, &ref)));
+			REQUIRE(world.updateAll() > 0);
+			REQUIRE(!world.isWalkable(doorA, 0.3f));
+			REQUIRE(dtStatusSucceed(tc->removeObstacle(ref)));
+			REQUIRE(world.updateAll() > 0);
+			REQUIRE(world.isWalkable(doorA, 0.3f));
+		}
+		REQUIRE(world.compressor.decompressCount == 1);
+		tc->getLayerCacheStats(&stats);
+		REQUIRE(stats.misses == 1);
+		REQUIRE(stats.hits == 7);
+		REQUIRE(stats.layerCount == 1);
+		REQUIRE(stats.usedBytes == layerSize);
+
+		// Removing the tile drops its layer.
+		unsigned char* data = nullptr;
+		int dataSize = 0;
+		REQUIRE(dtStatusSucceed(tc->removeTile(tiles[0], &data, &dataSize)));
+		tc->getLayerCacheStats(&stats);
+		REQUIRE(stats.layerCount == 0);
+		REQUIRE(stats.usedBytes == 0);
+	}
+
+	SECTION("The least recently used layer is evicted")
+	{
+		REQUIRE(dtStatusSucceed(tc->setLayerCacheSize(layerSize)));
+		world.compressor.decompressCount = 0;
+		dtObstacleRef refA = 0, refB = 0;
+		REQUIRE(dtStatusSucceed(tc->addObstacle(doorA, 1.0f, 2.0f, &refA)));
+		REQUIRE(world.updateAll() > 0);
+		REQUIRE(dtStatusSucceed(tc->addObstacle(doorB, 1.0f, 2.0f, &refB)));
+		REQUIRE(world.updateAll() > 0);
+		REQUIRE(dtStatusSucceed(tc->removeObstacle(refB)));
+		REQUIRE(world.updateAll() > 0);
+		REQUIRE(world.compressor.decompressCount == 2);
+		tc->getLayerCacheStats(&stats);
+		REQUIRE(stats.evictions == 1);
+		REQUIRE(stats.hits == 1);
+		REQUIRE(stats.usedBytes <= stats.maxBytes);
+
+		// Disabling the cache frees the layers.
+		REQUIRE(dtStatusSucceed(tc->setLayerCacheSize(0)));
+		tc->getLayerCacheStats(&stats);
+		REQUIRE(stats.layerCount == 0);
+		REQUIRE(dtStatusSucceed(tc->removeObstacle(refA)));
+		REQUIRE(world.updateAll() > 0);
+		REQUIRE(world.compressor.decompressCount == 3);
+		REQUIRE(world.isWalkable(doorA, 0.3f));
+	}
+}
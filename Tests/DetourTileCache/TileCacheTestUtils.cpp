@@ -0,0 +1,164 @@
+#include "TileCacheTestUtils.h"
+
+#include <string.h>
+
+#include "Recast.h"
+#include "DetourAlloc.h"
+#include "DetourCommon.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshBuilder.h"
+#include "DetourNavMeshQuery.h"
+
+namespace
+{
+const int kMaxLayers = 4;
+}
+
+int TestTileCacheCompressor::maxCompressedSize(const int bufferSize)
+{
+	return bufferSize;
+}
+
+dtStatus TestTileCacheCompressor::compress(const unsigned char* buffer, const int bufferSize,
+										   unsigned char* compressed, const int maxCompressedSize, int* compressedSize)
+{
+	if (bufferSize > maxCompressedSize)
+		return DT_FAILURE | DT_BUFFER_TOO_SMALL;
+	memcpy(compressed, buffer, bufferSize);
+	*compressedSize = bufferSize;
+	return DT_SUCCESS;
+}
+
+dtStatus TestTileCacheCompressor::decompress(const unsigned char* compressed, const int compressedSize,
+											 unsigned char* buffer, const int maxBufferSize, int* bufferSize)
+{
+	if (compressedSize > maxBufferSize)
+		return DT_FAILURE | DT_BUFFER_TOO_SMALL;
+	memcpy(buffer, compressed, compressedSize);
+	*bufferSize = compressedSize;
+	decompressCount++;
+	return DT_SUCCESS;
+}
+
+void TestTileCacheMeshProcess::process(dtNavMeshCreateParams* params, unsigned char* /*polyAreas*/, unsigned short* polyFlags)
+{
+	for (int i = 0; i < params->polyCount; ++i)
+		polyFlags[i] = 1;
+	processCount++;
+}
+
+TestTileCacheWorld::~TestTileCacheWorld()
+{
+	dtFreeTileCache(tileCache);
+	dtFreeNavMesh(navMesh);
+}
+
+bool TestTileCacheWorld::init(const TestWorldParams& worldParams, const int maxObstacles)
+{
+	params = worldParams;
+
+	rcConfig cfg;
+	initTestTileConfig(params, 0, 0, cfg);
+
+	dtTileCacheParams tcparams;
+	memset(&tcparams, 0, sizeof(tcparams));
+	tcparams.cs = cfg.cs;
+	tcparams.ch = cfg.ch;
+	tcparams.width = cfg.tileSize;
+	tcparams.height = cfg.tileSize;
+	tcparams.walkableHeight = cfg.walkableHeight * cfg.ch;
+	tcparams.walkableRadius = cfg.walkableRadius * cfg.cs;
+	tcparams.walkableClimb = cfg.walkableClimb * cfg.ch;
+	tcparams.maxSimplificationError = cfg.maxSimplificationError;
+	tcparams.maxTiles = params.tilesX * params.tilesZ * kMaxLayers;
+	tcparams.maxObstacles = maxObstacles;
+
+	tileCache = dtAllocTileCache();
+	if (!tileCache || dtStatusFailed(tileCache->init(&tcparams, &alloc, &compressor, &meshProcess)))
+		return false;
+
+	navMesh = allocTestNavMesh(params);
+	if (!navMesh)
+		return false;
+
+	rcContext ctx(false);
+	for (int ty = 0; ty < params.tilesZ; ++ty)
+	{
+		for (int tx = 0; tx < params.tilesX; ++tx)
+		{
+			initTestTileConfig(params, tx, ty, cfg);
+			rcCompactHeightfield* chf = rcAllocCompactHeightfield();
+			rcHeightfieldLayerSet* lset = rcAllocHeightfieldLayerSet();
+			bool ok = rasterizeTestTile(&ctx, params, cfg, *chf);
+			ok = ok && rcBuildHeightfieldLayers(&ctx, *chf, cfg.borderSize, cfg.walkableHeight, *lset);
+			for (int i = 0; ok && i < rcMin(lset->nlayers, kMaxLayers); ++i)
+			{
+				const rcHeightfieldLayer* layer = &lset->layers[i];
+				dtTileCacheLayerHeader header;
+				header.magic = DT_TILECACHE_MAGIC;
+				header.version = DT_TILECACHE_VERSION;
+				header.tx = tx;
+				header.ty = ty;
+				header.tlayer = i;
+				dtVcopy(header.bmin, layer->bmin);
+				dtVcopy(header.bmax, layer->bmax);
+				header.width = (unsigned char)layer->width;
+				header.height = (unsigned char)layer->height;
+				header.minx = (unsigned char)layer->minx;
+				header.maxx = (unsigned char)layer->maxx;
+				header.miny = (unsigned char)layer->miny;
+				header.maxy = (unsigned char)layer->maxy;
+				header.hmin = (unsigned short)layer->hmin;
+				header.hmax = (unsigned short)layer->hmax;
+
+				unsigned char* data = 0;
+				int dataSize = 0;
+				ok = dtStatusSucceed(dtBuildTileCacheLayer(&compressor, &header, layer->heights, layer->areas, layer->cons,
+														   &data, &dataSize));
+				if (ok && dtStatusFailed(tileCache->addTile(data, dataSize, DT_COMPRESSEDTILE_FREE_DATA, 0)))
+				{
+					dtFree(data);
+					ok = false;
+				}
+			}
+			rcFreeCompactHeightfield(chf);
+			rcFreeHeightfieldLayerSet(lset);
+			if (!ok)
+				return false;
+
+			if (dtStatusFailed(tileCache->buildNavMeshTilesAt(tx, ty, navMesh)))
+				return false;
+		}
+	}
+	return true;
+}
+
+int TestTileCacheWorld::updateAll(const float dt)
+{
+	int calls = 0;
+	bool upToDate = false;
+	while (!upToDate)
+	{
+		if (dtStatusFailed(tileCache->update(dt, navMesh, &upToDate)))
+			return -1;
+		calls++;
+	}
+	return calls;
+}
+
+bool TestTileCacheWorld::isWalkable(const float* pos, const float radius) const
+{
+	dtNavMeshQuery query;
+	if (dtStatusFailed(query.init(navMesh, 256)))
+		return false;
+	dtQueryFilter filter;
+	const float halfExtents[3] = { radius, 2.0f, radius };
+	dtPolyRef ref = 0;
+	float nearest[3];
+	query.findNearestPoly(pos, halfExtents, &filter, &ref, nearest);
+	if (!ref)
+		return false;
+	const float dx = nearest[0] - pos[0];
+	const float dz = nearest[2] - pos[2];
+	return dx*dx + dz*dz <= radius*radius;
+}
@@ -0,0 +1,57 @@
+#ifndef TILECACHETESTUTILS_H
+#define TILECACHETESTUTILS_H
+
+#include "DetourTileCache.h"
+#include "DetourTileCacheBuilder.h"
+
+#include "../Detour/NavMeshTestUtils.h"
+
+class dtNavMesh;
+
+/// Stores the layers uncompressed, which keeps the tests free of compression libraries.
+struct TestTileCacheCompressor : public dtTileCacheCompressor
+{
+	int decompressCount;	///< Number of layers decompressed.
+
+	TestTileCacheCompressor() : decompressCount(0) {}
+	virtual int maxCompressedSize(const int bufferSize);
+	virtual dtStatus compress(const unsigned char* buffer, const int bufferSize,
+							  unsigned char* compressed, const int maxCompressedSize, int* compressedSize);
+	virtual dtStatus decompress(const unsigned char* compressed, const int compressedSize,
+								unsigned char* buffer, const int maxBufferSize, int* bufferSize);
+};
+
+/// Marks every polygon of the rebuilt tiles walkable.
+struct TestTileCacheMeshProcess : public dtTileCacheMeshProcess
+{
+	int processCount;	///< Number of tiles built.
+
+	TestTileCacheMeshProcess() : processCount(0) {}
+	virtual void process(struct dtNavMeshCreateParams* params, unsigned char* polyAreas, unsigned short* polyFlags);
+};
+
+/// A tile cache over the test world together with the navigation mesh it builds.
+struct TestTileCacheWorld
+{
+	TestWorldParams params;
+	dtTileCacheAlloc alloc;
+	TestTileCacheCompressor compressor;
+	TestTileCacheMeshProcess meshProcess;
+	dtTileCache* tileCache;
+	dtNavMesh* navMesh;
+
+	TestTileCacheWorld() : tileCache(0), navMesh(0) {}
+	~TestTileCacheWorld();
+
+	/// Rasterizes the layers of every tile into the tile cache and builds the navigation mesh.
+	bool init(const TestWorldParams& worldParams, const int maxObstacles);
+
+	/// Calls dtTileCache::update with time step @p dt until the tile cache is up to date.
+	/// Returns the number of update calls, or -1 if an update failed.
+	int updateAll(const float dt = 0.0f);
+
+	/// Returns true if there is a walkable polygon within @p radius of @p pos on the xz-plane.
+	bool isWalkable(const float* pos, const float radius) const;
+};
+
+#endif // TILECACHETESTUTILS_H
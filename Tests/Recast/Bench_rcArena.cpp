@@ -0,0 +1,60 @@
+#include <stdio.h>
+
+#include "catch2/catch_all.hpp"
+
+#include "Recast.h"
+#include "RecastAlloc.h"
+#include "DetourAlloc.h"
+
+#include "../Detour/NavMeshTestUtils.h"
+
+static int sBenchAllocs = 0;
+
+static void* BenchCountingAlloc(size_t size, rcAllocHint)
+{
+	sBenchAllocs++;
+	return malloc(size);
+}
+
+/// Builds every tile of the world and returns the time per tile.
+static double benchBuildTiles(const TestWorldParams& params, rcContext* ctx, const int rounds)
+{
+	const int64_t begin = testNowNanos();
+	for (int r = 0; r < rounds; ++r)
+	{
+		for (int ty = 0; ty < params.tilesZ; ++ty)
+		{
+			for (int tx = 0; tx < params.tilesX; ++tx)
+			{
+				rcArenaScope scope(ctx);
+				int dataSize = 0;
+				dtFree(buildTestTileData(params, tx, ty, &dataSize));
+			}
+		}
+	}
+	return (testNowNanos() - begin) / (double)(rounds * params.tilesX * params.tilesZ);
+}
+
+TEST_CASE("Bench_rcArena")
+{
+	TestWorldParams params;
+	const int rounds = 4;
+	const int tiles = rounds * params.tilesX * params.tilesZ;
+	rcAllocSetCustom(BenchCountingAlloc, 0);
+
+	rcContext ctx(false);
+	sBenchAllocs = 0;
+	const double plainNanos = benchBuildTiles(params, &ctx, rounds);
+	const int plainAllocs = sBenchAllocs;
+
+	rcArena arena;
+	ctx.setArena(&arena);
+	sBenchAllocs = 0;
+	const double arenaNanos = benchBuildTiles(params, &ctx, rounds);
+	const int arenaAllocs = sBenchAllocs;
+	rcAllocSetCustom(0, 0);
+	REQUIRE(arenaAllocs < plainAllocs);
+
+	printf("BM_%-35s %10.2f nanos/tile (%.1f rcAlloc calls/tile)\n", "rcBuildTile:", plainNanos, plainAllocs / (double)tiles);
+	printf("BM_%-35s %10.2f nanos/tile (%.1f rcAlloc calls/tile, %zu bytes high water)\n", "rcBuildTileArena:", arenaNanos, arenaAllocs / (double)tiles, arena.getHighWaterMark());
+}
@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch_all.hpp"
+
+#include "Recast.h"
+
+#include "../Detour/NavMeshTestUtils.h"
+
+struct BenchTile
+{
+	rcConfig cfg;
+	std::vector<float> verts;
+	std::vector<int> tris;
+	std::vector<unsigned char> areas;
+};
+
+/// Rasterizes and filters every tile, either into a new heightfield per tile or
+/// into one heightfield that is reset and packed. Returns the time per tile.
+static double benchRasterizeTiles(const std::vector<BenchTile>& tiles, const int rounds, const bool reuse, int& spanCount)
+{
+	rcContext ctx(false);
+	rcHeightfield* reused = rcAllocHeightfield();
+	spanCount = 0;
+
+	const int64_t begin = testNowNanos();
+	for (int r = 0; r < rounds; ++r)
+	{
+		for (size_t i = 0; i < tiles.size(); ++i)
+		{
+			const BenchTile& tile = tiles[i];
+			const rcConfig& cfg = tile.cfg;
+			rcHeightfield* solid = reused;
+			if (reuse)
+			{
+				REQUIRE(rcResetHeightfield(&ctx, *solid, cfg.width, cfg.height, cfg.bmin, cfg.bmax, cfg.cs, cfg.ch));
+			}
+			else
+			{
+				solid = rcAllocHeightfield();
+				REQUIRE(rcCreateHeightfield(&ctx, *solid, cfg.width, cfg.height, cfg.bmin, cfg.bmax, cfg.cs, cfg.ch));
+			}
+			REQUIRE(rcRasterizeTriangles(&ctx, &tile.verts[0], (int)tile.verts.size() / 3, &tile.tris[0], &tile.areas[0],
+										 (int)tile.tris.size() / 3, *solid, cfg.walkableClimb));
+			if (reuse)
+			{
+				REQUIRE(rcPackHeightfieldSpans(&ctx, *solid));
+			}
+			rcFilterLowHangingWalkableObstacles(&ctx, cfg.walkableClimb, *solid);
+			rcFilterLedgeSpans(&ctx, cfg.walkableHeight, cfg.walkableClimb, *solid);
+			rcFilterWalkableLowHeightSpans(&ctx, cfg.walkableHeight, *solid);
+			spanCount += rcGetHeightFieldSpanCount(&ctx, *solid);
+			if (!reuse)
+			{
+				rcFreeHeightField(solid);
+			}
+		}
+	}
+	const int64_t end = testNowNanos();
+	rcFreeHeightField(reused);
+	return (end - begin) / (double)(rounds * tiles.size());
+}
+
+TEST_CASE("Bench_rcHeightfield")
+{
+	TestWorldParams params;
+	std::vector<BenchTile> tiles(params.tilesX * params.tilesZ);
+	for (int ty = 0; ty < params.tilesZ; ++ty)
+	{
+		for (int tx = 0; tx < params.tilesX; ++tx)
+		{
+			BenchTile& tile = tiles[tx + ty * params.tilesX];
+			initTestTileConfig(params, tx, ty, tile.cfg);
+			buildTestGeometry(params, tile.cfg.bmin, tile.cfg.bmax, tile.verts, tile.tris);
+			tile.areas.assign(tile.tris.size() / 3, RC_WALKABLE_AREA);
+		}
+	}
+
+	const int rounds = 8;
+	int createSpans = 0;
+	int reuseSpans = 0;
+	const double createNanos = benchRasterizeTiles(tiles, rounds, false, createSpans);
+	const double reuseNanos = benchRasterizeTiles(tiles, rounds, true, reuseSpans);
+	REQUIRE(createSpans == reuseSpans);
+
+	printf("BM_%-35s %10.2f nanos/tile\n", "rcRasterizeFilterTile:", createNanos);
+	printf("BM_%-35s %10.2f nanos/tile\n", "rcRasterizeFilterTileReusePacked:", reuseNanos);
+}
+
+/// Runs the area filters and the distance field over the compact heightfields and returns the time per tile.
+static double benchCompactFilters(std::vector<rcCompactHeightfield*>& chfs, const std::vector<std::vector<unsigned char> >& areas,
+								  const int erosionRadius, const int rounds)
+{
+	rcContext ctx(false);
+	int64_t elapsed = 0;
+	for (int r = 0; r < rounds; ++r)
+	{
+		for (size_t i = 0; i < chfs.size(); ++i)
+		{
+			rcCompactHeightfield& chf = *chfs[i];
+			memcpy(chf.areas, &areas[i][0], areas[i].size());
+
+			const int64_t begin = testNowNanos();
+			REQUIRE(rcErodeWalkableArea(&ctx, erosionRadius, chf));
+			REQUIRE(rcMedianFilterWalkableArea(&ctx, chf));
+			REQUIRE(rcBuildDistanceField(&ctx, chf));
+			elapsed += testNowNanos() - begin;
+		}
+	}
+	return elapsed / (double)(rounds * chfs.size());
+}
+
+TEST_CASE("Bench_rcCompactHeightfieldFilters")
+{
+	TestWorldParams params;
+	rcContext ctx(false);
+
+	// The same tiles, once as built and once with an isolated span above every column,
+	// which makes the filters take the generic path.
+	std::vector<rcCompactHeightfield*> dense;
+	std::vector<rcCompactHeightfield*> generic;
+	std::vector<std::vector<unsigned char> > denseAreas;
+	std::vector<std::vector<unsigned char> > genericAreas;
+	int erosionRadius = 0;
+	for (int ty = 0; ty < params.tilesZ; ++ty)
+	{
+		for (int tx = 0; tx < params.tilesX; ++tx)
+		{
+			rcConfig cfg;
+			initTestTileConfig(params, tx, ty, cfg);
+			erosionRadius = cfg.walkableRadius;
+			std::vector<float> verts;
+			std::vector<int> tris;
+			buildTestGeometry(params, cfg.bmin, cfg.bmax, verts, tris);
+			std::vector<unsigned char> triAreas(tris.size() / 3, RC_WALKABLE_AREA);
+
+			for (int variant = 0; variant < 2; ++variant)
+			{
+				rcHeightfield* solid = rcAllocHeightfield();
+				REQUIRE(rcCreateHeightfield(&ctx, *solid, cfg.width, cfg.height, cfg.bmin, cfg.bmax, cfg.cs, cfg.ch));
+				REQUIRE(rcRasterizeTriangles(&ctx, &verts[0], (int)verts.size() / 3, &tris[0], &triAreas[0],
+											 (int)tris.size() / 3, *solid, cfg.walkableClimb));
+				for (int z = 0; variant == 1 && z < cfg.height; ++z)
+				{
+					for (int x = 0; x < cfg.width; ++x)
+					{
+						const unsigned short roofHeight = (unsigned short)(RC_SPAN_MAX_HEIGHT - 40 + ((x + z) & 1) * 20);
+						REQUIRE(rcAddSpan(&ctx, *solid, x, z, roofHeight, (unsigned short)(roofHeight + 1), RC_WALKABLE_AREA, 0));
+					}
+				}
+				rcCompactHeightfield* chf = rcAllocCompactHeightfield();
+				REQUIRE(rcBuildCompactHeightfield(&ctx, cfg.walkableHeight, cfg.walkableClimb, *solid, *chf));
+				rcFreeHeightField(solid);
+
+				std::vector<unsigned char> chfAreas(chf->areas, chf->areas + chf->spanCount);
+				(variant == 0 ? dense : generic).push_back(chf);
+				(variant == 0 ? denseAreas : genericAreas).push_back(chfAreas);
+			}
+		}
+	}
+
+	const int rounds = 8;
+	const double genericNanos = benchCompactFilters(generic, genericAreas, erosionRadius, rounds);
+	const double denseNanos = benchCompactFilters(dense, denseAreas, erosionRadius, rounds);
+
+	for (size_t i = 0; i < dense.size(); ++i)
+	{
+		REQUIRE(dense[i]->maxDistance == generic[i]->maxDistance);
+		rcFreeCompactHeightfield(dense[i]);
+		rcFreeCompactHeightfield(generic[i]);
+	}
+
+	printf("BM_%-35s %10.2f nanos/tile\n", "rcCompactFiltersGeneric:", genericNanos);
+	printf("BM_%-35s %10.2f nanos/tile\n", "rcCompactFiltersDense:", denseNanos);
+}
+
+/// Builds the compact heightfield repeatedly and returns the time per build.
+static double benchBuildCompactHeightfield(rcContext& ctx, const rcConfig& cfg, const rcHeightfield& solid, const int rounds)
+{
+	int64_t elapsed = 0;
+	for (int r = 0; r < rounds; ++r)
+	{
+		rcCompactHeightfield* chf = rcAllocCompactHeightfield();
+		const int64_t begin = testNowNanos();
+		REQUIRE(rcBuildCompactHeightfield(&ctx, cfg.walkableHeight, cfg.walkableClimb, solid, *chf));
+		elapsed += testNowNanos() - begin;
+		rcFreeCompactHeightfield(chf);
+	}
+	return elapsed / (double)rounds;
+}
+
+TEST_CASE("Bench_rcBuildCompactHeightfield")
+{
+	// The whole world as a single heightfield.
+	TestWorldParams params;
+	params.tilesX = 12;
+	params.tilesZ = 12;
+	rcConfig cfg;
+	rcConfig lastCfg;
+	initTestTileConfig(params, 0, 0, cfg);
+	initTestTileConfig(params, params.tilesX - 1, params.tilesZ - 1, lastCfg);
+	rcVcopy(cfg.bmax, lastCfg.bmax);
+	rcCalcGridSize(cfg.bmin, cfg.bmax, cfg.cs, &cfg.width, &cfg.height);
+
+	std::vector<float> verts;
+	std::vector<int> tris;
+	buildTestGeometry(params, cfg.bmin, cfg.bmax, verts, tris);
+	std::vector<unsigned char> triAreas(tris.size() / 3, RC_WALKABLE_AREA);
+
+	rcContext ctx(false);
+	rcHeightfield solid;
+	REQUIRE(rcCreateHeightfield(&ctx, solid, cfg.width, cfg.height, cfg.bmin, cfg.bmax, cfg.cs, cfg.ch));
+	REQUIRE(rcRasterizeTriangles(&ctx, &verts[0], (int)verts.size() / 3, &tris[0], &triAreas[0],
+								 (int)tris.size() / 3, solid, cfg.walkableClimb));
+
+	const int threadCount = rcMax(1, (int)std::thread::hardware_concurrency());
+	TestTaskContext taskCtx(threadCount);
+
+	const int rounds = 8;
+	const double serialNanos = benchBuildCompactHeightfield(ctx, cfg, solid, rounds);
+	const double taskNanos = benchBuildCompactHeightfield(taskCtx, cfg, solid, rounds);
+
+	printf("BM_%-35s %10.2f nanos/build (%dx%d)\n", "rcBuildCompactHeightfield:", serialNanos, cfg.width, cfg.height);
+	printf("BM_%-35s %10.2f nanos/build (%d threads)\n", "rcBuildCompactHeightfieldTasks:", taskNanos, threadCount);
+}
@@ -3,9 +3,13 @@
 
 #include "catch2/catch_all.hpp"
 
+#include "Recast.h"
 #include "RecastAlloc.h"
 #include "RecastAssert.h"
 
+#include "../Detour/NavMeshTestUtils.h"
+#include "DetourAlloc.h"
+
 /// Used to verify that rcVector constructs/destroys objects correctly.
 struct Incrementor {
 	static int constructions;
@@ -258,3 +262,143 @@ TEST_CASE("rcVector", "[recast, alloc]")
 		v.clear();
 	}
 }
+
+/// Counts the temporary allocations reaching the allocation functions.
+static int sCountedTempAllocs = 0;
+
+static void* CountingAlloc(size_t size, rcAllocHint hint) {
+	if (hint == RC_ALLOC_TEMP) {
+		sCountedTempAllocs++;
+	}
+	return malloc(size);
+}
+
+static void CountingFree(void* ptr) {
+	free(ptr);
+}
+
+TEST_CASE("rcArena", "[recast, alloc]")
+{
+	SECTION("Arena basics")
+	{
+		rcArena arena(1024);
+		REQUIRE(arena.getCapacity() == 0);
+
+		void* a = arena.alloc(10);
+		void* b = arena.alloc(100);
+		REQUIRE(a != nullptr);
+		REQUIRE(b != nullptr);
+		REQUIRE(((uintptr_t)a & 15) == 0);
+		REQUIRE(((uintptr_t)b & 15) == 0);
+		REQUIRE(arena.owns(a));
+		REQUIRE(arena.owns(b));
+		int local = 0;
+		REQUIRE(!arena.owns(&local));
+		REQUIRE(arena.getUsedSize() == 16 + 112);
+		REQUIRE(arena.getChunkCount() == 1);
+
+		// Only the last block is released before the reset.
+		arena.free(a);
+		REQUIRE(arena.getUsedSize() == 16 + 112);
+		arena.free(b);
+		REQUIRE(arena.getUsedSize() == 16);
+		REQUIRE(arena.alloc(100) == b);
+
+		// Blocks larger than a chunk get a chunk of their own.
+		void* big = arena.alloc(4000);
+		REQUIRE(big != nullptr);
+		REQUIRE(arena.getChunkCount() == 2);
+		REQUIRE(arena.getHighWaterMark() == 16 + 112 + 4000);
+		REQUIRE(arena.getAllocCount() == 4);
+
+		// Resetting merges the chunks.
+		const size_t capacity = arena.getCapacity();
+		arena.reset();
+		REQUIRE(arena.getUsedSize() == 0);
+		REQUIRE(arena.getChunkCount() == 1);
+		REQUIRE(arena.getCapacity() == capacity);
+		REQUIRE(arena.getHighWaterMark() == 16 + 112 + 4000);
+		arena.resetHighWaterMark();
+		REQUIRE(arena.getHighWaterMark() == 0);
+
+		arena.purge();
+		REQUIRE(arena.getCapacity() == 0);
+		REQUIRE(arena.getChunkCount() == 0);
+	}
+
+	SECTION("Scopes route temporary allocations")
+	{
+		rcArena arena;
+		rcContext ctx(false);
+		REQUIRE(ctx.getArena() == nullptr);
+		{
+			// No arena, no change.
+			rcArenaScope scope(&ctx);
+			REQUIRE(rcGetThreadArena() == nullptr);
+		}
+
+		ctx.setArena(&arena);
+		{
+			rcArenaScope scope(&ctx);
+			REQUIRE(rcGetThreadArena() == &arena);
+			void* temp = rcAlloc(64, RC_ALLOC_TEMP);
+			void* perm = rcAlloc(64, RC_ALLOC_PERM);
+			REQUIRE(arena.owns(temp));
+			REQUIRE(!arena.owns(perm));
+			{
+				rcArenaScope nested(&ctx);
+				REQUIRE(rcAlloc(64, RC_ALLOC_TEMP) != nullptr);
+			}
+			// The nested scope does not release the blocks of the outer one.
+			REQUIRE(arena.getUsedSize() == 128);
+			rcFree(temp);
+			rcFree(perm);
+		}
+		REQUIRE(rcGetThreadArena() == nullptr);
+		REQUIRE(arena.getUsedSize() == 0);
+		REQUIRE(arena.getHighWaterMark() == 128);
+	}
+
+	SECTION("Tile builds allocate temporaries from the arena")
+	{
+		TestWorldParams params;
+		int plainSize = 0;
+		unsigned char* plain = buildTestTileData(params, 1, 1, &plainSize);
+		REQUIRE(plain != nullptr);
+
+		rcAllocSetCustom(CountingAlloc, CountingFree);
+		sCountedTempAllocs = 0;
+		int plainTempAllocs = 0;
+		{
+			unsigned char* data = buildTestTileData(params, 1, 1, &plainSize);
+			plainTempAllocs = sCountedTempAllocs;
+			dtFree(data);
+		}
+
+		rcArena arena;
+		rcContext ctx(false);
+		ctx.setArena(&arena);
+		int arenaSize = 0;
+		unsigned char* arenaData = nullptr;
+		for (int i = 0; i < 2; ++i)
+		{
+			dtFree(arenaData);
+			sCountedTempAllocs = 0;
+			rcArenaScope scope(&ctx);
+			arenaData = buildTestTileData(params, 1, 1, &arenaSize);
+		}
+		const int arenaTempAllocs = sCountedTempAllocs;
+		rcAllocSetCustom(nullptr, nullptr);
+
+		REQUIRE(arenaData != nullptr);
+		REQUIRE(arenaSize == plainSize);
+		REQUIRE(memcmp(arenaData, plain, plainSize) == 0);
+		REQUIRE(plainTempAllocs > 10);
+		REQUIRE(arenaTempAllocs == 0);
+		REQUIRE(arena.getChunkCount() == 1);
+		REQUIRE(arena.getHighWaterMark() > 0);
+		REQUIRE(arena.getUsedSize() == 0);
+		dtFree(plain);
+		dtFree(arenaData);
+	}
+}
@@ -5,6 +5,10 @@
 
 #include "Recast.h"
 
+#include "../Detour/NavMeshTestUtils.h"
+
+#include <vector>
+
 TEST_CASE("rcSwap", "[recast]")
 {
 	SECTION("Swap two values")
@@ -600,6 +604,144 @@ TEST_CASE("rcAddSpan", "[recast]")
 	}
 }
 
+/// Returns the number of spans in the free list of the heightfield.
+static int countFreeSpans(const rcHeightfield& hf)
+{
+	int count = 0;
+	for (const rcSpan* span = hf.freelist; span; span = span->next)
+	{
+		count++;
+	}
+	return count;
+}
+
+TEST_CASE("rcResetHeightfield", "[recast]")
+{
+	rcContext ctx(false);
+	const float bmin[3] = { 0, 0, 0 };
+	const float bmax[3] = { 32, 32, 32 };
+
+	rcHeightfield hf;
+	REQUIRE(rcResetHeightfield(&ctx, hf, 32, 32, bmin, bmax, 1.0f, 1.0f));
+	REQUIRE(hf.spans != 0);
+	REQUIRE(hf.width == 32);
+
+	for (int i = 0; i < 1000; ++i)
+	{
+		REQUIRE(rcAddSpan(&ctx, hf, i % 32, i / 32, 0, 1, 1, 1));
+	}
+	const rcSpanPool* pools = hf.pools;
+	rcSpan** spans = hf.spans;
+	REQUIRE(pools != 0);
+
+	SECTION("Reset keeps the memory")
+	{
+		REQUIRE(rcResetHeightfield(&ctx, hf, 16, 16, bmin, bmax, 2.0f, 1.0f));
+		REQUIRE(hf.width == 16);
+		REQUIRE(hf.cs == Catch::Approx(2.0f));
+		REQUIRE(hf.spans == spans);
+		REQUIRE(hf.pools == pools);
+		REQUIRE(countFreeSpans(hf) == RC_SPANS_PER_POOL);
+		for (int i = 0; i < 16 * 16; ++i)
+		{
+			REQUIRE(hf.spans[i] == 0);
+		}
+
+		// Spans are allocated from the kept pools.
+		for (int i = 0; i < 256; ++i)
+		{
+			REQUIRE(rcAddSpan(&ctx, hf, i % 16, i / 16, 0, 1, 1, 1));
+		}
+		REQUIRE(hf.pools == pools);
+		REQUIRE(hf.pools->next == 0);
+	}
+
+	SECTION("A larger grid gets a new column array")
+	{
+		REQUIRE(rcResetHeightfield(&ctx, hf, 64, 64, bmin, bmax, 0.5f, 1.0f));
+		REQUIRE(hf.width == 64);
+		REQUIRE(hf.pools == pools);
+		for (int i = 0; i < 64 * 64; ++i)
+		{
+			REQUIRE(hf.spans[i] == 0);
+		}
+	}
+}
+
+TEST_CASE("rcPackHeightfieldSpans", "[recast]")
+{
+	rcContext ctx(false);
+	const float bmin[3] = { 0, 0, 0 };
+	const float bmax[3] = { 64, 64, 64 };
+
+	rcHeightfield hf;
+	REQUIRE(rcCreateHeightfield(&ctx, hf, 64, 64, bmin, bmax, 1.0f, 1.0f));
+
+	// Add the spans in an order that scatters the columns over the pools.
+	const int layers = 3;
+	for (int layer = layers - 1; layer >= 0; --layer)
+	{
+		for (int i = 0; i < 64 * 64; ++i)
+		{
+			const int column = (i * 37) % (64 * 64);
+			const unsigned short smin = (unsigned short)(layer * 10 + column % 5);
+			REQUIRE(rcAddSpan(&ctx, hf, column % 64, column / 64, smin, (unsigned short)(smin + 2), (unsigned char)(column % 7), 1));
+		}
+	}
+	const int spanCount = layers * 64 * 64;
+
+	// Remember the spans of each column.
+	std::vector<unsigned int> before;
+	for (int i = 0; i < 64 * 64; ++i)
+	{
+		for (const rcSpan* span = hf.spans[i]; span; span = span->next)
+		{
+			before.push_back(span->smin | (span->smax << 13) | (span->area << 26));
+		}
+	}
+	REQUIRE((int)before.size() == spanCount);
+
+	REQUIRE(rcPackHeightfieldSpans(&ctx, hf));
+
+	int poolCount = 0;
+	for (const rcSpanPool* pool = hf.pools; pool; pool = pool->next)
+	{
+		poolCount++;
+	}
+	REQUIRE(countFreeSpans(hf) == poolCount * RC_SPANS_PER_POOL - spanCount);
+
+	// Same spans, each column contiguous and the columns in row order within a pool.
+	size_t n = 0;
+	const rcSpan* previousTop = 0;
+	int adjacentColumns = 0;
+	for (int i = 0; i < 64 * 64; ++i)
+	{
+		const rcSpan* first = hf.spans[i];
+		REQUIRE(first != 0);
+		if (previousTop && first == previousTop + 1)
+		{
+			adjacentColumns++;
+		}
+		for (const rcSpan* span = first; span; span = span->next)
+		{
+			REQUIRE(n < before.size());
+			REQUIRE((unsigned int)(span->smin | (span->smax << 13) | (span->area << 26)) == before[n]);
+			n++;
+			if (span->next)
+			{
+				REQUIRE(span->next == span + 1);
+			}
+			previousTop = span;
+		}
+	}
+	REQUIRE(n == before.size());
+	REQUIRE(adjacentColumns >= 64 * 64 - poolCount);
+
+	// The heightfield keeps working.
+	REQUIRE(rcAddSpan(&ctx, hf, 0, 0, 50, 52, 1, 1));
+	REQUIRE(hf.spans[0]->next->next->next != 0);
+}
+
 TEST_CASE("rcRasterizeTriangle", "[recast]")
 {
 	rcContext ctx;
@@ -935,3 +1077,222 @@ TEST_CASE("rcRasterizeTriangles", "[recast]")
 		REQUIRE(!solid.spans[1 + 2 * width]->next);
 	}
 }
+
+TEST_CASE("rcBuildCompactHeightfield", "[recast]")
+{
+	// Wide enough to be split into several blocks of rows, the last one partial.
+	const int width = 700;
+	const int height = 37;
+	const float bmin[3] = { 0, 0, 0 };
+	const float bmax[3] = { (float)width, 100.0f, (float)height };
+
+	rcContext ctx(false);
+	rcHeightfield hf;
+	REQUIRE(rcCreateHeightfield(&ctx, hf, width, height, bmin, bmax, 1.0f, 1.0f));
+	unsigned int seed = 4321;
+	for (int z = 0; z < height; ++z)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			seed = seed * 1103515245u + 12345u;
+			const unsigned int r = seed >> 16;
+			if (r % 11 == 0)
+			{
+				continue;
+			}
+			const unsigned char area = (r % 5 == 0) ? RC_NULL_AREA : RC_WALKABLE_AREA;
+			REQUIRE(rcAddSpan(&ctx, hf, x, z, 0, (unsigned short)(10 + r % 4), area, 1));
+			if (r % 3 == 0)
+			{
+				REQUIRE(rcAddSpan(&ctx, hf, x, z, 30, (unsigned short)(31 + r % 3), RC_WALKABLE_AREA, 1));
+			}
+		}
+	}
+
+	rcCompactHeightfield serial;
+	REQUIRE(rcBuildCompactHeightfield(&ctx, 2, 2, hf, serial));
+	REQUIRE(serial.spanCount == rcGetHeightFieldSpanCount(&ctx, hf));
+
+	SECTION("Spans are stored column by column")
+	{
+		int index = 0;
+		for (int i = 0; i < width * height; ++i)
+		{
+			const rcCompactCell& cell = serial.cells[i];
+			int walkable = 0;
+			for (const rcSpan* span = hf.spans[i]; span; span = span->next)
+			{
+				walkable += span->area != RC_NULL_AREA ? 1 : 0;
+			}
+			REQUIRE((int)cell.count == walkable);
+			REQUIRE((int)cell.index == (hf.spans[i] ? index : 0));
+			index += walkable;
+		}
+		REQUIRE(index == serial.spanCount);
+	}
+
+	SECTION("Tasks on worker threads build the same heightfield")
+	{
+		TestTaskContext taskCtx(4);
+		rcCompactHeightfield parallel;
+		REQUIRE(rcBuildCompactHeightfield(&taskCtx, 2, 2, hf, parallel));
+		REQUIRE(taskCtx.getTaskCount() > 3);
+
+		REQUIRE(parallel.spanCount == serial.spanCount);
+		for (int i = 0; i < width * height; ++i)
+		{
+			REQUIRE(parallel.cells[i].index == serial.cells[i].index);
+			REQUIRE(parallel.cells[i].count == serial.cells[i].count);
+		}
+		int connections = 0;
+		for (int i = 0; i < serial.spanCount; ++i)
+		{
+			REQUIRE(parallel.spans[i].y == serial.spans[i].y);
+			REQUIRE(parallel.spans[i].h == serial.spans[i].h);
+			REQUIRE(parallel.spans[i].con == serial.spans[i].con);
+			REQUIRE(parallel.spans[i].reg == 0);
+			REQUIRE(parallel.areas[i] == serial.areas[i]);
+			for (int dir = 0; dir < 4; ++dir)
+			{
+				connections += rcGetCon(serial.spans[i], dir) != RC_NOT_CONNECTED ? 1 : 0;
+			}
+		}
+		REQUIRE(connections > 0);
+	}
+}
+
+/// Builds a compact heightfield of uneven terrain with holes and several area types.
+/// With @p bridge, a ramp leads onto a bridge deck above the terrain, so that some columns have two
+/// connected layers. With @p roof, every column gets a second, isolated span high above the terrain,
+/// which makes the filters take their generic path over otherwise identical spans.
+static void buildTerrainCompactHeightfield(rcContext& ctx, const bool bridge, const bool roof, rcCompactHeightfield& chf)
+{
+	const int width = 53;
+	const int height = 41;
+	const float bmin[3] = { 0, 0, 0 };
+	const float bmax[3] = { (float)width, 300.0f, (float)height };
+
+	rcHeightfield hf;
+	REQUIRE(rcCreateHeightfield(&ctx, hf, width, height, bmin, bmax, 1.0f, 1.0f));
+
+	unsigned int seed = 1234;
+	for (int z = 0; z < height; ++z)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			seed = seed * 1103515245u + 12345u;
+			const unsigned int r = seed >> 16;
+			if (roof)
+			{
+				// Alternate the heights, so that the roof spans are not connected.
+				const unsigned short roofHeight = (unsigned short)(200 + ((x + z) & 1) * 10);
+				REQUIRE(rcAddSpan(&ctx, hf, x, z, roofHeight, (unsigned short)(roofHeight + 1), RC_WALKABLE_AREA, 1));
+			}
+			if (r % 23 == 0)
+			{
+				continue;
+			}
+			unsigned short smax = (unsigned short)(10 + (x / 6 + z / 5) % 4 + (r % 17 == 0 ? 3 : 0));
+			const unsigned char area = (r % 13 == 0) ? 2 : ((r % 7 == 0) ? 1 : RC_WALKABLE_AREA);
+			if (bridge && z >= 10 && z < 20)
+			{
+				if (x >= 13 && x < 20)
+				{
+					smax = (unsigned short)(26 - (20 - x) * 2);
+				}
+				else if (x >= 20 && x < 30)
+				{
+					REQUIRE(rcAddSpan(&ctx, hf, x, z, 25, 26, area, 1));
+				}
+			}
+			REQUIRE(rcAddSpan(&ctx, hf, x, z, 0, smax, area, 1));
+		}
+	}
+
+	REQUIRE(rcBuildCompactHeightfield(&ctx, 2, 3, hf, chf));
+}
+
+TEST_CASE("Dense compact heightfield filters", "[recast]")
+{
+	rcContext ctx(false);
+	const bool bridge = GENERATE(false, true);
+
+	// The columns with a single span take the dense path, the roofed ones the generic path.
+	rcCompactHeightfield chf;
+	rcCompactHeightfield roofed;
+	buildTerrainCompactHeightfield(ctx, bridge, false, chf);
+	buildTerrainCompactHeightfield(ctx, bridge, true, roofed);
+
+	int multiLayerColumns = 0;
+	for (int i = 0; i < chf.width * chf.height; ++i)
+	{
+		REQUIRE(roofed.cells[i].count == chf.cells[i].count + 1);
+		multiLayerColumns += chf.cells[i].count > 1 ? 1 : 0;
+	}
+	REQUIRE((multiLayerColumns > 0) == bridge);
+
+	/// Checks that the spans below the roof match.
+	struct Compare
+	{
+		static void areas(const rcCompactHeightfield& a, const rcCompactHeightfield& b)
+		{
+			for (int i = 0; i < a.width * a.height; ++i)
+			{
+				for (int layer = 0; layer < (int)a.cells[i].count; ++layer)
+				{
+					REQUIRE(a.areas[a.cells[i].index + layer] == b.areas[b.cells[i].index + layer]);
+				}
+			}
+		}
+		static void distances(const rcCompactHeightfield& a, const rcCompactHeightfield& b)
+		{
+			REQUIRE(a.maxDistance == b.maxDistance);
+			for (int i = 0; i < a.width * a.height; ++i)
+			{
+				for (int layer = 0; layer < (int)a.cells[i].count; ++layer)
+				{
+					REQUIRE(a.dist[a.cells[i].index + layer] == b.dist[b.cells[i].index + layer]);
+				}
+			}
+		}
+	};
+
+	SECTION("Erode")
+	{
+		const int radius = GENERATE(1, 2, 4);
+		REQUIRE(rcErodeWalkableArea(&ctx, radius, chf));
+		REQUIRE(rcErodeWalkableArea(&ctx, radius, roofed));
+		Compare::areas(chf, roofed);
+
+		int nullCount = 0;
+		for (int i = 0; i < chf.spanCount; ++i)
+		{
+			nullCount += chf.areas[i] == RC_NULL_AREA ? 1 : 0;
+		}
+		REQUIRE(nullCount > 0);
+		REQUIRE(nullCount < chf.spanCount);
+	}
+
+	SECTION("Median")
+	{
+		REQUIRE(rcErodeWalkableArea(&ctx, 1, chf));
+		REQUIRE(rcErodeWalkableArea(&ctx, 1, roofed));
+		REQUIRE(rcMedianFilterWalkableArea(&ctx, chf));
+		REQUIRE(rcMedianFilterWalkableArea(&ctx, roofed));
+		Compare::areas(chf, roofed);
+	}
+
+	SECTION("Distance field")
+	{
+		REQUIRE(rcBuildDistanceField(&ctx, chf));
+		REQUIRE(rcBuildDistanceField(&ctx, roofed));
+		REQUIRE(chf.maxDistance > 2);
+		Compare::distances(chf, roofed);
+
+		REQUIRE(rcErodeWalkableArea(&ctx, 1, chf));
+		REQUIRE(rcErodeWalkableArea(&ctx, 1, roofed));
+		REQUIRE(rcBuildDistanceField(&ctx, chf));
+		REQUIRE(rcBuildDistanceField(&ctx, roofed));
+		Compare::distances(chf, roofed);
+	}
+}